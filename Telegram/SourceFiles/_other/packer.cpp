@@ -126,12 +126,99 @@ int32 *hashSha1(const void *data, uint32 len, void *dest) {
 
 QString AlphaSignature;
 
+const quint32 DeltaPackageMarker = 0xFFFFFFFFU;
+const quint8 DeltaFileFull = 0;
+const quint8 DeltaFilePatch = 1;
+const quint8 DeltaOpCopy = 0;
+const quint8 DeltaOpInsert = 1;
+const int DeltaBlockSize = 64;
+const quint32 DeltaHashBase = 257;
+
+QByteArray fileSha1(const QByteArray &data) {
+	QByteArray result(20, Qt::Uninitialized);
+	hashSha1(data.constData(), data.size(), result.data());
+	return result;
+}
+
+quint32 deltaBlockHash(const uchar *data) {
+	quint32 result = 0;
+	for (int i = 0; i < DeltaBlockSize; ++i) {
+		result = result * DeltaHashBase + data[i];
+	}
+	return result;
+}
+
+// Rsync-like matching: base is indexed by non-overlapping blocks, target
+// is scanned with a rolling hash, matches are extended in both directions.
+// Returns serialized ops and their count in opsCount.
+QByteArray computeDelta(const QByteArray &base, const QByteArray &target, quint32 &opsCount) {
+	QByteArray result;
+	QBuffer buffer(&result);
+	buffer.open(QIODevice::WriteOnly);
+	QDataStream stream(&buffer);
+	stream.setVersion(QDataStream::Qt_5_1);
+
+	opsCount = 0;
+	const uchar *b = (const uchar*)base.constData();
+	const uchar *t = (const uchar*)target.constData();
+	const int baseSize = base.size(), targetSize = target.size();
+
+	std::unordered_map<quint32, int> index;
+	for (int offset = 0; offset + DeltaBlockSize <= baseSize; offset += DeltaBlockSize) {
+		index.emplace(deltaBlockHash(b + offset), offset);
+	}
+
+	quint32 highest = 1;
+	for (int i = 1; i < DeltaBlockSize; ++i) {
+		highest *= DeltaHashBase;
+	}
+
+	int literalStart = 0, pos = 0;
+	const auto flushLiteral = [&](int till) {
+		if (till > literalStart) {
+			stream << DeltaOpInsert << QByteArray::fromRawData(target.constData() + literalStart, till - literalStart);
+			++opsCount;
+		}
+	};
+	quint32 hash = (targetSize >= DeltaBlockSize) ? deltaBlockHash(t) : 0;
+	while (pos + DeltaBlockSize <= targetSize) {
+		const auto i = index.find(hash);
+		if (i != index.end() && !memcmp(b + i->second, t + pos, DeltaBlockSize)) {
+			int from = i->second, length = DeltaBlockSize;
+			while (from + length < baseSize && pos + length < targetSize && b[from + length] == t[pos + length]) {
+				++length;
+			}
+			while (pos > literalStart && from > 0 && b[from - 1] == t[pos - 1]) {
+				--pos;
+				--from;
+				++length;
+			}
+			flushLiteral(pos);
+			stream << DeltaOpCopy << quint32(from) << quint32(length);
+			++opsCount;
+
+			pos += length;
+			literalStart = pos;
+			if (pos + DeltaBlockSize <= targetSize) {
+				hash = deltaBlockHash(t + pos);
+			}
+			continue;
+		}
+		if (pos + DeltaBlockSize < targetSize) {
+			hash = (hash - t[pos] * highest) * DeltaHashBase + t[pos + DeltaBlockSize];
+		}
+		++pos;
+	}
+	flushLiteral(targetSize);
+	return result;
+}
+
 int main(int argc, char *argv[])
 {
 	QString workDir;
 
-	QString remove;
-	int version = 0;
+	QString remove, baseDir;
+	int version = 0, baseVersion = 0;
 	bool target32 = false;
 	QFileInfoList files;
 	for (int i = 0; i < argc; ++i) {
@@ -144,6 +231,10 @@ int main(int argc, char *argv[])
 			target32 = (string("mac32") == argv[i + 1]);
 		} else if (string("-version") == argv[i] && i + 1 < argc) {
 			version = QString(argv[i + 1]).toInt();
+		} else if (string("-base") == argv[i] && i + 1 < argc) {
+			baseDir = QFileInfo(workDir + QString(argv[i + 1])).canonicalFilePath() + "/";
+		} else if (string("-baseversion") == argv[i] && i + 1 < argc) {
+			baseVersion = QString(argv[i + 1]).toInt();
 		} else if (string("-beta") == argv[i]) {
 			BetaChannel = true;
 		} else if (string("-alpha") == argv[i] && i + 1 < argc) {
@@ -171,6 +262,10 @@ int main(int argc, char *argv[])
 #endif
 		return -1;
 	}
+	if (!baseDir.isEmpty() && (AlphaVersion || baseVersion <= 1016 || baseVersion >= version)) {
+		cout << "Usage: -base {dir} -baseversion {version} for a delta package, alpha versions are not supported\n";
+		return -1;
+	}
 
 	bool hasDirs = true;
 	while (hasDirs) {
@@ -218,25 +313,70 @@ int main(int argc, char *argv[])
 			stream << quint32(version);
 		}
 
-		stream << quint32(files.size());
 		cout << "Found " << files.size() << " file" << (files.size() == 1 ? "" : "s") << "..\n";
+		if (baseDir.isEmpty()) {
+			stream << quint32(files.size());
+		} else {
+			cout << "Packing delta from version " << baseVersion << " in '" << baseDir.toUtf8().constData() << "'..\n";
+			stream << DeltaPackageMarker << quint32(baseVersion);
+		}
+
+		// Delta packages skip unchanged files, so entries are counted first.
+		QByteArray entries;
+		quint32 entriesCount = 0;
+		QBuffer entriesBuffer(&entries);
+		entriesBuffer.open(QIODevice::WriteOnly);
+		QDataStream entriesStream(&entriesBuffer);
+		entriesStream.setVersion(QDataStream::Qt_5_1);
 		for (QFileInfoList::iterator i = files.begin(); i != files.end(); ++i) {
 			QFileInfo info(*i);
 			QString fullName = info.canonicalFilePath();
 			QString name = fullName.mid(remove.length());
-			cout << name.toUtf8().constData() << " (" << info.size() << ")\n";
+			cout << name.toUtf8().constData() << " (" << info.size() << ")";
 
 			QFile f(fullName);
 			if (!f.open(QIODevice::ReadOnly)) {
-				cout << "Can't open '" << fullName.toUtf8().constData() << "' for read..\n";
+				cout << "\nCan't open '" << fullName.toUtf8().constData() << "' for read..\n";
 				return -1;
 			}
 			QByteArray inner = f.readAll();
-			stream << name << quint32(inner.size()) << inner;
+			if (baseDir.isEmpty()) {
+				entriesStream << name << quint32(inner.size()) << inner;
+			} else {
+				QFile b(baseDir + name);
+				QByteArray base = b.open(QIODevice::ReadOnly) ? b.readAll() : QByteArray();
+				if (!base.isEmpty() && base == inner) {
+					cout << " unchanged, skipping\n";
+					continue;
+				}
+				quint32 opsCount = 0;
+				QByteArray ops = base.isEmpty() ? QByteArray() : computeDelta(base, inner, opsCount);
+				entriesStream << name;
+				if (!base.isEmpty() && ops.size() < inner.size()) {
+					cout << " patch " << ops.size();
+					entriesStream << DeltaFilePatch << quint32(inner.size()) << fileSha1(inner) << fileSha1(base) << opsCount;
+					entriesStream.writeRawData(ops.constData(), ops.size());
+				} else {
+					entriesStream << DeltaFileFull << quint32(inner.size()) << fileSha1(inner) << inner;
+				}
+			}
+			cout << "\n";
+			++entriesCount;
 #if defined Q_OS_MAC || defined Q_OS_LINUX
-			stream << (QFileInfo(fullName).isExecutable() ? true : false);
+			entriesStream << (QFileInfo(fullName).isExecutable() ? true : false);
 #endif
 		}
+		if (entriesStream.status() != QDataStream::Ok) {
+			cout << "Stream status is bad: " << entriesStream.status() << "\n";
+			return -1;
+		} else if (!entriesCount) {
+			cout << "No changed files found!\n";
+			return -1;
+		}
+		if (!baseDir.isEmpty()) {
+			stream << entriesCount;
+		}
+		stream.writeRawData(entries.constData(), entries.size());
 		if (stream.status() != QDataStream::Ok) {
 			cout << "Stream status is bad: " << stream.status() << "\n";
 			return -1;
@@ -455,6 +595,8 @@ int main(int argc, char *argv[])
 #endif
 	if (AlphaVersion) {
 		outName += "_" + AlphaSignature;
+	} else if (!baseDir.isEmpty()) {
+		outName += QString("_d%1").arg(baseVersion);
 	}
 	QFile out(outName);
 	if (!out.open(QIODevice::WriteOnly)) {
@@ -34,6 +34,8 @@ extern "C" {
 #endif
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include <iostream>
 #include <exception>
 
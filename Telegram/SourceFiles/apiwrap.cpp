@@ -61,6 +61,8 @@ constexpr auto kSaveDraftBeforeQuitTimeout = 1500; // give the app 1.5 secs to s
 constexpr auto kProxyPromotionInterval = TimeId(60 * 60);
 constexpr auto kProxyPromotionMinDelay = TimeId(10);
 constexpr auto kSmallDelayMs = 5;
+constexpr auto kPeersResolveDelay = TimeMs(20);
+constexpr auto kPeersBatchLimit = 100;
 constexpr auto kUnreadMentionsPreloadIfLess = 5;
 constexpr auto kUnreadMentionsFirstRequestLimit = 10;
 constexpr auto kUnreadMentionsNextRequestLimit = 100;
@@ -164,6 +166,10 @@ MTPInputPrivacyKey ApiWrap::Privacy::Input(Key key) {
 ApiWrap::ApiWrap(not_null<AuthSession*> session)
 : _session(session)
 , _messageDataResolveDelayed([=] { resolveMessageDatas(); })
+, _userRequests(kPeersBatchLimit)
+, _chatRequests(kPeersBatchLimit)
+, _channelRequests(kPeersBatchLimit)
+, _peersResolveTimer([=] { resolvePeers(); })
 , _webPagesTimer([=] { resolveWebPages(); })
 , _draftsSaveTimer([=] { saveDraftsToCloud(); })
 , _featuredSetsReadTimer([=] { readFeaturedSets(); })
@@ -1035,54 +1041,114 @@ void ApiWrap::gotUserFull(UserData *user, const MTPUserFull &result, mtpRequestI
 }
 
 void ApiWrap::requestPeer(PeerData *peer) {
-	if (!peer || _fullPeerRequests.contains(peer) || _peerRequests.contains(peer)) return;
+	if (!peer || _fullPeerRequests.contains(peer)) return;
 
-	auto sendRequest = [this, peer] {
-		auto failHandler = [this, peer](const RPCError &error) {
-			_peerRequests.remove(peer);
-		};
-		auto chatHandler = [this, peer](const MTPmessages_Chats &result) {
-			_peerRequests.remove(peer);
-
-			if (auto chats = Api::getChatsFromMessagesChats(result)) {
-				auto &v = chats->v;
-				bool badVersion = false;
-				if (const auto chat = peer->asChat()) {
-					badVersion = !v.isEmpty()
-						&& (v[0].type() == mtpc_chat)
-						&& (v[0].c_chat().vversion.v < chat->version);
-				} else if (const auto channel = peer->asChannel()) {
-					badVersion = !v.isEmpty()
-						&& (v[0].type() == mtpc_channel)
-						&& (v[0].c_channel().vversion.v < channel->version);
+	const auto added = [&] {
+		if (const auto user = peer->asUser()) {
+			return _userRequests.add(user);
+		} else if (const auto chat = peer->asChat()) {
+			return _chatRequests.add(chat);
+		} else if (const auto channel = peer->asChannel()) {
+			return _channelRequests.add(channel);
+		}
+		return false;
+	}();
+	if (added && !_peersResolveTimer.isActive()) {
+		_peersResolveTimer.callOnce(kPeersResolveDelay);
+	}
+}
+
+void ApiWrap::resolvePeers() {
+	while (_userRequests.hasWaiting()) {
+		const auto batch = _userRequests.take();
+		auto users = QVector<MTPInputUser>();
+		users.reserve(batch.keys.size());
+		for (const auto user : batch.keys) {
+			users.push_back(user->inputUser);
+		}
+		const auto id = batch.id;
+		request(MTPusers_GetUsers(
+			MTP_vector<MTPInputUser>(users)
+		)).done([=](const MTPVector<MTPUser> &result) {
+			_userRequests.finish(id);
+			App::feedUsers(result);
+		}).fail([=](const RPCError &error) {
+			_userRequests.finish(id);
+		}).afterDelay(kSmallDelayMs).send();
+	}
+	while (_chatRequests.hasWaiting()) {
+		const auto batch = _chatRequests.take();
+		auto chats = QVector<MTPint>();
+		chats.reserve(batch.keys.size());
+		for (const auto chat : batch.keys) {
+			chats.push_back(chat->inputChat);
+		}
+		const auto id = batch.id;
+		request(MTPmessages_GetChats(
+			MTP_vector<MTPint>(chats)
+		)).done([=](const MTPmessages_Chats &result) {
+			_chatRequests.finish(id);
+			gotPeerChats(result);
+		}).fail([=](const RPCError &error) {
+			_chatRequests.finish(id);
+		}).afterDelay(kSmallDelayMs).send();
+	}
+	while (_channelRequests.hasWaiting()) {
+		const auto batch = _channelRequests.take();
+		auto channels = QVector<MTPInputChannel>();
+		channels.reserve(batch.keys.size());
+		for (const auto channel : batch.keys) {
+			channels.push_back(channel->inputChannel);
+		}
+		const auto id = batch.id;
+		request(MTPchannels_GetChannels(
+			MTP_vector<MTPInputChannel>(channels)
+		)).done([=](const MTPmessages_Chats &result) {
+			_channelRequests.finish(id);
+			gotPeerChats(result);
+		}).fail([=](const RPCError &error) {
+			_channelRequests.finish(id);
+		}).afterDelay(kSmallDelayMs).send();
+	}
+	DEBUG_LOG(("API Info: peer requests saved by batching: %1"
+		).arg(_userRequests.savedRequests()
+			+ _chatRequests.savedRequests()
+			+ _channelRequests.savedRequests()));
+}
+
+void ApiWrap::gotPeerChats(const MTPmessages_Chats &result) {
+	const auto chats = Api::getChatsFromMessagesChats(result);
+	if (!chats) {
+		return;
+	}
+
+	// If we have a newer version than the server sent we request it again.
+	auto outdated = std::vector<std::pair<not_null<PeerData*>, int>>();
+	for (const auto &chat : chats->v) {
+		if (chat.type() == mtpc_chat) {
+			const auto &data = chat.c_chat();
+			if (const auto local = App::chatLoaded(data.vid.v)) {
+				if (data.vversion.v < local->version) {
+					outdated.emplace_back(local, data.vversion.v);
 				}
-				auto chat = App::feedChats(*chats);
-				if (chat == peer) {
-					if (badVersion) {
-						if (auto chat = peer->asChat()) {
-							chat->version = v[0].c_chat().vversion.v;
-						} else if (auto channel = peer->asChannel()) {
-							channel->version = v[0].c_channel().vversion.v;
-						}
-						requestPeer(peer);
-					}
+			}
+		} else if (chat.type() == mtpc_channel) {
+			const auto &data = chat.c_channel();
+			if (const auto local = App::channelLoaded(data.vid.v)) {
+				if (data.vversion.v < local->version) {
+					outdated.emplace_back(local, data.vversion.v);
 				}
 			}
-		};
-		if (auto user = peer->asUser()) {
-			return request(MTPusers_GetUsers(MTP_vector<MTPInputUser>(1, user->inputUser))).done([this, user](const MTPVector<MTPUser> &result) {
-				_peerRequests.remove(user);
-				App::feedUsers(result);
-			}).fail(failHandler).send();
-		} else if (auto chat = peer->asChat()) {
-			return request(MTPmessages_GetChats(MTP_vector<MTPint>(1, chat->inputChat))).done(chatHandler).fail(failHandler).send();
-		} else if (auto channel = peer->asChannel()) {
-			return request(MTPchannels_GetChannels(MTP_vector<MTPInputChannel>(1, channel->inputChannel))).done(chatHandler).fail(failHandler).send();
 		}
-		return 0;
-	};
-	if (auto requestId = sendRequest()) {
-		_peerRequests.insert(peer, requestId);
+	}
+	App::feedChats(*chats);
+	for (const auto [peer, version] : outdated) {
+		if (const auto chat = peer->asChat()) {
+			chat->version = version;
+		} else if (const auto channel = peer->asChannel()) {
+			channel->version = version;
+		}
+		requestPeer(peer);
 	}
 }
 
@@ -1146,37 +1212,8 @@ void ApiWrap::markMediaRead(not_null<HistoryItem*> item) {
 }
 
 void ApiWrap::requestPeers(const QList<PeerData*> &peers) {
-	QVector<MTPint> chats;
-	QVector<MTPInputChannel> channels;
-	QVector<MTPInputUser> users;
-	chats.reserve(peers.size());
-	channels.reserve(peers.size());
-	users.reserve(peers.size());
-	for (QList<PeerData*>::const_iterator i = peers.cbegin(), e = peers.cend(); i != e; ++i) {
-		if (!*i || _fullPeerRequests.contains(*i) || _peerRequests.contains(*i)) continue;
-		if ((*i)->isUser()) {
-			users.push_back((*i)->asUser()->inputUser);
-		} else if ((*i)->isChat()) {
-			chats.push_back((*i)->asChat()->inputChat);
-		} else if ((*i)->isChannel()) {
-			channels.push_back((*i)->asChannel()->inputChannel);
-		}
-	}
-	auto handleChats = [=](const MTPmessages_Chats &result) {
-		if (auto chats = Api::getChatsFromMessagesChats(result)) {
-			App::feedChats(*chats);
-		}
-	};
-	if (!chats.isEmpty()) {
-		request(MTPmessages_GetChats(MTP_vector<MTPint>(chats))).done(handleChats).send();
-	}
-	if (!channels.isEmpty()) {
-		request(MTPchannels_GetChannels(MTP_vector<MTPInputChannel>(channels))).done(handleChats).send();
-	}
-	if (!users.isEmpty()) {
-		request(MTPusers_GetUsers(MTP_vector<MTPInputUser>(users))).done([=](const MTPVector<MTPUser> &result) {
-			App::feedUsers(result);
-		}).send();
+	for (const auto peer : peers) {
+		requestPeer(peer);
 	}
 }
 
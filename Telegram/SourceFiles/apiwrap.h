@@ -13,6 +13,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "base/flat_set.h"
 #include "core/single_timer.h"
 #include "mtproto/sender.h"
+#include "mtproto/request_batcher.h"
 #include "chat_helpers/stickers.h"
 #include "data/data_messages.h"
 
@@ -396,6 +397,8 @@ private:
 	void saveDraftsToCloud();
 
 	void resolveMessageDatas();
+	void resolvePeers();
+	void gotPeerChats(const MTPmessages_Chats &result);
 	void gotMessageDatas(ChannelData *channel, const MTPmessages_Messages &result, mtpRequestId requestId);
 	void finalizeMessageDataRequest(
 		ChannelData *channel,
@@ -568,7 +571,10 @@ private:
 
 	using PeerRequests = QMap<PeerData*, mtpRequestId>;
 	PeerRequests _fullPeerRequests;
-	PeerRequests _peerRequests;
+	MTP::RequestBatcher<not_null<UserData*>> _userRequests;
+	MTP::RequestBatcher<not_null<ChatData*>> _chatRequests;
+	MTP::RequestBatcher<not_null<ChannelData*>> _channelRequests;
+	base::Timer _peersResolveTimer;
 
 	PeerRequests _participantsRequests;
 	PeerRequests _botsRequests;
@@ -0,0 +1,364 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+
+namespace base {
+
+// Sorted set of unique values, kept in a list of small sorted chunks.
+//
+// Insertion or removal of a value moves items only inside one chunk plus
+// the chunk headers, so it stays cheap for hundreds of thousands of items
+// where a flat_set would shift the whole storage.
+template <
+	typename Type,
+	typename Compare = std::less<>,
+	std::size_t ChunkSize = 256>
+class chunked_set {
+	static_assert(ChunkSize >= 4, "Too small chunks in base::chunked_set.");
+
+	using chunk = std::vector<Type>;
+	using chunks = std::vector<chunk>;
+
+public:
+	using value_type = Type;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const Type*;
+	using reference = const Type&;
+
+	class const_iterator {
+	public:
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = Type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const Type*;
+		using reference = const Type&;
+
+		const_iterator() = default;
+
+		reference operator*() const {
+			return (*_chunks)[_chunk][_index];
+		}
+		pointer operator->() const {
+			return &**this;
+		}
+		const_iterator &operator++() {
+			if (++_index == (*_chunks)[_chunk].size()) {
+				++_chunk;
+				_index = 0;
+			}
+			return *this;
+		}
+		const_iterator operator++(int) {
+			auto result = *this;
+			++*this;
+			return result;
+		}
+		const_iterator &operator--() {
+			if (!_index) {
+				_index = (*_chunks)[--_chunk].size();
+			}
+			--_index;
+			return *this;
+		}
+		const_iterator operator--(int) {
+			auto result = *this;
+			--*this;
+			return result;
+		}
+		friend inline bool operator==(
+				const const_iterator &a,
+				const const_iterator &b) {
+			return (a._chunk == b._chunk) && (a._index == b._index);
+		}
+		friend inline bool operator!=(
+				const const_iterator &a,
+				const const_iterator &b) {
+			return !(a == b);
+		}
+
+	private:
+		friend class chunked_set;
+
+		const_iterator(
+			const chunks *list,
+			size_type which,
+			size_type index)
+		: _chunks(list)
+		, _chunk(which)
+		, _index(index) {
+		}
+
+		const chunks *_chunks = nullptr;
+		size_type _chunk = 0;
+		size_type _index = 0;
+
+	};
+	using iterator = const_iterator;
+
+	chunked_set() = default;
+
+	template <
+		typename Iterator,
+		typename = typename std::iterator_traits<Iterator>::iterator_category>
+	chunked_set(Iterator first, Iterator last) {
+		auto values = chunk(first, last);
+		std::sort(values.begin(), values.end(), compare());
+		values.erase(
+			std::unique(values.begin(), values.end(), equal()),
+			values.end());
+		assign_sorted(std::move(values));
+	}
+
+	chunked_set(std::initializer_list<Type> list)
+	: chunked_set(list.begin(), list.end()) {
+	}
+
+	size_type size() const {
+		return _size;
+	}
+	bool empty() const {
+		return !_size;
+	}
+	void clear() {
+		_chunks.clear();
+		_size = 0;
+	}
+
+	const_iterator begin() const {
+		return const_iterator(&_chunks, 0, 0);
+	}
+	const_iterator end() const {
+		return const_iterator(&_chunks, _chunks.size(), 0);
+	}
+	const_iterator cbegin() const {
+		return begin();
+	}
+	const_iterator cend() const {
+		return end();
+	}
+
+	reference front() const {
+		return _chunks.front().front();
+	}
+	reference back() const {
+		return _chunks.back().back();
+	}
+
+	const_iterator lower_bound(const Type &value) const {
+		const auto which = find_chunk(value);
+		if (which == _chunks.size()) {
+			return end();
+		}
+		const auto &values = _chunks[which];
+		const auto index = std::lower_bound(
+			values.begin(),
+			values.end(),
+			value,
+			compare()) - values.begin();
+		return const_iterator(&_chunks, which, index);
+	}
+	const_iterator find(const Type &value) const {
+		const auto result = lower_bound(value);
+		return (result == end() || compare()(value, *result))
+			? end()
+			: result;
+	}
+	bool contains(const Type &value) const {
+		return find(value) != end();
+	}
+
+	// Count of values that are less than the passed one.
+	size_type rank(const Type &value) const {
+		const auto which = find_chunk(value);
+		auto result = size_type(0);
+		for (auto i = size_type(0); i != which; ++i) {
+			result += _chunks[i].size();
+		}
+		if (which != _chunks.size()) {
+			const auto &values = _chunks[which];
+			result += std::lower_bound(
+				values.begin(),
+				values.end(),
+				value,
+				compare()) - values.begin();
+		}
+		return result;
+	}
+
+	// Iterator to the value with the passed index in the sorted order.
+	const_iterator nth(size_type index) const {
+		for (auto i = size_type(0); i != _chunks.size(); ++i) {
+			const auto count = _chunks[i].size();
+			if (index < count) {
+				return const_iterator(&_chunks, i, index);
+			}
+			index -= count;
+		}
+		return end();
+	}
+
+	bool insert(const Type &value) {
+		if (_chunks.empty()) {
+			_chunks.push_back(chunk(1, value));
+			_size = 1;
+			return true;
+		}
+		const auto which = std::min(find_chunk(value), _chunks.size() - 1);
+		auto &values = _chunks[which];
+		const auto i = std::lower_bound(
+			values.begin(),
+			values.end(),
+			value,
+			compare());
+		if (i != values.end() && !compare()(value, *i)) {
+			return false;
+		}
+		values.insert(i, value);
+		++_size;
+		if (values.size() > ChunkSize) {
+			split_chunk(which);
+		}
+		return true;
+	}
+
+	bool remove(const Type &value) {
+		const auto i = find(value);
+		if (i == end()) {
+			return false;
+		}
+		auto &values = _chunks[i._chunk];
+		values.erase(values.begin() + i._index);
+		--_size;
+		shrink_chunk(i._chunk);
+		return true;
+	}
+
+	template <
+		typename Iterator,
+		typename = typename std::iterator_traits<Iterator>::iterator_category>
+	void merge(Iterator first, Iterator last) {
+		const auto count = size_type(std::distance(first, last));
+		if (count < ChunkSize) {
+			for (; first != last; ++first) {
+				insert(*first);
+			}
+			return;
+		}
+		auto values = chunk(first, last);
+		std::sort(values.begin(), values.end(), compare());
+		values.erase(
+			std::unique(values.begin(), values.end(), equal()),
+			values.end());
+		if (empty() || compare()(back(), values.front())) {
+			append_sorted(std::move(values));
+			return;
+		}
+		auto merged = chunk();
+		merged.reserve(_size + values.size());
+		std::set_union(
+			begin(),
+			end(),
+			values.begin(),
+			values.end(),
+			std::back_inserter(merged),
+			compare());
+		assign_sorted(std::move(merged));
+	}
+	void merge(const chunked_set &other) {
+		merge(other.begin(), other.end());
+	}
+
+private:
+	static Compare compare() {
+		return Compare();
+	}
+	static auto equal() {
+		return [](const Type &a, const Type &b) {
+			return !compare()(a, b) && !compare()(b, a);
+		};
+	}
+
+	// Index of the first chunk which last value is not less than value.
+	size_type find_chunk(const Type &value) const {
+		return std::lower_bound(
+			_chunks.begin(),
+			_chunks.end(),
+			value,
+			[](const chunk &values, const Type &value) {
+				return compare()(values.back(), value);
+			}) - _chunks.begin();
+	}
+
+	void split_chunk(size_type index) {
+		auto &values = _chunks[index];
+		const auto half = values.begin() + values.size() / 2;
+		auto second = chunk(
+			std::make_move_iterator(half),
+			std::make_move_iterator(values.end()));
+		values.erase(half, values.end());
+		_chunks.insert(_chunks.begin() + index + 1, std::move(second));
+	}
+
+	void shrink_chunk(size_type index) {
+		auto &values = _chunks[index];
+		if (values.empty()) {
+			_chunks.erase(_chunks.begin() + index);
+		} else if (values.size() < ChunkSize / 4
+			&& index + 1 < _chunks.size()
+			&& values.size() + _chunks[index + 1].size() <= ChunkSize) {
+			auto &next = _chunks[index + 1];
+			values.insert(
+				values.end(),
+				std::make_move_iterator(next.begin()),
+				std::make_move_iterator(next.end()));
+			_chunks.erase(_chunks.begin() + index + 1);
+		}
+	}
+
+	void append_sorted(chunk &&values) {
+		const auto half = ChunkSize / 2;
+		auto from = values.begin();
+		if (!_chunks.empty() && _chunks.back().size() < half) {
+			auto &last = _chunks.back();
+			const auto add = std::min(
+				half - last.size(),
+				size_type(values.end() - from));
+			last.insert(
+				last.end(),
+				std::make_move_iterator(from),
+				std::make_move_iterator(from + add));
+			from += add;
+			_size += add;
+		}
+		while (from != values.end()) {
+			const auto add = std::min(half, size_type(values.end() - from));
+			_chunks.emplace_back(
+				std::make_move_iterator(from),
+				std::make_move_iterator(from + add));
+			from += add;
+			_size += add;
+		}
+	}
+
+	void assign_sorted(chunk &&values) {
+		clear();
+		_chunks.reserve(values.size() * 2 / ChunkSize + 1);
+		append_sorted(std::move(values));
+	}
+
+	chunks _chunks;
+	size_type _size = 0;
+
+};
+
+} // namespace base
@@ -0,0 +1,149 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "base/chunked_set.h"
+#include "base/flat_set.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <set>
+
+using small_chunked_set = base::chunked_set<int, std::less<>, 8>;
+
+template <typename Set>
+void CheckSame(const Set &set, const std::set<int> &expected) {
+	REQUIRE(set.size() == expected.size());
+	REQUIRE(std::equal(set.begin(), set.end(), expected.begin()));
+}
+
+TEST_CASE("chunked_sets should keep items sorted", "[chunked_set]") {
+	auto v = small_chunked_set{ 5, 0, 4, 2 };
+	REQUIRE(v.size() == 4);
+	REQUIRE(v.contains(4));
+	REQUIRE(!v.contains(3));
+	REQUIRE(v.front() == 0);
+	REQUIRE(v.back() == 5);
+
+	SECTION("adding item puts it in the right position") {
+		REQUIRE(v.insert(3));
+		REQUIRE(!v.insert(3));
+		CheckSame(v, { 0, 2, 3, 4, 5 });
+	}
+	SECTION("removing item keeps others sorted") {
+		REQUIRE(v.remove(4));
+		REQUIRE(!v.remove(4));
+		CheckSame(v, { 0, 2, 5 });
+	}
+	SECTION("lower_bound, rank and nth agree") {
+		REQUIRE(*v.lower_bound(3) == 4);
+		REQUIRE(v.lower_bound(6) == v.end());
+		REQUIRE(v.rank(3) == 2);
+		REQUIRE(v.rank(6) == 4);
+		REQUIRE(*v.nth(2) == 4);
+		REQUIRE(v.nth(4) == v.end());
+	}
+}
+
+TEST_CASE("chunked_sets work with many chunks", "[chunked_set]") {
+	auto engine = std::mt19937(123);
+	auto v = small_chunked_set();
+	auto expected = std::set<int>();
+
+	SECTION("random inserts and removals") {
+		for (auto i = 0; i != 5000; ++i) {
+			const auto value = int(engine() % 1000);
+			if (engine() % 3) {
+				REQUIRE(v.insert(value) == expected.emplace(value).second);
+			} else {
+				REQUIRE(v.remove(value) == (expected.erase(value) > 0));
+			}
+		}
+		CheckSame(v, expected);
+		for (auto value = -1; value != 1001; ++value) {
+			const auto i = expected.lower_bound(value);
+			const auto rank = std::size_t(std::distance(expected.begin(), i));
+			REQUIRE(v.rank(value) == rank);
+			REQUIRE(v.contains(value) == (expected.count(value) > 0));
+			if (i != expected.end()) {
+				REQUIRE(*v.lower_bound(value) == *i);
+				REQUIRE(*v.nth(rank) == *i);
+			}
+		}
+	}
+	SECTION("merging small and large ranges") {
+		for (auto i = 0; i != 100; ++i) {
+			auto values = std::vector<int>(engine() % 40);
+			for (auto &value : values) {
+				value = int(engine() % 3000);
+			}
+			v.merge(values.begin(), values.end());
+			expected.insert(values.begin(), values.end());
+		}
+		CheckSame(v, expected);
+
+		const auto other = small_chunked_set(expected.begin(), expected.end());
+		v.merge(other);
+		CheckSame(v, expected);
+
+		auto tail = std::vector<int>();
+		for (auto i = 0; i != 100; ++i) {
+			tail.push_back(5000 + i);
+		}
+		v.merge(tail.begin(), tail.end());
+		expected.insert(tail.begin(), tail.end());
+		CheckSame(v, expected);
+	}
+	SECTION("iterating backwards") {
+		for (auto i = 0; i != 100; ++i) {
+			v.insert(i);
+		}
+		auto value = 100;
+		for (auto i = v.end(); i != v.begin();) {
+			REQUIRE(*--i == --value);
+		}
+		REQUIRE(value == 0);
+	}
+}
+
+template <typename Set>
+void BenchmarkInserts(const char *name, const std::vector<int> &values) {
+	const auto start = std::chrono::steady_clock::now();
+	auto set = Set();
+	for (const auto value : values) {
+		set.insert(value);
+	}
+	const auto finish = std::chrono::steady_clock::now();
+	const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+		finish - start).count();
+	std::cout
+		<< name << ": "
+		<< values.size() << " inserts in "
+		<< ms << " ms, "
+		<< set.size() << " items." << std::endl;
+}
+
+// Not run by default, use "[benchmark]" filter to run it.
+TEST_CASE("chunked_set insert performance", "[.][benchmark]") {
+	constexpr auto kCount = 200000;
+
+	auto append = std::vector<int>(kCount);
+	for (auto i = 0; i != kCount; ++i) {
+		append[i] = i;
+	}
+	auto engine = std::mt19937(123);
+	auto random = append;
+	std::shuffle(random.begin(), random.end(), engine);
+
+	BenchmarkInserts<base::flat_set<int>>("flat_set append", append);
+	BenchmarkInserts<base::chunked_set<int>>("chunked_set append", append);
+	BenchmarkInserts<base::flat_set<int>>("flat_set random", random);
+	BenchmarkInserts<base::chunked_set<int>>("chunked_set random", random);
+}
@@ -7,12 +7,102 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #include "base/runtime_composer.h"
 
+#include <QtCore/QMutex>
+#include <atomic>
+#include <map>
+#include <thread>
+
+namespace {
+
+constexpr auto kSlabGranularity = std::size_t(alignof(std::max_align_t));
+constexpr auto kSlabMaxBlockSize = std::size_t(256);
+constexpr auto kSlabClassesCount = kSlabMaxBlockSize / kSlabGranularity;
+constexpr auto kSlabSize = std::size_t(64 * 1024);
+constexpr auto kMetadataCacheSize = 16;
+
 struct RuntimeComposerMetadatasMap {
 	std::map<uint64, std::unique_ptr<RuntimeComposerMetadata>> data;
 	QMutex mutex;
 };
 
-const RuntimeComposerMetadata *GetRuntimeComposerMetadata(uint64 mask) {
+struct MetadataCacheEntry {
+	uint64 mask = 0;
+	const RuntimeComposerMetadata *meta = nullptr;
+};
+
+class SpinLock {
+public:
+	void lock() {
+		while (_flag.test_and_set(std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+	}
+	void unlock() {
+		_flag.clear(std::memory_order_release);
+	}
+
+private:
+	std::atomic_flag _flag = ATOMIC_FLAG_INIT;
+
+};
+
+// Blocks of a single size carved out of large slabs. Slabs are never
+// returned to the heap, freed blocks go to an intrusive free list.
+class SlabPool {
+public:
+	void *allocate(std::size_t blockSize);
+	void free(void *block);
+
+private:
+	struct FreeBlock {
+		FreeBlock *next = nullptr;
+	};
+
+	SpinLock _lock;
+	FreeBlock *_free = nullptr;
+	std::vector<std::unique_ptr<char[]>> _slabs;
+
+};
+
+void *SlabPool::allocate(std::size_t blockSize) {
+	std::lock_guard<SpinLock> lock(_lock);
+	if (!_free) {
+		auto slab = std::unique_ptr<char[]>(new char[kSlabSize]);
+		for (auto i = kSlabSize / blockSize; i != 0;) {
+			const auto block = reinterpret_cast<FreeBlock*>(
+				slab.get() + (--i) * blockSize);
+			block->next = _free;
+			_free = block;
+		}
+		_slabs.push_back(std::move(slab));
+	}
+	const auto result = _free;
+	_free = result->next;
+	return result;
+}
+
+void SlabPool::free(void *block) {
+	std::lock_guard<SpinLock> lock(_lock);
+	const auto freed = static_cast<FreeBlock*>(block);
+	freed->next = _free;
+	_free = freed;
+}
+
+SlabPool &PoolForClass(std::size_t sizeClass) {
+	// Intentionally leaked, blocks may be freed during static destruction.
+	static const auto Pools = new SlabPool[kSlabClassesCount];
+	return Pools[sizeClass];
+}
+
+std::size_t SizeClass(std::size_t size) {
+	return (size + kSlabGranularity - 1) / kSlabGranularity - 1;
+}
+
+int MetadataCacheIndex(uint64 mask) {
+	return int((mask * 0x9E3779B97F4A7C15ULL) >> 60) % kMetadataCacheSize;
+}
+
+const RuntimeComposerMetadata *LookupRuntimeComposerMetadata(uint64 mask) {
 	static RuntimeComposerMetadatasMap RuntimeComposerMetadatas;
 
 	QMutexLocker lock(&RuntimeComposerMetadatas.mutex);
@@ -25,6 +115,40 @@ const RuntimeComposerMetadata *GetRuntimeComposerMetadata(uint64 mask) {
 	return i->second.get();
 }
 
+} // namespace
+
+const RuntimeComposerMetadata *GetRuntimeComposerMetadata(uint64 mask) {
+	// Each thread keeps a small direct-mapped cache in front of the
+	// locked map, so the hot masks are resolved without the mutex.
+	thread_local MetadataCacheEntry Cache[kMetadataCacheSize];
+
+	auto &cached = Cache[MetadataCacheIndex(mask)];
+	if (!cached.meta || cached.mask != mask) {
+		cached.meta = LookupRuntimeComposerMetadata(mask);
+		cached.mask = mask;
+	}
+	return cached.meta;
+}
+
+void *AllocateRuntimeComposerData(std::size_t size) {
+	Expects(size > 0);
+
+	if (size > kSlabMaxBlockSize) {
+		return operator new(size);
+	}
+	const auto sizeClass = SizeClass(size);
+	return PoolForClass(sizeClass).allocate(
+		(sizeClass + 1) * kSlabGranularity);
+}
+
+void FreeRuntimeComposerData(void *data, std::size_t size) {
+	if (size > kSlabMaxBlockSize) {
+		operator delete(data);
+		return;
+	}
+	PoolForClass(SizeClass(size)).free(data);
+}
+
 const RuntimeComposerMetadata *RuntimeComposerBase::ZeroRuntimeComposerMetadata = GetRuntimeComposerMetadata(0);
 
 RuntimeComponentWrapStruct RuntimeComponentWraps[64];
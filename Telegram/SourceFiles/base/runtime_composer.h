@@ -7,6 +7,12 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #pragma once
 
+#include "base/basic_types.h"
+#include "base/algorithm.h"
+#include "base/assertion.h"
+
+#include <QtCore/QAtomicInt>
+
 template <typename Base>
 class RuntimeComposer;
 
@@ -137,15 +143,21 @@ private:
 
 };
 
+// Metadata objects are created once per mask and never destroyed.
 const RuntimeComposerMetadata *GetRuntimeComposerMetadata(uint64 mask);
 
+// Component blocks are allocated from per-size-class slab pools,
+// large blocks fall back to the general heap.
+void *AllocateRuntimeComposerData(std::size_t size);
+void FreeRuntimeComposerData(void *data, std::size_t size);
+
 class RuntimeComposerBase {
 public:
 	RuntimeComposerBase(uint64 mask = 0) : _data(zerodata()) {
 		if (mask) {
 			auto meta = GetRuntimeComposerMetadata(mask);
 
-			auto data = operator new(meta->size);
+			auto data = AllocateRuntimeComposerData(meta->size);
 			Assert(data != nullptr);
 
 			_data = data;
@@ -185,7 +197,7 @@ public:
 					RuntimeComponentWraps[i].Destruct(_dataptrunsafe(offset));
 				}
 			}
-			operator delete(_data);
+			FreeRuntimeComposerData(_data, meta->size);
 		}
 	}
 
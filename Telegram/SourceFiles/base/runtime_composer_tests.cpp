@@ -0,0 +1,132 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "base/runtime_composer.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace {
+
+int ComponentsAlive = 0;
+
+class TestItem;
+
+struct TestValue : public RuntimeComponent<TestValue, TestItem> {
+	TestValue() {
+		++ComponentsAlive;
+	}
+	~TestValue() {
+		--ComponentsAlive;
+	}
+	int value = 0;
+};
+
+struct TestText : public RuntimeComponent<TestText, TestItem> {
+	std::string text;
+};
+
+struct TestLarge : public RuntimeComponent<TestLarge, TestItem> {
+	char data[512] = { 0 };
+};
+
+class TestItem : public RuntimeComposer<TestItem> {
+public:
+	TestItem(uint64 mask) : RuntimeComposer<TestItem>(mask) {
+	}
+
+	using RuntimeComposerBase::AddComponents;
+	using RuntimeComposerBase::RemoveComponents;
+
+};
+
+} // namespace
+
+TEST_CASE("runtime composer constructs and destroys components", "[runtime_composer]") {
+	{
+		TestItem item(TestValue::Bit() | TestText::Bit());
+		REQUIRE(item.Has<TestValue>());
+		REQUIRE(item.Has<TestText>());
+		REQUIRE(!item.Has<TestLarge>());
+		REQUIRE(item.Get<TestLarge>() == nullptr);
+		REQUIRE(ComponentsAlive == 1);
+		item.Get<TestValue>()->value = 7;
+		item.Get<TestText>()->text = "text";
+
+		SECTION("adding components keeps the values") {
+			item.AddComponents(TestLarge::Bit());
+			REQUIRE(item.Has<TestLarge>());
+			REQUIRE(item.Get<TestValue>()->value == 7);
+			REQUIRE(item.Get<TestText>()->text == "text");
+			REQUIRE(ComponentsAlive == 1);
+		}
+		SECTION("removing components keeps the rest") {
+			item.RemoveComponents(TestValue::Bit());
+			REQUIRE(!item.Has<TestValue>());
+			REQUIRE(item.Get<TestText>()->text == "text");
+			REQUIRE(ComponentsAlive == 0);
+		}
+	}
+	REQUIRE(ComponentsAlive == 0);
+}
+
+TEST_CASE("runtime composer blocks are reused", "[runtime_composer]") {
+	const auto first = AllocateRuntimeComposerData(33);
+	FreeRuntimeComposerData(first, 33);
+	const auto second = AllocateRuntimeComposerData(40);
+	REQUIRE(first == second);
+	FreeRuntimeComposerData(second, 40);
+
+	const auto large = AllocateRuntimeComposerData(4096);
+	REQUIRE(large != nullptr);
+	FreeRuntimeComposerData(large, 4096);
+}
+
+TEST_CASE("runtime composer metadata is shared between threads", "[runtime_composer]") {
+	const auto mask = TestValue::Bit() | TestLarge::Bit();
+	const auto meta = GetRuntimeComposerMetadata(mask);
+	REQUIRE(meta == GetRuntimeComposerMetadata(mask));
+	REQUIRE(meta->equals(mask));
+
+	auto other = (const RuntimeComposerMetadata*)nullptr;
+	std::thread([&] {
+		other = GetRuntimeComposerMetadata(mask);
+	}).join();
+	REQUIRE(meta == other);
+}
+
+// Not run by default, use "[benchmark]" filter to run it.
+TEST_CASE("runtime composer construction throughput", "[.][benchmark]") {
+	constexpr auto kCount = 1000000;
+	const uint64 masks[] = {
+		0,
+		TestValue::Bit(),
+		TestValue::Bit() | TestText::Bit(),
+		TestText::Bit(),
+	};
+
+	auto items = std::vector<std::unique_ptr<TestItem>>();
+	items.reserve(kCount);
+	const auto start = std::chrono::steady_clock::now();
+	for (auto i = 0; i != kCount; ++i) {
+		items.push_back(std::make_unique<TestItem>(masks[i % 4]));
+	}
+	for (auto i = 0; i < kCount; i += 3) {
+		items[i]->AddComponents(TestLarge::Bit());
+	}
+	items.clear();
+	const auto finish = std::chrono::steady_clock::now();
+
+	const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+		finish - start).count();
+	std::cout
+		<< kCount << " items constructed and destroyed in "
+		<< ms << " ms." << std::endl;
+}
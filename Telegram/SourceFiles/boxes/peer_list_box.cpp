@@ -643,8 +643,9 @@ void PeerListContent::addToSearchIndex(not_null<PeerListRow*> row) {
 	removeFromSearchIndex(row);
 	row->setNameFirstLetters(row->peer()->nameFirstLetters());
 	for (auto ch : row->nameFirstLetters()) {
-		_searchIndex[ch].push_back(row);
+		_searchIndex[ch].emplace(row);
 	}
+	invalidateLocalResults();
 }
 
 void PeerListContent::removeFromSearchIndex(not_null<PeerListRow*> row) {
@@ -654,7 +655,7 @@ void PeerListContent::removeFromSearchIndex(not_null<PeerListRow*> row) {
 			auto it = _searchIndex.find(ch);
 			if (it != _searchIndex.cend()) {
 				auto &entry = it->second;
-				entry.erase(ranges::remove(entry, row), end(entry));
+				entry.erase(row);
 				if (entry.empty()) {
 					_searchIndex.erase(it);
 				}
@@ -735,6 +736,9 @@ void PeerListContent::removeRow(not_null<PeerListRow*> row) {
 	_filterResults.erase(
 		ranges::remove(_filterResults, row),
 		end(_filterResults));
+	_localResults.erase(
+		ranges::remove(_localResults, row),
+		end(_localResults));
 	removeRowAtIndex(eraseFrom, index);
 
 	restoreSelection();
@@ -750,6 +754,7 @@ void PeerListContent::clearAllContent() {
 	_rowsByPeer.clear();
 	_filterResults.clear();
 	_searchIndex.clear();
+	invalidateLocalResults();
 	_rows.clear();
 	_searchRows.clear();
 	_searchQuery
@@ -1260,46 +1265,10 @@ void PeerListContent::searchQueryChanged(QString query) {
 	if (_normalizedSearchQuery != normalizedQuery) {
 		setSearchQuery(query, normalizedQuery);
 		if (_controller->searchInLocal() && !searchWordsList.isEmpty()) {
-			auto minimalList = (const std::vector<not_null<PeerListRow*>>*)nullptr;
-			for_const (auto &searchWord, searchWordsList) {
-				auto searchWordStart = searchWord[0].toLower();
-				auto it = _searchIndex.find(searchWordStart);
-				if (it == _searchIndex.cend()) {
-					// Some word can't be found in any row.
-					minimalList = nullptr;
-					break;
-				} else if (!minimalList || minimalList->size() > it->second.size()) {
-					minimalList = &it->second;
-				}
-			}
-			if (minimalList) {
-				auto searchWordInNames = [](
-						not_null<PeerData*> peer,
-						const QString &searchWord) {
-					for (auto &nameWord : peer->nameWords()) {
-						if (nameWord.startsWith(searchWord)) {
-							return true;
-						}
-					}
-					return false;
-				};
-				auto allSearchWordsInNames = [&](
-						not_null<PeerData*> peer) {
-					for_const (auto &searchWord, searchWordsList) {
-						if (!searchWordInNames(peer, searchWord)) {
-							return false;
-						}
-					}
-					return true;
-				};
-
-				_filterResults.reserve(minimalList->size());
-				for_const (auto row, *minimalList) {
-					if (allSearchWordsInNames(row->peer())) {
-						_filterResults.push_back(row);
-					}
-				}
-			}
+			searchInLocalRows(searchWordsList, normalizedQuery);
+			_filterResults = _localResults;
+		} else {
+			invalidateLocalResults();
 		}
 		if (_controller->hasComplexSearch()) {
 			_controller->search(_searchQuery);
@@ -1309,6 +1278,78 @@ void PeerListContent::searchQueryChanged(QString query) {
 	}
 }
 
+void PeerListContent::searchInLocalRows(
+		const QStringList &searchWordsList,
+		const QString &normalizedQuery) {
+	const auto searchWordInNames = [](
+			not_null<PeerData*> peer,
+			const QString &searchWord) {
+		for (auto &nameWord : peer->nameWords()) {
+			if (nameWord.startsWith(searchWord)) {
+				return true;
+			}
+		}
+		return false;
+	};
+	const auto allSearchWordsInNames = [&](not_null<PeerData*> peer) {
+		for_const (auto &searchWord, searchWordsList) {
+			if (!searchWordInNames(peer, searchWord)) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	if (!_localResultsQuery.isEmpty()
+		&& normalizedQuery.startsWith(_localResultsQuery)) {
+		// Each word of the previous query is a prefix of some word
+		// of the new one, so the new results are a subset of the old.
+		_localResults.erase(
+			ranges::remove_if(_localResults, [&](
+					not_null<PeerListRow*> row) {
+				return !allSearchWordsInNames(row->peer());
+			}),
+			end(_localResults));
+		_localResultsQuery = normalizedQuery;
+		return;
+	}
+
+	_localResults.clear();
+	_localResultsQuery = normalizedQuery;
+	auto minimalList = (const std::set<not_null<PeerListRow*>>*)nullptr;
+	for_const (auto &searchWord, searchWordsList) {
+		auto searchWordStart = searchWord[0].toLower();
+		auto it = _searchIndex.find(searchWordStart);
+		if (it == _searchIndex.cend()) {
+			// Some word can't be found in any row.
+			return;
+		} else if (!minimalList || minimalList->size() > it->second.size()) {
+			minimalList = &it->second;
+		}
+	}
+	if (!minimalList) {
+		return;
+	}
+	_localResults.reserve(minimalList->size());
+	for (const auto row : *minimalList) {
+		if (allSearchWordsInNames(row->peer())) {
+			_localResults.push_back(row);
+		}
+	}
+
+	// Index buckets are not kept in the rows order, restore it here.
+	ranges::sort(_localResults, [](
+			not_null<PeerListRow*> a,
+			not_null<PeerListRow*> b) {
+		return a->absoluteIndex() < b->absoluteIndex();
+	});
+}
+
+void PeerListContent::invalidateLocalResults() {
+	_localResults.clear();
+	_localResultsQuery = QString();
+}
+
 std::unique_ptr<PeerListState> PeerListContent::saveState() const {
 	auto result = std::make_unique<PeerListState>();
 	result->controllerState
@@ -471,10 +471,8 @@ public:
 	template <typename ReorderCallback>
 	void reorderRows(ReorderCallback &&callback) {
 		callback(_rows.begin(), _rows.end());
-		for (auto &searchEntity : _searchIndex) {
-			callback(searchEntity.second.begin(), searchEntity.second.end());
-		}
 		refreshIndices();
+		invalidateLocalResults();
 		update();
 	}
 
@@ -570,6 +568,10 @@ private:
 	void addToSearchIndex(not_null<PeerListRow*> row);
 	bool addingToSearchIndex() const;
 	void removeFromSearchIndex(not_null<PeerListRow*> row);
+	void searchInLocalRows(
+		const QStringList &searchWordsList,
+		const QString &normalizedQuery);
+	void invalidateLocalResults();
 	void setSearchQuery(const QString &query, const QString &normalizedQuery);
 	bool showingSearch() const {
 		return !_searchQuery.isEmpty();
@@ -610,12 +612,17 @@ private:
 	std::map<PeerListRowId, not_null<PeerListRow*>> _rowsById;
 	std::map<PeerData*, std::vector<not_null<PeerListRow*>>> _rowsByPeer;
 
-	std::map<QChar, std::vector<not_null<PeerListRow*>>> _searchIndex;
+	std::map<QChar, std::set<not_null<PeerListRow*>>> _searchIndex;
 	QString _searchQuery;
 	QString _normalizedSearchQuery;
 	QString _mentionHighlight;
 	std::vector<not_null<PeerListRow*>> _filterResults;
 
+	// Local rows matching _localResultsQuery, ordered by absolute index.
+	// Typing more letters refines them instead of rescanning the index.
+	std::vector<not_null<PeerListRow*>> _localResults;
+	QString _localResultsQuery;
+
 	int _aboveHeight = 0;
 	object_ptr<TWidget> _aboveWidget = { nullptr };
 	object_ptr<Ui::FlatLabel> _description = { nullptr };
@@ -31,6 +31,10 @@ constexpr auto kSaveChosenTabTimeout = 1000;
 constexpr auto kSearchRequestDelay = 400;
 constexpr auto kInlineItemsMaxPerRow = 5;
 constexpr auto kSearchBotUsername = str_const("gif");
+constexpr auto kScrollVelocityTimeout = TimeMs(200);
+constexpr auto kPrefetchLookahead = TimeMs(400);
+constexpr auto kPrefetchMaxScreens = 3;
+constexpr auto kPrefetchPrepareLimit = 4;
 
 } // namespace
 
@@ -165,11 +169,47 @@ void GifsListWidget::visibleTopBottomUpdated(
 	auto top = getVisibleTop();
 	Inner::visibleTopBottomUpdated(visibleTop, visibleBottom);
 	if (top != getVisibleTop()) {
-		_lastScrolled = getms();
+		const auto now = getms();
+		prefetchThumbs(getVisibleTop() - top, now - _lastScrolled);
+		_lastScrolled = now;
 	}
 	checkLoadMore();
 }
 
+void GifsListWidget::prefetchThumbs(int scrolledBy, TimeMs elapsed) {
+	// Look further ahead the faster we scroll, so that thumbs are
+	// loaded and scaled before the rows become visible.
+	const auto velocity = (elapsed > 0 && elapsed < kScrollVelocityTimeout)
+		? (std::abs(scrolledBy) / float64(elapsed))
+		: 0.;
+	const auto visibleHeight = getVisibleBottom() - getVisibleTop();
+	const auto ahead = snap(
+		int(velocity * kPrefetchLookahead),
+		visibleHeight / 2,
+		visibleHeight * kPrefetchMaxScreens);
+	const auto from = (scrolledBy > 0)
+		? getVisibleBottom()
+		: (getVisibleTop() - ahead);
+	const auto till = from + ahead;
+
+	auto prepared = 0;
+	auto top = st::stickerPanPadding;
+	for (const auto &row : _rows) {
+		if (top >= till) {
+			break;
+		} else if (top + row.height > from) {
+			for (const auto item : row.items) {
+				item->preload();
+				if (prepared < kPrefetchPrepareLimit
+					&& item->prepareThumbnail()) {
+					++prepared;
+				}
+			}
+		}
+		top += row.height;
+	}
+}
+
 void GifsListWidget::checkLoadMore() {
 	auto visibleHeight = (getVisibleBottom() - getVisibleTop());
 	if (getVisibleBottom() + visibleHeight > height()) {
@@ -119,6 +119,7 @@ private:
 
 	void updateSelected();
 	void paintInlineItems(Painter &p, QRect clip);
+	void prefetchThumbs(int scrolledBy, TimeMs elapsed);
 
 	Section _section = Section::Gifs;
 	TimeMs _lastScrolled = 0;
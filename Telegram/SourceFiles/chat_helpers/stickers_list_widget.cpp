@@ -34,6 +34,14 @@ namespace {
 constexpr auto kInlineItemsMaxPerRow = 5;
 constexpr auto kSearchRequestDelay = 400;
 constexpr auto kRecentDisplayLimit = 20;
+constexpr auto kAtlasCellsPerRow = 8;
+constexpr auto kAtlasCellsPerPage = kAtlasCellsPerRow * kAtlasCellsPerRow;
+constexpr auto kAtlasMaxPages = 4;
+constexpr auto kAtlasMaxCells = kAtlasCellsPerPage * kAtlasMaxPages;
+constexpr auto kScrollVelocityTimeout = TimeMs(200);
+constexpr auto kPrefetchLookahead = TimeMs(400);
+constexpr auto kPrefetchMaxScreens = 3;
+constexpr auto kPrefetchPrepareLimit = 8;
 
 bool SetInMyList(MTPDstickerSet::Flags flags) {
 	return (flags & MTPDstickerSet::Flag::f_installed_date)
@@ -676,6 +684,152 @@ void StickersListWidget::Footer::step_icons(TimeMs ms, bool timer) {
 	}
 }
 
+// Prepared sticker thumbs packed into a few shared pixmaps,
+// evicting the least recently used ones when all cells are taken.
+class StickersListWidget::ThumbsAtlas {
+public:
+	explicit ThumbsAtlas(QSize cell);
+
+	QSize cell() const;
+
+	bool prepare(not_null<DocumentData*> document, QSize size);
+	bool paint(
+		Painter &p,
+		QPoint position,
+		int outerw,
+		not_null<DocumentData*> document,
+		QSize size);
+
+private:
+	struct Entry {
+		const Image *image = nullptr;
+		QSize size;
+		int slot = 0;
+		uint64 lastUsed = 0;
+	};
+
+	const Entry *find(not_null<DocumentData*> document, QSize size);
+	const Entry *render(not_null<DocumentData*> document, QSize size);
+	int allocateSlot();
+	QPoint slotPosition(int slot) const;
+
+	QSize _cell;
+	std::vector<QPixmap> _pages;
+	base::flat_map<DocumentId, Entry> _entries;
+	int _allocated = 0;
+	uint64 _useCounter = 0;
+
+};
+
+StickersListWidget::ThumbsAtlas::ThumbsAtlas(QSize cell) : _cell(cell) {
+}
+
+QSize StickersListWidget::ThumbsAtlas::cell() const {
+	return _cell;
+}
+
+bool StickersListWidget::ThumbsAtlas::prepare(
+		not_null<DocumentData*> document,
+		QSize size) {
+	return !find(document, size) && render(document, size);
+}
+
+bool StickersListWidget::ThumbsAtlas::paint(
+		Painter &p,
+		QPoint position,
+		int outerw,
+		not_null<DocumentData*> document,
+		QSize size) {
+	auto entry = find(document, size);
+	if (!entry) {
+		entry = render(document, size);
+		if (!entry) {
+			return false;
+		}
+	}
+	p.drawPixmapLeft(
+		QRect(position, size),
+		outerw,
+		_pages[entry->slot / kAtlasCellsPerPage],
+		QRect(slotPosition(entry->slot), size * cIntRetinaFactor()));
+	return true;
+}
+
+auto StickersListWidget::ThumbsAtlas::find(
+		not_null<DocumentData*> document,
+		QSize size) -> const Entry* {
+	const auto i = _entries.find(document->id);
+	if (i == end(_entries)
+		|| i->second.size != size
+		|| i->second.image != document->getStickerThumb()) {
+		return nullptr;
+	}
+	i->second.lastUsed = ++_useCounter;
+	return &i->second;
+}
+
+auto StickersListWidget::ThumbsAtlas::render(
+		not_null<DocumentData*> document,
+		QSize size) -> const Entry* {
+	const auto image = document->getStickerThumb();
+	const auto pixels = size * cIntRetinaFactor();
+	if (!image
+		|| !image->loaded()
+		|| pixels.width() > _cell.width()
+		|| pixels.height() > _cell.height()) {
+		return nullptr;
+	}
+	const auto i = _entries.find(document->id);
+	const auto slot = (i != end(_entries))
+		? i->second.slot
+		: allocateSlot();
+	const auto pixmap = image->pixNoCache(
+		document->stickerSetOrigin(),
+		pixels.width(),
+		pixels.height(),
+		Images::Option::Smooth);
+	{
+		QPainter p(&_pages[slot / kAtlasCellsPerPage]);
+		p.setCompositionMode(QPainter::CompositionMode_Source);
+		p.fillRect(QRect(slotPosition(slot), _cell), Qt::transparent);
+		p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+		p.drawPixmap(QRect(slotPosition(slot), pixels), pixmap);
+	}
+	auto &entry = _entries[document->id];
+	entry = Entry{ image, size, slot, ++_useCounter };
+	return &entry;
+}
+
+int StickersListWidget::ThumbsAtlas::allocateSlot() {
+	if (_allocated < kAtlasMaxCells) {
+		if (_allocated == int(_pages.size()) * kAtlasCellsPerPage) {
+			auto image = QImage(
+				kAtlasCellsPerRow * _cell.width(),
+				kAtlasCellsPerRow * _cell.height(),
+				QImage::Format_ARGB32_Premultiplied);
+			image.fill(Qt::transparent);
+			_pages.push_back(App::pixmapFromImageInPlace(std::move(image)));
+		}
+		return _allocated++;
+	}
+	const auto lru = std::min_element(
+		begin(_entries),
+		end(_entries),
+		[](const auto &a, const auto &b) {
+			return (a.second.lastUsed < b.second.lastUsed);
+		});
+	const auto result = lru->second.slot;
+	_entries.erase(lru);
+	return result;
+}
+
+QPoint StickersListWidget::ThumbsAtlas::slotPosition(int slot) const {
+	const auto inpage = slot % kAtlasCellsPerPage;
+	return QPoint(
+		(inpage % kAtlasCellsPerRow) * _cell.width(),
+		(inpage / kAtlasCellsPerRow) * _cell.height());
+}
+
 StickersListWidget::StickersListWidget(QWidget *parent, not_null<Window::Controller*> controller) : Inner(parent, controller)
 , _section(Section::Stickers)
 , _megagroupSetAbout(st::columnMinimalWidthThird - st::emojiScroll.width - st::emojiPanHeaderLeft)
@@ -719,9 +873,91 @@ void StickersListWidget::visibleTopBottomUpdated(
 	if (_section == Section::Featured) {
 		readVisibleSets();
 	}
+	if (top != getVisibleTop()) {
+		prefetchThumbs(getVisibleTop() - top);
+	}
 	validateSelectedIcon(ValidateIconAnimations::Full);
 }
 
+void StickersListWidget::prefetchThumbs(int scrolledBy) {
+	const auto now = getms();
+	const auto elapsed = now - _lastScrolled;
+	_lastScrolled = now;
+
+	// Look further ahead the faster we scroll, so that thumbs are
+	// loaded and packed into the atlas before they become visible.
+	const auto velocity = (elapsed > 0 && elapsed < kScrollVelocityTimeout)
+		? (std::abs(scrolledBy) / float64(elapsed))
+		: 0.;
+	const auto visibleHeight = getVisibleBottom() - getVisibleTop();
+	const auto ahead = snap(
+		int(velocity * kPrefetchLookahead),
+		visibleHeight / 2,
+		visibleHeight * kPrefetchMaxScreens);
+	const auto from = (scrolledBy > 0)
+		? getVisibleBottom()
+		: (getVisibleTop() - ahead);
+	const auto till = from + ahead;
+
+	auto &sets = shownSets();
+	auto &atlas = thumbsAtlas();
+	auto prepared = 0;
+	enumerateSections([&](const SectionInfo &info) {
+		if (info.rowsBottom <= from) {
+			return true;
+		} else if (info.rowsTop >= till) {
+			return false;
+		}
+		const auto &set = sets[info.section];
+		const auto rowHeight = _singleSize.height();
+		const auto rowFrom = floorclamp(
+			from - info.rowsTop,
+			rowHeight,
+			0,
+			info.rowsCount);
+		const auto rowTo = ceilclamp(
+			till - info.rowsTop,
+			rowHeight,
+			0,
+			info.rowsCount);
+		const auto count = set.externalLayout
+			? std::min(info.count, _columnCount)
+			: info.count;
+		const auto indexTill = std::min(rowTo * _columnCount, count);
+		for (auto index = rowFrom * _columnCount; index < indexTill; ++index) {
+			const auto document = set.pack[index];
+			if (!document->sticker()) {
+				continue;
+			}
+			document->checkStickerThumb();
+			if (prepared < kPrefetchPrepareLimit
+				&& atlas.prepare(document, stickerThumbSize(document))) {
+				++prepared;
+			}
+		}
+		return true;
+	});
+}
+
+QSize StickersListWidget::stickerThumbSize(
+		not_null<DocumentData*> document) const {
+	auto coef = qMin((_singleSize.width() - st::buttonRadius * 2) / float64(document->dimensions.width()), (_singleSize.height() - st::buttonRadius * 2) / float64(document->dimensions.height()));
+	if (coef > 1) coef = 1;
+	auto w = qMax(qRound(coef * document->dimensions.width()), 1);
+	auto h = qMax(qRound(coef * document->dimensions.height()), 1);
+	return QSize(w, h);
+}
+
+auto StickersListWidget::thumbsAtlas() -> ThumbsAtlas& {
+	const auto cell = QSize(
+		_singleSize.width() - st::buttonRadius * 2,
+		_singleSize.height() - st::buttonRadius * 2) * cIntRetinaFactor();
+	if (!_thumbsAtlas || _thumbsAtlas->cell() != cell) {
+		_thumbsAtlas = std::make_unique<ThumbsAtlas>(cell);
+	}
+	return *_thumbsAtlas;
+}
+
 void StickersListWidget::readVisibleSets() {
 	auto itemsVisibleTop = getVisibleTop();
 	auto itemsVisibleBottom = getVisibleBottom();
@@ -1327,25 +1563,11 @@ void StickersListWidget::paintSticker(Painter &p, Set &set, int y, int index, bo
 
 	document->checkStickerThumb();
 
-	auto coef = qMin((_singleSize.width() - st::buttonRadius * 2) / float64(document->dimensions.width()), (_singleSize.height() - st::buttonRadius * 2) / float64(document->dimensions.height()));
-	if (coef > 1) coef = 1;
-	auto w = qMax(qRound(coef * document->dimensions.width()), 1);
-	auto h = qMax(qRound(coef * document->dimensions.height()), 1);
-	auto ppos = pos + QPoint((_singleSize.width() - w) / 2, (_singleSize.height() - h) / 2);
-	if (const auto image = document->getStickerThumb()) {
-		if (image->loaded()) {
-			p.drawPixmapLeft(
-				ppos,
-				width(),
-				image->pixSingle(
-					document->stickerSetOrigin(),
-					w,
-					h,
-					w,
-					h,
-					ImageRoundRadius::None));
-		}
-	}
+	const auto size = stickerThumbSize(document);
+	const auto ppos = pos + QPoint(
+		(_singleSize.width() - size.width()) / 2,
+		(_singleSize.height() - size.height()) / 2);
+	thumbsAtlas().paint(p, ppos, width(), document, size);
 
 	if (selected && stickerHasDeleteButton(set, index)) {
 		auto xPos = pos + QPoint(_singleSize.width() - st::stickerPanDeleteIconBg.width(), 0);
@@ -1670,6 +1892,7 @@ void StickersListWidget::processHideFinished() {
 
 void StickersListWidget::processPanelHideFinished() {
 	clearInstalledLocally();
+	_thumbsAtlas = nullptr;
 
 	// Preserve panel state through visibility toggles.
 	//// Reset to the recent stickers section.
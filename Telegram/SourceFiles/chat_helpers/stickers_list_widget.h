@@ -93,6 +93,7 @@ signals:
 
 private:
 	class Footer;
+	class ThumbsAtlas;
 
 	enum class Section {
 		Featured,
@@ -203,6 +204,9 @@ private:
 	const std::vector<Set> &shownSets() const;
 	int featuredRowHeight() const;
 	void readVisibleSets();
+	void prefetchThumbs(int scrolledBy);
+	QSize stickerThumbSize(not_null<DocumentData*> document) const;
+	ThumbsAtlas &thumbsAtlas();
 
 	void paintFeaturedStickers(Painter &p, QRect clip);
 	void paintStickers(Painter &p, QRect clip);
@@ -265,6 +269,8 @@ private:
 	int _rowsLeft = 0;
 	int _columnCount = 1;
 	QSize _singleSize;
+	std::unique_ptr<ThumbsAtlas> _thumbsAtlas;
+	TimeMs _lastScrolled = 0;
 
 	OverState _selected;
 	OverState _pressed;
@@ -46,7 +46,6 @@ enum {
 
 	AnimationTimerDelta = 7,
 	ClipThreadsCount = 8,
-	AverageGifSize = 320 * 240,
 	WaitBeforeGifPause = 200, // wait 200ms for gif draw before pausing it
 	RecentInlineBotsLimit = 10,
 
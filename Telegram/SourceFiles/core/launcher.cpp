@@ -10,6 +10,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "platform/platform_launcher.h"
 #include "platform/platform_specific.h"
 #include "core/crash_reports.h"
+#include "core/startup_trace.h"
 #include "core/main_queue_processor.h"
 #include "core/update_checker.h"
 #include "base/concurrent_timer.h"
@@ -47,16 +48,25 @@ void Launcher::init() {
 }
 
 int Launcher::exec() {
+	StartupTrace::Start();
+
 	init();
 
-	if (cLaunchMode() == LaunchModeFixPrevious) {
+	if (!_decodeMtpTrace.isEmpty()) {
+		return Logs::DecodeMtpTrace(
+			_decodeMtpTrace,
+			_decodeMtpTrace + qsl(".txt")) ? 0 : 1;
+	} else if (cLaunchMode() == LaunchModeFixPrevious) {
 		return psFixPrevious();
 	} else if (cLaunchMode() == LaunchModeCleanup) {
 		return psCleanup();
 	}
 
 	// both are finished in Application::closeApplication
-	Logs::start(this); // must be started before Platform is started
+	{
+		const auto trace = StartupTrace::Scope("Logs::start");
+		Logs::start(this); // must be started before Platform is started
+	}
 	Platform::start(); // must be started before QApplication is created
 
 	auto result = executeApplication();
@@ -188,8 +198,10 @@ void Launcher::processArguments() {
 		{ "-externalupdater", KeyFormat::NoValues },
 		{ "-tosettings"     , KeyFormat::NoValues },
 		{ "-startintray"    , KeyFormat::NoValues },
+		{ "-emojisprites"   , KeyFormat::NoValues },
 		{ "-sendpath"       , KeyFormat::AllLeftValues },
 		{ "-workdir"        , KeyFormat::OneValue },
+		{ "-decodemtp"      , KeyFormat::OneValue },
 		{ "--"              , KeyFormat::OneValue },
 	};
 	auto parseResult = QMap<QByteArray, QStringList>();
@@ -230,6 +242,7 @@ void Launcher::processArguments() {
 	gNoStartUpdate = parseResult.contains("-noupdate");
 	gStartToSettings = parseResult.contains("-tosettings");
 	gStartInTray = parseResult.contains("-startintray");
+	gEmojiSprites = parseResult.contains("-emojisprites");
 	gSendPaths = parseResult.value("-sendpath", {});
 	gWorkingDir = parseResult.value("-workdir", {}).join(QString());
 	if (!gWorkingDir.isEmpty()) {
@@ -240,6 +253,7 @@ void Launcher::processArguments() {
 		}
 	}
 	gStartUrl = parseResult.value("--", {}).join(QString());
+	_decodeMtpTrace = parseResult.value("-decodemtp", {}).join(QString());
 }
 
 int Launcher::executeApplication() {
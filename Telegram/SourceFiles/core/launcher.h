@@ -58,6 +58,7 @@ private:
 	int _argc;
 	char **_argv;
 	QStringList _arguments;
+	QString _decodeMtpTrace;
 
 	const QString _deviceModel;
 	const QString _systemVersion;
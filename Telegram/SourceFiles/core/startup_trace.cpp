@@ -0,0 +1,141 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "core/startup_trace.h"
+
+#include <chrono>
+#include <mutex>
+
+namespace Core {
+namespace StartupTrace {
+namespace {
+
+constexpr auto kSummaryStepsCount = 5;
+
+struct Event {
+	QByteArray name;
+	int64 started = 0;
+	int64 duration = 0;
+	int thread = 0;
+};
+
+std::mutex EventsMutex;
+std::vector<Event> Events;
+bool Finished = false;
+std::chrono::steady_clock::time_point StartTime;
+std::atomic<int> ThreadsCounter = 0;
+thread_local int ThreadIndex = -1;
+
+int64 Now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - StartTime).count();
+}
+
+int CurrentThread() {
+	if (ThreadIndex < 0) {
+		ThreadIndex = ThreadsCounter++;
+	}
+	return ThreadIndex;
+}
+
+QByteArray Escape(const QByteArray &name) {
+	auto result = name;
+	return result.replace('\\', "\\\\").replace('"', "\\\"");
+}
+
+QByteArray Serialize(const std::vector<Event> &events) {
+	auto result = QByteArray();
+	result.reserve(events.size() * 128 + 32);
+	result.append("{\"traceEvents\":[\n");
+	auto first = true;
+	for (const auto &event : events) {
+		if (!first) {
+			result.append(",\n");
+		}
+		first = false;
+		result.append("{\"name\":\"").append(Escape(event.name));
+		result.append("\",\"cat\":\"startup\",\"ph\":\"X\",\"ts\":");
+		result.append(QByteArray::number(event.started));
+		result.append(",\"dur\":").append(QByteArray::number(event.duration));
+		result.append(",\"pid\":1,\"tid\":");
+		result.append(QByteArray::number(event.thread)).append('}');
+	}
+	result.append("\n]}\n");
+	return result;
+}
+
+} // namespace
+
+void Start() {
+	StartTime = std::chrono::steady_clock::now();
+	CurrentThread();
+}
+
+void Finish() {
+	const auto total = Now();
+	auto events = [&] {
+		std::lock_guard<std::mutex> lock(EventsMutex);
+		Finished = true;
+		return base::take(Events);
+	}();
+
+	auto main = std::vector<const Event*>();
+	for (const auto &event : events) {
+		if (!event.thread) {
+			main.push_back(&event);
+		}
+	}
+	ranges::sort(main, [](const Event *a, const Event *b) {
+		return a->duration > b->duration;
+	});
+	if (main.size() > kSummaryStepsCount) {
+		main.resize(kSummaryStepsCount);
+	}
+	auto summary = QStringList();
+	for (const auto event : main) {
+		summary.push_back(qsl("%1 %2ms"
+			).arg(QString::fromUtf8(event->name)
+			).arg(event->duration / 1000));
+	}
+	LOG(("Startup Info: %1ms total, longest steps: %2"
+		).arg(total / 1000
+		).arg(summary.join(qsl(", "))));
+
+	if (!Logs::DebugEnabled()) {
+		return;
+	}
+	crl::async([events = std::move(events)] {
+		const auto folder = cWorkingDir() + qsl("DebugLogs");
+		QDir().mkpath(folder);
+		QFile f(folder + qsl("/startup.json"));
+		if (f.open(QIODevice::WriteOnly)) {
+			f.write(Serialize(events));
+		}
+	});
+}
+
+Scope::Scope(const QByteArray &name)
+: _name(name)
+, _started(Now()) {
+}
+
+Scope::~Scope() {
+	const auto finished = Now();
+	const auto thread = CurrentThread();
+
+	std::lock_guard<std::mutex> lock(EventsMutex);
+	if (!Finished) {
+		Events.push_back({
+			std::move(_name),
+			_started,
+			finished - _started,
+			thread });
+	}
+}
+
+} // namespace StartupTrace
+} // namespace Core
@@ -0,0 +1,74 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <future>
+
+namespace Core {
+namespace StartupTrace {
+
+// Must be called on the main thread before any Scope is created.
+void Start();
+
+// Logs a summary and writes DebugLogs/startup.json in Chrome trace format
+// if debug logs are enabled. Scopes finished after that are ignored.
+void Finish();
+
+class Scope {
+public:
+	explicit Scope(const QByteArray &name);
+	Scope(const Scope &other) = delete;
+	Scope &operator=(const Scope &other) = delete;
+	~Scope();
+
+private:
+	QByteArray _name;
+	int64 _started = 0;
+
+};
+
+} // namespace StartupTrace
+
+// Runs a startup step in the background, join() is the explicit point
+// where the main thread waits for the result.
+template <typename Result>
+class StartupTask {
+public:
+	template <typename Callable>
+	StartupTask(const QByteArray &name, Callable &&callable);
+
+	Result join();
+
+private:
+	QByteArray _name;
+	std::future<Result> _result;
+
+};
+
+template <typename Result>
+template <typename Callable>
+StartupTask<Result>::StartupTask(const QByteArray &name, Callable &&callable)
+: _name(name) {
+	auto task = std::make_shared<std::packaged_task<Result()>>(
+		std::forward<Callable>(callable));
+	_result = task->get_future();
+	crl::async([=] {
+		const auto scope = StartupTrace::Scope(name);
+		(*task)();
+	});
+}
+
+template <typename Result>
+Result StartupTask<Result>::join() {
+	Expects(_result.valid());
+
+	const auto scope = StartupTrace::Scope("join: " + _name);
+	return _result.get();
+}
+
+} // namespace Core
@@ -26,6 +26,7 @@ extern "C" {
 #include <openssl/pem.h>
 #include <openssl/bio.h>
 #include <openssl/err.h>
+#include <openssl/sha.h>
 } // extern "C"
 
 #ifdef Q_OS_WIN // use Lzma SDK for win
@@ -41,6 +42,14 @@ constexpr auto kUpdaterTimeout = 10 * TimeMs(1000);
 constexpr auto kMaxResponseSize = 1024 * 1024;
 constexpr auto kMaxUpdateSize = 256 * 1024 * 1024;
 constexpr auto kChunkSize = 128 * 1024;
+constexpr auto kUnpackChunkSize = 256 * 1024;
+
+// Delta packages have this marker instead of the files count.
+constexpr auto kDeltaPackageMarker = quint32(0xFFFFFFFFU);
+constexpr auto kDeltaFileFull = quint8(0);
+constexpr auto kDeltaFilePatch = quint8(1);
+constexpr auto kDeltaOpCopy = quint8(0);
+constexpr auto kDeltaOpInsert = quint8(1);
 
 #ifdef TDESKTOP_DISABLE_AUTOUPDATE
 bool UpdaterIsDisabled = true;
@@ -49,6 +58,7 @@ bool UpdaterIsDisabled = false;
 #endif // TDESKTOP_DISABLE_AUTOUPDATE
 
 std::weak_ptr<Updater> UpdaterInstance;
+std::atomic<bool> DeltaUpdateFailed = false;
 
 using ErrorSignal = void(QNetworkReply::*)(QNetworkReply::NetworkError);
 const auto QNetworkReply_error = ErrorSignal(&QNetworkReply::error);
@@ -161,6 +171,9 @@ private:
 	std::optional<QString> parseOldResponse(
 		const QByteArray &response) const;
 	std::optional<QString> parseResponse(const QByteArray &response) const;
+	std::optional<QString> findDeltaLink(
+		bool isAvailableAlpha,
+		const QJsonObject &map) const;
 	QString validateLatestUrl(
 		uint64 availableVersion,
 		bool isAvailableAlpha,
@@ -353,84 +366,130 @@ QString ExtractFilename(const QString &url) {
 	return QString();
 }
 
-bool UnpackUpdate(const QString &filepath) {
-	QFile input(filepath);
-	QByteArray packed;
-	if (!input.open(QIODevice::ReadOnly)) {
-		LOG(("Update Error: cant read updates file!"));
+bool VerifyUpdateSignature(QFile &input, int32 hSigLen, int32 hShaLen) {
+	if (!input.seek(0)) {
+		LOG(("Update Error: cant seek in updates file!"));
 		return false;
 	}
-
-#ifdef Q_OS_WIN // use Lzma SDK for win
-	const int32 hSigLen = 128, hShaLen = 20, hPropsLen = LZMA_PROPS_SIZE, hOriginalSizeLen = sizeof(int32), hSize = hSigLen + hShaLen + hPropsLen + hOriginalSizeLen; // header
-#else // Q_OS_WIN
-	const int32 hSigLen = 128, hShaLen = 20, hPropsLen = 0, hOriginalSizeLen = sizeof(int32), hSize = hSigLen + hShaLen + hOriginalSizeLen; // header
-#endif // Q_OS_WIN
-
-	QByteArray compressed = input.readAll();
-	int32 compressedLen = compressed.size() - hSize;
-	if (compressedLen <= 0) {
-		LOG(("Update Error: bad compressed size: %1").arg(compressed.size()));
+	const auto signature = input.read(hSigLen);
+	const auto sha1 = input.read(hShaLen);
+	if (signature.size() != hSigLen || sha1.size() != hShaLen) {
+		LOG(("Update Error: bad updates file header!"));
 		return false;
 	}
-	input.close();
 
-	QString tempDirPath = cWorkingDir() + qsl("tupdates/temp"), readyFilePath = cWorkingDir() + qsl("tupdates/temp/ready");
-	psDeleteDir(tempDirPath);
-
-	QDir tempDir(tempDirPath);
-	if (tempDir.exists() || QFile(readyFilePath).exists()) {
-		LOG(("Update Error: cant clear tupdates/temp dir!"));
-		return false;
+	// Hash the rest of the file without reading it to memory.
+	SHA_CTX context;
+	SHA1_Init(&context);
+	auto buffer = QByteArray(kUnpackChunkSize, Qt::Uninitialized);
+	while (true) {
+		const auto read = input.read(buffer.data(), buffer.size());
+		if (read < 0) {
+			LOG(("Update Error: cant read updates file!"));
+			return false;
+		} else if (!read) {
+			break;
+		}
+		SHA1_Update(&context, buffer.constData(), read);
 	}
-
 	uchar sha1Buffer[20];
-	bool goodSha1 = !memcmp(compressed.constData() + hSigLen, hashSha1(compressed.constData() + hSigLen + hShaLen, compressedLen + hPropsLen + hOriginalSizeLen, sha1Buffer), hShaLen);
-	if (!goodSha1) {
+	SHA1_Final(sha1Buffer, &context);
+	if (memcmp(sha1.constData(), sha1Buffer, hShaLen)) {
 		LOG(("Update Error: bad SHA1 hash of update file!"));
 		return false;
 	}
 
-	RSA *pbKey = PEM_read_bio_RSAPublicKey(BIO_new_mem_buf(const_cast<char*>(AppBetaVersion ? UpdatesPublicBetaKey : UpdatesPublicKey), -1), 0, 0, 0);
-	if (!pbKey) {
-		LOG(("Update Error: cant read public rsa key!"));
-		return false;
-	}
-	if (RSA_verify(NID_sha1, (const uchar*)(compressed.constData() + hSigLen), hShaLen, (const uchar*)(compressed.constData()), hSigLen, pbKey) != 1) { // verify signature
-		RSA_free(pbKey);
-
-		// try other public key, if we update from beta to stable or vice versa
-		pbKey = PEM_read_bio_RSAPublicKey(BIO_new_mem_buf(const_cast<char*>(AppBetaVersion ? UpdatesPublicKey : UpdatesPublicBetaKey), -1), 0, 0, 0);
+	const auto verify = [&](const char *key) {
+		RSA *pbKey = PEM_read_bio_RSAPublicKey(BIO_new_mem_buf(const_cast<char*>(key), -1), 0, 0, 0);
 		if (!pbKey) {
 			LOG(("Update Error: cant read public rsa key!"));
 			return false;
 		}
-		if (RSA_verify(NID_sha1, (const uchar*)(compressed.constData() + hSigLen), hShaLen, (const uchar*)(compressed.constData()), hSigLen, pbKey) != 1) { // verify signature
-			RSA_free(pbKey);
-			LOG(("Update Error: bad RSA signature of update file!"));
-			return false;
-		}
+		const auto result = RSA_verify(
+			NID_sha1,
+			(const uchar*)(sha1.constData()),
+			hShaLen,
+			(const uchar*)(signature.constData()),
+			hSigLen,
+			pbKey);
+		RSA_free(pbKey);
+		return (result == 1);
+	};
+
+	// try other public key, if we update from beta to stable or vice versa
+	if (!verify(AppBetaVersion ? UpdatesPublicBetaKey : UpdatesPublicKey)
+		&& !verify(AppBetaVersion ? UpdatesPublicKey : UpdatesPublicBetaKey)) {
+		LOG(("Update Error: bad RSA signature of update file!"));
+		return false;
 	}
-	RSA_free(pbKey);
+	return true;
+}
 
-	QByteArray uncompressed;
+#ifdef Q_OS_WIN // use Lzma SDK for win
 
-	int32 uncompressedLen;
-	memcpy(&uncompressedLen, compressed.constData() + hSigLen + hShaLen + hPropsLen, hOriginalSizeLen);
+// LzmaLib provides only the one-shot decoder, so the uncompressed
+// package is kept in memory here, files are still written in chunks.
+std::unique_ptr<QIODevice> OpenUncompressed(
+		QFile &input,
+		const QByteArray &props,
+		int32 compressedLen,
+		int32 uncompressedLen) {
+	const auto compressed = input.read(compressedLen);
+	if (compressed.size() != compressedLen) {
+		LOG(("Update Error: cant read compressed data!"));
+		return nullptr;
+	}
+	QByteArray uncompressed;
 	uncompressed.resize(uncompressedLen);
 
 	size_t resultLen = uncompressed.size();
-#ifdef Q_OS_WIN // use Lzma SDK for win
 	SizeT srcLen = compressedLen;
-	int uncompressRes = LzmaUncompress((uchar*)uncompressed.data(), &resultLen, (const uchar*)(compressed.constData() + hSize), &srcLen, (const uchar*)(compressed.constData() + hSigLen + hShaLen), LZMA_PROPS_SIZE);
+	int uncompressRes = LzmaUncompress((uchar*)uncompressed.data(), &resultLen, (const uchar*)(compressed.constData()), &srcLen, (const uchar*)(props.constData()), LZMA_PROPS_SIZE);
 	if (uncompressRes != SZ_OK) {
 		LOG(("Update Error: could not uncompress lzma, code: %1").arg(uncompressRes));
-		return false;
+		return nullptr;
+	}
+	auto result = std::make_unique<QBuffer>();
+	result->setData(uncompressed);
+	if (!result->open(QIODevice::ReadOnly)) {
+		return nullptr;
 	}
+	return std::move(result);
+}
+
 #else // Q_OS_WIN
-	lzma_stream stream = LZMA_STREAM_INIT;
 
-	lzma_ret ret = lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED);
+class LzmaReadDevice : public QIODevice {
+public:
+	LzmaReadDevice(not_null<QIODevice*> source);
+
+	bool start();
+
+	bool isSequential() const override;
+
+	~LzmaReadDevice();
+
+protected:
+	qint64 readData(char *data, qint64 maxSize) override;
+	qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+	not_null<QIODevice*> _source;
+	QByteArray _input;
+	lzma_stream _stream = LZMA_STREAM_INIT;
+	bool _sourceFinished = false;
+	bool _finished = false;
+	bool _failed = false;
+
+};
+
+LzmaReadDevice::LzmaReadDevice(not_null<QIODevice*> source)
+: _source(source)
+, _input(kUnpackChunkSize, Qt::Uninitialized) {
+}
+
+bool LzmaReadDevice::start() {
+	lzma_ret ret = lzma_stream_decoder(&_stream, UINT64_MAX, LZMA_CONCATENATED);
 	if (ret != LZMA_OK) {
 		const char *msg;
 		switch (ret) {
@@ -442,41 +501,332 @@ bool UnpackUpdate(const QString &filepath) {
 		LOG(("Error initializing the decoder: %1 (error code %2)").arg(msg).arg(ret));
 		return false;
 	}
+	return open(QIODevice::ReadOnly);
+}
+
+bool LzmaReadDevice::isSequential() const {
+	return true;
+}
 
-	stream.avail_in = compressedLen;
-	stream.next_in = (uint8_t*)(compressed.constData() + hSize);
-	stream.avail_out = resultLen;
-	stream.next_out = (uint8_t*)uncompressed.data();
+qint64 LzmaReadDevice::readData(char *data, qint64 maxSize) {
+	if (_failed) {
+		return -1;
+	} else if (_finished || maxSize <= 0) {
+		return 0;
+	}
+	_stream.next_out = reinterpret_cast<uint8_t*>(data);
+	_stream.avail_out = size_t(maxSize);
+	while (_stream.avail_out > 0 && !_finished) {
+		if (!_stream.avail_in && !_sourceFinished) {
+			const auto read = _source->read(_input.data(), _input.size());
+			if (read < 0) {
+				LOG(("Update Error: cant read compressed data!"));
+				_failed = true;
+				return -1;
+			} else if (!read) {
+				_sourceFinished = true;
+			}
+			_stream.next_in = reinterpret_cast<const uint8_t*>(_input.constData());
+			_stream.avail_in = size_t(read);
+		}
+		const auto res = lzma_code(&_stream, _sourceFinished ? LZMA_FINISH : LZMA_RUN);
+		if (res == LZMA_STREAM_END) {
+			_finished = true;
+		} else if (res != LZMA_OK) {
+			const char *msg;
+			switch (res) {
+			case LZMA_MEM_ERROR: msg = "Memory allocation failed"; break;
+			case LZMA_FORMAT_ERROR: msg = "The input data is not in the .xz format"; break;
+			case LZMA_OPTIONS_ERROR: msg = "Unsupported compression options"; break;
+			case LZMA_DATA_ERROR: msg = "Compressed file is corrupt"; break;
+			case LZMA_BUF_ERROR: msg = "Compressed data is truncated or otherwise corrupt"; break;
+			default: msg = "Unknown error, possibly a bug"; break;
+			}
+			LOG(("Error in decompression: %1 (error code %2)").arg(msg).arg(res));
+			_failed = true;
+			return -1;
+		}
+	}
+	return maxSize - qint64(_stream.avail_out);
+}
 
-	lzma_ret res = lzma_code(&stream, LZMA_FINISH);
-	if (stream.avail_in) {
-		LOG(("Error in decompression, %1 bytes left in _in of %2 whole.").arg(stream.avail_in).arg(compressedLen));
+qint64 LzmaReadDevice::writeData(const char *data, qint64 maxSize) {
+	return -1;
+}
+
+LzmaReadDevice::~LzmaReadDevice() {
+	lzma_end(&_stream);
+}
+
+std::unique_ptr<QIODevice> OpenUncompressed(
+		QFile &input,
+		const QByteArray &props,
+		int32 compressedLen,
+		int32 uncompressedLen) {
+	auto result = std::make_unique<LzmaReadDevice>(&input);
+	if (!result->start()) {
+		return nullptr;
+	}
+	return std::move(result);
+}
+
+#endif // Q_OS_WIN
+
+bool CopyUpdateBytes(
+		not_null<QIODevice*> from,
+		not_null<QIODevice*> to,
+		qint64 size,
+		SHA_CTX *hash = nullptr) {
+	auto buffer = QByteArray(
+		int(std::min(size, qint64(kUnpackChunkSize))),
+		Qt::Uninitialized);
+	while (size > 0) {
+		const auto portion = std::min(size, qint64(buffer.size()));
+		if (from->read(buffer.data(), portion) != portion) {
+			LOG(("Update Error: cant read %1 bytes of file data."
+				).arg(portion));
+			return false;
+		} else if (to->write(buffer.constData(), portion) != portion) {
+			LOG(("Update Error: cant write %1 bytes of file data."
+				).arg(portion));
+			return false;
+		}
+		if (hash) {
+			SHA1_Update(hash, buffer.constData(), portion);
+		}
+		size -= portion;
+	}
+	return true;
+}
+
+QByteArray HashUpdateFile(const QString &path) {
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return QByteArray();
+	}
+	SHA_CTX context;
+	SHA1_Init(&context);
+	auto buffer = QByteArray(kUnpackChunkSize, Qt::Uninitialized);
+	while (true) {
+		const auto read = file.read(buffer.data(), buffer.size());
+		if (read < 0) {
+			return QByteArray();
+		} else if (!read) {
+			break;
+		}
+		SHA1_Update(&context, buffer.constData(), read);
+	}
+	auto result = QByteArray(SHA_DIGEST_LENGTH, Qt::Uninitialized);
+	SHA1_Final(reinterpret_cast<uchar*>(result.data()), &context);
+	return result;
+}
+
+QString DeltaBasePath(const QString &relativeName) {
+	const auto result = cExeDir() + relativeName;
+	if (!QFile::exists(result) && relativeName == qstr("Telegram")) {
+		return cExeDir() + cExeName();
+	}
+	return result;
+}
+
+bool ApplyDeltaPatch(
+		QDataStream &stream,
+		not_null<QIODevice*> device,
+		const QString &basePath,
+		QFile &output,
+		SHA_CTX *hash) {
+	QByteArray baseSha1;
+	quint32 opsCount = 0;
+	stream >> baseSha1 >> opsCount;
+	if (stream.status() != QDataStream::Ok) {
+		LOG(("Update Error: cant read patch header from downloaded stream, status: %1").arg(stream.status()));
 		return false;
-	} else if (stream.avail_out) {
-		LOG(("Error in decompression, %1 bytes free left in _out of %2 whole.").arg(stream.avail_out).arg(resultLen));
+	} else if (HashUpdateFile(basePath) != baseSha1) {
+		LOG(("Update Error: installed file '%1' does not match delta base").arg(basePath));
 		return false;
 	}
-	lzma_end(&stream);
-	if (res != LZMA_OK && res != LZMA_STREAM_END) {
-		const char *msg;
-		switch (res) {
-		case LZMA_MEM_ERROR: msg = "Memory allocation failed"; break;
-		case LZMA_FORMAT_ERROR: msg = "The input data is not in the .xz format"; break;
-		case LZMA_OPTIONS_ERROR: msg = "Unsupported compression options"; break;
-		case LZMA_DATA_ERROR: msg = "Compressed file is corrupt"; break;
-		case LZMA_BUF_ERROR: msg = "Compressed data is truncated or otherwise corrupt"; break;
-		default: msg = "Unknown error, possibly a bug"; break;
+	QFile base(basePath);
+	if (!base.open(QIODevice::ReadOnly)) {
+		LOG(("Update Error: cant open delta base file '%1'").arg(basePath));
+		return false;
+	}
+	for (auto i = quint32(0); i != opsCount; ++i) {
+		quint8 op = 0;
+		stream >> op;
+		if (op == kDeltaOpCopy) {
+			quint32 offset = 0, length = 0;
+			stream >> offset >> length;
+			if (stream.status() != QDataStream::Ok) {
+				LOG(("Update Error: cant read patch copy op, status: %1").arg(stream.status()));
+				return false;
+			} else if (qint64(offset) + length > base.size()
+				|| !base.seek(offset)
+				|| !CopyUpdateBytes(&base, &output, length, hash)) {
+				LOG(("Update Error: bad patch copy op %1:%2 for '%3'").arg(offset).arg(length).arg(basePath));
+				return false;
+			}
+		} else if (op == kDeltaOpInsert) {
+			quint32 length = 0;
+			stream >> length;
+			if (stream.status() != QDataStream::Ok
+				|| length == quint32(0xFFFFFFFF)
+				|| !CopyUpdateBytes(device, &output, length, hash)) {
+				LOG(("Update Error: bad patch insert op for '%1'").arg(basePath));
+				return false;
+			}
+		} else {
+			LOG(("Update Error: unknown patch op %1").arg(op));
+			return false;
 		}
-		LOG(("Error in decompression: %1 (error code %2)").arg(msg).arg(res));
+	}
+	return true;
+}
+
+bool UnpackUpdateFile(
+		QDataStream &stream,
+		not_null<QIODevice*> device,
+		const QString &tempDirPath,
+		bool delta) {
+	QString relativeName;
+	quint8 kind = kDeltaFileFull;
+	quint32 fileSize = 0;
+	QByteArray resultSha1;
+	bool executable = false;
+
+	stream >> relativeName;
+	if (delta) {
+		stream >> kind >> fileSize >> resultSha1;
+	} else {
+		stream >> fileSize;
+	}
+	if (stream.status() != QDataStream::Ok) {
+		LOG(("Update Error: cant read file from downloaded stream, status: %1").arg(stream.status()));
+		return false;
+	}
+
+	QFile f(tempDirPath + '/' + relativeName);
+	if (!QDir().mkpath(QFileInfo(f).absolutePath())) {
+		LOG(("Update Error: cant mkpath for file '%1'").arg(tempDirPath + '/' + relativeName));
+		return false;
+	}
+	if (!f.open(QIODevice::WriteOnly)) {
+		LOG(("Update Error: cant open file '%1' for writing").arg(tempDirPath + '/' + relativeName));
 		return false;
 	}
+
+	SHA_CTX context;
+	SHA1_Init(&context);
+	if (kind == kDeltaFilePatch) {
+		if (!ApplyDeltaPatch(stream, device, DeltaBasePath(relativeName), f, &context)) {
+			return false;
+		}
+	} else if (kind == kDeltaFileFull) {
+		// Serialized QByteArray: quint32 size followed by the bytes.
+		quint32 dataSize = 0;
+		stream >> dataSize;
+		if (stream.status() != QDataStream::Ok) {
+			LOG(("Update Error: cant read file size from downloaded stream, status: %1").arg(stream.status()));
+			return false;
+		} else if (fileSize != dataSize) {
+			LOG(("Update Error: bad file size %1 not matching data size %2").arg(fileSize).arg(dataSize));
+			return false;
+		} else if (!CopyUpdateBytes(device, &f, dataSize, &context)) {
+			LOG(("Update Error: cant write file '%1', desiredSize: %2").arg(tempDirPath + '/' + relativeName).arg(fileSize));
+			return false;
+		}
+	} else {
+		LOG(("Update Error: unknown file kind %1 in delta update").arg(kind));
+		return false;
+	}
+	if (f.size() != fileSize) {
+		LOG(("Update Error: bad file size %1 of '%2', expected %3").arg(f.size()).arg(relativeName).arg(fileSize));
+		return false;
+	}
+	f.close();
+
+	if (delta) {
+		auto sha1 = QByteArray(SHA_DIGEST_LENGTH, Qt::Uninitialized);
+		SHA1_Final(reinterpret_cast<uchar*>(sha1.data()), &context);
+		if (sha1 != resultSha1) {
+			LOG(("Update Error: bad SHA1 hash of patched file '%1'").arg(relativeName));
+			return false;
+		}
+	}
+
+#if defined Q_OS_MAC || defined Q_OS_LINUX
+	stream >> executable;
+	if (stream.status() != QDataStream::Ok) {
+		LOG(("Update Error: cant read file from downloaded stream, status: %1").arg(stream.status()));
+		return false;
+	}
+#endif // Q_OS_MAC || Q_OS_LINUX
+	if (executable) {
+		QFileDevice::Permissions p = f.permissions();
+		p |= QFileDevice::ExeOwner | QFileDevice::ExeUser | QFileDevice::ExeGroup | QFileDevice::ExeOther;
+		f.setPermissions(p);
+	}
+	return true;
+}
+
+bool UnpackUpdate(const QString &filepath) {
+	QFile input(filepath);
+	if (!input.open(QIODevice::ReadOnly)) {
+		LOG(("Update Error: cant read updates file!"));
+		return false;
+	}
+
+#ifdef Q_OS_WIN // use Lzma SDK for win
+	const int32 hSigLen = 128, hShaLen = 20, hPropsLen = LZMA_PROPS_SIZE, hOriginalSizeLen = sizeof(int32), hSize = hSigLen + hShaLen + hPropsLen + hOriginalSizeLen; // header
+#else // Q_OS_WIN
+	const int32 hSigLen = 128, hShaLen = 20, hPropsLen = 0, hOriginalSizeLen = sizeof(int32), hSize = hSigLen + hShaLen + hOriginalSizeLen; // header
 #endif // Q_OS_WIN
 
+	const auto compressedLen = input.size() - hSize;
+	if (compressedLen <= 0 || input.size() > kMaxUpdateSize) {
+		LOG(("Update Error: bad compressed size: %1").arg(input.size()));
+		return false;
+	}
+
+	QString tempDirPath = cWorkingDir() + qsl("tupdates/temp"), readyFilePath = cWorkingDir() + qsl("tupdates/temp/ready");
+	psDeleteDir(tempDirPath);
+
+	QDir tempDir(tempDirPath);
+	if (tempDir.exists() || QFile(readyFilePath).exists()) {
+		LOG(("Update Error: cant clear tupdates/temp dir!"));
+		return false;
+	}
+
+	if (!VerifyUpdateSignature(input, hSigLen, hShaLen)) {
+		return false;
+	}
+
+	if (!input.seek(hSigLen + hShaLen)) {
+		LOG(("Update Error: cant seek in updates file!"));
+		return false;
+	}
+	const auto props = input.read(hPropsLen);
+	int32 uncompressedLen = 0;
+	if (props.size() != hPropsLen
+		|| input.read((char*)&uncompressedLen, hOriginalSizeLen) != hOriginalSizeLen
+		|| uncompressedLen <= 0) {
+		LOG(("Update Error: bad updates file header!"));
+		return false;
+	}
+
+	const auto device = OpenUncompressed(
+		input,
+		props,
+		int32(compressedLen),
+		uncompressedLen);
+	if (!device) {
+		return false;
+	}
+
 	tempDir.mkdir(tempDir.absolutePath());
 
 	quint32 version;
 	{
-		QDataStream stream(uncompressed);
+		QDataStream stream(device.get());
 		stream.setVersion(QDataStream::Qt_5_1);
 
 		stream >> version;
@@ -507,50 +857,37 @@ bool UnpackUpdate(const QString &filepath) {
 			LOG(("Update Error: cant read files count from downloaded stream, status: %1").arg(stream.status()));
 			return false;
 		}
-		if (!filesCount) {
-			LOG(("Update Error: update is empty!"));
-			return false;
-		}
-		for (uint32 i = 0; i < filesCount; ++i) {
-			QString relativeName;
-			quint32 fileSize;
-			QByteArray fileInnerData;
-			bool executable = false;
+		const auto delta = (filesCount == kDeltaPackageMarker);
+		if (delta) {
+			// If anything goes wrong the full package will be requested.
+			DeltaUpdateFailed = true;
 
-			stream >> relativeName >> fileSize >> fileInnerData;
-#if defined Q_OS_MAC || defined Q_OS_LINUX
-			stream >> executable;
-#endif // Q_OS_MAC || Q_OS_LINUX
+			quint32 baseVersion = 0;
+			stream >> baseVersion >> filesCount;
 			if (stream.status() != QDataStream::Ok) {
-				LOG(("Update Error: cant read file from downloaded stream, status: %1").arg(stream.status()));
-				return false;
-			}
-			if (fileSize != quint32(fileInnerData.size())) {
-				LOG(("Update Error: bad file size %1 not matching data size %2").arg(fileSize).arg(fileInnerData.size()));
+				LOG(("Update Error: cant read delta header from downloaded stream, status: %1").arg(stream.status()));
 				return false;
-			}
-
-			QFile f(tempDirPath + '/' + relativeName);
-			if (!QDir().mkpath(QFileInfo(f).absolutePath())) {
-				LOG(("Update Error: cant mkpath for file '%1'").arg(tempDirPath + '/' + relativeName));
+			} else if (cAlphaVersion() || int32(baseVersion) != AppVersion) {
+				LOG(("Update Error: delta base version %1 is not mine %2").arg(baseVersion).arg(AppVersion));
 				return false;
 			}
-			if (!f.open(QIODevice::WriteOnly)) {
-				LOG(("Update Error: cant open file '%1' for writing").arg(tempDirPath + '/' + relativeName));
-				return false;
-			}
-			auto writtenBytes = f.write(fileInnerData);
-			if (writtenBytes != fileSize) {
-				f.close();
-				LOG(("Update Error: cant write file '%1', desiredSize: %2, write result: %3").arg(tempDirPath + '/' + relativeName).arg(fileSize).arg(writtenBytes));
+		}
+		if (!filesCount) {
+			LOG(("Update Error: update is empty!"));
+			return false;
+		}
+		for (uint32 i = 0; i < filesCount; ++i) {
+			if (!UnpackUpdateFile(stream, device.get(), tempDirPath, delta)) {
 				return false;
 			}
-			f.close();
-			if (executable) {
-				QFileDevice::Permissions p = f.permissions();
-				p |= QFileDevice::ExeOwner | QFileDevice::ExeUser | QFileDevice::ExeGroup | QFileDevice::ExeOther;
-				f.setPermissions(p);
-			}
+		}
+		char extra = 0;
+		if (device->read(&extra, 1) != 0) {
+			LOG(("Update Error: unexpected data after the last file in update!"));
+			return false;
+		}
+		if (delta) {
+			DeltaUpdateFailed = false;
 		}
 
 		// create tdata/version file
@@ -998,6 +1335,11 @@ std::optional<QString> HttpChecker::parseResponse(
 			return false;
 		}
 		bestLink = (*link).toString();
+		if (const auto delta = findDeltaLink(isAlpha, map)) {
+			LOG(("Update Info: Using delta package for version %1."
+				).arg(version));
+			bestLink = *delta;
+		}
 		return true;
 	};
 	const auto result = ParseCommonMap(response, testing(), accumulate);
@@ -1010,6 +1352,25 @@ std::optional<QString> HttpChecker::parseResponse(
 		Local::readAutoupdatePrefix() + bestLink);
 }
 
+std::optional<QString> HttpChecker::findDeltaLink(
+		bool isAvailableAlpha,
+		const QJsonObject &map) const {
+	// "delta": { "<installed version>": "<link to the delta package>" }
+	if (isAvailableAlpha || cAlphaVersion() || DeltaUpdateFailed) {
+		return std::nullopt;
+	}
+	const auto deltas = map.constFind("delta");
+	if (deltas == map.constEnd() || !(*deltas).isObject()) {
+		return std::nullopt;
+	}
+	const auto list = (*deltas).toObject();
+	const auto link = list.constFind(QString::number(AppVersion));
+	if (link == list.constEnd() || !(*link).isString()) {
+		return std::nullopt;
+	}
+	return (*link).toString();
+}
+
 QString HttpChecker::validateLatestUrl(
 		uint64 availableVersion,
 		bool isAvailableAlpha,
@@ -356,6 +356,10 @@ void DocumentOpenClickHandler::Open(
 	}
 
 	data->save(origin, filename, action, msgId);
+	if (playVideo && data->canBeStreamed()) {
+		// Start playing while the rest of the file is loading.
+		Messenger::Instance().showDocument(data, context);
+	}
 }
 
 void DocumentOpenClickHandler::onClickImpl() const {
@@ -1324,6 +1328,17 @@ bool DocumentData::supportsStreaming() const {
 	return _supportsStreaming;
 }
 
+bool DocumentData::canBeStreamed() const {
+	// See save() for the loader type choice.
+	return supportsStreaming()
+		&& loading()
+		&& (hasWebLocation() || _access || _url.isEmpty());
+}
+
+std::shared_ptr<Storage::StreamedFile> DocumentData::streamedFile() {
+	return canBeStreamed() ? _loader->streamedFile() : nullptr;
+}
+
 void DocumentData::recountIsImage() {
 	_isImage = !isAnimation()
 		&& !isVideoFile()
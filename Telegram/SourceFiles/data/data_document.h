@@ -17,6 +17,7 @@ namespace Storage {
 namespace Cache {
 struct Key;
 } // namespace Cache
+class StreamedFile;
 } // namespace Storage
 
 class AuthSession;
@@ -154,6 +155,10 @@ public:
 	bool isImage() const;
 	void recountIsImage();
 	bool supportsStreaming() const;
+
+	// Playback may start before the download is finished.
+	bool canBeStreamed() const;
+	std::shared_ptr<Storage::StreamedFile> streamedFile();
 	void setData(const QByteArray &data) {
 		_data = data;
 	}
@@ -0,0 +1,42 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/basic_types.h"
+
+using MsgId = int32;
+constexpr auto StartClientMsgId = MsgId(-0x7FFFFFFF);
+constexpr auto EndClientMsgId = MsgId(-0x40000000);
+constexpr auto ShowAtTheEndMsgId = MsgId(-0x40000000);
+constexpr auto SwitchAtTopMsgId = MsgId(-0x3FFFFFFF);
+constexpr auto ShowAtProfileMsgId = MsgId(-0x3FFFFFFE);
+constexpr auto ShowAndStartBotMsgId = MsgId(-0x3FFFFFD);
+constexpr auto ShowAtGameShareMsgId = MsgId(-0x3FFFFFC);
+constexpr auto ServerMaxMsgId = MsgId(0x3FFFFFFF);
+constexpr auto ShowAtUnreadMsgId = MsgId(0);
+constexpr inline bool IsClientMsgId(MsgId id) {
+	return (id >= StartClientMsgId && id < EndClientMsgId);
+}
+constexpr inline bool IsServerMsgId(MsgId id) {
+	return (id > 0 && id < ServerMaxMsgId);
+}
+
+struct MsgRange {
+	MsgRange() = default;
+	MsgRange(MsgId from, MsgId till) : from(from), till(till) {
+	}
+
+	MsgId from = 0;
+	MsgId till = 0;
+};
+inline bool operator==(const MsgRange &a, const MsgRange &b) {
+	return (a.from == b.from) && (a.till == b.till);
+}
+inline bool operator!=(const MsgRange &a, const MsgRange &b) {
+	return !(a == b);
+}
@@ -28,6 +28,9 @@ namespace {
 
 using Type = Storage::SharedMediaType;
 
+// A search around an id loads a half of the shared media limit after it.
+constexpr auto kMissingItemsCoveredBySearch = 40;
+
 } // namespace
 
 std::optional<Storage::SharedMediaType> SharedMediaOverviewType(
@@ -88,8 +91,37 @@ rpl::producer<SparseIdsSlice> SharedMediaViewer(
 		builder->insufficientAround(
 		) | rpl::start_with_next(requestMediaAround, lifetime);
 
+		// Ids restored from the local storage don't have loaded items,
+		// so we request the media around them to create those items.
+		// The search result also removes the ids deleted meanwhile.
+		auto requestedMissing = lifetime.make_state<base::flat_set<MsgId>>();
+		auto requestMissingItems = [=](const SparseIdsSlice &slice) {
+			const auto peer = App::peer(key.peerId);
+			const auto channelId = peerToChannel(key.peerId);
+			for (auto i = 0, count = slice.size(); i != count;) {
+				const auto messageId = slice[i];
+				if (requestedMissing->contains(messageId)
+					|| App::histItemById(channelId, messageId)) {
+					++i;
+					continue;
+				}
+				Auth().api().requestSharedMedia(
+					peer,
+					key.type,
+					messageId,
+					Data::LoadDirection::Around);
+				const auto covered = std::min(
+					i + kMissingItemsCoveredBySearch,
+					count);
+				for (; i != covered; ++i) {
+					requestedMissing->emplace(slice[i]);
+				}
+			}
+		};
 		auto pushNextSnapshot = [=] {
-			consumer.put_next(builder->snapshot());
+			auto snapshot = builder->snapshot();
+			requestMissingItems(snapshot);
+			consumer.put_next(std::move(snapshot));
 		};
 
 		using SliceUpdate = Storage::SharedMediaSliceUpdate;
@@ -199,17 +199,37 @@ bool SparseIdsSliceBuilder::applyUpdate(
 	if (!needMergeMessages && !update.count) {
 		return false;
 	}
+	if (!needMergeMessages) {
+		mergeSliceData(update.count, {});
+		return true;
+	}
+
+	// Everything farther than the limits from the key is sliced away
+	// after the merge anyway, so take only the ids around the key.
+	const auto &messages = *update.messages;
+	const auto count = int(messages.size());
+	const auto around = _key ? int(messages.rank(_key)) : 0;
+	const auto from = _key
+		? std::max(std::min(around - _limitBefore, count - 1), 0)
+		: 0;
+	const auto till = _key
+		? std::min(std::max(around + _limitAfter + 1, from + 1), count)
+		: count;
+	auto ids = std::vector<MsgId>();
+	ids.reserve(till - from);
+	auto i = messages.nth(from);
+	for (auto left = till - from; left != 0; --left, ++i) {
+		ids.push_back(*i);
+	}
 	auto skippedBefore = (update.range.from == 0)
-		? 0
+		? from
 		: std::optional<int> {};
 	auto skippedAfter = (update.range.till == ServerMaxMsgId)
-		? 0
+		? (count - till)
 		: std::optional<int> {};
 	mergeSliceData(
 		update.count,
-		needMergeMessages
-			? *update.messages
-			: base::flat_set<MsgId> {},
+		base::flat_set<MsgId> { ids.begin(), ids.end() },
 		skippedBefore,
 		skippedAfter);
 	return true;
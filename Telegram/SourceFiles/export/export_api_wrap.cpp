@@ -23,6 +23,8 @@ namespace {
 constexpr auto kUserpicsSliceLimit = 100;
 constexpr auto kFileChunkSize = 128 * 1024;
 constexpr auto kFileRequestsCount = 2;
+constexpr auto kFileProcessesCount = 4;
+constexpr auto kMessagesSlicesPrefetch = 2;
 constexpr auto kFileNextRequestDelay = TimeMs(20);
 constexpr auto kChatsSliceLimit = 100;
 constexpr auto kMessagesSliceLimit = 100;
@@ -37,6 +39,9 @@ struct LocationKey {
 	inline bool operator<(const LocationKey &other) const {
 		return std::tie(type, id) < std::tie(other.type, other.id);
 	}
+	inline bool operator==(const LocationKey &other) const {
+		return std::tie(type, id) == std::tie(other.type, other.id);
+	}
 };
 
 std::tuple<const uint64 &, const uint64 &> value_ordering_helper(const LocationKey &value) {
@@ -155,6 +160,9 @@ struct ApiWrap::FileProcess {
 	Fn<bool(FileProgress)> progress;
 	FnMut<void(const QString &relativePath)> done;
 
+	// Loads of the same location requested while this one was running.
+	std::vector<FnMut<void(const QString &relativePath)>> duplicates;
+
 	Data::FileLocation location;
 	int offset = 0;
 	int size = 0;
@@ -167,6 +175,7 @@ struct ApiWrap::FileProcess {
 };
 
 struct ApiWrap::FileProgress {
+	QString path;
 	int ready = 0;
 	int total = 0;
 };
@@ -193,12 +202,19 @@ struct ApiWrap::DialogsProcess : ChatsProcess {
 	MTPInputPeer offsetPeer = MTP_inputPeerEmpty();
 };
 
+struct ApiWrap::ChatSlice {
+	int index = 0;
+	Data::MessagesSlice data;
+	int fileIndex = 0;
+	int filesLoading = 0;
+};
+
 struct ApiWrap::ChatProcess {
 	Data::DialogInfo info;
 
 	FnMut<bool(const Data::DialogInfo &)> start;
 	Fn<bool(DownloadProgress)> fileProgress;
-	Fn<bool(Data::MessagesSlice&&)> handleSlice;
+	Fn<void(Data::MessagesSlice&&, FnMut<void(bool)>)> handleSlice;
 	FnMut<void()> done;
 
 	FnMut<void(MTPmessages_Messages&&)> requestDone;
@@ -206,10 +222,17 @@ struct ApiWrap::ChatProcess {
 	int localSplitIndex = 0;
 	int32 largestIdPlusOne = 1;
 
+	// Files of the received slices are loaded in parallel,
+	// but the slices are passed to handleSlice strictly in order,
+	// the next one only after the previous one is written.
 	Data::ParseMediaContext context;
-	std::optional<Data::MessagesSlice> slice;
+	std::deque<ChatSlice> slices;
+	int slicesReceived = 0;
+	int filesLoading = 0;
+	bool requestingSlice = false;
+	bool writingSlice = false;
+	bool processingSlices = false;
 	bool lastSlice = false;
-	int fileIndex = 0;
 };
 
 
@@ -351,7 +374,10 @@ auto ApiWrap::splitRequest(int index, Request &&request) {
 		std::forward<Request>(request)));
 }
 
-auto ApiWrap::fileRequest(const Data::FileLocation &location, int offset) {
+auto ApiWrap::fileRequest(
+		uint64 id,
+		const Data::FileLocation &location,
+		int offset) {
 	Expects(location.dcId != 0
 		|| location.data.type() == mtpc_inputTakeoutFileLocation);
 	Expects(_takeoutId.has_value());
@@ -365,12 +391,12 @@ auto ApiWrap::fileRequest(const Data::FileLocation &location, int offset) {
 	)).fail([=](RPCError &&result) {
 		if (result.type() == qstr("TAKEOUT_FILE_EMPTY")
 			&& _otherDataProcess != nullptr) {
-			filePartDone(0, MTP_upload_file(MTP_storage_filePartial(),
+			filePartDone(id, 0, MTP_upload_file(MTP_storage_filePartial(),
 				MTP_int(0),
 				MTP_bytes(QByteArray())));
 		} else if (result.type() == qstr("LOCATION_INVALID")
 			|| result.type() == qstr("VERSION_INVALID")) {
-			filePartUnavailable();
+			filePartUnavailable(id);
 		} else {
 			error(std::move(result));
 		}
@@ -787,7 +813,6 @@ void ApiWrap::finishUserpicsSlice() {
 }
 
 bool ApiWrap::loadUserpicProgress(FileProgress progress) {
-	Expects(_fileProcess != nullptr);
 	Expects(_userpicsProcess != nullptr);
 	Expects(_userpicsProcess->slice.has_value());
 	Expects((_userpicsProcess->fileIndex >= 0)
@@ -795,7 +820,7 @@ bool ApiWrap::loadUserpicProgress(FileProgress progress) {
 			< _userpicsProcess->slice->list.size()));
 
 	return _userpicsProcess->fileProgress(DownloadProgress{
-		_fileProcess->relativePath,
+		progress.path,
 		_userpicsProcess->fileIndex,
 		progress.ready,
 		progress.total });
@@ -904,7 +929,7 @@ void ApiWrap::requestMessages(
 		const Data::DialogInfo &info,
 		FnMut<bool(const Data::DialogInfo &)> start,
 		Fn<bool(DownloadProgress)> progress,
-		Fn<bool(Data::MessagesSlice&&)> slice,
+		Fn<void(Data::MessagesSlice&&, FnMut<void(bool)>)> slice,
 		FnMut<void()> done) {
 	Expects(_chatProcess == nullptr);
 
@@ -1239,13 +1264,15 @@ void ApiWrap::appendChatsSlice(
 
 void ApiWrap::requestMessagesSlice() {
 	Expects(_chatProcess != nullptr);
+	Expects(!_chatProcess->requestingSlice);
 
 	const auto count = _chatProcess->info.messagesCountPerSplit[
 		_chatProcess->localSplitIndex];
 	if (!count) {
-		loadMessagesFiles({});
+		appendMessagesSlice({});
 		return;
 	}
+	_chatProcess->requestingSlice = true;
 	requestChatMessages(
 		_chatProcess->info.splits[_chatProcess->localSplitIndex],
 		_chatProcess->largestIdPlusOne,
@@ -1254,13 +1281,14 @@ void ApiWrap::requestMessagesSlice() {
 		[=](const MTPmessages_Messages &result) {
 		Expects(_chatProcess != nullptr);
 
+		_chatProcess->requestingSlice = false;
 		result.match([&](const MTPDmessages_messagesNotModified &data) {
 			error("Unexpected messagesNotModified received.");
 		}, [&](const auto &data) {
 			if constexpr (MTPDmessages_messages::Is<decltype(data)>()) {
 				_chatProcess->lastSlice = true;
 			}
-			loadMessagesFiles(Data::ParseMessagesSlice(
+			appendMessagesSlice(Data::ParseMessagesSlice(
 				_chatProcess->context,
 				data.vmessages,
 				data.vusers,
@@ -1334,131 +1362,185 @@ void ApiWrap::requestChatMessages(
 	}
 }
 
-void ApiWrap::loadMessagesFiles(Data::MessagesSlice &&slice) {
+void ApiWrap::appendMessagesSlice(Data::MessagesSlice &&slice) {
 	Expects(_chatProcess != nullptr);
-	Expects(!_chatProcess->slice.has_value());
 
+	// Move the request position right away, so that the next slice
+	// can be requested while the files of this one are being loaded.
+	auto &process = *_chatProcess;
 	if (slice.list.empty()) {
-		_chatProcess->lastSlice = true;
+		process.lastSlice = true;
+	} else {
+		process.largestIdPlusOne = slice.list.back().id + 1;
+	}
+	if (process.lastSlice
+		&& (++process.localSplitIndex < process.info.splits.size())) {
+		process.lastSlice = false;
+		process.largestIdPlusOne = 1;
 	}
-	_chatProcess->slice = std::move(slice);
-	_chatProcess->fileIndex = 0;
+	auto entry = ChatSlice();
+	entry.index = process.slicesReceived++;
+	entry.data = std::move(slice);
+	process.slices.push_back(std::move(entry));
 
-	loadNextMessageFile();
+	processMessagesSlices();
 }
 
-void ApiWrap::loadNextMessageFile() {
+void ApiWrap::processMessagesSlices() {
 	Expects(_chatProcess != nullptr);
-	Expects(_chatProcess->slice.has_value());
-
-	for (auto &list = _chatProcess->slice->list
-		; _chatProcess->fileIndex < list.size()
-		; ++_chatProcess->fileIndex) {
-		const auto &message = list[_chatProcess->fileIndex];
-		if (Data::SkipMessageByDate(message, *_settings)) {
-			continue;
+
+	auto &process = *_chatProcess;
+	loadMessagesFiles();
+	process.processingSlices = true;
+	while (!process.slices.empty() && !process.writingSlice) {
+		auto &front = process.slices.front();
+		if (front.filesLoading > 0
+			|| front.fileIndex < front.data.list.size()) {
+			break;
 		}
-		const auto fileProgress = [=](FileProgress value) {
-			return loadMessageFileProgress(value);
-		};
-		const auto ready = processFileLoad(
-			list[_chatProcess->fileIndex].file(),
-			fileProgress,
-			[=](const QString &path) { loadMessageFileDone(path); },
-			&list[_chatProcess->fileIndex]);
-		if (!ready) {
-			return;
+		auto slice = std::move(front.data);
+		process.slices.pop_front();
+		if (!slice.list.empty()) {
+			process.writingSlice = true;
+			process.handleSlice(std::move(slice), [=](bool success) {
+				messagesSliceWritten(success);
+			});
 		}
-		const auto thumbProgress = [=](FileProgress value) {
-			return loadMessageThumbProgress(value);
-		};
-		const auto thumbReady = processFileLoad(
-			list[_chatProcess->fileIndex].thumb().file,
-			thumbProgress,
-			[=](const QString &path) { loadMessageThumbDone(path); },
-			&list[_chatProcess->fileIndex]);
-		if (!thumbReady) {
-			return;
+	}
+	process.processingSlices = false;
+	if (!process.lastSlice) {
+		if (!process.requestingSlice
+			&& process.slices.size() < kMessagesSlicesPrefetch) {
+			requestMessagesSlice();
 		}
+	} else if (process.slices.empty()
+		&& !process.requestingSlice
+		&& !process.writingSlice) {
+		finishMessages();
 	}
-	finishMessagesSlice();
 }
 
-void ApiWrap::finishMessagesSlice() {
+void ApiWrap::messagesSliceWritten(bool success) {
 	Expects(_chatProcess != nullptr);
-	Expects(_chatProcess->slice.has_value());
+	Expects(_chatProcess->writingSlice);
 
-	auto slice = *base::take(_chatProcess->slice);
-	if (!slice.list.empty()) {
-		_chatProcess->largestIdPlusOne = slice.list.back().id + 1;
-		if (!_chatProcess->handleSlice(std::move(slice))) {
-			return;
-		}
+	// Nothing is written after a failed slice.
+	if (!success) {
+		return;
 	}
-	if (_chatProcess->lastSlice
-		&& (++_chatProcess->localSplitIndex
-			< _chatProcess->info.splits.size())) {
-		_chatProcess->lastSlice = false;
-		_chatProcess->largestIdPlusOne = 1;
+	_chatProcess->writingSlice = false;
+	if (!_chatProcess->processingSlices) {
+		processMessagesSlices();
 	}
-	if (!_chatProcess->lastSlice) {
-		requestMessagesSlice();
-	} else {
-		finishMessages();
+}
+
+void ApiWrap::loadMessagesFiles() {
+	Expects(_chatProcess != nullptr);
+
+	auto &process = *_chatProcess;
+	for (auto &slice : process.slices) {
+		auto &list = slice.data.list;
+		for (; slice.fileIndex < list.size(); ++slice.fileIndex) {
+			if (process.filesLoading >= kFileProcessesCount) {
+				return;
+			}
+			auto &message = list[slice.fileIndex];
+			if (Data::SkipMessageByDate(message, *_settings)) {
+				continue;
+			}
+			const auto sliceIndex = slice.index;
+			const auto index = slice.fileIndex;
+			const auto progress = [=](FileProgress value) {
+				return loadMessageFileProgress(sliceIndex, index, value);
+			};
+			const auto fileReady = processFileLoad(
+				message.file(),
+				progress,
+				[=](const QString &path) {
+					loadMessageFileDone(sliceIndex, index, path);
+				},
+				&message);
+			const auto thumbReady = processFileLoad(
+				message.thumb().file,
+				progress,
+				[=](const QString &path) {
+					loadMessageThumbDone(sliceIndex, index, path);
+				},
+				&message);
+			const auto loading = (fileReady ? 0 : 1) + (thumbReady ? 0 : 1);
+			slice.filesLoading += loading;
+			process.filesLoading += loading;
+		}
 	}
 }
 
-bool ApiWrap::loadMessageFileProgress(FileProgress progress) {
-	Expects(_fileProcess != nullptr);
+auto ApiWrap::messagesSlice(int sliceIndex) -> ChatSlice& {
 	Expects(_chatProcess != nullptr);
-	Expects(_chatProcess->slice.has_value());
-	Expects((_chatProcess->fileIndex >= 0)
-		&& (_chatProcess->fileIndex < _chatProcess->slice->list.size()));
+	Expects(!_chatProcess->slices.empty());
+
+	const auto position = sliceIndex - _chatProcess->slices.front().index;
+	Assert(position >= 0 && position < _chatProcess->slices.size());
+	return _chatProcess->slices[position];
+}
 
+bool ApiWrap::loadMessageFileProgress(
+		int sliceIndex,
+		int index,
+		FileProgress progress) {
+	Expects(_chatProcess != nullptr);
+
+	// Count the item index from the first slice that is not written yet.
+	auto itemIndex = index;
+	for (const auto &slice : _chatProcess->slices) {
+		if (slice.index == sliceIndex) {
+			break;
+		}
+		itemIndex += slice.data.list.size();
+	}
 	return _chatProcess->fileProgress(DownloadProgress{
-		_fileProcess->relativePath,
-		_chatProcess->fileIndex,
+		progress.path,
+		itemIndex,
 		progress.ready,
 		progress.total });
 }
 
-void ApiWrap::loadMessageFileDone(const QString &relativePath) {
-	Expects(_chatProcess != nullptr);
-	Expects(_chatProcess->slice.has_value());
-	Expects((_chatProcess->fileIndex >= 0)
-		&& (_chatProcess->fileIndex < _chatProcess->slice->list.size()));
-
-	const auto index = _chatProcess->fileIndex;
-	auto &file = _chatProcess->slice->list[index].file();
+void ApiWrap::loadMessageFileDone(
+		int sliceIndex,
+		int index,
+		const QString &relativePath) {
+	auto &file = messagesSlice(sliceIndex).data.list[index].file();
 	file.relativePath = relativePath;
 	if (relativePath.isEmpty()) {
 		file.skipReason = Data::File::SkipReason::Unavailable;
 	}
-	loadNextMessageFile();
-}
-
-bool ApiWrap::loadMessageThumbProgress(FileProgress progress) {
-	return loadMessageFileProgress(progress);
+	messageFileLoaded(sliceIndex);
 }
 
-void ApiWrap::loadMessageThumbDone(const QString &relativePath) {
-	Expects(_chatProcess != nullptr);
-	Expects(_chatProcess->slice.has_value());
-	Expects((_chatProcess->fileIndex >= 0)
-		&& (_chatProcess->fileIndex < _chatProcess->slice->list.size()));
-
-	const auto index = _chatProcess->fileIndex;
-	auto &file = _chatProcess->slice->list[index].thumb().file;
+void ApiWrap::loadMessageThumbDone(
+		int sliceIndex,
+		int index,
+		const QString &relativePath) {
+	auto &file = messagesSlice(sliceIndex).data.list[index].thumb().file;
 	file.relativePath = relativePath;
 	if (relativePath.isEmpty()) {
 		file.skipReason = Data::File::SkipReason::Unavailable;
 	}
-	loadNextMessageFile();
+	messageFileLoaded(sliceIndex);
+}
+
+void ApiWrap::messageFileLoaded(int sliceIndex) {
+	auto &slice = messagesSlice(sliceIndex);
+	Assert(slice.filesLoading > 0);
+	Assert(_chatProcess->filesLoading > 0);
+
+	--slice.filesLoading;
+	--_chatProcess->filesLoading;
+	processMessagesSlices();
 }
 
 void ApiWrap::finishMessages() {
 	Expects(_chatProcess != nullptr);
-	Expects(!_chatProcess->slice.has_value());
+	Expects(_chatProcess->slices.empty());
 
 	const auto process = base::take(_chatProcess);
 	process->done();
@@ -1527,11 +1609,13 @@ bool ApiWrap::writePreloadedFile(Data::File &file) {
 		return true;
 	} else if (!file.content.isEmpty()) {
 		const auto process = prepareFileProcess(file);
-		if (const auto result = process->file.writeBlock(file.content)) {
+		if (const auto result = process->file.writeBlock(file.content); !result) {
+			ioError(result);
+		} else if (const auto flushed = process->file.flush(); !flushed) {
+			ioError(flushed);
+		} else {
 			file.relativePath = process->relativePath;
 			_fileCache->save(file.location, file.relativePath);
-		} else {
-			ioError(result);
 		}
 		return true;
 	}
@@ -1542,34 +1626,49 @@ void ApiWrap::loadFile(
 		const Data::File &file,
 		Fn<bool(FileProgress)> progress,
 		FnMut<void(QString)> done) {
-	Expects(_fileProcess == nullptr);
 	Expects(file.location.dcId != 0
 		|| file.location.data.type() == mtpc_inputTakeoutFileLocation);
 
-	_fileProcess = prepareFileProcess(file);
-	_fileProcess->progress = std::move(progress);
-	_fileProcess->done = std::move(done);
+	if (const auto process = fileProcess(file.location)) {
+		process->duplicates.push_back(std::move(done));
+		return;
+	}
+
+	const auto id = ++_fileProcessIdLast;
+	auto owned = prepareFileProcess(file);
+	const auto process = owned.get();
+	process->progress = std::move(progress);
+	process->done = std::move(done);
+	_fileProcesses.emplace(id, std::move(owned));
 
-	if (_fileProcess->progress) {
+	if (process->progress) {
 		const auto progress = FileProgress{
-			_fileProcess->file.size(),
-			_fileProcess->size
+			process->relativePath,
+			process->file.size(),
+			process->size
 		};
-		if (!_fileProcess->progress(progress)) {
+		if (!process->progress(progress)) {
 			return;
 		}
 	}
 
-	loadFilePart();
+	loadFilePart(id);
 }
 
 auto ApiWrap::prepareFileProcess(const Data::File &file) const
 -> std::unique_ptr<FileProcess> {
 	Expects(_settings != nullptr);
 
+	// Files are created on the first write, so the paths of the files
+	// being loaded are not on the disk yet.
+	auto reserved = base::flat_set<QString>();
+	for (const auto &[id, process] : _fileProcesses) {
+		reserved.emplace(process->relativePath);
+	}
 	const auto relativePath = Output::File::PrepareRelativePath(
 		_settings->path,
-		file.suggestedPath);
+		file.suggestedPath,
+		reserved);
 	auto result = std::make_unique<FileProcess>(
 		_settings->path + relativePath,
 		_stats);
@@ -1579,40 +1678,66 @@ auto ApiWrap::prepareFileProcess(const Data::File &file) const
 	return result;
 }
 
-void ApiWrap::loadFilePart() {
-	if (!_fileProcess
-		|| _fileProcess->requests.size() >= kFileRequestsCount
-		|| (_fileProcess->size > 0
-			&& _fileProcess->offset >= _fileProcess->size)) {
+ApiWrap::FileProcess *ApiWrap::fileProcess(uint64 id) const {
+	const auto i = _fileProcesses.find(id);
+	return (i != end(_fileProcesses)) ? i->second.get() : nullptr;
+}
+
+ApiWrap::FileProcess *ApiWrap::fileProcess(
+		const Data::FileLocation &location) const {
+	if (!location) {
+		return nullptr;
+	}
+	const auto key = ComputeLocationKey(location);
+	for (const auto &[id, process] : _fileProcesses) {
+		if (process->location
+			&& ComputeLocationKey(process->location) == key) {
+			return process.get();
+		}
+	}
+	return nullptr;
+}
+
+void ApiWrap::loadFilePart(uint64 id) {
+	const auto process = fileProcess(id);
+	if (!process
+		|| process->requests.size() >= kFileRequestsCount
+		|| (process->size > 0
+			&& process->offset >= process->size)) {
 		return;
 	}
 
-	const auto offset = _fileProcess->offset;
-	_fileProcess->requests.push_back({ offset });
+	const auto offset = process->offset;
+	process->requests.push_back({ offset });
 	fileRequest(
-		_fileProcess->location,
-		_fileProcess->offset
+		id,
+		process->location,
+		process->offset
 	).done([=](const MTPupload_File &result) {
-		filePartDone(offset, result);
+		filePartDone(id, offset, result);
 	}).send();
-	_fileProcess->offset += kFileChunkSize;
+	process->offset += kFileChunkSize;
 
-	if (_fileProcess->size > 0
-		&& _fileProcess->requests.size() < kFileRequestsCount) {
+	if (process->size > 0
+		&& process->requests.size() < kFileRequestsCount) {
 		//const auto runner = _runner;
 		//crl::on_main([=] {
 		//	QTimer::singleShot(kFileNextRequestDelay, [=] {
 		//		runner([=] {
-		//			loadFilePart();
+		//			loadFilePart(id);
 		//		});
 		//	});
 		//});
 	}
 }
 
-void ApiWrap::filePartDone(int offset, const MTPupload_File &result) {
-	Expects(_fileProcess != nullptr);
-	Expects(!_fileProcess->requests.empty());
+void ApiWrap::filePartDone(
+		uint64 id,
+		int offset,
+		const MTPupload_File &result) {
+	const auto process = fileProcess(id);
+	Assert(process != nullptr);
+	Assert(!process->requests.empty());
 
 	if (result.type() == mtpc_upload_fileCdnRedirect) {
 		error("Cdn redirect is not supported.");
@@ -1620,18 +1745,18 @@ void ApiWrap::filePartDone(int offset, const MTPupload_File &result) {
 	}
 	const auto &data = result.c_upload_file();
 	if (data.vbytes.v.isEmpty()) {
-		if (_fileProcess->size > 0) {
+		if (process->size > 0) {
 			error("Empty bytes received in file part.");
 			return;
 		}
-		const auto result = _fileProcess->file.writeBlock({});
+		const auto result = process->file.writeBlock({});
 		if (!result) {
 			ioError(result);
 			return;
 		}
 	} else {
 		using Request = FileProcess::Request;
-		auto &requests = _fileProcess->requests;
+		auto &requests = process->requests;
 		const auto i = ranges::find(
 			requests,
 			offset,
@@ -1640,7 +1765,7 @@ void ApiWrap::filePartDone(int offset, const MTPupload_File &result) {
 
 		i->bytes = data.vbytes.v;
 
-		auto &file = _fileProcess->file;
+		auto &file = process->file;
 		while (!requests.empty() && !requests.front().bytes.isEmpty()) {
 			const auto &bytes = requests.front().bytes;
 			if (const auto result = file.writeBlock(bytes); !result) {
@@ -1650,33 +1775,54 @@ void ApiWrap::filePartDone(int offset, const MTPupload_File &result) {
 			requests.pop_front();
 		}
 
-		if (_fileProcess->progress) {
-			_fileProcess->progress(FileProgress{
+		if (process->progress) {
+			process->progress(FileProgress{
+				process->relativePath,
 				file.size(),
-				_fileProcess->size });
+				process->size });
 		}
 
 		if (!requests.empty()
-			|| !_fileProcess->size
-			|| _fileProcess->size > _fileProcess->offset) {
-			loadFilePart();
+			|| !process->size
+			|| process->size > process->offset) {
+			loadFilePart(id);
 			return;
 		}
 	}
 
-	auto process = base::take(_fileProcess);
-	const auto relativePath = process->relativePath;
-	_fileCache->save(process->location, relativePath);
-	process->done(process->relativePath);
+	if (const auto result = process->file.flush(); !result) {
+		ioError(result);
+		return;
+	}
+	auto owned = takeFileProcess(id);
+	_fileCache->save(owned->location, owned->relativePath);
+	owned->done(owned->relativePath);
+	for (auto &done : owned->duplicates) {
+		done(owned->relativePath);
+	}
 }
 
-void ApiWrap::filePartUnavailable() {
-	Expects(_fileProcess != nullptr);
-	Expects(!_fileProcess->requests.empty());
-
+void ApiWrap::filePartUnavailable(uint64 id) {
 	LOG(("Export Error: File unavailable."));
 
-	base::take(_fileProcess)->done(QString());
+	auto owned = takeFileProcess(id);
+	Assert(owned != nullptr);
+	Assert(!owned->requests.empty());
+
+	owned->done(QString());
+	for (auto &done : owned->duplicates) {
+		done(QString());
+	}
+}
+
+auto ApiWrap::takeFileProcess(uint64 id) -> std::unique_ptr<FileProcess> {
+	const auto i = _fileProcesses.find(id);
+	if (i == end(_fileProcesses)) {
+		return nullptr;
+	}
+	auto result = std::move(i->second);
+	_fileProcesses.erase(i);
+	return result;
 }
 
 void ApiWrap::error(RPCError &&error) {
@@ -78,7 +78,7 @@ public:
 		const Data::DialogInfo &info,
 		FnMut<bool(const Data::DialogInfo &)> start,
 		Fn<bool(DownloadProgress)> progress,
-		Fn<bool(Data::MessagesSlice&&)> slice,
+		Fn<void(Data::MessagesSlice&&, FnMut<void(bool)>)> slice,
 		FnMut<void()> done);
 
 	void finishExport(FnMut<void()> done);
@@ -97,6 +97,7 @@ private:
 	struct ChatsProcess;
 	struct LeftChannelsProcess;
 	struct DialogsProcess;
+	struct ChatSlice;
 	struct ChatProcess;
 
 	void startMainSession(FnMut<void()> done);
@@ -150,13 +151,24 @@ private:
 		int addOffset,
 		int limit,
 		FnMut<void(MTPmessages_Messages&&)> done);
-	void loadMessagesFiles(Data::MessagesSlice &&slice);
-	void loadNextMessageFile();
-	bool loadMessageFileProgress(FileProgress value);
-	void loadMessageFileDone(const QString &relativePath);
-	bool loadMessageThumbProgress(FileProgress value);
-	void loadMessageThumbDone(const QString &relativePath);
-	void finishMessagesSlice();
+	void appendMessagesSlice(Data::MessagesSlice &&slice);
+	void processMessagesSlices();
+	void messagesSliceWritten(bool success);
+	void loadMessagesFiles();
+	ChatSlice &messagesSlice(int sliceIndex);
+	bool loadMessageFileProgress(
+		int sliceIndex,
+		int index,
+		FileProgress value);
+	void loadMessageFileDone(
+		int sliceIndex,
+		int index,
+		const QString &relativePath);
+	void loadMessageThumbDone(
+		int sliceIndex,
+		int index,
+		const QString &relativePath);
+	void messageFileLoaded(int sliceIndex);
 	void finishMessages();
 
 	bool processFileLoad(
@@ -171,9 +183,15 @@ private:
 		const Data::File &file,
 		Fn<bool(FileProgress)> progress,
 		FnMut<void(QString)> done);
-	void loadFilePart();
-	void filePartDone(int offset, const MTPupload_File &result);
-	void filePartUnavailable();
+	FileProcess *fileProcess(uint64 id) const;
+	FileProcess *fileProcess(const Data::FileLocation &location) const;
+	std::unique_ptr<FileProcess> takeFileProcess(uint64 id);
+	void loadFilePart(uint64 id);
+	void filePartDone(
+		uint64 id,
+		int offset,
+		const MTPupload_File &result);
+	void filePartUnavailable(uint64 id);
 
 	template <typename Request>
 	class RequestBuilder;
@@ -185,6 +203,7 @@ private:
 	[[nodiscard]] auto splitRequest(int index, Request &&request);
 
 	[[nodiscard]] auto fileRequest(
+		uint64 id,
 		const Data::FileLocation &location,
 		int offset);
 
@@ -204,7 +223,8 @@ private:
 	std::unique_ptr<ContactsProcess> _contactsProcess;
 	std::unique_ptr<UserpicsProcess> _userpicsProcess;
 	std::unique_ptr<OtherDataProcess> _otherDataProcess;
-	std::unique_ptr<FileProcess> _fileProcess;
+	std::map<uint64, std::unique_ptr<FileProcess>> _fileProcesses;
+	uint64 _fileProcessIdLast = 0;
 	std::unique_ptr<LeftChannelsProcess> _leftChannelsProcess;
 	std::unique_ptr<DialogsProcess> _dialogsProcess;
 	std::unique_ptr<ChatProcess> _chatProcess;
@@ -98,6 +98,7 @@ private:
 
 	int substepsInStep(Step step) const;
 
+	Fn<void(FnMut<void()>)> _runner;
 	ApiWrap _api;
 	Settings _settings;
 	Environment _environment;
@@ -133,7 +134,8 @@ private:
 Controller::Controller(
 	crl::weak_on_queue<Controller> weak,
 	const MTPInputPeer &peer)
-: _api(weak.runner())
+: _runner(weak.runner())
+, _api(_runner)
 , _state(PasswordCheckState{}) {
 	_api.errors(
 	) | rpl::start_with_next([=](RPCError &&error) {
@@ -452,13 +454,21 @@ void Controller::exportNextDialog() {
 		}, [=](DownloadProgress progress) {
 			setState(stateDialogs(progress));
 			return true;
-		}, [=](Data::MessagesSlice &&result) {
-			if (ioCatchError(_writer->writeDialogSlice(result))) {
-				return false;
-			}
-			_messagesWritten += result.list.size();
-			setState(stateDialogs(DownloadProgress()));
-			return true;
+		}, [=](Data::MessagesSlice &&slice, FnMut<void(bool)> written) {
+			const auto count = int(slice.list.size());
+			_writer->writeDialogSlice(
+				std::make_shared<Data::MessagesSlice>(std::move(slice)),
+				_runner,
+				[=, written = std::move(written)](
+						Output::Result result) mutable {
+					if (ioCatchError(result)) {
+						written(false);
+						return;
+					}
+					_messagesWritten += count;
+					setState(stateDialogs(DownloadProgress()));
+					written(true);
+				});
 		}, [=] {
 			if (ioCatchError(_writer->writeDialogEnd())) {
 				return;
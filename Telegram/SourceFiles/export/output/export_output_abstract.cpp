@@ -473,13 +473,20 @@ Stats AbstractWriter::produceTestExample(
 	dialogs.chats.push_back(dialogChat);
 
 	check(writeDialogsStart(dialogs));
+	const auto slice = [&](Data::MessagesSlice &data) {
+		// Without a runner the slice is written right away.
+		writeDialogSlice(
+			std::make_shared<Data::MessagesSlice>(std::move(data)),
+			nullptr,
+			check);
+	};
 	check(writeDialogStart(dialogBot));
-	check(writeDialogSlice(sliceBot1));
-	check(writeDialogSlice(sliceBot2));
+	slice(sliceBot1);
+	slice(sliceBot2);
 	check(writeDialogEnd());
 	check(writeDialogStart(dialogChat));
-	check(writeDialogSlice(sliceChat1));
-	check(writeDialogSlice(sliceChat2));
+	slice(sliceChat1);
+	slice(sliceChat2);
 	check(writeDialogEnd());
 	check(writeDialogsEnd());
 
@@ -70,8 +70,13 @@ public:
 		const Data::DialogsInfo &data) = 0;
 	[[nodiscard]] virtual Result writeDialogStart(
 		const Data::DialogInfo &data) = 0;
-	[[nodiscard]] virtual Result writeDialogSlice(
-		const Data::MessagesSlice &data) = 0;
+
+	// The slice may be serialized on the thread pool, in that case done
+	// is called later through the runner, otherwise right away.
+	virtual void writeDialogSlice(
+		std::shared_ptr<const Data::MessagesSlice> data,
+		Fn<void(FnMut<void()>)> runner,
+		FnMut<void(Result)> done) = 0;
 	[[nodiscard]] virtual Result writeDialogEnd() = 0;
 	[[nodiscard]] virtual Result writeDialogsEnd() = 0;
 
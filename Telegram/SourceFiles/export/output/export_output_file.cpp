@@ -17,40 +17,75 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 namespace Export {
 namespace Output {
+namespace {
+
+constexpr auto kBufferSize = 256 * 1024;
+constexpr auto kFlushTimeout = crl::time_type(1000);
+
+} // namespace
 
 File::File(const QString &path, Stats *stats) : _path(path), _stats(stats) {
 }
 
+File::~File() {
+	if (!_buffer.isEmpty()) {
+		(void)flush();
+	}
+}
+
 int File::size() const {
-	return _offset;
+	return _offset + _buffer.size();
 }
 
 bool File::empty() const {
-	return !_offset;
+	return !size();
 }
 
 Result File::writeBlock(const QByteArray &block) {
-	const auto result = writeBlockAttempt(block);
+	if (_stats && !_inStats) {
+		_inStats = true;
+		_stats->incrementFiles();
+	}
+	if (!_file) {
+		// Create the file right away, only the contents are delayed.
+		if (const auto result = reopen(); !result) {
+			_file.reset();
+			return result;
+		}
+		_lastFlushTime = crl::time();
+	}
+	if (block.isEmpty()) {
+		return Result::Success();
+	} else if (_buffer.capacity() < kBufferSize) {
+		_buffer.reserve(kBufferSize);
+	}
+	_buffer.append(block);
+	return (_buffer.size() >= kBufferSize
+		|| crl::time() - _lastFlushTime >= kFlushTimeout)
+		? flush()
+		: Result::Success();
+}
+
+Result File::flush() {
+	const auto result = flushAttempt();
 	if (!result) {
 		_file.reset();
 	}
 	return result;
 }
 
-Result File::writeBlockAttempt(const QByteArray &block) {
-	if (_stats && !_inStats) {
-		_inStats = true;
-		_stats->incrementFiles();
-	}
+Result File::flushAttempt() {
 	if (const auto result = reopen(); !result) {
 		return result;
 	}
-	const auto size = block.size();
+	_lastFlushTime = crl::time();
+	const auto size = _buffer.size();
 	if (!size) {
 		return Result::Success();
 	}
-	if (_file->write(block) == size && _file->flush()) {
+	if (_file->write(_buffer) == size && _file->flush()) {
 		_offset += size;
+		_buffer.resize(0);
 		if (_stats) {
 			_stats->incrementBytes(size);
 		}
@@ -95,8 +130,13 @@ Result File::fatalError() const {
 
 QString File::PrepareRelativePath(
 		const QString &folder,
-		const QString &suggested) {
-	if (!QFile::exists(folder + suggested)) {
+		const QString &suggested,
+		const base::flat_set<QString> &reserved) {
+	const auto taken = [&](const QString &relativePath) {
+		return reserved.contains(relativePath)
+			|| QFile::exists(folder + relativePath);
+	};
+	if (!taken(suggested)) {
 		return suggested;
 	}
 
@@ -114,7 +154,7 @@ QString File::PrepareRelativePath(
 	auto attempt = 0;
 	while (true) {
 		const auto relativePath = relativePart(++attempt);
-		if (!QFile::exists(folder + relativePath)) {
+		if (!taken(relativePath)) {
 			return relativePath;
 		}
 	}
@@ -132,7 +172,9 @@ Result File::Copy(
 	if (bytes.size() != f.size()) {
 		return Result(Result::Type::FatalError, source);
 	}
-	return File(path, stats).writeBlock(bytes);
+	auto file = File(path, stats);
+	const auto result = file.writeBlock(bytes);
+	return result ? file.flush() : result;
 }
 
 } // namespace Output
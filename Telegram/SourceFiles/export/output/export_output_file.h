@@ -8,7 +8,9 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #pragma once
 
 #include "base/optional.h"
+#include "base/flat_set.h"
 
+#include <crl/crl_time.h>
 #include <QtCore/QFile>
 #include <QtCore/QString>
 #include <QtCore/QByteArray>
@@ -19,18 +21,26 @@ namespace Output {
 struct Result;
 class Stats;
 
+// Blocks are collected in memory and written to disk in big chunks.
+// The file on disk always ends on a block boundary at _offset, a failed
+// write is truncated back to it and retried with the next flush().
 class File {
 public:
 	File(const QString &path, Stats *stats);
+	~File();
 
 	[[nodiscard]] int size() const;
 	[[nodiscard]] bool empty() const;
 
 	[[nodiscard]] Result writeBlock(const QByteArray &block);
+	[[nodiscard]] Result flush();
 
+	// Paths from the reserved set are treated as taken even if
+	// nothing was written to them yet.
 	[[nodiscard]] static QString PrepareRelativePath(
 		const QString &folder,
-		const QString &suggested);
+		const QString &suggested,
+		const base::flat_set<QString> &reserved = {});
 
 	[[nodiscard]] static Result Copy(
 		const QString &source,
@@ -39,7 +49,7 @@ public:
 
 private:
 	[[nodiscard]] Result reopen();
-	[[nodiscard]] Result writeBlockAttempt(const QByteArray &block);
+	[[nodiscard]] Result flushAttempt();
 
 	[[nodiscard]] Result error() const;
 	[[nodiscard]] Result fatalError() const;
@@ -47,6 +57,8 @@ private:
 	QString _path;
 	int _offset = 0;
 	std::optional<QFile> _file;
+	QByteArray _buffer;
+	crl::time_type _lastFlushTime = 0;
 
 	Stats *_stats = nullptr;
 	bool _inStats = false;
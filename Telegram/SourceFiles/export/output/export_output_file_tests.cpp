@@ -0,0 +1,156 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "export/output/export_output_file.h"
+#include "export/output/export_output_json.h"
+#include "export/output/export_output_result.h"
+#include "export/output/export_output_stats.h"
+#include "export/export_settings.h"
+#include "export/data/export_data_types.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+
+#include <chrono>
+#include <iostream>
+
+using namespace Export;
+
+const auto Folder = QDir::tempPath() + "/tdesktop_export_tests/";
+const auto Name = Folder + "test.file";
+
+QByteArray ReadAll(const QString &path) {
+	QFile f(path);
+	return f.open(QIODevice::ReadOnly) ? f.readAll() : QByteArray();
+}
+
+TEST_CASE("buffered export file", "[export]") {
+	QDir(Folder).removeRecursively();
+
+	SECTION("file is created at the first write") {
+		auto file = Output::File(Name, nullptr);
+		REQUIRE(file.empty());
+		REQUIRE(file.writeBlock(QByteArray()).isSuccess());
+		REQUIRE(QFile::exists(Name));
+		REQUIRE(file.empty());
+	}
+	SECTION("small blocks are written on flush") {
+		auto stats = Output::Stats();
+		auto file = Output::File(Name, &stats);
+		REQUIRE(file.writeBlock("first ").isSuccess());
+		REQUIRE(file.writeBlock("second").isSuccess());
+		REQUIRE(file.size() == 12);
+		REQUIRE(ReadAll(Name).isEmpty());
+		REQUIRE(stats.filesCount() == 1);
+		REQUIRE(stats.bytesCount() == 0);
+
+		REQUIRE(file.flush().isSuccess());
+		REQUIRE(ReadAll(Name) == "first second");
+		REQUIRE(stats.bytesCount() == 12);
+	}
+	SECTION("large blocks are written right away") {
+		const auto block = QByteArray(1024 * 1024, 'x');
+		auto file = Output::File(Name, nullptr);
+		REQUIRE(file.writeBlock("head").isSuccess());
+		REQUIRE(file.writeBlock(block).isSuccess());
+		REQUIRE(ReadAll(Name) == "head" + block);
+	}
+	SECTION("destructor writes pending blocks") {
+		{
+			auto file = Output::File(Name, nullptr);
+			REQUIRE(file.writeBlock("pending").isSuccess());
+		}
+		REQUIRE(ReadAll(Name) == "pending");
+	}
+	SECTION("copy writes the whole source") {
+		const auto block = QByteArray(1024 * 1024 + 1, 'y');
+		{
+			auto file = Output::File(Name, nullptr);
+			REQUIRE(file.writeBlock(block).isSuccess());
+		}
+		REQUIRE(Output::File::Copy(Name, Name + ".copy", nullptr).isSuccess());
+		REQUIRE(ReadAll(Name + ".copy") == block);
+	}
+
+	QDir(Folder).removeRecursively();
+}
+
+Data::MessagesSlice GenerateSlice(int from, int count) {
+	auto user = Data::User();
+	user.info.userId = 1;
+	user.info.firstName = "John";
+	user.info.lastName = "Preston";
+
+	auto result = Data::MessagesSlice();
+	result.peers.emplace(Data::UserPeerId(1), Data::Peer{ user });
+	result.list.reserve(count);
+	for (auto i = 0; i != count; ++i) {
+		auto message = Data::Message();
+		message.id = from + i;
+		message.date = 1500000000 + message.id;
+		message.fromId = user.info.userId;
+		message.toId = Data::UserPeerId(user.info.userId);
+		message.text.push_back(Data::TextPart{
+			Data::TextPart::Type::Text,
+			"Synthetic message text with some \"quotes\" & <tags>. "
+		});
+		message.text.push_back(Data::TextPart{
+			Data::TextPart::Type::Url,
+			"https://telegram.org"
+		});
+		result.list.push_back(std::move(message));
+	}
+	return result;
+}
+
+// Not run by default, use "[benchmark]" filter to run it.
+TEST_CASE("export json throughput", "[.][benchmark]") {
+	constexpr auto kSlices = 1000;
+	constexpr auto kSliceSize = 100;
+
+	QDir(Folder).removeRecursively();
+	auto settings = Settings();
+	settings.format = Output::Format::Json;
+	settings.path = Folder;
+
+	auto dialog = Data::DialogInfo();
+	dialog.type = Data::DialogInfo::Type::Personal;
+	dialog.name = "John";
+	auto dialogs = Data::DialogsInfo();
+	dialogs.chats.push_back(dialog);
+
+	auto slices = std::vector<Data::MessagesSlice>();
+	slices.reserve(kSlices);
+	for (auto i = 0; i != kSlices; ++i) {
+		slices.push_back(GenerateSlice(i * kSliceSize + 1, kSliceSize));
+	}
+
+	auto stats = Output::Stats();
+	auto writer = Output::JsonWriter();
+	const auto start = std::chrono::steady_clock::now();
+	REQUIRE(writer.start(settings, Environment(), &stats).isSuccess());
+	REQUIRE(writer.writeDialogsStart(dialogs).isSuccess());
+	REQUIRE(writer.writeDialogStart(dialog).isSuccess());
+	for (const auto &slice : slices) {
+		REQUIRE(writer.writeDialogSlice(slice).isSuccess());
+	}
+	REQUIRE(writer.writeDialogEnd().isSuccess());
+	REQUIRE(writer.writeDialogsEnd().isSuccess());
+	REQUIRE(writer.finish().isSuccess());
+	const auto finish = std::chrono::steady_clock::now();
+
+	const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+		finish - start).count();
+	std::cout
+		<< (kSlices * kSliceSize) << " messages, "
+		<< stats.bytesCount() << " bytes exported in "
+		<< ms << " ms." << std::endl;
+
+	QDir(Folder).removeRecursively();
+}
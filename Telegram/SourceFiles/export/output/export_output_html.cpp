@@ -8,6 +8,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "export/output/export_output_html.h"
 
 #include "export/output/export_output_result.h"
+#include "export/output/export_output_parallel.h"
 #include "export/data/export_data_types.h"
 #include "core/utils.h"
 
@@ -520,6 +521,10 @@ class HtmlWriter::Wrap {
 public:
 	Wrap(const QString &path, const QString &base, Stats *stats);
 
+	// Creates a wrap with the same tags nesting that can't write anything.
+	// It is used to format messages on several threads at the same time.
+	[[nodiscard]] std::unique_ptr<Wrap> fork() const;
+
 	[[nodiscard]] bool empty() const;
 
 	[[nodiscard]] QByteArray pushTag(
@@ -563,6 +568,10 @@ public:
 		const QString &basePath,
 		const QByteArray &text,
 		const Data::Photo *photo = nullptr);
+
+	// Everything the joining of the next message depends on, cheap.
+	[[nodiscard]] static MessageInfo prepareMessageInfo(
+		const Data::Message &message);
 	[[nodiscard]] std::pair<MessageInfo, QByteArray> pushMessage(
 		const Data::Message &message,
 		const MessageInfo *previous,
@@ -582,6 +591,8 @@ public:
 	~Wrap();
 
 private:
+	Wrap(const QByteArray &base, const Context &context);
+
 	[[nodiscard]] QByteArray composeStart();
 	[[nodiscard]] QByteArray pushGenericListEntry(
 		const QString &link,
@@ -678,6 +689,17 @@ HtmlWriter::Wrap::Wrap(
 	_base = QString("../").repeated(nesting).toUtf8();
 }
 
+HtmlWriter::Wrap::Wrap(const QByteArray &base, const Context &context)
+: _file(QString(), nullptr)
+, _closed(true)
+, _base(base)
+, _context(context) {
+}
+
+auto HtmlWriter::Wrap::fork() const -> std::unique_ptr<Wrap> {
+	return std::unique_ptr<Wrap>(new Wrap(_base, _context));
+}
+
 bool HtmlWriter::Wrap::empty() const {
 	return _file.empty();
 }
@@ -928,6 +950,34 @@ QByteArray HtmlWriter::Wrap::pushServiceMessage(
 	return result;
 }
 
+auto HtmlWriter::Wrap::prepareMessageInfo(const Data::Message &message)
+-> MessageInfo {
+	using namespace Data;
+
+	auto info = MessageInfo();
+	info.id = message.id;
+	info.fromId = message.fromId;
+	info.date = message.date;
+	info.forwardedFromId = message.forwardedFromId;
+	info.forwardedDate = message.forwardedDate;
+
+	// Actions without a service text are shown as regular messages.
+	const auto service = message.media.content.is<UnsupportedMedia>()
+		|| message.action.content.match([](const ActionPhoneCall &data) {
+			return false;
+		}, [](const ActionCustomAction &data) {
+			return !data.message.isEmpty();
+		}, [](const auto &data) {
+			return true;
+		}, [](std::nullopt_t) {
+			return false;
+		});
+	info.type = service
+		? MessageInfo::Type::Service
+		: MessageInfo::Type::Default;
+	return info;
+}
+
 auto HtmlWriter::Wrap::pushMessage(
 	const Data::Message &message,
 	const MessageInfo *previous,
@@ -939,12 +989,7 @@ auto HtmlWriter::Wrap::pushMessage(
 ) -> std::pair<MessageInfo, QByteArray> {
 	using namespace Data;
 
-	auto info = MessageInfo();
-	info.id = message.id;
-	info.fromId = message.fromId;
-	info.date = message.date;
-	info.forwardedFromId = message.forwardedFromId;
-	info.forwardedDate = message.forwardedDate;
+	const auto info = prepareMessageInfo(message);
 	if (message.media.content.is<UnsupportedMedia>()) {
 		return { info, pushServiceMessage(
 			message.id,
@@ -1060,7 +1105,9 @@ auto HtmlWriter::Wrap::pushMessage(
 			+ SerializeList(list);
 	}, [](std::nullopt_t) { return QByteArray(); });
 
-	if (!serviceText.isEmpty()) {
+	if (info.type == MessageInfo::Type::Service) {
+		Assert(!serviceText.isEmpty());
+
 		const auto &content = message.action.content;
 		const auto photo = content.is<ActionChatEditPhoto>()
 			? &content.get_unchecked<ActionChatEditPhoto>().photo
@@ -1072,7 +1119,6 @@ auto HtmlWriter::Wrap::pushMessage(
 			serviceText,
 			photo) };
 	}
-	info.type = MessageInfo::Type::Default;
 
 	const auto wrap = messageNeedsWrap(message, previous);
 	const auto fromPeerId = message.fromId
@@ -1686,7 +1732,10 @@ Result HtmlWriter::Wrap::close() {
 		while (!_context.empty()) {
 			block.append(_context.popTag());
 		}
-		return _file.writeBlock(block);
+		if (const auto result = _file.writeBlock(block); !result) {
+			return result;
+		}
+		return _file.flush();
 	}
 	return Result::Success();
 }
@@ -2265,73 +2314,172 @@ Result HtmlWriter::writeDialogStart(const Data::DialogInfo &data) {
 	return Result::Success();
 }
 
-Result HtmlWriter::writeDialogSlice(const Data::MessagesSlice &data) {
+void HtmlWriter::writeDialogSlice(
+		std::shared_ptr<const Data::MessagesSlice> data,
+		Fn<void(FnMut<void()>)> runner,
+		FnMut<void(Result)> done) {
 	Expects(_chat != nullptr);
-	Expects(!data.list.empty());
+	Expects(!data->list.empty());
 
-	const auto messageLinkWrapper = [&](int messageId, QByteArray text) {
-		return wrapMessageLink(messageId, text);
-	};
-	auto oldIndex = (_messagesCount > 0)
+	auto messages = std::make_shared<MessagesList>();
+	messages->reserve(data->list.size());
+	for (const auto &message : data->list) {
+		if (!Data::SkipMessageByDate(message, _settings)) {
+			messages->push_back(&message);
+		}
+	}
+	writeDialogSliceFrom(
+		std::move(data),
+		std::move(messages),
+		0,
+		std::move(runner),
+		std::move(done));
+}
+
+void HtmlWriter::writeDialogSliceFrom(
+		std::shared_ptr<const Data::MessagesSlice> data,
+		std::shared_ptr<const MessagesList> messages,
+		int from,
+		Fn<void(FnMut<void()>)> runner,
+		FnMut<void(Result)> done) {
+	Expects(_chat != nullptr);
+
+	const auto count = int(messages->size());
+	if (from == count) {
+		done(Result::Success());
+		return;
+	}
+	const auto oldIndex = (_messagesCount > 0)
 		? ((_messagesCount - 1) / kMessagesInFile)
 		: 0;
-	auto previous = _lastMessageInfo.get();
-	auto saved = std::optional<MessageInfo>();
-	auto block = QByteArray();
-	for (const auto &message : data.list) {
-		if (Data::SkipMessageByDate(message, _settings)) {
-			continue;
-		}
-		const auto newIndex = (_messagesCount / kMessagesInFile);
-		if (oldIndex != newIndex) {
-			if (const auto result = _chat->writeBlock(block); !result) {
-				return result;
-			} else if (const auto next = switchToNextChatFile(newIndex)) {
-				Assert(saved.has_value() || _lastMessageInfo != nullptr);
-				_lastMessageIdsPerFile.push_back(saved
-					? saved->id
-					: _lastMessageInfo->id);
-				block = QByteArray();
-				_lastMessageInfo = nullptr;
-				previous = nullptr;
-				saved = std::nullopt;
-				oldIndex = newIndex;
-			} else {
-				return next;
-			}
+	const auto newIndex = (_messagesCount / kMessagesInFile);
+	if (oldIndex != newIndex) {
+		Assert(from > 0 || _lastMessageInfo != nullptr);
+		const auto lastMessageId = (from > 0)
+			? (*messages)[from - 1]->id
+			: _lastMessageInfo->id;
+		if (const auto next = switchToNextChatFile(newIndex); !next) {
+			done(next);
+			return;
 		}
-		if (_chatFileEmpty) {
-			if (const auto result = writeDialogOpening(oldIndex); !result) {
-				return result;
-			}
-			_chatFileEmpty = false;
+		_lastMessageIdsPerFile.push_back(lastMessageId);
+		_lastMessageInfo = nullptr;
+	}
+	if (_chatFileEmpty) {
+		if (const auto result = writeDialogOpening(newIndex); !result) {
+			done(result);
+			return;
 		}
-		const auto date = message.date;
-		if (DisplayDate(date, previous ? previous->date : 0)) {
-			block.append(_chat->pushServiceMessage(
-				--_dateMessageId,
-				_dialog,
-				_settings.path,
-				FormatDateText(date)));
+		_chatFileEmpty = false;
+	}
+	const auto till = std::min(
+		from + (newIndex + 1) * kMessagesInFile - _messagesCount,
+		count);
+	writeMessages(data, messages, from, till, runner, [
+		=,
+		done = std::move(done)
+	](Result result) mutable {
+		if (!result) {
+			done(result);
+			return;
 		}
-		const auto [info, content] = _chat->pushMessage(
-			message,
-			previous,
-			_dialog,
-			_settings.path,
-			data.peers,
-			_environment.internalLinksDomain,
-			messageLinkWrapper);
-		block.append(content);
+		writeDialogSliceFrom(
+			data,
+			messages,
+			till,
+			runner,
+			std::move(done));
+	});
+}
 
-		++_messagesCount;
-		saved = info;
-		previous = &*saved;
-	}
-	if (saved) {
-		_lastMessageInfo = std::make_unique<MessageInfo>(*saved);
+void HtmlWriter::writeMessages(
+		std::shared_ptr<const Data::MessagesSlice> data,
+		std::shared_ptr<const MessagesList> messages,
+		int from,
+		int till,
+		Fn<void(FnMut<void()>)> runner,
+		FnMut<void(Result)> done) {
+	Expects(_chat != nullptr);
+	Expects(from < till);
+
+	// Date service messages are numbered in order and joining depends on
+	// the message before, so prepare both here and pass them to the ranges.
+	struct Prepared {
+		std::vector<int> dateMessageIds;
+		std::vector<MessageInfo> infos;
+		std::optional<MessageInfo> before;
+	};
+	const auto count = till - from;
+	const auto prepared = std::make_shared<Prepared>();
+	prepared->dateMessageIds.resize(count, 0);
+	prepared->infos.reserve(count);
+	if (_lastMessageInfo) {
+		prepared->before = *_lastMessageInfo;
+	}
+	auto previousDate = _lastMessageInfo ? _lastMessageInfo->date : 0;
+	for (auto i = 0; i != count; ++i) {
+		const auto &message = *(*messages)[from + i];
+		if (DisplayDate(message.date, previousDate)) {
+			prepared->dateMessageIds[i] = --_dateMessageId;
+		}
+		previousDate = message.date;
+		prepared->infos.push_back(Wrap::prepareMessageInfo(message));
 	}
-	return block.isEmpty() ? Result::Success() : _chat->writeBlock(block);
+
+	// The ranges are serialized on the thread pool and may outlive
+	// the writer, so they own everything they use.
+	const auto base = std::shared_ptr<const Wrap>(_chat->fork());
+	const auto messageLinkWrapper = [
+		ids = _lastMessageIdsPerFile
+	](int messageId, QByteArray text) {
+		return wrapMessageLink(ids, messageId, text);
+	};
+	SerializeInParallel(count, [
+		data,
+		messages,
+		from,
+		prepared,
+		base,
+		messageLinkWrapper,
+		dialog = _dialog,
+		path = _settings.path,
+		domain = _environment.internalLinksDomain
+	](int rangeFrom, int rangeTill) {
+		const auto wrap = base->fork();
+		auto result = QByteArray();
+		for (auto i = rangeFrom; i != rangeTill; ++i) {
+			const auto &message = *(*messages)[from + i];
+			if (const auto id = prepared->dateMessageIds[i]) {
+				result.append(wrap->pushServiceMessage(
+					id,
+					dialog,
+					path,
+					FormatDateText(message.date)));
+			}
+			const auto previous = (i > 0)
+				? &prepared->infos[i - 1]
+				: prepared->before
+				? &*prepared->before
+				: nullptr;
+			result.append(wrap->pushMessage(
+				message,
+				previous,
+				dialog,
+				path,
+				data->peers,
+				domain,
+				messageLinkWrapper).second);
+		}
+		return result;
+	}, runner, [
+		=,
+		done = std::move(done)
+	](QByteArray &&block) mutable {
+		_messagesCount += count;
+		_lastMessageInfo = std::make_unique<MessageInfo>(
+			prepared->infos.back());
+		done(_chat->writeBlock(block));
+	});
 }
 
 Result HtmlWriter::writeEmptySinglePeer() {
@@ -2534,12 +2682,14 @@ Result HtmlWriter::writeSections() {
 	return _summary->writeBlock(block);
 }
 
-QByteArray HtmlWriter::wrapMessageLink(int messageId, QByteArray text) {
-	const auto finishedCount = _lastMessageIdsPerFile.size();
-	const auto it = ranges::find_if(_lastMessageIdsPerFile, [&](int maxMessageId) {
+QByteArray HtmlWriter::wrapMessageLink(
+		const std::vector<int> &lastMessageIdsPerFile,
+		int messageId,
+		QByteArray text) {
+	const auto it = ranges::find_if(lastMessageIdsPerFile, [&](int maxMessageId) {
 		return messageId <= maxMessageId;
 	});
-	if (it == end(_lastMessageIdsPerFile)) {
+	if (it == end(lastMessageIdsPerFile)) {
 		return "<a href=\"#go_to_message"
 			+ Data::NumberToString(messageId)
 			+ "\" onclick=\"return GoToMessage("
@@ -2547,7 +2697,7 @@ QByteArray HtmlWriter::wrapMessageLink(int messageId, QByteArray text) {
 			+ ")\">"
 			+ text + "</a>";
 	} else {
-		const auto index = it - begin(_lastMessageIdsPerFile);
+		const auto index = it - begin(lastMessageIdsPerFile);
 		return "<a href=\"" + messagesFile(index).toUtf8()
 			+ "#go_to_message"
 			+ Data::NumberToString(messageId)
@@ -2625,7 +2775,7 @@ QString HtmlWriter::pathWithRelativePath(const QString &path) const {
 	return _settings.path + path;
 }
 
-QString HtmlWriter::messagesFile(int index) const {
+QString HtmlWriter::messagesFile(int index) {
 	return "messages"
 		+ (index > 0 ? QString::number(index + 1) : QString())
 		+ ".html";
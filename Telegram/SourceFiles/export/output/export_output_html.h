@@ -67,7 +67,10 @@ public:
 
 	Result writeDialogsStart(const Data::DialogsInfo &data) override;
 	Result writeDialogStart(const Data::DialogInfo &data) override;
-	Result writeDialogSlice(const Data::MessagesSlice &data) override;
+	void writeDialogSlice(
+		std::shared_ptr<const Data::MessagesSlice> data,
+		Fn<void(FnMut<void()>)> runner,
+		FnMut<void(Result)> done) override;
 	Result writeDialogEnd() override;
 	Result writeDialogsEnd() override;
 
@@ -83,6 +86,7 @@ private:
 	using MediaData = details::MediaData;
 	class Wrap;
 	struct MessageInfo;
+	using MessagesList = std::vector<not_null<const Data::Message*>>;
 	enum class DialogsMode {
 		None,
 		Chats,
@@ -97,7 +101,7 @@ private:
 	[[nodiscard]] QString pathWithRelativePath(const QString &path) const;
 	[[nodiscard]] std::unique_ptr<Wrap> fileWithRelativePath(
 		const QString &path) const;
-	[[nodiscard]] QString messagesFile(int index) const;
+	[[nodiscard]] static QString messagesFile(int index);
 
 	[[nodiscard]] Result writeSavedContacts(const Data::ContactsList &data);
 	[[nodiscard]] Result writeFrequentContacts(const Data::ContactsList &data);
@@ -108,6 +112,19 @@ private:
 	[[nodiscard]] Result validateDialogsMode(bool isLeftChannel);
 	[[nodiscard]] Result writeDialogOpening(int index);
 	[[nodiscard]] Result switchToNextChatFile(int index);
+	void writeDialogSliceFrom(
+		std::shared_ptr<const Data::MessagesSlice> data,
+		std::shared_ptr<const MessagesList> messages,
+		int from,
+		Fn<void(FnMut<void()>)> runner,
+		FnMut<void(Result)> done);
+	void writeMessages(
+		std::shared_ptr<const Data::MessagesSlice> data,
+		std::shared_ptr<const MessagesList> messages,
+		int from,
+		int till,
+		Fn<void(FnMut<void()>)> runner,
+		FnMut<void(Result)> done);
 	[[nodiscard]] Result writeEmptySinglePeer();
 
 	void pushSection(
@@ -128,7 +145,8 @@ private:
 
 	[[nodiscard]] QString userpicsFilePath() const;
 
-	[[nodiscard]] QByteArray wrapMessageLink(
+	[[nodiscard]] static QByteArray wrapMessageLink(
+		const std::vector<int> &lastMessageIdsPerFile,
 		int messageId,
 		QByteArray text);
 
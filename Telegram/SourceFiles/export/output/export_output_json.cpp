@@ -8,6 +8,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "export/output/export_output_json.h"
 
 #include "export/output/export_output_result.h"
+#include "export/output/export_output_parallel.h"
 #include "export/data/export_data_types.h"
 #include "core/utils.h"
 
@@ -1005,21 +1006,50 @@ Result JsonWriter::validateDialogsMode(bool isLeftChannel) {
 			: _environment.aboutChats));
 }
 
-Result JsonWriter::writeDialogSlice(const Data::MessagesSlice &data) {
+void JsonWriter::writeDialogSlice(
+		std::shared_ptr<const Data::MessagesSlice> data,
+		Fn<void(FnMut<void()>)> runner,
+		FnMut<void(Result)> done) {
 	Expects(_output != nullptr);
 
-	auto block = QByteArray();
-	for (const auto &message : data.list) {
-		if (Data::SkipMessageByDate(message, _settings)) {
-			continue;
+	auto messages = std::vector<not_null<const Data::Message*>>();
+	messages.reserve(data->list.size());
+	for (const auto &message : data->list) {
+		if (!Data::SkipMessageByDate(message, _settings)) {
+			messages.push_back(&message);
 		}
-		block.append(prepareArrayItemStart() + SerializeMessage(
-			_context,
-			message,
-			data.peers,
-			_environment.internalLinksDomain));
 	}
-	return block.isEmpty() ? Result::Success() : _output->writeBlock(block);
+	if (messages.empty()) {
+		done(Result::Success());
+		return;
+	}
+
+	// Only the first separator depends on the writer state.
+	const auto first = prepareArrayItemStart();
+	const auto separator = prepareArrayItemStart();
+	const auto count = int(messages.size());
+	SerializeInParallel(count, [
+		messages,
+		data,
+		first,
+		separator,
+		context = _context,
+		domain = _environment.internalLinksDomain
+	](int from, int till) {
+		auto copy = context;
+		auto result = QByteArray();
+		for (auto i = from; i != till; ++i) {
+			result.append(i ? separator : first);
+			result.append(SerializeMessage(
+				copy,
+				*messages[i],
+				data->peers,
+				domain));
+		}
+		return result;
+	}, runner, [=, done = std::move(done)](QByteArray &&block) mutable {
+		done(_output->writeBlock(block));
+	});
 }
 
 Result JsonWriter::writeDialogEnd() {
@@ -1058,7 +1088,10 @@ Result JsonWriter::finish() {
 
 	auto block = popNesting();
 	Assert(_context.nesting.empty());
-	return _output->writeBlock(block);
+	if (const auto result = _output->writeBlock(block); !result) {
+		return result;
+	}
+	return _output->flush();
 }
 
 QString JsonWriter::mainFilePath() {
@@ -0,0 +1,84 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "export/output/export_output_parallel.h"
+
+#include <thread>
+
+namespace Export {
+namespace Output {
+namespace {
+
+constexpr auto kMinRangeSize = 16;
+constexpr auto kMaxRangesCount = 16;
+
+int RangesCount(int count) {
+	const auto threads = std::max(
+		int(std::thread::hardware_concurrency()),
+		1);
+	const auto byCount = count / kMinRangeSize;
+	return std::clamp(std::min(byCount, threads), 1, kMaxRangesCount);
+}
+
+} // namespace
+
+void SerializeInParallel(
+		int count,
+		Fn<QByteArray(int from, int till)> serialize,
+		Fn<void(FnMut<void()>)> runner,
+		FnMut<void(QByteArray&&)> done) {
+	Expects(count >= 0);
+
+	const auto ranges = runner ? RangesCount(count) : 1;
+	if (ranges < 2) {
+		done(count ? serialize(0, count) : QByteArray());
+		return;
+	}
+	struct State {
+		std::vector<QByteArray> parts;
+		int left = 0;
+		FnMut<void(QByteArray&&)> done;
+	};
+	const auto state = std::make_shared<State>();
+	state->parts.resize(ranges);
+	state->left = ranges;
+	state->done = std::move(done);
+
+	const auto range = (count + ranges - 1) / ranges;
+	const auto rangeFrom = [&](int index) {
+		return std::min(index * range, count);
+	};
+	for (auto i = 0; i != ranges; ++i) {
+		const auto from = rangeFrom(i);
+		const auto till = rangeFrom(i + 1);
+		crl::async([=] {
+			auto part = serialize(from, till);
+			runner([=, part = std::move(part)]() mutable {
+				state->parts[i] = std::move(part);
+				if (!--state->left) {
+					base::take(state->done)(JoinBlocks(state->parts));
+				}
+			});
+		});
+	}
+}
+
+QByteArray JoinBlocks(const std::vector<QByteArray> &parts) {
+	auto size = 0;
+	for (const auto &part : parts) {
+		size += part.size();
+	}
+	auto result = QByteArray();
+	result.reserve(size);
+	for (const auto &part : parts) {
+		result.append(part);
+	}
+	return result;
+}
+
+} // namespace Output
+} // namespace Export
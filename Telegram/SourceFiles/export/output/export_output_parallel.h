@@ -0,0 +1,34 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <QtCore/QByteArray>
+
+namespace Export {
+namespace Output {
+
+// Splits [0, count) into contiguous ranges, calls serialize(from, till)
+// for each of them on the thread pool and passes the serialized ranges
+// joined in order to done, which is called through the runner. Nothing
+// waits for the ranges, they are counted when posted back. Small counts
+// or a null runner serialize everything on the calling thread and call
+// done right away.
+//
+// The callback may be called concurrently, it must not change any state
+// shared between the ranges and must own everything it uses.
+void SerializeInParallel(
+	int count,
+	Fn<QByteArray(int from, int till)> serialize,
+	Fn<void(FnMut<void()>)> runner,
+	FnMut<void(QByteArray&&)> done);
+
+// Joins the parts into one buffer allocated with the exact final size.
+[[nodiscard]] QByteArray JoinBlocks(const std::vector<QByteArray> &parts);
+
+} // namespace Output
+} // namespace Export
@@ -0,0 +1,66 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "export/output/export_output_parallel.h"
+
+#include <mutex>
+
+using namespace Export::Output;
+
+// Runs the posted callbacks one at a time, like a crl queue does.
+void Runner(FnMut<void()> callback) {
+	static auto Mutex = std::mutex();
+	const auto lock = std::lock_guard<std::mutex>(Mutex);
+	callback();
+}
+
+QByteArray Serialize(
+		int count,
+		Fn<QByteArray(int from, int till)> serialize,
+		Fn<void(FnMut<void()>)> runner) {
+	auto result = QByteArray();
+	auto semaphore = crl::semaphore();
+	SerializeInParallel(count, serialize, runner, [&](QByteArray &&data) {
+		result = std::move(data);
+		semaphore.release();
+	});
+	semaphore.acquire();
+	return result;
+}
+
+TEST_CASE("parallel serialization", "[export]") {
+	const auto serialize = [](int from, int till) {
+		auto result = QByteArray();
+		for (auto i = from; i != till; ++i) {
+			result.append(QByteArray::number(i)).append(',');
+		}
+		return result;
+	};
+
+	SECTION("empty input gives empty output") {
+		REQUIRE(Serialize(0, serialize, Runner).isEmpty());
+	}
+	SECTION("ranges are joined in order") {
+		for (const auto count : { 1, 15, 16, 33, 1000, 12345 }) {
+			REQUIRE(Serialize(count, serialize, Runner)
+				== serialize(0, count));
+		}
+	}
+	SECTION("without a runner done is called right away") {
+		auto result = QByteArray();
+		SerializeInParallel(1000, serialize, nullptr, [&](
+				QByteArray &&data) {
+			result = std::move(data);
+		});
+		REQUIRE(result == serialize(0, 1000));
+	}
+	SECTION("blocks are joined in order") {
+		REQUIRE(JoinBlocks({ "ab", QByteArray(), "cde" }) == "abcde");
+	}
+}
@@ -536,7 +536,9 @@ Result TextWriter::writeUserpicsSlice(const Data::UserpicsSlice &data) {
 }
 
 Result TextWriter::writeUserpicsEnd() {
-	_userpics = nullptr;
+	if (const auto userpics = base::take(_userpics)) {
+		return userpics->flush();
+	}
 	return Result::Success();
 }
 
@@ -584,6 +586,8 @@ Result TextWriter::writeSavedContacts(const Data::ContactsList &data) {
 		+ JoinList(kLineBreak, list);
 	if (const auto result = file->writeBlock(full); !result) {
 		return result;
+	} else if (const auto flushed = file->flush(); !flushed) {
+		return flushed;
 	}
 
 	const auto header = "Contacts "
@@ -663,6 +667,8 @@ Result TextWriter::writeFrequentContacts(const Data::ContactsList &data) {
 		+ JoinList(kLineBreak, list);
 	if (const auto result = file->writeBlock(full); !result) {
 		return result;
+	} else if (const auto flushed = file->flush(); !flushed) {
+		return flushed;
 	}
 
 	const auto header = "Frequent contacts "
@@ -719,6 +725,8 @@ Result TextWriter::writeSessions(const Data::SessionsList &data) {
 		+ JoinList(kLineBreak, list);
 	if (const auto result = file->writeBlock(full); !result) {
 		return result;
+	} else if (const auto flushed = file->flush(); !flushed) {
+		return flushed;
 	}
 
 	const auto header = "Sessions "
@@ -767,6 +775,8 @@ Result TextWriter::writeWebSessions(const Data::SessionsList &data) {
 		+ JoinList(kLineBreak, list);
 	if (const auto result = file->writeBlock(full); !result) {
 		return result;
+	} else if (const auto flushed = file->flush(); !flushed) {
+		return flushed;
 	}
 
 	const auto header = "Web sessions "
@@ -826,36 +836,42 @@ Result TextWriter::validateDialogsMode(bool isLeftChannel) {
 		isLeftChannel ? "lists/left_chats.txt" : "lists/chats.txt");
 }
 
-Result TextWriter::writeDialogSlice(const Data::MessagesSlice &data) {
+void TextWriter::writeDialogSlice(
+		std::shared_ptr<const Data::MessagesSlice> data,
+		Fn<void(FnMut<void()>)> runner,
+		FnMut<void(Result)> done) {
 	Expects(_chat != nullptr);
-	Expects(!data.list.empty());
+	Expects(!data->list.empty());
 
 	auto list = std::vector<QByteArray>();
-	list.reserve(data.list.size());
-	for (const auto &message : data.list) {
+	list.reserve(data->list.size());
+	for (const auto &message : data->list) {
 		if (Data::SkipMessageByDate(message, _settings)) {
 			continue;
 		}
 		list.push_back(SerializeMessage(
 			message,
-			data.peers,
+			data->peers,
 			_environment.internalLinksDomain));
 		++_messagesCount;
 	}
 	if (list.empty()) {
-		return Result::Success();
+		done(Result::Success());
+		return;
 	}
 	const auto full = _chat->empty()
 		? JoinList(kLineBreak, list)
 		: kLineBreak + JoinList(kLineBreak, list);
-	return _chat->writeBlock(full);
+	done(_chat->writeBlock(full));
 }
 
 Result TextWriter::writeDialogEnd() {
 	Expects(_chats != nullptr);
 	Expects(_chat != nullptr);
 
-	_chat = nullptr;
+	if (const auto result = base::take(_chat)->flush(); !result) {
+		return result;
+	}
 
 	using Type = Data::DialogInfo::Type;
 	const auto TypeString = [](Type type) {
@@ -944,12 +960,16 @@ Result TextWriter::writeChatsStart(
 }
 
 Result TextWriter::writeChatsEnd() {
-	_chats = nullptr;
+	if (const auto chats = base::take(_chats)) {
+		return chats->flush();
+	}
 	return Result::Success();
 }
 
 Result TextWriter::finish() {
-	return Result::Success();
+	Expects(_summary != nullptr);
+
+	return _summary->flush();
 }
 
 QString TextWriter::mainFilePath() {
@@ -40,7 +40,10 @@ public:
 
 	Result writeDialogsStart(const Data::DialogsInfo &data) override;
 	Result writeDialogStart(const Data::DialogInfo &data) override;
-	Result writeDialogSlice(const Data::MessagesSlice &data) override;
+	void writeDialogSlice(
+		std::shared_ptr<const Data::MessagesSlice> data,
+		Fn<void(FnMut<void()>)> runner,
+		FnMut<void(Result)> done) override;
 	Result writeDialogEnd() override;
 	Result writeDialogsEnd() override;
 
@@ -942,7 +942,12 @@ not_null<HistoryItem*> History::addNewItem(
 		bool unread) {
 	Expects(!isBuildingFrontBlock());
 
-	addItemToBlock(item);
+	if (hasUnloadedBelow()) {
+		// The view will be created when the bottom views are restored.
+		_unloadedBelow.insert(begin(_unloadedBelow), { item->id, 0 });
+	} else {
+		addItemToBlock(item);
+	}
 
 	if (!unread && IsServerMsgId(item->id)) {
 		if (const auto sharedMediaTypes = item->sharedMediaTypes()) {
@@ -1604,6 +1609,7 @@ void History::inboxRead(MsgId upTo) {
 	}
 
 	_firstUnreadView = nullptr;
+	_unloadedUnread.firstId = 0;
 	Auth().notifications().clearFromHistory(this);
 }
 
@@ -1639,6 +1645,12 @@ MsgId History::loadAroundId() const {
 }
 
 HistoryItem *History::lastAvailableMessage() const {
+	for (const auto &unloaded : _unloadedBelow) {
+		const auto item = App::histItemById(channelId(), unloaded.id);
+		if (item && item->history() == this && !item->mainView()) {
+			return item;
+		}
+	}
 	return isEmpty() ? nullptr : blocks.back()->messages.back()->data().get();
 }
 
@@ -1661,7 +1673,10 @@ void History::setUnreadCount(int newUnreadCount) {
 			return newUnreadCount - count;
 		};
 		if (newUnreadCount == 1) {
-			if (loadedAtBottom()) {
+			if (loadedAtBottom() && hasUnloadedBelow()) {
+				_firstUnreadView = nullptr;
+				_unloadedUnread.firstId = _unloadedBelow.front().id;
+			} else if (loadedAtBottom()) {
 				_firstUnreadView = !isEmpty()
 					? blocks.back()->messages.back().get()
 					: nullptr;
@@ -1675,7 +1690,10 @@ void History::setUnreadCount(int newUnreadCount) {
 				setInboxReadTill(last);
 			}
 		} else {
-			if (!_firstUnreadView && !_unreadBarView && loadedAtBottom()) {
+			if (!_firstUnreadView
+				&& !_unreadBarView
+				&& loadedAtBottom()
+				&& !hasUnloadedBelow()) {
 				calculateFirstUnreadMessage();
 			}
 		}
@@ -1932,6 +1950,7 @@ void History::destroyUnreadBar() {
 	if (const auto view = base::take(_unreadBarView)) {
 		view->destroyUnreadBar();
 	}
+	_unloadedUnread.barId = 0;
 }
 
 bool History::hasNotFreezedUnreadBar() const {
@@ -1947,6 +1966,7 @@ bool History::hasNotFreezedUnreadBar() const {
 
 void History::unsetFirstUnreadMessage() {
 	_firstUnreadView = nullptr;
+	_unloadedUnread.firstId = 0;
 }
 
 HistoryView::Element *History::unreadBar() const {
@@ -2400,7 +2420,7 @@ MsgId History::msgIdForRead() const {
 }
 
 HistoryItem *History::lastSentMessage() const {
-	if (!loadedAtBottom()) {
+	if (!loadedAtBottom() || hasUnloadedBelow()) {
 		return nullptr;
 	}
 	for (const auto &block : base::reversed(blocks)) {
@@ -2429,12 +2449,14 @@ void History::resizeToWidth(int newWidth) {
 	_flags &= ~(Flag::f_has_pending_resized_items);
 
 	_width = newWidth;
-	int y = 0;
+
+	// Unloaded views keep the height they had when they were unloaded.
+	int y = _unloadedAboveHeight;
 	for (const auto &block : blocks) {
 		block->setY(y);
 		y += block->resizeGetHeight(newWidth, resizeAllItems);
 	}
-	_height = y;
+	_height = y + _unloadedBelowHeight;
 }
 
 ChannelId History::channelId() const {
@@ -2669,6 +2691,249 @@ void History::unloadBlocks() {
 	clearBlocks(true);
 }
 
+void History::freezeTextsOutside(int from, int till) {
+	for (const auto &block : blocks) {
+		const auto blockTop = block->y();
+		const auto blockVisible = (blockTop < till)
+			&& (blockTop + block->height() > from);
+		for (const auto &view : block->messages) {
+			const auto top = blockTop + view->y();
+			if (!blockVisible
+				|| top >= till
+				|| top + view->height() <= from) {
+				view->data()->freezeText();
+			}
+		}
+	}
+}
+
+int64 History::textMemoryUsage() const {
+	auto result = int64(0);
+	for (const auto &block : blocks) {
+		for (const auto &view : block->messages) {
+			result += view->data()->textMemoryUsage();
+		}
+	}
+	return result;
+}
+
+bool History::unloadBlocksOutside(int from, int till) {
+	if (isBuildingFrontBlock()) {
+		return false;
+	}
+
+	// Always keep at least one block loaded.
+	const auto count = int(blocks.size());
+	auto above = 0;
+	while (above + 1 < count) {
+		const auto block = blocks[above].get();
+		if (block->y() + block->height() > from) {
+			break;
+		}
+		++above;
+	}
+	auto below = 0;
+	while (above + below + 1 < count) {
+		const auto block = blocks[count - below - 1].get();
+		if (block->y() < till) {
+			break;
+		}
+		++below;
+	}
+	if (!above && !below) {
+		return false;
+	}
+
+	const auto firstUnread = _firstUnreadView
+		? _firstUnreadView->data().get()
+		: nullptr;
+	const auto unreadBar = _unreadBarView
+		? _unreadBarView->Get<HistoryView::UnreadBar>()
+		: nullptr;
+	const auto unreadBarItem = unreadBar
+		? _unreadBarView->data().get()
+		: nullptr;
+	const auto unreadBarCount = unreadBar ? unreadBar->count : 0;
+	const auto unreadBarFreezed = unreadBar && unreadBar->freezed;
+
+	if (above) {
+		if (_unloadedAbove.empty()) {
+			_unloadedAboveLoadedAtTop = _loadedAtTop;
+		}
+		for (auto i = 0; i != above; ++i) {
+			for (const auto &view : blocks[i]->messages) {
+				const auto height = view->height();
+				_unloadedAbove.push_back({ view->data()->id, height });
+				_unloadedAboveHeight += height;
+			}
+		}
+		_loadedAtTop = false;
+	}
+	if (below) {
+		for (auto i = count; i != count - below;) {
+			const auto &block = blocks[--i];
+			for (const auto &view : base::reversed(block->messages)) {
+				const auto height = view->height();
+				_unloadedBelow.push_back({ view->data()->id, height });
+				_unloadedBelowHeight += height;
+			}
+		}
+	}
+	unloadBlocksRange(count - below, count);
+	unloadBlocksRange(0, above);
+
+	// Remember where the unread bar was to show it again on restore.
+	if (firstUnread && !firstUnread->mainView()) {
+		_unloadedUnread.firstId = firstUnread->id;
+	}
+	if (unreadBarItem && !unreadBarItem->mainView()) {
+		_unloadedUnread.barId = unreadBarItem->id;
+		_unloadedUnread.barCount = unreadBarCount;
+		_unloadedUnread.barFreezed = unreadBarFreezed;
+	}
+	setHasPendingResizedItems();
+	Auth().data().notifyHistoryChangeDelayed(this);
+	return true;
+}
+
+void History::unloadBlocksRange(int from, int till) {
+	if (from == till) {
+		return;
+	}
+
+	// Views are destroyed together with their blocks, so we only forget
+	// the pointers to them and relayout the neighbour views once.
+	for (auto i = from; i != till; ++i) {
+		for (const auto &view : blocks[i]->messages) {
+			if (_joinedMessage == view->data()) {
+				_joinedMessage = nullptr;
+			}
+			if (_firstUnreadView == view.get()) {
+				_firstUnreadView = nullptr;
+			}
+			if (_unreadBarView == view.get()) {
+				_unreadBarView = nullptr;
+			}
+			if (scrollTopItem == view.get()) {
+				scrollTopItem = nullptr;
+			}
+		}
+	}
+	blocks.erase(blocks.begin() + from, blocks.begin() + till);
+	for (auto i = from, count = int(blocks.size()); i != count; ++i) {
+		blocks[i]->setIndexInHistory(i);
+	}
+	if (from < blocks.size()) {
+		blocks[from]->messages.front()->previousInBlocksChanged();
+	} else if (!blocks.empty()) {
+		blocks.back()->messages.back()->nextInBlocksRemoved();
+	}
+}
+
+bool History::hasUnloadedAbove() const {
+	return !_unloadedAbove.empty();
+}
+
+bool History::hasUnloadedBelow() const {
+	return !_unloadedBelow.empty();
+}
+
+std::vector<not_null<HistoryItem*>> History::takeUnloaded(
+		std::vector<UnloadedView> &views,
+		int &height,
+		int count) {
+	auto result = std::vector<not_null<HistoryItem*>>();
+	result.reserve(std::min(count, int(views.size())));
+	while (!views.empty() && int(result.size()) < count) {
+		const auto item = App::histItemById(channelId(), views.back().id);
+		height -= views.back().height;
+		views.pop_back();
+
+		// Items could be destroyed or shown again while they were unloaded.
+		if (item && item->history() == this && !item->mainView()) {
+			result.push_back(item);
+		}
+	}
+	if (views.empty()) {
+		height = 0;
+	}
+	return result;
+}
+
+void History::restoreUnloadedUnread() {
+	const auto restoredView = [&](MsgId id) -> HistoryView::Element* {
+		if (const auto item = id ? App::histItemById(channelId(), id) : nullptr) {
+			return (item->history() == this) ? item->mainView() : nullptr;
+		}
+		return nullptr;
+	};
+	if (const auto view = restoredView(_unloadedUnread.firstId)) {
+		_firstUnreadView = view;
+		_unloadedUnread.firstId = 0;
+	}
+	if (const auto view = restoredView(_unloadedUnread.barId)) {
+		if (!_unreadBarView) {
+			_unreadBarView = view;
+			view->setUnreadBarCount(_unloadedUnread.barCount);
+			if (_unloadedUnread.barFreezed) {
+				view->setUnreadBarFreezed();
+			}
+		}
+		_unloadedUnread.barId = 0;
+	}
+	if (!hasUnloadedAbove() && !hasUnloadedBelow()) {
+		_unloadedUnread = UnloadedUnread();
+	}
+}
+
+bool History::restoreUnloadedAbove(int count) {
+	const auto items = takeUnloaded(
+		_unloadedAbove,
+		_unloadedAboveHeight,
+		count);
+	if (_unloadedAbove.empty()) {
+		_loadedAtTop = _unloadedAboveLoadedAtTop;
+	}
+	setHasPendingResizedItems();
+	if (items.empty()) {
+		return false;
+	}
+	startBuildingFrontBlock(items.size());
+	for (const auto item : base::reversed(items)) {
+		addItemToBlock(item);
+	}
+	finishBuildingFrontBlock();
+
+	restoreUnloadedUnread();
+	checkJoinedMessage();
+	Auth().data().notifyHistoryChangeDelayed(this);
+	return true;
+}
+
+bool History::restoreUnloadedBelow(int count) {
+	Expects(!isBuildingFrontBlock());
+
+	// Unloading views doesn't change _loadedAtBottom, new messages that
+	// arrive while the bottom views are unloaded are queued in _unloadedBelow.
+	const auto items = takeUnloaded(
+		_unloadedBelow,
+		_unloadedBelowHeight,
+		count);
+	setHasPendingResizedItems();
+	if (items.empty()) {
+		return false;
+	}
+	for (const auto item : items) {
+		addItemToBlock(item);
+	}
+
+	restoreUnloadedUnread();
+	checkJoinedMessage();
+	checkLastMessage();
+	Auth().data().notifyHistoryChangeDelayed(this);
+	return true;
+}
+
 void History::clearBlocks(bool leaveItems) {
 	_unreadBarView = nullptr;
 	_firstUnreadView = nullptr;
@@ -2685,6 +2950,11 @@ void History::clearBlocks(bool leaveItems) {
 		Auth().data().notifyHistoryCleared(this);
 	}
 	blocks.clear();
+	_unloadedAbove.clear();
+	_unloadedBelow.clear();
+	_unloadedAboveHeight = _unloadedBelowHeight = 0;
+	_unloadedAboveLoadedAtTop = false;
+	_unloadedUnread = UnloadedUnread();
 	if (leaveItems) {
 		lastKeyboardInited = false;
 	} else {
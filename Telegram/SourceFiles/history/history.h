@@ -135,6 +135,27 @@ public:
 	void clear();
 	void markFullyLoaded();
 	void unloadBlocks();
+
+	// Freezes texts of items outside [from, till) in history coordinates.
+	void freezeTextsOutside(int from, int till);
+	int64 textMemoryUsage() const;
+
+	// Destroys views of whole blocks lying outside [from, till) in history
+	// coordinates, remembering the item ids, so that they can be shown
+	// again without requesting them from the server. Only the views and
+	// their layout are freed, the items themselves stay in memory and
+	// loadedAtBottom() is not changed. The unloaded views still count
+	// in height() with their last heights.
+	// Returns false if nothing was unloaded.
+	bool unloadBlocksOutside(int from, int till);
+	bool hasUnloadedAbove() const;
+	bool hasUnloadedBelow() const;
+
+	// Restore up to count views of the unloaded items nearest to the
+	// loaded part. Returns false if no items were available anymore.
+	bool restoreUnloadedAbove(int count);
+	bool restoreUnloadedBelow(int count);
+
 	void clearUpTill(MsgId availableMinId);
 
 	void applyGroupAdminChanges(
@@ -413,7 +434,24 @@ private:
 	// calls the required previousItemChanged()
 	void removeBlock(not_null<HistoryBlock*> block);
 
+	struct UnloadedView {
+		MsgId id = 0;
+		int height = 0;
+	};
+	struct UnloadedUnread {
+		MsgId firstId = 0;
+		MsgId barId = 0;
+		int barCount = 0;
+		bool barFreezed = false;
+	};
+
 	void clearBlocks(bool leaveItems);
+	void unloadBlocksRange(int from, int till);
+	std::vector<not_null<HistoryItem*>> takeUnloaded(
+		std::vector<UnloadedView> &views,
+		int &height,
+		int count);
+	void restoreUnloadedUnread();
 
 	not_null<HistoryItem*> addNewItem(
 		not_null<HistoryItem*> item,
@@ -494,6 +532,14 @@ private:
 	bool _loadedAtTop = false;
 	bool _loadedAtBottom = true;
 
+	// Items with unloaded views, the nearest to blocks are the last.
+	std::vector<UnloadedView> _unloadedAbove;
+	std::vector<UnloadedView> _unloadedBelow;
+	int _unloadedAboveHeight = 0;
+	int _unloadedBelowHeight = 0;
+	bool _unloadedAboveLoadedAtTop = false;
+	UnloadedUnread _unloadedUnread;
+
 	std::optional<MsgId> _inboxReadBefore;
 	std::optional<MsgId> _outboxReadBefore;
 	std::optional<int> _unreadCount;
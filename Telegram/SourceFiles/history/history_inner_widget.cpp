@@ -42,6 +42,10 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 namespace {
 
 constexpr auto kScrollDateHideTimeout = 1000;
+constexpr auto kFreezeTextsTimeout = 3000;
+
+// Texts of items farther than this many screens away are frozen.
+constexpr auto kFreezeTextsDistance = 3;
 
 // Helper binary search for an item in a list that is not completely
 // above the given top of the visible area or below the given bottom of the visible area
@@ -117,7 +121,8 @@ HistoryInner::HistoryInner(
 , _widget(historyWidget)
 , _scroll(scroll)
 , _scrollDateCheck([this] { scrollDateCheck(); })
-, _scrollDateHideTimer([this] { scrollDateHideByTimer(); }) {
+, _scrollDateHideTimer([this] { scrollDateHideByTimer(); })
+, _freezeTextsTimer([this] { freezeFarTexts(); }) {
 	_touchSelectTimer.setSingleShot(true);
 	connect(&_touchSelectTimer, SIGNAL(timeout()), this, SLOT(onTouchSelect()));
 
@@ -226,6 +231,15 @@ void HistoryInner::enumerateItemsInHistory(History *history, int historytop, Met
 		return;
 	}
 
+	// The visible area could be in the place of the unloaded views.
+	const auto &firstBlock = history->blocks.front();
+	const auto &lastBlock = history->blocks.back();
+	const auto loadedTop = historytop + firstBlock->y();
+	const auto loadedBottom = historytop + lastBlock->y() + lastBlock->height();
+	if (_visibleAreaBottom <= loadedTop || loadedBottom <= _visibleAreaTop) {
+		return;
+	}
+
 	auto searchEdge = TopToBottom ? _visibleAreaTop : _visibleAreaBottom;
 
 	// Binary search for blockIndex of the first block that is not completely below the visible area.
@@ -2079,6 +2093,27 @@ void HistoryInner::visibleAreaUpdated(int top, int bottom) {
 	} else {
 		scrollDateHideByTimer();
 	}
+	_freezeTextsTimer.callOnce(kFreezeTextsTimeout);
+}
+
+void HistoryInner::freezeFarTexts() {
+	const auto distance = kFreezeTextsDistance
+		* (_visibleAreaBottom - _visibleAreaTop);
+	const auto freeze = [&](not_null<History*> history, int top) {
+		if (top >= 0) {
+			history->freezeTextsOutside(
+				_visibleAreaTop - top - distance,
+				_visibleAreaBottom - top + distance);
+		}
+	};
+	freeze(_history, historyTop());
+	if (_migrated) {
+		freeze(_migrated, migratedTop());
+	}
+	DEBUG_LOG(("History: texts of %1 use %2 bytes."
+		).arg(_history->peer->id
+		).arg(_history->textMemoryUsage()
+			+ (_migrated ? _migrated->textMemoryUsage() : 0)));
 }
 
 bool HistoryInner::displayScrollDate() const {
@@ -2194,6 +2229,11 @@ void HistoryInner::leaveEventHook(QEvent *e) {
 }
 
 HistoryInner::~HistoryInner() {
+	// Nothing of this history is visible anymore.
+	_history->freezeTextsOutside(0, 0);
+	if (_migrated) {
+		_migrated->freezeTextsOutside(0, 0);
+	}
 	delete _menu;
 	_mouseAction = MouseAction::None;
 }
@@ -190,6 +190,7 @@ private:
 
 	void scrollDateCheck();
 	void scrollDateHideByTimer();
+	void freezeFarTexts();
 	bool canHaveFromUserpics() const;
 	void mouseActionStart(const QPoint &screenPos, Qt::MouseButton button);
 	void mouseActionUpdate();
@@ -360,6 +361,7 @@ private:
 	Animation _scrollDateOpacity;
 	SingleQueuedInvokation _scrollDateCheck;
 	base::Timer _scrollDateHideTimer;
+	base::Timer _freezeTextsTimer;
 	Element *_scrollDateLastItem = nullptr;
 	int _scrollDateLastItemTop = 0;
 	ClickHandlerPtr _scrollDateLink;
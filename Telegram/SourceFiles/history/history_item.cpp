@@ -567,8 +567,60 @@ MessageGroupId HistoryItem::groupId() const {
 	return _groupId;
 }
 
+Text &HistoryItem::text() {
+	if (_frozenText) {
+		const auto frozen = base::take(_frozenText);
+		const auto textWidth = _textWidth;
+		const auto textHeight = _textHeight;
+		setText(frozen->source);
+		if (!frozen->skipBlock.isEmpty()) {
+			_text.updateSkipBlock(
+				frozen->skipBlock.width(),
+				frozen->skipBlock.height());
+		}
+
+		// The same text with the same skip block, cached sizes are valid.
+		_textWidth = textWidth;
+		_textHeight = textHeight;
+	}
+	return _text;
+}
+
+const Text &HistoryItem::text() const {
+	return const_cast<HistoryItem*>(this)->text();
+}
+
+void HistoryItem::freezeText() {
+	if (_frozenText || _text.isEmpty() || !allowsFreezeText()) {
+		return;
+	}
+	auto frozen = std::make_unique<FrozenText>();
+	frozen->source = _text.originalTextWithEntities();
+	frozen->skipBlock = _text.skipBlockSize();
+	_text = Text(int(st::msgMinWidth));
+	_frozenText = std::move(frozen);
+}
+
+int64 HistoryItem::textMemoryUsage() const {
+	if (!_frozenText) {
+		return _text.memoryUsage();
+	}
+	const auto &source = _frozenText->source;
+	auto result = int64(sizeof(FrozenText))
+		+ int64(source.text.capacity()) * sizeof(QChar)
+		+ int64(source.entities.capacity()) * sizeof(EntityInText);
+	for (const auto &entity : source.entities) {
+		result += int64(entity.data().size()) * sizeof(QChar);
+	}
+	return result;
+}
+
+QString HistoryItem::originalPlainText() const {
+	return _frozenText ? _frozenText->source.text : _text.originalText();
+}
+
 bool HistoryItem::isEmpty() const {
-	return _text.isEmpty()
+	return emptyText()
 		&& !_media
 		&& !Has<HistoryMessageLogEntryOriginal>();
 }
@@ -578,7 +630,7 @@ QString HistoryItem::notificationText() const {
 		if (_media) {
 			return _media->notificationText();
 		} else if (!emptyText()) {
-			return _text.originalText();
+			return originalPlainText();
 		}
 		return QString();
 	};
@@ -595,7 +647,7 @@ QString HistoryItem::inDialogsText(DrawInDialog way) const {
 		if (_media) {
 			return _media->chatsListText();
 		} else if (!emptyText()) {
-			return TextUtilities::Clean(_text.originalText());
+			return TextUtilities::Clean(originalPlainText());
 		}
 		return QString();
 	};
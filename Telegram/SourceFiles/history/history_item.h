@@ -206,9 +206,19 @@ public:
 		Text &cache) const;
 
 	bool emptyText() const {
-		return _text.isEmpty();
+		return !_frozenText && _text.isEmpty();
 	}
 
+	// Parsed text of items far from the viewport may be dropped keeping
+	// only the source text with entities, text() rebuilds it on demand.
+	Text &text();
+	const Text &text() const;
+	void freezeText();
+	bool textFrozen() const {
+		return (_frozenText != nullptr);
+	}
+	int64 textMemoryUsage() const;
+
 	bool isPinned() const;
 	bool canPin() const;
 	virtual bool allowsForward() const;
@@ -275,6 +285,10 @@ protected:
 
 	virtual void markMediaAsReadHook() {
 	}
+	virtual bool allowsFreezeText() const {
+		return false;
+	}
+	QString originalPlainText() const;
 
 	void finishEdition(int oldKeyboardTop);
 	void finishEditionToEmpty();
@@ -295,7 +309,13 @@ protected:
 
 	void setGroupId(MessageGroupId groupId);
 
+	struct FrozenText {
+		TextWithEntities source;
+		QSize skipBlock;
+	};
+
 	Text _text = { int(st::msgMinWidth) };
+	std::unique_ptr<FrozenText> _frozenText;
 	int _textWidth = -1;
 	int _textHeight = 0;
 
@@ -2232,7 +2232,7 @@ void HistoryGif::draw(Painter &p, const QRect &r, TextSelection selection, TimeM
 	auto displayLoading = (item->id < 0) || _data->displayLoading();
 	auto selected = (selection == FullSelection);
 
-	if (loaded
+	if ((loaded || _data->canBeStreamed())
 		&& cAutoPlayGif()
 		&& !_gif
 		&& !_gif.isBad()
@@ -2849,7 +2849,8 @@ void HistoryGif::playAnimation(bool autoplay) {
 	using Mode = Media::Clip::Reader::Mode;
 	if (_gif) {
 		stopAnimation();
-	} else if (_data->loaded(DocumentData::FilePathResolveChecked)) {
+	} else if (_data->loaded(DocumentData::FilePathResolveChecked)
+		|| _data->canBeStreamed()) {
 		if (!cAutoPlayGif()) {
 			Auth().data().stopAutoplayAnimations();
 		}
@@ -970,6 +970,7 @@ Storage::SharedMediaTypesMask HistoryMessage::sharedMediaTypes() const {
 }
 
 void HistoryMessage::setText(const TextWithEntities &textWithEntities) {
+	_frozenText = nullptr;
 	for_const (auto &entity, textWithEntities.entities) {
 		auto type = entity.type();
 		if (type == EntityInTextUrl
@@ -1001,6 +1002,7 @@ void HistoryMessage::setText(const TextWithEntities &textWithEntities) {
 }
 
 void HistoryMessage::setEmptyText() {
+	_frozenText = nullptr;
 	_text.setMarkedText(
 		st::messageTextStyle,
 		{ QString(), EntitiesInText() },
@@ -1055,6 +1057,8 @@ void HistoryMessage::setReplyMarkup(const MTPReplyMarkup *markup) {
 TextWithEntities HistoryMessage::originalText() const {
 	if (emptyText()) {
 		return { QString(), EntitiesInText() };
+	} else if (textFrozen()) {
+		return _frozenText->source;
 	}
 	return _text.originalTextWithEntities();
 }
@@ -1063,11 +1067,11 @@ TextWithEntities HistoryMessage::clipboardText() const {
 	if (emptyText()) {
 		return { QString(), EntitiesInText() };
 	}
-	return _text.originalTextWithEntities(AllTextSelection, ExpandLinksAll);
+	return text().originalTextWithEntities(AllTextSelection, ExpandLinksAll);
 }
 
 bool HistoryMessage::textHasLinks() const {
-	return emptyText() ? false : _text.hasLinks();
+	return emptyText() ? false : text().hasLinks();
 }
 
 void HistoryMessage::setViewsCount(int32 count) {
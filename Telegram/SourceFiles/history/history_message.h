@@ -145,6 +145,9 @@ public:
 
 private:
 	void setEmptyText();
+	bool allowsFreezeText() const override {
+		return true;
+	}
 	bool hasAdminBadge() const {
 		return _flags & MTPDmessage_ClientFlag::f_has_admin_badge;
 	}
@@ -88,6 +88,7 @@ namespace {
 constexpr auto kMessagesPerPageFirst = 30;
 constexpr auto kMessagesPerPage = 50;
 constexpr auto kPreloadHeightsCount = 3; // when 3 screens to scroll left make a preload request
+constexpr auto kUnloadHeightsCount = 10; // blocks farther than 10 screens away are unloaded
 constexpr auto kTabbedSelectorToggleTooltipTimeoutMs = 3000;
 constexpr auto kTabbedSelectorToggleTooltipCount = 3;
 constexpr auto kScrollToVoiceAfterScrolledMs = 1000;
@@ -2644,7 +2645,7 @@ void HistoryWidget::windowShown() {
 bool HistoryWidget::doWeReadServerHistory() const {
 	if (!_history || !_list) return true;
 	if (_firstLoadRequest || _a_show.animating()) return false;
-	if (_history->loadedAtBottom()) {
+	if (_history->loadedAtBottom() && !_history->hasUnloadedBelow()) {
 		int scrollTop = _scroll->scrollTop();
 		if (scrollTop + 1 > _scroll->scrollTopMax()) return true;
 
@@ -2736,6 +2737,8 @@ void HistoryWidget::loadMessages() {
 	auto from = loadMigrated ? _migrated : _history;
 	if (from->loadedAtTop()) {
 		return;
+	} else if (from->hasUnloadedAbove()) {
+		return queueHistoryWindowUpdate();
 	}
 
 	auto offsetId = from->minMsgId();
@@ -2771,7 +2774,9 @@ void HistoryWidget::loadMessagesDown() {
 
 	auto loadMigrated = _migrated && !(_migrated->isEmpty() || _migrated->loadedAtBottom() || (!_history->isEmpty() && !_history->loadedAtTop()));
 	auto from = loadMigrated ? _migrated : _history;
-	if (from->loadedAtBottom()) {
+	if (from->hasUnloadedBelow()) {
+		return queueHistoryWindowUpdate();
+	} else if (from->loadedAtBottom()) {
 		return;
 	}
 
@@ -2929,6 +2934,105 @@ void HistoryWidget::preloadHistoryByScroll() {
 	if (scrollTop <= kPreloadHeightsCount * scrollHeight) {
 		loadMessages();
 	}
+	queueHistoryWindowUpdate();
+}
+
+void HistoryWidget::queueHistoryWindowUpdate() {
+	if (_historyWindowUpdateQueued) {
+		return;
+	}
+	_historyWindowUpdateQueued = true;
+	InvokeQueued(this, [=] { updateHistoryWindow(); });
+}
+
+void HistoryWidget::updateHistoryWindow() {
+	_historyWindowUpdateQueued = false;
+	if (!_history
+		|| _firstLoadRequest
+		|| _scroll->isHidden()
+		|| _scrollToAnimation.animating()
+		|| hasPendingResizedItems()) {
+		return;
+	}
+
+	const auto migrated = (_migrated && !_migrated->isEmpty())
+		? _migrated
+		: nullptr;
+	if (!migrated && _history->isEmpty()) {
+		return;
+	}
+	const auto top = migrated ? migrated : _history;
+	const auto bottom = (migrated && _history->isEmpty())
+		? migrated
+		: _history;
+	const auto topShift = (top == migrated)
+		? _list->migratedTop()
+		: _list->historyTop();
+	const auto bottomShift = (bottom == migrated)
+		? _list->migratedTop()
+		: _list->historyTop();
+
+	// The unloaded views keep their place, so we look at the distance
+	// from the visible area to the edges of the loaded views.
+	const auto scrollTop = _scroll->scrollTop();
+	const auto scrollHeight = _scroll->height();
+	const auto preload = kPreloadHeightsCount * scrollHeight;
+	const auto loadedTop = topShift + top->blocks.front()->y();
+	const auto &last = bottom->blocks.back();
+	const auto loadedBottom = bottomShift + last->y() + last->height();
+
+	// First show again the unloaded items we're approaching.
+	auto changed = false;
+	if (scrollTop <= loadedTop + preload && top->hasUnloadedAbove()) {
+		if (top->restoreUnloadedAbove(kMessagesPerPage)) {
+			changed = true;
+		} else {
+			loadMessages();
+		}
+	}
+	if (scrollTop + scrollHeight + preload >= loadedBottom
+		&& bottom->hasUnloadedBelow()) {
+		if (bottom->restoreUnloadedBelow(kMessagesPerPage)) {
+			changed = true;
+		} else {
+			loadMessagesDown();
+		}
+	}
+
+	// Then unload the blocks far from the visible area. We don't unload
+	// blocks between the migrated and the channel histories, so that no
+	// gap appears in the middle of the displayed messages. While a slice
+	// is being loaded we don't unload anything either, because it will be
+	// attached next to the blocks that are loaded when it arrives.
+	if (!changed && !_preloadRequest && !_preloadDownRequest) {
+		const auto distance = kUnloadHeightsCount * scrollHeight;
+		const auto from = scrollTop - distance;
+		const auto till = scrollTop + scrollHeight + distance;
+		const auto kNoLimit = std::numeric_limits<int>::max();
+		if (migrated) {
+			const auto shift = _list->migratedTop();
+			if (migrated->unloadBlocksOutside(
+					from - shift,
+					(bottom == migrated) ? (till - shift) : kNoLimit)) {
+				changed = true;
+			}
+		}
+		if (!_history->isEmpty()) {
+			const auto shift = _list->historyTop();
+			if (_history->unloadBlocksOutside(
+					migrated ? -kNoLimit : (from - shift),
+					till - shift)) {
+				changed = true;
+			}
+		}
+	}
+	if (changed) {
+		// History scroll state is kept by scrollTopItem and scrollTopOffset.
+		updateHistoryGeometry(false, true, { ScrollChangeAdd, 0 });
+
+		// We could jump far into the unloaded part, continue restoring.
+		queueHistoryWindowUpdate();
+	}
 }
 
 void HistoryWidget::checkReplyReturns() {
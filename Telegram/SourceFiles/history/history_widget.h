@@ -740,6 +740,8 @@ private:
 	int countInitialScrollTop();
 	int countAutomaticScrollTop();
 	void preloadHistoryByScroll();
+	void queueHistoryWindowUpdate();
+	void updateHistoryWindow();
 	void checkReplyReturns();
 	void scrollToAnimationCallback(FullMsgId attachToId);
 
@@ -757,6 +759,7 @@ private:
 	mtpRequestId _firstLoadRequest = 0;
 	mtpRequestId _preloadRequest = 0;
 	mtpRequestId _preloadDownRequest = 0;
+	bool _historyWindowUpdateQueued = false;
 
 	MsgId _delayedShowAtMsgId = -1;
 	mtpRequestId _delayedShowAtRequest = 0;
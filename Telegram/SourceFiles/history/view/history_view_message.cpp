@@ -250,17 +250,17 @@ QSize Message::performCountOptimalSize() {
 		auto mediaOnTop = (mediaDisplayed && media->isBubbleTop()) || (entry && entry->isBubbleTop());
 
 		if (mediaOnBottom) {
-			if (item->_text.removeSkipBlock()) {
+			if (item->text().removeSkipBlock()) {
 				item->_textWidth = -1;
 				item->_textHeight = 0;
 			}
-		} else if (item->_text.updateSkipBlock(skipBlockWidth(), skipBlockHeight())) {
+		} else if (item->text().updateSkipBlock(skipBlockWidth(), skipBlockHeight())) {
 			item->_textWidth = -1;
 			item->_textHeight = 0;
 		}
 
 		maxWidth = plainMaxWidth();
-		minHeight = hasVisibleText() ? item->_text.minHeight() : 0;
+		minHeight = hasVisibleText() ? item->text().minHeight() : 0;
 		if (!mediaOnBottom) {
 			minHeight += st::msgPadding.bottom();
 			if (mediaDisplayed) minHeight += st::mediaInBubbleSkip;
@@ -613,7 +613,7 @@ void Message::paintText(Painter &p, QRect &trect, TextSelection selection) const
 	auto selected = (selection == FullSelection);
 	p.setPen(outbg ? (selected ? st::historyTextOutFgSelected : st::historyTextOutFg) : (selected ? st::historyTextInFgSelected : st::historyTextInFg));
 	p.setFont(st::msgFont);
-	item->_text.draw(p, trect.x(), trect.y(), trect.width(), style::al_left, 0, -1, selection);
+	item->text().draw(p, trect.x(), trect.y(), trect.width(), style::al_left, 0, -1, selection);
 }
 
 PointState Message::pointState(QPoint point) const {
@@ -755,7 +755,7 @@ TextState Message::textState(
 				result = entry->textState(
 					point - QPoint(entryLeft, entryTop),
 					request);
-				result.symbol += item->_text.length() + (mediaDisplayed ? media->fullSelectionLength() : 0);
+				result.symbol += item->text().length() + (mediaDisplayed ? media->fullSelectionLength() : 0);
 			}
 		}
 
@@ -780,18 +780,18 @@ TextState Message::textState(
 
 				if (point.y() >= mediaTop && point.y() < mediaTop + mediaHeight) {
 					result = media->textState(point - QPoint(mediaLeft, mediaTop), request);
-					result.symbol += item->_text.length();
+					result.symbol += item->text().length();
 				} else if (getStateText(point, trect, &result, request)) {
 					checkForPointInTime();
 					return result;
 				} else if (point.y() >= trect.y() + trect.height()) {
-					result.symbol = item->_text.length();
+					result.symbol = item->text().length();
 				}
 			} else if (getStateText(point, trect, &result, request)) {
 				checkForPointInTime();
 				return result;
 			} else if (point.y() >= trect.y() + trect.height()) {
-				result.symbol = item->_text.length();
+				result.symbol = item->text().length();
 			}
 		}
 		checkForPointInTime();
@@ -813,7 +813,7 @@ TextState Message::textState(
 		}
 	} else if (media && media->isDisplayed()) {
 		result = media->textState(point - g.topLeft(), request);
-		result.symbol += item->_text.length();
+		result.symbol += item->text().length();
 	}
 
 	if (keyboard && !item->isLogEntry()) {
@@ -953,7 +953,7 @@ bool Message::getStateText(
 	}
 	const auto item = message();
 	if (base::in_range(point.y(), trect.y(), trect.y() + trect.height())) {
-		*outResult = TextState(item, item->_text.getState(
+		*outResult = TextState(item, item->text().getState(
 			point - trect.topLeft(),
 			trect.width(),
 			request.forText()));
@@ -1021,7 +1021,7 @@ TextWithEntities Message::selectedText(TextSelection selection) const {
 	const auto media = this->media();
 
 	TextWithEntities logEntryOriginalResult;
-	auto textResult = item->_text.originalTextWithEntities(
+	auto textResult = item->text().originalTextWithEntities(
 		selection,
 		ExpandLinksAll);
 	auto skipped = skipTextSelection(selection);
@@ -1057,8 +1057,8 @@ TextSelection Message::adjustSelection(
 	const auto item = message();
 	const auto media = this->media();
 
-	auto result = item->_text.adjustSelection(selection, type);
-	auto beforeMediaLength = item->_text.length();
+	auto result = item->text().adjustSelection(selection, type);
+	auto beforeMediaLength = item->text().length();
 	if (selection.to <= beforeMediaLength) {
 		return result;
 	}
@@ -1255,7 +1255,7 @@ int Message::timeLeft() const {
 
 int Message::plainMaxWidth() const {
 	return st::msgPadding.left()
-		+ (hasVisibleText() ? message()->_text.maxWidth() : 0)
+		+ (hasVisibleText() ? message()->text().maxWidth() : 0)
 		+ st::msgPadding.right();
 }
 
@@ -1525,11 +1525,11 @@ void Message::fromNameUpdated(int width) const {
 }
 
 TextSelection Message::skipTextSelection(TextSelection selection) const {
-	return HistoryView::UnshiftItemSelection(selection, message()->_text);
+	return HistoryView::UnshiftItemSelection(selection, message()->text());
 }
 
 TextSelection Message::unskipTextSelection(TextSelection selection) const {
-	return HistoryView::ShiftItemSelection(selection, message()->_text);
+	return HistoryView::ShiftItemSelection(selection, message()->text());
 }
 
 QRect Message::countGeometry() const {
@@ -1632,7 +1632,7 @@ int Message::resizeContentGetHeight(int newWidth) {
 				auto textWidth = qMax(contentWidth - st::msgPadding.left() - st::msgPadding.right(), 1);
 				if (textWidth != item->_textWidth) {
 					item->_textWidth = textWidth;
-					item->_textHeight = item->_text.countHeight(textWidth);
+					item->_textHeight = item->text().countHeight(textWidth);
 				}
 				newHeight = item->_textHeight;
 			} else {
@@ -1754,8 +1754,8 @@ void Message::initTime() {
 			? 0
 			: st::msgDateFont->width(views->_viewsText);
 	}
-	if (item->_text.hasSkipBlock()) {
-		if (item->_text.updateSkipBlock(skipBlockWidth(), skipBlockHeight())) {
+	if (item->text().hasSkipBlock()) {
+		if (item->text().updateSkipBlock(skipBlockWidth(), skipBlockHeight())) {
 			item->_textWidth = -1;
 			item->_textHeight = 0;
 		}
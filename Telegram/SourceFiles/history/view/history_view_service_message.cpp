@@ -323,7 +323,7 @@ QSize Service::performCountCurrentSize(int newWidth) {
 	const auto item = message();
 	const auto media = this->media();
 
-	if (item->_text.isEmpty()) {
+	if (item->text().isEmpty()) {
 		item->_textHeight = 0;
 	} else {
 		auto contentWidth = newWidth;
@@ -338,7 +338,7 @@ QSize Service::performCountCurrentSize(int newWidth) {
 		auto nwidth = qMax(contentWidth - st::msgServicePadding.left() - st::msgServicePadding.right(), 0);
 		if (nwidth != item->_textWidth) {
 			item->_textWidth = nwidth;
-			item->_textHeight = item->_text.countHeight(nwidth);
+			item->_textHeight = item->text().countHeight(nwidth);
 		}
 		if (contentWidth >= maxWidth()) {
 			newHeight += minHeight();
@@ -358,8 +358,8 @@ QSize Service::performCountOptimalSize() {
 	const auto item = message();
 	const auto media = this->media();
 
-	auto maxWidth = item->_text.maxWidth() + st::msgServicePadding.left() + st::msgServicePadding.right();
-	auto minHeight = item->_text.minHeight();
+	auto maxWidth = item->text().maxWidth() + st::msgServicePadding.left() + st::msgServicePadding.right();
+	auto minHeight = item->text().minHeight();
 	if (media) {
 		media->initDimensions();
 	}
@@ -432,12 +432,12 @@ void Service::draw(
 
 	auto trect = QRect(g.left(), st::msgServiceMargin.top(), g.width(), height).marginsAdded(-st::msgServicePadding);
 
-	ServiceMessagePainter::paintComplexBubble(p, g.left(), g.width(), item->_text, trect);
+	ServiceMessagePainter::paintComplexBubble(p, g.left(), g.width(), item->text(), trect);
 
 	p.setBrush(Qt::NoBrush);
 	p.setPen(st::msgServiceFg);
 	p.setFont(st::msgServiceFont);
-	item->_text.draw(p, trect.x(), trect.y(), trect.width(), Qt::AlignCenter, 0, -1, selection, false);
+	item->text().draw(p, trect.x(), trect.y(), trect.width(), Qt::AlignCenter, 0, -1, selection, false);
 
 	p.restoreTextPalette();
 
@@ -495,7 +495,7 @@ TextState Service::textState(QPoint point, StateRequest request) const {
 	if (trect.contains(point)) {
 		auto textRequest = request.forText();
 		textRequest.align = style::al_center;
-		result = TextState(item, item->_text.getState(
+		result = TextState(item, item->text().getState(
 			point - trect.topLeft(),
 			trect.width(),
 			textRequest));
@@ -522,13 +522,13 @@ void Service::updatePressed(QPoint point) {
 }
 
 TextWithEntities Service::selectedText(TextSelection selection) const {
-	return message()->_text.originalTextWithEntities(selection);
+	return message()->text().originalTextWithEntities(selection);
 }
 
 TextSelection Service::adjustSelection(
 		TextSelection selection,
 		TextSelectType type) const {
-	return message()->_text.adjustSelection(selection, type);
+	return message()->text().adjustSelection(selection, type);
 }
 
 } // namespace HistoryView
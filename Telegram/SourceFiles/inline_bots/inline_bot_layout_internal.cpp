@@ -135,6 +135,15 @@ int Gif::resizeGetHeight(int width) {
 	return _height;
 }
 
+bool Gif::prepareThumbnail() const {
+	if (_width <= 0 || (_gif && _gif->started())) {
+		return false;
+	}
+	const auto was = _thumb.cacheKey();
+	prepareThumb(_width, st::inlineMediaHeight, countFrameSize());
+	return (_thumb.cacheKey() != was);
+}
+
 void Gif::paint(Painter &p, const QRect &clip, const PaintContext *context) const {
 	const auto document = getShownDocument();
 	document->automaticLoad(fileOrigin(), nullptr);
@@ -58,6 +58,7 @@ public:
 	bool hasRightSkip() const override {
 		return true;
 	}
+	bool prepareThumbnail() const override;
 
 	void paint(Painter &p, const QRect &clip, const PaintContext *context) const override;
 	TextState getState(
@@ -78,6 +78,12 @@ public:
 
 	virtual void preload() const;
 
+	// Prepare the thumbnail pixmap ahead of painting, if it is loaded.
+	// Returns true if some work was done.
+	virtual bool prepareThumbnail() const {
+		return false;
+	}
+
 	void update();
 	void layoutChanged();
 
@@ -12,15 +12,175 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "core/crash_reports.h"
 #include "core/launcher.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 enum LogDataType {
 	LogDataMain,
 	LogDataDebug,
 	LogDataTcp,
 	LogDataMtp,
+	LogDataMtpTrace,
 
 	LogDataCount
 };
 
+namespace {
+
+constexpr auto kLogsQueueSize = 4096; // must be a power of two
+constexpr auto kLogsFlushTimeout = crl::time_type(200);
+constexpr auto kMtpTraceMagic = 0x50544D54; // 'TMTP'
+constexpr auto kMtpTraceVersion = 2;
+constexpr auto kMtpTraceOutgoing = 0x01;
+
+struct MtpTraceFileHeader {
+	int32 magic = kMtpTraceMagic;
+	int32 version = kMtpTraceVersion;
+	int32 dayIndex = 0;
+	int32 reserved = 0;
+};
+
+static_assert(
+	sizeof(MtpTraceFileHeader) == 4 * sizeof(int32),
+	"MtpTraceFileHeader must not have padding.");
+
+struct MtpTraceRecordHeader {
+	qint64 when = 0;
+	int32 dc = 0;
+	int32 flags = 0;
+	int32 thread = 0;
+	int32 primes = 0;
+};
+
+// Record headers are written field by field, so that struct padding
+// does not get into the trace.
+constexpr auto kMtpTraceRecordHeaderSize = int(sizeof(qint64))
+	+ 4 * int(sizeof(int32));
+
+void SerializeMtpTraceRecordHeader(
+		char *to,
+		const MtpTraceRecordHeader &header) {
+	const auto write = [&](const auto &value) {
+		memcpy(to, &value, sizeof(value));
+		to += sizeof(value);
+	};
+	write(header.when);
+	write(header.dc);
+	write(header.flags);
+	write(header.thread);
+	write(header.primes);
+}
+
+MtpTraceRecordHeader DeserializeMtpTraceRecordHeader(const char *from) {
+	auto result = MtpTraceRecordHeader();
+	const auto read = [&](auto &value) {
+		memcpy(&value, from, sizeof(value));
+		from += sizeof(value);
+	};
+	read(result.when);
+	read(result.dc);
+	read(result.flags);
+	read(result.thread);
+	read(result.primes);
+	return result;
+}
+
+struct LogsEntry {
+	LogDataType type = LogDataMain;
+	QString text;
+	QByteArray binary;
+};
+
+// Bounded multi-producer queue (D. Vyukov), entries are only moved in
+// and out of preallocated cells, producers never take a lock.
+class LogsQueue {
+public:
+	LogsQueue() : _cells(std::make_unique<Cell[]>(kLogsQueueSize)) {
+		static_assert(
+			(kLogsQueueSize & (kLogsQueueSize - 1)) == 0,
+			"kLogsQueueSize must be a power of two.");
+		for (auto i = 0; i != kLogsQueueSize; ++i) {
+			_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	bool push(LogsEntry &&entry) {
+		auto position = _enqueue.load(std::memory_order_relaxed);
+		while (true) {
+			auto &cell = _cells[position & kMask];
+			const auto sequence = cell.sequence.load(
+				std::memory_order_acquire);
+			const auto difference = intptr_t(sequence) - intptr_t(position);
+			if (!difference) {
+				if (_enqueue.compare_exchange_weak(
+						position,
+						position + 1,
+						std::memory_order_relaxed)) {
+					cell.entry = std::move(entry);
+					cell.sequence.store(
+						position + 1,
+						std::memory_order_release);
+					return true;
+				}
+			} else if (difference < 0) {
+				return false;
+			} else {
+				position = _enqueue.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool pop(LogsEntry &entry) {
+		auto position = _dequeue.load(std::memory_order_relaxed);
+		while (true) {
+			auto &cell = _cells[position & kMask];
+			const auto sequence = cell.sequence.load(
+				std::memory_order_acquire);
+			const auto difference = intptr_t(sequence)
+				- intptr_t(position + 1);
+			if (!difference) {
+				if (_dequeue.compare_exchange_weak(
+						position,
+						position + 1,
+						std::memory_order_relaxed)) {
+					entry = std::move(cell.entry);
+					cell.sequence.store(
+						position + kLogsQueueSize,
+						std::memory_order_release);
+					return true;
+				}
+			} else if (difference < 0) {
+				return false;
+			} else {
+				position = _dequeue.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+	static constexpr auto kMask = size_t(kLogsQueueSize - 1);
+
+	struct Cell {
+		std::atomic<size_t> sequence = 0;
+		LogsEntry entry;
+	};
+	std::unique_ptr<Cell[]> _cells;
+	std::atomic<size_t> _enqueue = 0;
+	std::atomic<size_t> _dequeue = 0;
+
+};
+
+thread_local bool InsideLogsWriter = false;
+
+int32 CurrentThreadIndex() {
+	const auto thread = qobject_cast<MTP::internal::Thread*>(
+		QThread::currentThread());
+	return thread ? thread->getThreadIndex() : 0;
+}
+
+} // namespace
+
 QMutex *_logsMutex(LogDataType type, bool clear = false) {
 	static QMutex *LogsMutexes = 0;
 	if (clear) {
@@ -39,6 +199,7 @@ QString _logsFilePath(LogDataType type, const QString &postfix = QString()) {
 	case LogDataDebug: path += qstr("DebugLogs/log") + postfix + qstr(".txt"); break;
 	case LogDataTcp: path += qstr("DebugLogs/tcp") + postfix + qstr(".txt"); break;
 	case LogDataMtp: path += qstr("DebugLogs/mtp") + postfix + qstr(".txt"); break;
+	case LogDataMtpTrace: path += qstr("DebugLogs/mtp") + postfix + qstr(".bin"); break;
 	}
 	return path;
 }
@@ -48,8 +209,7 @@ QString _logsEntryStart() {
 	static int32 index = 0;
 	QDateTime tm(QDateTime::currentDateTime());
 
-	auto thread = qobject_cast<MTP::internal::Thread*>(QThread::currentThread());
-	auto threadId = thread ? thread->getThreadIndex() : 0;
+	auto threadId = CurrentThreadIndex();
 
 	return QString("[%1 %2-%3]").arg(tm.toString("hh:mm:ss.zzz")).arg(QString("%1").arg(threadId, 2, 10, QChar('0'))).arg(++index, 7, 10, QChar('0'));
 }
@@ -61,6 +221,13 @@ public:
 		for (int32 i = 0; i < LogDataCount; ++i) {
 			files[i].reset(new QFile());
 		}
+		writer = std::thread([=] { writerLoop(); });
+	}
+
+	~LogsDataFields() {
+		stopping = true;
+		wake.notify_one();
+		writer.join();
 	}
 
 	bool openMain() {
@@ -93,16 +260,21 @@ public:
 	}
 
 	void write(LogDataType type, const QString &msg) {
-		QMutexLocker lock(_logsMutex(type));
-		if (type != LogDataMain) {
-			reopenDebug();
-		}
-		const auto file = files[type].get();
-		if (!file || !file->isOpen()) {
-			return;
+		if (type == LogDataMain) {
+			// Main log is rare and must survive crashes, keep it synchronous.
+			QMutexLocker lock(_logsMutex(type));
+			if (writeToFile(type, msg.toUtf8())) {
+				files[type]->flush();
+			}
+		} else {
+			enqueue({ type, msg, QByteArray() });
 		}
-		file->write(msg.toUtf8());
-		file->flush();
+	}
+
+	void writeBinary(LogDataType type, QByteArray &&data) {
+		Expects(type != LogDataMain);
+
+		enqueue({ type, QString(), std::move(data) });
 	}
 
 private:
@@ -110,6 +282,87 @@ private:
 
 	int32 part = -1;
 
+	LogsQueue queue;
+	std::thread writer;
+	std::atomic<bool> stopping = false;
+	std::atomic<bool> pending = false;
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+
+	void enqueue(LogsEntry &&entry) {
+		if (InsideLogsWriter) {
+			// Some LOG() was called while writing, we own the files here.
+			writeEntry(entry);
+			return;
+		}
+		while (!queue.push(std::move(entry))) {
+			wake.notify_one();
+			std::this_thread::yield();
+		}
+		if (!pending.exchange(true)) {
+			wake.notify_one();
+		}
+	}
+
+	void writerLoop() {
+		InsideLogsWriter = true;
+
+		auto entry = LogsEntry();
+		bool written[LogDataCount] = { false };
+		while (true) {
+			pending = false;
+			auto any = false;
+			while (queue.pop(entry)) {
+				if (!any) {
+					reopenDebug();
+					any = true;
+				}
+				written[entry.type] = writeEntry(entry) || written[entry.type];
+			}
+			if (any) {
+				for (auto type = 0; type != LogDataCount; ++type) {
+					if (written[type]) {
+						files[type]->flush();
+						written[type] = false;
+					}
+				}
+			}
+			if (stopping) {
+				if (!queue.pop(entry)) {
+					break;
+				}
+				// Someone was still writing while we were stopping.
+				writeEntry(entry);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wake.wait_for(
+				lock,
+				std::chrono::milliseconds(kLogsFlushTimeout),
+				[&] { return pending.load() || stopping.load(); });
+		}
+		for (auto type = 0; type != LogDataCount; ++type) {
+			if (type != LogDataMain && files[type]->isOpen()) {
+				files[type]->flush();
+			}
+		}
+	}
+
+	bool writeEntry(const LogsEntry &entry) {
+		return entry.binary.isEmpty()
+			? writeToFile(entry.type, entry.text.toUtf8())
+			: writeToFile(entry.type, entry.binary);
+	}
+
+	bool writeToFile(LogDataType type, const QByteArray &data) {
+		const auto file = files[type].get();
+		if (!file || !file->isOpen()) {
+			return false;
+		}
+		file->write(data);
+		return true;
+	}
+
 	bool reopen(LogDataType type, int32 dayIndex, const QString &postfix) {
 		if (files[type] && files[type]->isOpen()) {
 			if (type == LogDataMain) {
@@ -227,6 +480,40 @@ NEW LOGGING INSTANCE STARTED!!!\n\
 		reopen(LogDataDebug, dayIndex, postfix);
 		reopen(LogDataTcp, dayIndex, postfix);
 		reopen(LogDataMtp, dayIndex, postfix);
+		reopenTrace(dayIndex, postfix);
+	}
+
+	bool reopenTrace(int32 dayIndex, const QString &postfix) {
+		const auto file = files[LogDataMtpTrace].get();
+		if (file->isOpen()) {
+			file->close();
+		}
+		file->setFileName(_logsFilePath(LogDataMtpTrace, postfix));
+
+		auto mode = QIODevice::WriteOnly;
+		if (file->open(QIODevice::ReadOnly)) {
+			auto header = MtpTraceFileHeader();
+			if (file->read(reinterpret_cast<char*>(&header), sizeof(header))
+				== sizeof(header)
+				&& header.magic == kMtpTraceMagic
+				&& header.version == kMtpTraceVersion
+				&& header.dayIndex == dayIndex) {
+				mode |= QIODevice::Append;
+			}
+			file->close();
+		}
+		if (!file->open(mode)) {
+			LOG(("Could not open mtp trace '%1'!").arg(file->fileName()));
+			return false;
+		}
+		if (!(mode & QIODevice::Append)) {
+			auto header = MtpTraceFileHeader();
+			header.dayIndex = dayIndex;
+			file->write(
+				reinterpret_cast<const char*>(&header),
+				sizeof(header));
+		}
+		return true;
 	}
 
 };
@@ -564,6 +851,96 @@ void writeMtp(int32 dc, const QString &v) {
 	_logsWrite(LogDataMtp, msg);
 }
 
+void writeMtpTrace(
+		int32 dc,
+		bool outgoing,
+		const int32 *from,
+		const int32 *till) {
+	if (!LogsData || LogsStartIndexChosen >= 0) {
+		// The trace file is not opened yet, keep it in the text logs.
+		writeMtp(dc, (outgoing ? qsl("Send: ") : qsl("Recv: "))
+			+ mtpTextSerialize(from, till));
+		return;
+	} else if (!DebugEnabled()) {
+		return;
+	}
+	const auto primes = int32(till - from);
+	if (primes <= 0) {
+		return;
+	}
+	auto header = MtpTraceRecordHeader();
+	header.when = QDateTime::currentMSecsSinceEpoch();
+	header.dc = dc;
+	header.flags = outgoing ? kMtpTraceOutgoing : 0;
+	header.thread = CurrentThreadIndex();
+	header.primes = primes;
+
+	const auto bytes = primes * int(sizeof(int32));
+	auto record = QByteArray(
+		kMtpTraceRecordHeaderSize + bytes,
+		Qt::Uninitialized);
+	SerializeMtpTraceRecordHeader(record.data(), header);
+	memcpy(record.data() + kMtpTraceRecordHeaderSize, from, bytes);
+	LogsData->writeBinary(LogDataMtpTrace, std::move(record));
+}
+
+bool DecodeMtpTrace(const QString &path, const QString &output) {
+	QFile input(path);
+	if (!input.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	const auto data = input.readAll();
+	input.close();
+
+	auto fileHeader = MtpTraceFileHeader();
+	if (data.size() < int(sizeof(fileHeader))) {
+		return false;
+	}
+	memcpy(&fileHeader, data.constData(), sizeof(fileHeader));
+	if (fileHeader.magic != kMtpTraceMagic
+		|| fileHeader.version != kMtpTraceVersion) {
+		return false;
+	}
+
+	QFile result(output);
+	if (!result.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		return false;
+	}
+	result.write(qsl("%1\n").arg(fileHeader.dayIndex).toUtf8());
+
+	auto index = 0;
+	auto primes = std::vector<mtpPrime>();
+	auto offset = int(sizeof(fileHeader));
+	while (offset + kMtpTraceRecordHeaderSize <= data.size()) {
+		const auto header = DeserializeMtpTraceRecordHeader(
+			data.constData() + offset);
+		offset += kMtpTraceRecordHeaderSize;
+
+		const auto bytes = header.primes * int(sizeof(mtpPrime));
+		if (header.primes <= 0 || offset + bytes > data.size()) {
+			result.write("[ERROR] (truncated mtp trace record)\n");
+			break;
+		}
+		primes.resize(header.primes);
+		memcpy(primes.data(), data.constData() + offset, bytes);
+		offset += bytes;
+
+		const auto when = QDateTime::fromMSecsSinceEpoch(header.when);
+		const mtpPrime *from = primes.data();
+		const auto text = mtpTextSerialize(from, from + primes.size());
+		result.write(QString("[%1 %2-%3] (dc:%4) %5%6\n"
+			).arg(when.toString("hh:mm:ss.zzz")
+			).arg(header.thread, 2, 10, QChar('0')
+			).arg(++index, 7, 10, QChar('0')
+			).arg(header.dc
+			).arg((header.flags & kMtpTraceOutgoing)
+				? qsl("Send: ")
+				: qsl("Recv: ")
+			).arg(text).toUtf8());
+	}
+	return true;
+}
+
 QString full() {
 	if (LogsData) {
 		return LogsData->full();
@@ -33,6 +33,14 @@ void writeDebug(const char *file, int32 line, const QString &v);
 void writeTcp(const QString &v);
 void writeMtp(int32 dc, const QString &v);
 
+// Raw mtpPrime frames, serialized to text only by DecodeMtpTrace().
+void writeMtpTrace(
+	int32 dc,
+	bool outgoing,
+	const int32 *from,
+	const int32 *till);
+bool DecodeMtpTrace(const QString &path, const QString &output);
+
 QString full();
 
 inline const char *b(bool v) {
@@ -78,3 +86,6 @@ inline MemoryBuffer mb(const void *ptr, uint32 size) {
 
 #define MTP_LOG(dc, msg) { if (Logs::DebugEnabled() || !Logs::started()) Logs::writeMtp(dc, QString msg); }
 //usage MTP_LOG(dc, ("log: %1 %2").arg(1).arg(2))
+
+#define MTP_TRACE(dc, outgoing, from, till) { if (Logs::DebugEnabled() || !Logs::started()) Logs::writeMtpTrace(dc, outgoing, from, till); }
+//usage MTP_TRACE(dc, true, from, from + size)
@@ -0,0 +1,132 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "media/media_clip_frame.h"
+
+#include "base/assertion.h"
+
+#include <cstring>
+
+namespace Media {
+namespace Clip {
+namespace {
+
+// Each of the four components gets 16 bits, so it can be multiplied
+// by a value up to 256 without overflowing into the next one.
+inline uint64 Spread(uint32 components) {
+	const auto value = uint64(components);
+	return (value & 0x000000FFULL)
+		| ((value & 0x0000FF00ULL) << 8)
+		| ((value & 0x00FF0000ULL) << 16)
+		| ((value & 0xFF000000ULL) << 24);
+}
+
+// Takes the high bytes of the components, that is divides them by 256.
+inline uint32 Gather(uint64 spread) {
+	return uint32(((spread >> 8) & 0x000000FFULL)
+		| ((spread >> 16) & 0x0000FF00ULL)
+		| ((spread >> 24) & 0x00FF0000ULL)
+		| ((spread >> 32) & 0xFF000000ULL));
+}
+
+inline uint32 BlendOver(uint32 pixel, uint64 background) {
+	const auto alpha = (pixel >> 24);
+	if (alpha == 0xFF) {
+		return pixel;
+	}
+	// Treat the source alpha as opaque, so that it is premultiplied too.
+	const auto opaque = Spread(pixel | 0xFF000000U);
+	return Gather(opaque * (alpha + 1) + background * (0xFF - alpha));
+}
+
+inline uint32 Mask(uint32 pixel, uchar opacity) {
+	return Gather(Spread(pixel) * (uint32(opacity) + 1));
+}
+
+struct CornerRow {
+	const uchar *bytes = nullptr;
+	int bytesPerPixel = 0;
+	int from = 0;
+	int till = 0;
+};
+
+CornerRow ComputeCornerRow(const QImage *mask, int y, int left) {
+	if (!mask) {
+		return CornerRow();
+	}
+	auto result = CornerRow();
+	result.bytes = mask->constScanLine(y);
+	result.bytesPerPixel = (mask->depth() >> 3);
+	result.from = left;
+	result.till = left + mask->width();
+	return result;
+}
+
+} // namespace
+
+void ComposeFrame(
+		QImage &to,
+		const QImage &frame,
+		bool hasAlpha,
+		uint32 background,
+		const FrameCornerMasks &corners) {
+	Expects(to.format() == QImage::Format_ARGB32_Premultiplied);
+	Expects(frame.depth() == 32);
+	Expects(to.size() == frame.size());
+
+	const auto width = frame.width();
+	const auto height = frame.height();
+	const auto sample = corners[0]
+		? corners[0]
+		: corners[1]
+		? corners[1]
+		: corners[2]
+		? corners[2]
+		: corners[3];
+	const auto cornerWidth = sample ? sample->width() : 0;
+	const auto cornerHeight = sample ? sample->height() : 0;
+	const auto rounded = sample
+		&& (width >= 2 * cornerWidth)
+		&& (height >= 2 * cornerHeight);
+	const auto spreadBackground = Spread(background);
+
+	for (auto y = 0; y != height; ++y) {
+		const auto source = reinterpret_cast<const uint32*>(
+			frame.constScanLine(y));
+		const auto result = reinterpret_cast<uint32*>(to.scanLine(y));
+
+		auto left = CornerRow();
+		auto right = CornerRow();
+		if (rounded && y < cornerHeight) {
+			left = ComputeCornerRow(corners[0], y, 0);
+			right = ComputeCornerRow(corners[1], y, width - cornerWidth);
+		} else if (rounded && y >= height - cornerHeight) {
+			const auto row = y - (height - cornerHeight);
+			left = ComputeCornerRow(corners[2], row, 0);
+			right = ComputeCornerRow(corners[3], row, width - cornerWidth);
+		}
+		if (!hasAlpha && !left.bytes && !right.bytes) {
+			memcpy(result, source, width * sizeof(uint32));
+			continue;
+		}
+		for (auto x = 0; x != width; ++x) {
+			auto pixel = hasAlpha
+				? BlendOver(source[x], spreadBackground)
+				: source[x];
+			if (left.bytes && x < left.till) {
+				pixel = Mask(pixel, left.bytes[x * left.bytesPerPixel]);
+			} else if (right.bytes && x >= right.from) {
+				const auto index = (x - right.from) * right.bytesPerPixel;
+				pixel = Mask(pixel, right.bytes[index]);
+			}
+			result[x] = pixel;
+		}
+	}
+}
+
+} // namespace Clip
+} // namespace Media
@@ -0,0 +1,37 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/basic_types.h"
+
+#include <QtGui/QImage>
+
+#include <array>
+
+namespace Media {
+namespace Clip {
+
+// Corner masks in the top-left, top-right, bottom-left, bottom-right
+// order, nullptr for the corners that are not rounded.
+using FrameCornerMasks = std::array<const QImage*, 4>;
+
+// Prepares a decoded frame for painting in a single pass over pixels:
+// blends the transparent pixels over the premultiplied background and
+// applies the rounded corners masks.
+//
+// The frame is Format_ARGB32 of the same size as the result,
+// the result is Format_ARGB32_Premultiplied, ready for QPixmap.
+void ComposeFrame(
+	QImage &to,
+	const QImage &frame,
+	bool hasAlpha,
+	uint32 background,
+	const FrameCornerMasks &corners);
+
+} // namespace Clip
+} // namespace Media
@@ -0,0 +1,130 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "media/media_clip_frame.h"
+
+#include <QtGui/QPainter>
+
+#include <chrono>
+#include <iostream>
+
+using namespace Media::Clip;
+
+constexpr auto kBackground = 0xFF204060U;
+
+// White premultiplied masks, like the ones App::cornersMask() returns.
+QImage CornerMask(int size) {
+	auto result = QImage(size, size, QImage::Format_ARGB32_Premultiplied);
+	result.fill(0xFFFFFFFFU);
+	result.setPixel(0, 0, 0U);
+	return result;
+}
+
+bool Close(uint32 a, uint32 b) {
+	for (auto shift = 0; shift != 32; shift += 8) {
+		const auto x = int((a >> shift) & 0xFF);
+		const auto y = int((b >> shift) & 0xFF);
+		if (std::abs(x - y) > 1) {
+			return false;
+		}
+	}
+	return true;
+}
+
+uint32 Pixel(const QImage &image, int x, int y) {
+	return reinterpret_cast<const uint32*>(image.constScanLine(y))[x];
+}
+
+TEST_CASE("composing clip frames", "[clip_frame]") {
+	auto frame = QImage(8, 8, QImage::Format_ARGB32);
+	frame.fill(0xFF112233U);
+	auto to = QImage(8, 8, QImage::Format_ARGB32_Premultiplied);
+
+	SECTION("opaque frame is copied") {
+		ComposeFrame(to, frame, false, kBackground, FrameCornerMasks());
+		REQUIRE(Pixel(to, 0, 0) == 0xFF112233U);
+		REQUIRE(Pixel(to, 7, 7) == 0xFF112233U);
+	}
+	SECTION("transparent pixels are blended over the background") {
+		frame.setPixel(1, 1, 0x00FFFFFFU);
+		frame.setPixel(2, 2, 0x80FFFFFFU);
+		ComposeFrame(to, frame, true, kBackground, FrameCornerMasks());
+		REQUIRE(Pixel(to, 0, 0) == 0xFF112233U);
+		REQUIRE(Close(Pixel(to, 1, 1), kBackground));
+		REQUIRE(Close(Pixel(to, 2, 2), 0xFF90A0B0U));
+	}
+	SECTION("only the requested corners are masked") {
+		const auto mask = CornerMask(2);
+		auto corners = FrameCornerMasks();
+		corners[0] = &mask;
+		corners[3] = &mask;
+		ComposeFrame(to, frame, false, kBackground, corners);
+		REQUIRE(Pixel(to, 0, 0) == 0U);
+		REQUIRE(Pixel(to, 1, 0) == 0xFF112233U);
+		REQUIRE(Pixel(to, 6, 0) == 0xFF112233U);
+		REQUIRE(Pixel(to, 6, 6) == 0U);
+		REQUIRE(Pixel(to, 7, 7) == 0xFF112233U);
+	}
+	SECTION("masks are skipped for too small frames") {
+		const auto mask = CornerMask(5);
+		auto corners = FrameCornerMasks();
+		corners[0] = &mask;
+		ComposeFrame(to, frame, false, kBackground, corners);
+		REQUIRE(Pixel(to, 0, 0) == 0xFF112233U);
+	}
+}
+
+// Not run by default, use "[benchmark]" filter to run it.
+TEST_CASE("clip frame compose performance", "[.][benchmark]") {
+	constexpr auto kFrames = 1000;
+	constexpr auto kWidth = 854;
+	constexpr auto kHeight = 480;
+
+	auto frame = QImage(kWidth, kHeight, QImage::Format_ARGB32);
+	for (auto y = 0; y != kHeight; ++y) {
+		const auto line = reinterpret_cast<uint32*>(frame.scanLine(y));
+		for (auto x = 0; x != kWidth; ++x) {
+			line[x] = 0xFF000000U | uint32(x * 131 + y * 71);
+		}
+	}
+	const auto mask = CornerMask(16);
+	const auto corners = FrameCornerMasks{ &mask, &mask, &mask, &mask };
+	auto to = QImage(kWidth, kHeight, QImage::Format_ARGB32_Premultiplied);
+
+	const auto measure = [&](const char *name, auto &&method) {
+		const auto start = std::chrono::steady_clock::now();
+		for (auto i = 0; i != kFrames; ++i) {
+			method();
+		}
+		const auto finish = std::chrono::steady_clock::now();
+		const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+			finish - start).count();
+		std::cout
+			<< name << ": "
+			<< kFrames << " frames of "
+			<< kWidth << "x" << kHeight << " in "
+			<< ms << " ms, "
+			<< (ms ? (kFrames * 1000 / ms) : 0) << " fps." << std::endl;
+	};
+	measure("painter", [&] {
+		QPainter p(&to);
+		p.drawImage(0, 0, frame);
+		p.setCompositionMode(QPainter::CompositionMode_DestinationIn);
+		p.drawImage(0, 0, mask);
+		p.drawImage(kWidth - 16, 0, mask);
+		p.drawImage(0, kHeight - 16, mask);
+		p.drawImage(kWidth - 16, kHeight - 16, mask);
+	});
+	measure("composed", [&] {
+		ComposeFrame(to, frame, false, kBackground, corners);
+	});
+	measure("composed with alpha", [&] {
+		ComposeFrame(to, frame, true, kBackground, corners);
+	});
+}
@@ -7,11 +7,100 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #include "media/media_clip_implementation.h"
 
+#include "storage/storage_streamed_file.h"
+
 namespace Media {
 namespace Clip {
 namespace internal {
 
+// Reads block the decoding thread until the loader gets the parts.
+class StreamedFileDevice : public QIODevice {
+public:
+	StreamedFileDevice(
+		std::shared_ptr<Storage::StreamedFile> file,
+		Fn<bool()> interrupted,
+		Fn<void(bool)> blocked);
+
+	bool isSequential() const override;
+	qint64 size() const override;
+	bool dataReady() const;
+
+protected:
+	qint64 readData(char *data, qint64 maxSize) override;
+	qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+	const std::shared_ptr<Storage::StreamedFile> _file;
+	const Fn<bool()> _interrupted;
+	const Fn<void(bool)> _blocked;
+
+};
+
+StreamedFileDevice::StreamedFileDevice(
+	std::shared_ptr<Storage::StreamedFile> file,
+	Fn<bool()> interrupted,
+	Fn<void(bool)> blocked)
+: _file(std::move(file))
+, _interrupted(std::move(interrupted))
+, _blocked(std::move(blocked)) {
+}
+
+bool StreamedFileDevice::isSequential() const {
+	return false;
+}
+
+qint64 StreamedFileDevice::size() const {
+	return _file->size();
+}
+
+bool StreamedFileDevice::dataReady() const {
+	return _file->available(int(pos()));
+}
+
+qint64 StreamedFileDevice::readData(char *data, qint64 maxSize) {
+	const auto offset = int(pos());
+	const auto count = std::min(maxSize, qint64(_file->size()));
+	const auto blocking = !_file->available(offset);
+	if (blocking && _blocked) {
+		_blocked(true);
+	}
+	const auto result = _file->read(
+		offset,
+		bytes::make_span(data, count),
+		_interrupted);
+	if (blocking && _blocked) {
+		_blocked(false);
+	}
+	return result;
+}
+
+qint64 StreamedFileDevice::writeData(const char *data, qint64 maxSize) {
+	return -1;
+}
+
+void ReaderImplementation::setStreamedFile(
+		std::shared_ptr<Storage::StreamedFile> file,
+		Fn<bool()> interrupted,
+		Fn<void(bool)> blocked) {
+	_streamed = file
+		? std::make_unique<StreamedFileDevice>(
+			std::move(file),
+			std::move(interrupted),
+			std::move(blocked))
+		: nullptr;
+}
+
+bool ReaderImplementation::streamedDataReady() const {
+	return !_streamed || _streamed->dataReady();
+}
+
 void ReaderImplementation::initDevice() {
+	if (_streamed) {
+		if (_streamed->isOpen()) _streamed->close();
+		_dataSize = _streamed->size();
+		_device = _streamed.get();
+		return;
+	}
 	if (_data->isEmpty()) {
 		if (_file.isOpen()) _file.close();
 		_file.setFileName(_location->name());
@@ -24,6 +113,8 @@ void ReaderImplementation::initDevice() {
 	_device = _data->isEmpty() ? static_cast<QIODevice*>(&_file) : static_cast<QIODevice*>(&_buffer);
 }
 
+ReaderImplementation::~ReaderImplementation() = default;
+
 } // namespace internal
 } // namespace Clip
 } // namespace Media
@@ -9,10 +9,16 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 class FileLocation;
 
+namespace Storage {
+class StreamedFile;
+} // namespace Storage
+
 namespace Media {
 namespace Clip {
 namespace internal {
 
+class StreamedFileDevice;
+
 class ReaderImplementation {
 public:
 	ReaderImplementation(FileLocation *location, QByteArray *data)
@@ -45,8 +51,17 @@ public:
 
 	virtual bool start(Mode mode, TimeMs &positionMs) = 0;
 
-	virtual ~ReaderImplementation() {
-	}
+	// Read the file while it is loading, instead of location or data.
+	// The blocked callback is called around reads that wait for parts.
+	void setStreamedFile(
+		std::shared_ptr<Storage::StreamedFile> file,
+		Fn<bool()> interrupted,
+		Fn<void(bool)> blocked);
+
+	// False if the next read would wait for the streamed file parts.
+	bool streamedDataReady() const;
+
+	virtual ~ReaderImplementation();
 	int64 dataSize() const {
 		return _dataSize;
 	}
@@ -56,6 +71,7 @@ protected:
 	QByteArray *_data;
 	QFile _file;
 	QBuffer _buffer;
+	std::unique_ptr<StreamedFileDevice> _streamed;
 	QIODevice *_device = nullptr;
 	int64 _dataSize = 0;
 
@@ -9,9 +9,11 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "data/data_document.h"
 #include "storage/file_download.h"
+#include "storage/storage_streamed_file.h"
 #include "media/media_clip_ffmpeg.h"
 #include "media/media_clip_qtgif.h"
 #include "media/media_clip_check_streaming.h"
+#include "media/media_clip_frame.h"
 #include "mainwidget.h"
 #include "mainwindow.h"
 
@@ -22,12 +24,25 @@ extern "C" {
 #include <libswscale/swscale.h>
 }
 
+#include <atomic>
+#include <chrono>
+
 namespace Media {
 namespace Clip {
 namespace {
 
+constexpr auto kNeverProcess = std::numeric_limits<TimeMs>::max();
+
 QVector<QThread*> threads;
-QVector<Manager*> managers;
+QVector<Manager*> managers; // Changed and shared with readersMutex locked.
+
+// Scheduling state shared by all the clip threads.
+QMutex readersMutex;
+QMap<Reader*, QAtomicInt> readerPointers;
+bool readersChanged = false;
+base::flat_set<ReaderPrivate*> readers;
+std::set<std::pair<TimeMs, ReaderPrivate*>> readersQueue;
+uint64 processPass = 0;
 
 QImage PrepareFrameImage(const FrameRequest &request, const QImage &original, bool hasAlpha, QImage &cache) {
 	auto needResize = (original.width() != request.framew) || (original.height() != request.frameh);
@@ -38,6 +53,40 @@ QImage PrepareFrameImage(const FrameRequest &request, const QImage &original, bo
 	}
 
 	auto factor = request.factor;
+	if (!needResize
+		&& !needOuterFill
+		&& request.radius != ImageRoundRadius::Ellipse) {
+		// Blend and round the frame in one pass without a painter.
+		if (cache.size() != original.size()
+			|| cache.format() != QImage::Format_ARGB32_Premultiplied) {
+			cache = QImage(original.size(), QImage::Format_ARGB32_Premultiplied);
+		}
+		cache.setDevicePixelRatio(factor);
+		auto corners = FrameCornerMasks();
+		if (needRounding) {
+			const auto masks = App::cornersMask(request.radius);
+			const auto parts = {
+				RectPart::TopLeft,
+				RectPart::TopRight,
+				RectPart::BottomLeft,
+				RectPart::BottomRight,
+			};
+			auto index = 0;
+			for (const auto part : parts) {
+				if (request.corners & part) {
+					corners[index] = &masks[index];
+				}
+				++index;
+			}
+		}
+		ComposeFrame(
+			cache,
+			original,
+			hasAlpha,
+			anim::getPremultiplied(st::imageBgTransparent->c),
+			corners);
+		return cache;
+	}
 	auto needNewCache = (cache.width() != request.outerw || cache.height() != request.outerh);
 	if (needNewCache) {
 		cache = QImage(request.outerw, request.outerh, QImage::Format_ARGB32_Premultiplied);
@@ -79,6 +128,111 @@ QPixmap PrepareFrame(const FrameRequest &request, const QImage &original, bool h
 	return QPixmap::fromImage(PrepareFrameImage(request, original, hasAlpha, cache), Qt::ColorOnly);
 }
 
+struct SharedFramesKey {
+	SharedFramesKey(DocumentId documentId, const FrameRequest &request)
+	: documentId(documentId)
+	, factor(request.factor)
+	, framew(request.framew)
+	, frameh(request.frameh)
+	, outerw(request.outerw)
+	, outerh(request.outerh)
+	, radius(int(request.radius))
+	, corners(int(request.corners.value())) {
+	}
+
+	DocumentId documentId = 0;
+	int factor = 0;
+	int framew = 0;
+	int frameh = 0;
+	int outerw = 0;
+	int outerh = 0;
+	int radius = 0;
+	int corners = 0;
+
+	auto tie() const {
+		return std::tie(
+			documentId,
+			factor,
+			framew,
+			frameh,
+			outerw,
+			outerh,
+			radius,
+			corners);
+	}
+	friend inline bool operator<(
+			const SharedFramesKey &a,
+			const SharedFramesKey &b) {
+		return a.tie() < b.tie();
+	}
+	friend inline bool operator!=(
+			const SharedFramesKey &a,
+			const SharedFramesKey &b) {
+		return a.tie() != b.tie();
+	}
+
+};
+
+// Decoder and the last prepared frame of a GIF that is shown with the same
+// size by several readers. All of them follow the same timeline, so the
+// frame is decoded once by the first reader that needs it.
+struct SharedFrames {
+	SharedFrames(const SharedFramesKey &key, const QByteArray &data)
+	: key(key)
+	, data(data)
+	, implementation(std::make_unique<internal::FFMpegReaderImplementation>(
+		nullptr,
+		&this->data,
+		AudioMsgId())) {
+	}
+
+	const SharedFramesKey key;
+	QMutex mutex;
+	QByteArray data;
+	std::unique_ptr<internal::ReaderImplementation> implementation;
+	TimeMs animationStarted = 0;
+
+	uint64 index = 0;
+	QPixmap pix;
+	QImage original, cache;
+	bool alpha = true;
+	TimeMs when = 0;
+	TimeMs positionMs = 0;
+
+};
+
+QMutex sharedFramesMutex;
+std::map<SharedFramesKey, std::weak_ptr<SharedFrames>> sharedFrames;
+
+std::shared_ptr<SharedFrames> FindSharedFrames(
+		const SharedFramesKey &key,
+		const QByteArray &data,
+		TimeMs animationStarted) {
+	QMutexLocker lock(&sharedFramesMutex);
+	auto &weak = sharedFrames[key];
+	if (auto result = weak.lock()) {
+		return result;
+	}
+	for (auto i = sharedFrames.begin(); i != sharedFrames.end();) {
+		if (i->second.expired() && &i->second != &weak) {
+			i = sharedFrames.erase(i);
+		} else {
+			++i;
+		}
+	}
+
+	auto result = std::make_shared<SharedFrames>(key, data);
+	auto positionMs = TimeMs(0);
+	const auto mode = internal::ReaderImplementation::Mode::Silent;
+	if (!result->implementation->start(mode, positionMs)) {
+		sharedFrames.erase(key);
+		return nullptr;
+	}
+	result->animationStarted = animationStarted;
+	weak = result;
+	return result;
+}
+
 } // namespace
 
 Reader::Reader(const QString &filepath, Callback &&callback, Mode mode, TimeMs seekMs)
@@ -93,27 +247,27 @@ Reader::Reader(not_null<DocumentData*> document, FullMsgId msgId, Callback &&cal
 , _mode(mode)
 , _audioMsgId(document, msgId, (mode == Mode::Video) ? rand_value<uint32>() : 0)
 , _seekPositionMs(seekMs) {
-	init(document->location(), document->data());
+	init(document->location(), document->data(), document->streamedFile());
 }
 
-void Reader::init(const FileLocation &location, const QByteArray &data) {
+void Reader::init(
+		const FileLocation &location,
+		const QByteArray &data,
+		std::shared_ptr<Storage::StreamedFile> streamed) {
 	if (threads.size() < ClipThreadsCount) {
-		_threadIndex = threads.size();
-		threads.push_back(new QThread());
-		managers.push_back(new Manager(threads.back()));
-		threads.back()->start();
-	} else {
-		_threadIndex = int32(rand_value<uint32>() % threads.size());
-		int32 loadLevel = 0x7FFFFFFF;
-		for (int32 i = 0, l = threads.size(); i < l; ++i) {
-			int32 level = managers.at(i)->loadLevel();
-			if (level < loadLevel) {
-				_threadIndex = i;
-				loadLevel = level;
-			}
+		const auto thread = new QThread();
+		const auto manager = new Manager(threads.size(), thread);
+		threads.push_back(thread);
+		{
+			QMutexLocker lock(&readersMutex);
+			managers.push_back(manager);
 		}
+		thread->start();
+	}
+	if (streamed) {
+		streamed->setPartCallback([] { Manager::streamedPartLoaded(); });
 	}
-	managers.at(_threadIndex)->append(this, location, data);
+	Manager::append(this, location, data, std::move(streamed));
 }
 
 Reader::Frame *Reader::frameToShow(int32 *index) const { // 0 means not ready
@@ -187,13 +341,13 @@ void Reader::moveToNextWrite() const {
 
 void Reader::callback(Reader *reader, int32 threadIndex, Notification notification) {
 	// check if reader is not deleted already
-	if (managers.size() > threadIndex && managers.at(threadIndex)->carries(reader) && reader->_callback) {
+	if (managers.size() > threadIndex && Manager::carries(reader) && reader->_callback) {
 		reader->_callback(notification);
 	}
 }
 
 void Reader::start(int32 framew, int32 frameh, int32 outerw, int32 outerh, ImageRoundRadius radius, RectParts corners) {
-	if (managers.size() <= _threadIndex) error();
+	if (managers.isEmpty()) error();
 	if (_state == State::Error) return;
 
 	if (_step.loadAcquire() == WaitingForRequestStep) {
@@ -208,7 +362,7 @@ void Reader::start(int32 framew, int32 frameh, int32 outerw, int32 outerh, Image
 		request.corners = corners;
 		_frames[0].request = _frames[1].request = _frames[2].request = request;
 		moveToNextShow();
-		managers.at(_threadIndex)->start(this);
+		Manager::update(this);
 	}
 }
 
@@ -224,9 +378,9 @@ QPixmap Reader::current(int32 framew, int32 frameh, int32 outerw, int32 outerh,
 		frame->displayed.storeRelease(1);
 		if (_autoPausedGif.loadAcquire()) {
 			_autoPausedGif.storeRelease(0);
-			if (managers.size() <= _threadIndex) error();
+			if (managers.isEmpty()) error();
 			if (_state != State::Error) {
-				managers.at(_threadIndex)->update(this);
+				Manager::update(this);
 			}
 		}
 	} else {
@@ -257,9 +411,9 @@ QPixmap Reader::current(int32 framew, int32 frameh, int32 outerw, int32 outerh,
 
 	moveToNextShow();
 
-	if (managers.size() <= _threadIndex) error();
+	if (managers.isEmpty()) error();
 	if (_state != State::Error) {
-		managers.at(_threadIndex)->update(this);
+		Manager::update(this);
 	}
 
 	return frame->pix;
@@ -304,11 +458,11 @@ TimeMs Reader::getDurationMs() const {
 }
 
 void Reader::pauseResumeVideo() {
-	if (managers.size() <= _threadIndex) error();
+	if (managers.isEmpty()) error();
 	if (_state == State::Error) return;
 
 	_videoPauseRequest.storeRelease(1 - _videoPauseRequest.loadAcquire());
-	managers.at(_threadIndex)->start(this);
+	Manager::update(this);
 }
 
 bool Reader::videoPaused() const {
@@ -328,9 +482,9 @@ State Reader::state() const {
 }
 
 void Reader::stop() {
-	if (managers.size() <= _threadIndex) error();
+	if (managers.isEmpty()) error();
 	if (_state != State::Error) {
-		managers.at(_threadIndex)->stop(this);
+		Manager::stop(this);
 		_width = _height = 0;
 	}
 }
@@ -351,12 +505,19 @@ Reader::~Reader() {
 
 class ReaderPrivate {
 public:
-	ReaderPrivate(Reader *reader, const FileLocation &location, const QByteArray &data) : _interface(reader)
+	ReaderPrivate(
+		Reader *reader,
+		const FileLocation &location,
+		const QByteArray &data,
+		std::shared_ptr<Storage::StreamedFile> streamed)
+	: _interface(reader)
 	, _mode(reader->mode())
 	, _audioMsgId(reader->audioMsgId())
 	, _seekPositionMs(reader->seekPositionMs())
-	, _data(data) {
-		if (_data.isEmpty()) {
+	, _documentId(_audioMsgId.audio() ? _audioMsgId.audio()->id : 0)
+	, _data(data)
+	, _streamed(_data.isEmpty() ? std::move(streamed) : nullptr) {
+		if (_data.isEmpty() && !_streamed) {
 			_location = std::make_unique<FileLocation>(location);
 			if (!_location->accessEnable()) {
 				error();
@@ -377,7 +538,7 @@ public:
 				// get the frame size and return a black frame with that size.
 
 				auto firstFramePositionMs = TimeMs(0);
-				auto reader = std::make_unique<internal::FFMpegReaderImplementation>(_location.get(), &_data, AudioMsgId());
+				auto reader = createImplementation(AudioMsgId());
 				if (reader->start(internal::ReaderImplementation::Mode::Normal, firstFramePositionMs)) {
 					auto firstFrameReadResult = reader->readFramesTill(-1, ms);
 					if (firstFrameReadResult == internal::ReaderImplementation::ReadResult::Success) {
@@ -437,6 +598,13 @@ public:
 	}
 
 	ProcessResult finishProcess(TimeMs ms) {
+		if (!_sharedFrames && canShareFrames()) {
+			joinSharedFrames();
+		}
+		if (_sharedFrames) {
+			return finishSharedProcess(ms);
+		}
+
 		auto frameMs = _seekPositionMs + ms - _animationStarted;
 		auto readResult = _implementation->readFramesTill(frameMs, ms);
 		if (readResult == internal::ReaderImplementation::ReadResult::EndOfFile) {
@@ -460,6 +628,66 @@ public:
 		return ProcessResult::CopyFrame;
 	}
 
+	bool canShareFrames() const {
+		return (_mode == Reader::Mode::Gif)
+			&& (_documentId != 0)
+			&& !_seekPositionMs
+			&& !_data.isEmpty();
+	}
+
+	// Drops our own decoder, the shared one will be used instead.
+	void joinSharedFrames() {
+		const auto key = SharedFramesKey(_documentId, _request);
+		_sharedFrames = FindSharedFrames(key, _data, _animationStarted);
+		if (_sharedFrames) {
+			_animationStarted = _sharedFrames->animationStarted;
+			_sharedFrameIndex = 0;
+			_implementation = nullptr;
+		}
+	}
+
+	ProcessResult finishSharedProcess(TimeMs ms) {
+		if (SharedFramesKey(_documentId, _request) != _sharedFrames->key) {
+			// The frame size has changed, find the readers of the new one.
+			_sharedFrames = nullptr;
+			joinSharedFrames();
+			if (!_sharedFrames) {
+				return error();
+			}
+		}
+		// Keep the shared frames alive while the mutex is locked.
+		const auto shared = _sharedFrames;
+		QMutexLocker lock(&shared->mutex);
+		if (shared->index == _sharedFrameIndex) {
+			const auto frameMs = ms - shared->animationStarted;
+			const auto readResult = shared->implementation->readFramesTill(frameMs, ms);
+			if (readResult != internal::ReaderImplementation::ReadResult::Success) {
+				return error();
+			}
+			if (!shared->implementation->renderFrame(shared->original, shared->alpha, QSize(_request.framew, _request.frameh))) {
+				return error();
+			}
+			shared->original.setDevicePixelRatio(_request.factor);
+			shared->pix = QPixmap();
+			shared->pix = PrepareFrame(_request, shared->original, shared->alpha, shared->cache);
+			shared->when = std::max(
+				shared->animationStarted + shared->implementation->framePresentationTime(),
+				TimeMs(1));
+			shared->positionMs = shared->implementation->frameRealTime();
+			++shared->index;
+		}
+		_sharedFrameIndex = shared->index;
+		_nextFrameWhen = shared->when;
+		_nextFramePositionMs = shared->positionMs;
+
+		frame()->original = shared->original;
+		frame()->alpha = shared->alpha;
+		frame()->pix = shared->pix;
+		frame()->when = _nextFrameWhen;
+		frame()->positionMs = _nextFramePositionMs;
+		return ProcessResult::CopyFrame;
+	}
+
 	bool renderFrame() {
 		Assert(frame() != 0 && _request.valid());
 		if (!_implementation->renderFrame(frame()->original, frame()->alpha, QSize(_request.framew, _request.frameh))) {
@@ -474,7 +702,9 @@ public:
 	}
 
 	bool init() {
-		if (_data.isEmpty() && QFileInfo(_location->name()).size() <= Storage::kMaxAnimationInMemory) {
+		if (_data.isEmpty()
+			&& !_streamed
+			&& QFileInfo(_location->name()).size() <= Storage::kMaxAnimationInMemory) {
 			QFile f(_location->name());
 			if (f.open(QIODevice::ReadOnly)) {
 				_data = f.readAll();
@@ -484,7 +714,7 @@ public:
 			}
 		}
 
-		_implementation = std::make_unique<internal::FFMpegReaderImplementation>(_location.get(), &_data, _audioMsgId);
+		_implementation = createImplementation(_audioMsgId);
 //		_implementation = new QtGifReaderImplementation(_location, &_data);
 
 		auto implementationMode = [this]() {
@@ -497,6 +727,41 @@ public:
 		return _implementation->start(implementationMode(), _seekPositionMs);
 	}
 
+	std::unique_ptr<internal::ReaderImplementation> createImplementation(
+			const AudioMsgId &audio) {
+		auto result = std::make_unique<internal::FFMpegReaderImplementation>(
+			_location.get(),
+			&_data,
+			audio);
+		if (_streamed) {
+			result->setStreamedFile(_streamed, [=] {
+				return _interrupted.load()
+					|| QThread::currentThread()->isInterruptionRequested();
+			}, [](bool blocked) {
+				Manager::threadBlocked(blocked);
+			});
+		}
+		return result;
+	}
+
+	// False if processing now would wait for the streamed file parts.
+	bool streamedDataReady() const {
+		if (!_streamed) {
+			return true;
+		}
+		return _implementation
+			? _implementation->streamedDataReady()
+			: _streamed->available(0);
+	}
+
+	// Called from the main thread with the readers mutex locked.
+	void interrupt() {
+		_interrupted = true;
+		if (_streamed) {
+			_streamed->wakeReaders();
+		}
+	}
+
 	void startedAt(TimeMs ms) {
 		_animationStarted = _nextFrameWhen = ms;
 	}
@@ -523,6 +788,10 @@ public:
 		}
 	}
 
+	void countDecodeCost(int64 cost) {
+		_decodeCost = _decodeCost ? ((_decodeCost * 7 + cost) / 8) : cost;
+	}
+
 	ProcessResult error() {
 		stop(Player::State::StoppedAtError);
 		_state = State::Error;
@@ -531,6 +800,7 @@ public:
 
 	void stop(Player::State audioState) {
 		_implementation = nullptr;
+		_sharedFrames = nullptr;
 		if (_hasAudio) {
 			Player::mixer()->stop(_audioMsgId, audioState);
 		}
@@ -555,13 +825,18 @@ private:
 	Reader::Mode _mode;
 	AudioMsgId _audioMsgId;
 	TimeMs _seekPositionMs = 0;
+	DocumentId _documentId = 0;
 
 	QByteArray _data;
+	std::shared_ptr<Storage::StreamedFile> _streamed;
+	std::atomic<bool> _interrupted = false;
 	std::unique_ptr<FileLocation> _location;
 	bool _accessed = false;
 
 	QBuffer _buffer;
 	std::unique_ptr<internal::ReaderImplementation> _implementation;
+	std::shared_ptr<SharedFrames> _sharedFrames;
+	uint64 _sharedFrameIndex = 0;
 
 	FrameRequest _request;
 	struct Frame {
@@ -592,11 +867,21 @@ private:
 	bool _started = false;
 	TimeMs _videoPausedAtMs = 0;
 
+	// Guarded by the shared readers mutex.
+	TimeMs _queuedWhen = 0;
+	uint64 _processedPass = 0;
+	bool _processing = false;
+	bool _updatePending = false;
+	bool _waitingForData = false;
+
+	// Average frame decoding time in microseconds.
+	int64 _decodeCost = 0;
+
 	friend class Manager;
 
 };
 
-Manager::Manager(QThread *thread) : _processingInThread(0), _needReProcess(false) {
+Manager::Manager(int index, QThread *thread) : _index(index) {
 	moveToThread(thread);
 	connect(thread, SIGNAL(started()), this, SLOT(process()));
 	connect(thread, SIGNAL(finished()), this, SLOT(finish()));
@@ -609,77 +894,280 @@ Manager::Manager(QThread *thread) : _processingInThread(0), _needReProcess(false
 	anim::registerClipManager(this);
 }
 
-void Manager::append(Reader *reader, const FileLocation &location, const QByteArray &data) {
-	reader->_private = new ReaderPrivate(reader, location, data);
-	_loadLevel.fetchAndAddRelaxed(AverageGifSize);
-	update(reader);
-}
-
-void Manager::start(Reader *reader) {
+void Manager::append(
+		Reader *reader,
+		const FileLocation &location,
+		const QByteArray &data,
+		std::shared_ptr<Storage::StreamedFile> streamed) {
+	reader->_private = new ReaderPrivate(
+		reader,
+		location,
+		data,
+		std::move(streamed));
 	update(reader);
 }
 
 void Manager::update(Reader *reader) {
-	QMutexLocker lock(&_readerPointersMutex);
-	auto i = _readerPointers.find(reader);
-	if (i == _readerPointers.cend()) {
-		_readerPointers.insert(reader, QAtomicInt(1));
+	QMutexLocker lock(&readersMutex);
+	auto i = readerPointers.find(reader);
+	if (i == readerPointers.cend()) {
+		readerPointers.insert(reader, QAtomicInt(1));
 	} else {
 		i->storeRelease(1);
 	}
-	emit processDelayed();
+	readersChanged = true;
+
+	// A busy thread will apply the changes before going idle.
+	if (!anyBusy()) {
+		wakeIdle();
+	}
 }
 
 void Manager::stop(Reader *reader) {
-	if (!carries(reader)) return;
-
-	QMutexLocker lock(&_readerPointersMutex);
-	_readerPointers.remove(reader);
-	emit processDelayed();
+	QMutexLocker lock(&readersMutex);
+	if (!readerPointers.contains(reader)) {
+		return;
+	} else if (const auto data = reader->_private) {
+		// Don't let it wait for the file parts forever.
+		data->interrupt();
+	}
+	readerPointers.remove(reader);
+	readersChanged = true;
+	if (!anyBusy()) {
+		wakeIdle();
+	}
 }
 
-bool Manager::carries(Reader *reader) const {
-	QMutexLocker lock(&_readerPointersMutex);
-	return _readerPointers.contains(reader);
+bool Manager::carries(Reader *reader) {
+	QMutexLocker lock(&readersMutex);
+	return readerPointers.contains(reader);
 }
 
 Manager::ReaderPointers::iterator Manager::unsafeFindReaderPointer(ReaderPrivate *reader) {
-	ReaderPointers::iterator it = _readerPointers.find(reader->_interface);
+	ReaderPointers::iterator it = readerPointers.find(reader->_interface);
 
 	// could be a new reader which was realloced in the same address
-	return (it == _readerPointers.cend() || it.key()->_private == reader) ? it : _readerPointers.end();
+	return (it == readerPointers.cend() || it.key()->_private == reader) ? it : readerPointers.end();
 }
 
-Manager::ReaderPointers::const_iterator Manager::constUnsafeFindReaderPointer(ReaderPrivate *reader) const {
-	ReaderPointers::const_iterator it = _readerPointers.constFind(reader->_interface);
+Manager::ReaderPointers::const_iterator Manager::constUnsafeFindReaderPointer(ReaderPrivate *reader) {
+	ReaderPointers::const_iterator it = readerPointers.constFind(reader->_interface);
 
 	// could be a new reader which was realloced in the same address
-	return (it == _readerPointers.cend() || it.key()->_private == reader) ? it : _readerPointers.cend();
+	return (it == readerPointers.cend() || it.key()->_private == reader) ? it : readerPointers.cend();
+}
+
+void Manager::applyUpdates(TimeMs ms) {
+	if (!readersChanged) {
+		return;
+	}
+	readersChanged = false;
+	for (auto it = readerPointers.begin(), e = readerPointers.end(); it != e; ++it) {
+		const auto reader = it.key()->_private;
+		if (!it->loadAcquire() || !reader) {
+			continue;
+		} else if (reader->_processing) {
+			// Will be applied when the processing thread releases it.
+			reader->_updatePending = true;
+			continue;
+		}
+		if (!readers.contains(reader)) {
+			readers.insert(reader);
+		} else {
+			readersQueue.erase(std::make_pair(reader->_queuedWhen, reader));
+			if (reader->_autoPausedGif && !it.key()->_autoPausedGif.loadAcquire()) {
+				reader->_autoPausedGif = false;
+			}
+			if (it.key()->_videoPauseRequest.loadAcquire()) {
+				reader->pauseVideo(ms);
+			} else {
+				reader->resumeVideo(ms);
+			}
+		}
+		reader->_queuedWhen = ms;
+		readersQueue.emplace(reader->_queuedWhen, reader);
+		if (const auto frame = it.key()->frameToWrite()) {
+			reader->_request = frame->request;
+		}
+		it->storeRelease(0);
+	}
+}
+
+bool Manager::anyBusy() {
+	// Threads waiting for the streamed file parts won't apply changes.
+	for (const auto manager : managers) {
+		if (manager->_busy && !manager->_blocked) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Manager::armedBefore(TimeMs when) {
+	for (const auto manager : managers) {
+		if (!manager->_busy
+			&& manager->_armedWhen
+			&& manager->_armedWhen <= when) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Manager::streamedPartLoaded() {
+	QMutexLocker lock(&readersMutex);
+	const auto ms = getms();
+	auto woken = false;
+	for (const auto reader : readers) {
+		if (reader->_waitingForData) {
+			reader->_waitingForData = false;
+			readersQueue.erase(std::make_pair(reader->_queuedWhen, reader));
+			reader->_queuedWhen = ms;
+			readersQueue.emplace(reader->_queuedWhen, reader);
+			woken = true;
+		}
+	}
+	if (woken) {
+		wakeIdle();
+	}
+}
+
+void Manager::threadBlocked(bool blocked) {
+	QMutexLocker lock(&readersMutex);
+	const auto current = QThread::currentThread();
+	for (const auto manager : managers) {
+		if (manager->thread() == current) {
+			manager->_blocked = blocked;
+		}
+	}
+
+	// Let an idle thread process the other readers meanwhile.
+	if (blocked && (readersChanged || !readersQueue.empty())) {
+		wakeIdle();
+	}
+}
+
+void Manager::wakeIdle() {
+	for (const auto manager : managers) {
+		if (!manager->_busy) {
+			manager->_busy = true;
+			manager->_armedWhen = 0;
+			emit manager->processDelayed();
+			return;
+		}
+	}
+}
+
+ReaderPrivate *Manager::takeDue(TimeMs ms) {
+	QMutexLocker lock(&readersMutex);
+	applyUpdates(ms);
+	for (auto i = readersQueue.begin(), e = readersQueue.end(); i != e; ++i) {
+		if (i->first > ms) {
+			break;
+		}
+		const auto reader = i->second;
+		if (reader->_processedPass == _pass) {
+			// Each reader is processed once in a pass.
+			continue;
+		}
+		readersQueue.erase(i);
+		reader->_processing = true;
+		reader->_processedPass = _pass;
+
+		// If the next frame is due before we finish with this one,
+		// let an idle thread take it instead of waiting for us.
+		const auto finishes = ms + reader->_decodeCost / 1000;
+		if (!readersQueue.empty()) {
+			const auto next = readersQueue.begin()->first;
+			if (next <= finishes && !armedBefore(next)) {
+				wakeIdle();
+			}
+		}
+		return reader;
+	}
+	return nullptr;
+}
+
+void Manager::release(
+		ReaderPrivate *reader,
+		TimeMs when,
+		bool waitingForData) {
+	QMutexLocker lock(&readersMutex);
+	reader->_processing = false;
+
+	// Check it with the mutex locked, so that a part loaded meanwhile
+	// by the main thread doesn't leave the reader waiting forever.
+	reader->_waitingForData = waitingForData
+		&& !reader->streamedDataReady();
+	reader->_queuedWhen = reader->_waitingForData ? kNeverProcess : when;
+	readersQueue.emplace(reader->_queuedWhen, reader);
+	if (reader->_updatePending) {
+		reader->_updatePending = false;
+		readersChanged = true;
+	}
+}
+
+void Manager::scheduleProcess() {
+	auto when = TimeMs(0);
+	{
+		QMutexLocker lock(&readersMutex);
+		const auto ms = getms();
+		applyUpdates(ms);
+		if (readers.size() > readerPointers.size()) {
+			for (auto i = readers.begin(); i != readers.end();) {
+				const auto reader = *i;
+				if (!reader->_processing
+					&& constUnsafeFindReaderPointer(reader) == readerPointers.cend()) {
+					readersQueue.erase(std::make_pair(reader->_queuedWhen, reader));
+					delete reader;
+					i = readers.erase(i);
+				} else {
+					++i;
+				}
+			}
+		}
+
+		// Only one of the idle threads waits for the nearest deadline.
+		_busy = false;
+		_armedWhen = 0;
+		if (_needReProcess) {
+			_needReProcess = false;
+			when = ms;
+		} else if (!readersQueue.empty()) {
+			const auto first = readersQueue.begin()->first;
+			if (first != kNeverProcess && !armedBefore(first)) {
+				when = first;
+			}
+		}
+		_armedWhen = when;
+	}
+	if (when) {
+		_timer.start(std::max(when - getms(), TimeMs(1)));
+	}
 }
 
 bool Manager::handleProcessResult(ReaderPrivate *reader, ProcessResult result, TimeMs ms) {
-	QMutexLocker lock(&_readerPointersMutex);
+	QMutexLocker lock(&readersMutex);
 	auto it = unsafeFindReaderPointer(reader);
 	if (result == ProcessResult::Error) {
-		if (it != _readerPointers.cend()) {
+		if (it != readerPointers.cend()) {
 			it.key()->error();
-			emit callback(it.key(), it.key()->threadIndex(), NotificationReinit);
-			_readerPointers.erase(it);
+			emit callback(it.key(), _index, NotificationReinit);
+			readerPointers.erase(it);
 		}
 		return false;
 	} else if (result == ProcessResult::Finished) {
-		if (it != _readerPointers.cend()) {
+		if (it != readerPointers.cend()) {
 			it.key()->finished();
-			emit callback(it.key(), it.key()->threadIndex(), NotificationReinit);
+			emit callback(it.key(), _index, NotificationReinit);
 		}
 		return false;
 	}
-	if (it == _readerPointers.cend()) {
+	if (it == readerPointers.cend()) {
 		return false;
 	}
 
 	if (result == ProcessResult::Started) {
-		_loadLevel.fetchAndAddRelaxed(reader->_width * reader->_height - AverageGifSize);
 		it.key()->_durationMs = reader->_durationMs;
 		it.key()->_hasAudio = reader->_hasAudio;
 	}
@@ -707,21 +1195,24 @@ bool Manager::handleProcessResult(ReaderPrivate *reader, ProcessResult result, T
 		if (result == ProcessResult::Started) {
 			reader->startedAt(ms);
 			it.key()->moveToNextWrite();
-			emit callback(it.key(), it.key()->threadIndex(), NotificationReinit);
+			emit callback(it.key(), _index, NotificationReinit);
 		}
 	} else if (result == ProcessResult::Paused) {
 		it.key()->moveToNextWrite();
-		emit callback(it.key(), it.key()->threadIndex(), NotificationReinit);
+		emit callback(it.key(), _index, NotificationReinit);
 	} else if (result == ProcessResult::Repaint) {
 		it.key()->moveToNextWrite();
-		emit callback(it.key(), it.key()->threadIndex(), NotificationRepaint);
+		emit callback(it.key(), _index, NotificationRepaint);
 	}
 	return true;
 }
 
 Manager::ResultHandleState Manager::handleResult(ReaderPrivate *reader, ProcessResult result, TimeMs ms) {
 	if (!handleProcessResult(reader, result, ms)) {
-		_loadLevel.fetchAndAddRelaxed(-1 * (reader->_width > 0 ? reader->_width * reader->_height : AverageGifSize));
+		{
+			QMutexLocker lock(&readersMutex);
+			readers.removeOne(reader);
+		}
 		delete reader;
 		return ResultHandleRemove;
 	}
@@ -733,11 +1224,10 @@ Manager::ResultHandleState Manager::handleResult(ReaderPrivate *reader, ProcessR
 
 	if (result == ProcessResult::Repaint) {
 		{
-			QMutexLocker lock(&_readerPointersMutex);
+			QMutexLocker lock(&readersMutex);
 			auto it = constUnsafeFindReaderPointer(reader);
-			if (it != _readerPointers.cend()) {
+			if (it != readerPointers.cend()) {
 				int32 index = 0;
-				Reader *r = it.key();
 				Reader::Frame *frame = it.key()->frameToWrite(&index);
 				if (frame) {
 					frame->clear();
@@ -747,7 +1237,12 @@ Manager::ResultHandleState Manager::handleResult(ReaderPrivate *reader, ProcessR
 				reader->_frame = index;
 			}
 		}
-		return handleResult(reader, reader->finishProcess(ms), ms);
+		const auto decodeStarted = std::chrono::steady_clock::now();
+		const auto decoded = reader->finishProcess(ms);
+		reader->countDecodeCost(
+			std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - decodeStarted).count());
+		return handleResult(reader, decoded, ms);
 	}
 
 	return ResultHandleContinue;
@@ -761,104 +1256,59 @@ void Manager::process() {
 
 	_timer.stop();
 	_processingInThread = thread();
-
-	bool checkAllReaders = false;
-	auto ms = getms(), minms = ms + 86400 * 1000LL;
 	{
-		QMutexLocker lock(&_readerPointersMutex);
-		for (auto it = _readerPointers.begin(), e = _readerPointers.end(); it != e; ++it) {
-			if (it->loadAcquire() && it.key()->_private != nullptr) {
-				auto i = _readers.find(it.key()->_private);
-				if (i == _readers.cend()) {
-					_readers.insert(it.key()->_private, 0);
-				} else {
-					i.value() = ms;
-					if (i.key()->_autoPausedGif && !it.key()->_autoPausedGif.loadAcquire()) {
-						i.key()->_autoPausedGif = false;
-					}
-					if (it.key()->_videoPauseRequest.loadAcquire()) {
-						i.key()->pauseVideo(ms);
-					} else {
-						i.key()->resumeVideo(ms);
-					}
-				}
-				auto frame = it.key()->frameToWrite();
-				if (frame) it.key()->_private->_request = frame->request;
-				it->storeRelease(0);
-			}
-		}
-		checkAllReaders = (_readers.size() > _readerPointers.size());
+		QMutexLocker lock(&readersMutex);
+		_busy = true;
+		_armedWhen = 0;
+		_pass = ++processPass;
 	}
 
-	for (auto i = _readers.begin(), e = _readers.end(); i != e;) {
-		ReaderPrivate *reader = i.key();
-		if (i.value() <= ms) {
-			ResultHandleState state = handleResult(reader, reader->process(ms), ms);
-			if (state == ResultHandleRemove) {
-				i = _readers.erase(i);
-				continue;
-			} else if (state == ResultHandleStop) {
-				_processingInThread = 0;
-				return;
-			}
-			ms = getms();
-			if (reader->_videoPausedAtMs) {
-				i.value() = ms + 86400 * 1000ULL;
-			} else if (reader->_nextFrameWhen && reader->_started) {
-				i.value() = reader->_nextFrameWhen;
-			} else {
-				i.value() = (ms + 86400 * 1000ULL);
-			}
-		} else if (checkAllReaders) {
-			QMutexLocker lock(&_readerPointersMutex);
-			auto it = constUnsafeFindReaderPointer(reader);
-			if (it == _readerPointers.cend()) {
-				_loadLevel.fetchAndAddRelaxed(-1 * (reader->_width > 0 ? reader->_width * reader->_height : AverageGifSize));
-				delete reader;
-				i = _readers.erase(i);
-				continue;
-			}
+	auto ms = getms();
+	while (const auto reader = takeDue(ms)) {
+		if (!reader->streamedDataReady()) {
+			// Don't block the thread, wait until the loader gets the part.
+			release(reader, ms, true);
+			continue;
 		}
-		if (!reader->_autoPausedGif && i.value() < minms) {
-			minms = i.value();
+		const auto state = handleResult(reader, reader->process(ms), ms);
+		if (state == ResultHandleRemove) {
+			continue;
+		}
+		ms = getms();
+		const auto waiting = reader->_videoPausedAtMs
+			|| reader->_autoPausedGif
+			|| !reader->_nextFrameWhen
+			|| !reader->_started;
+		release(reader, waiting ? kNeverProcess : reader->_nextFrameWhen);
+		if (state == ResultHandleStop) {
+			break;
 		}
-		++i;
-	}
-
-	ms = getms();
-	if (_needReProcess || minms <= ms) {
-		_needReProcess = false;
-		_timer.start(1);
-	} else {
-		_timer.start(minms - ms);
 	}
+	scheduleProcess();
 
-	_processingInThread = 0;
+	_processingInThread = nullptr;
 }
 
 void Manager::finish() {
 	_timer.stop();
-	clear();
 }
 
 void Manager::clear() {
-	{
-		QMutexLocker lock(&_readerPointersMutex);
-		for (auto it = _readerPointers.begin(), e = _readerPointers.end(); it != e; ++it) {
-			it.key()->_private = nullptr;
-		}
-		_readerPointers.clear();
+	QMutexLocker lock(&readersMutex);
+	for (auto it = readerPointers.begin(), e = readerPointers.end(); it != e; ++it) {
+		it.key()->_private = nullptr;
 	}
+	readerPointers.clear();
+	readersChanged = false;
 
-	for (Readers::iterator i = _readers.begin(), e = _readers.end(); i != e; ++i) {
-		delete i.key();
+	for (const auto reader : readers) {
+		delete reader;
 	}
-	_readers.clear();
+	readers.clear();
+	readersQueue.clear();
 }
 
-Manager::~Manager() {
-	clear();
-}
+Manager::~Manager() = default;
 
 FileMediaInformation::Video PrepareForSending(const QString &fname, const QByteArray &data) {
 	auto result = FileMediaInformation::Video();
@@ -904,15 +1354,27 @@ FileMediaInformation::Video PrepareForSending(const QString &fname, const QByteA
 
 void Finish() {
 	if (!threads.isEmpty()) {
+		for (const auto thread : threads) {
+			thread->requestInterruption();
+			thread->quit();
+		}
 		for (int32 i = 0, l = threads.size(); i < l; ++i) {
-			threads.at(i)->quit();
 			DEBUG_LOG(("Waiting for clipThread to finish: %1").arg(i));
 			threads.at(i)->wait();
-			delete managers.at(i);
-			delete threads.at(i);
+		}
+
+		// Readers are shared by the threads, so destroy them after all
+		// the threads have finished.
+		Manager::clear();
+		{
+			QMutexLocker lock(&readersMutex);
+			for (int32 i = 0, l = threads.size(); i < l; ++i) {
+				delete managers.at(i);
+				delete threads.at(i);
+			}
+			managers.clear();
 		}
 		threads.clear();
-		managers.clear();
 	}
 }
 
@@ -12,6 +12,10 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 class FileLocation;
 
+namespace Storage {
+class StreamedFile;
+} // namespace Storage
+
 namespace Media {
 namespace Clip {
 
@@ -87,9 +91,6 @@ public:
 		return _autoPausedGif.loadAcquire();
 	}
 	bool videoPaused() const;
-	int threadIndex() const {
-		return _threadIndex;
-	}
 
 	int width() const;
 	int height() const;
@@ -117,7 +118,10 @@ public:
 	~Reader();
 
 private:
-	void init(const FileLocation &location, const QByteArray &data);
+	void init(
+		const FileLocation &location,
+		const QByteArray &data,
+		std::shared_ptr<Storage::StreamedFile> streamed = nullptr);
 
 	Callback _callback;
 	Mode _mode;
@@ -157,7 +161,6 @@ private:
 
 	QAtomicInt _autoPausedGif = 0;
 	QAtomicInt _videoPauseRequest = 0;
-	int32 _threadIndex;
 
 	bool _autoplay = false;
 
@@ -182,20 +185,29 @@ enum class ProcessResult {
 	Wait,
 };
 
+// Clip threads don't own readers: every thread takes the reader with
+// the nearest frame deadline from the queue shared by all of them.
 class Manager : public QObject {
 	Q_OBJECT
 
 public:
 
-	Manager(QThread *thread);
-	int32 loadLevel() const {
-		return _loadLevel.load();
-	}
-	void append(Reader *reader, const FileLocation &location, const QByteArray &data);
-	void start(Reader *reader);
-	void update(Reader *reader);
-	void stop(Reader *reader);
-	bool carries(Reader *reader) const;
+	Manager(int index, QThread *thread);
+	static void append(
+		Reader *reader,
+		const FileLocation &location,
+		const QByteArray &data,
+		std::shared_ptr<Storage::StreamedFile> streamed);
+	static void update(Reader *reader);
+	static void stop(Reader *reader);
+	static bool carries(Reader *reader);
+	static void clear();
+
+	// Queues again the readers that wait for the streamed file parts.
+	static void streamedPartLoaded();
+
+	// Called from a clip thread around reads that wait for the parts.
+	static void threadBlocked(bool blocked);
 	~Manager();
 
 signals:
@@ -208,16 +220,22 @@ public slots:
 	void finish();
 
 private:
-
-	void clear();
-
-	QAtomicInt _loadLevel;
 	using ReaderPointers = QMap<Reader*, QAtomicInt>;
-	ReaderPointers _readerPointers;
-	mutable QMutex _readerPointersMutex;
-
-	ReaderPointers::const_iterator constUnsafeFindReaderPointer(ReaderPrivate *reader) const;
-	ReaderPointers::iterator unsafeFindReaderPointer(ReaderPrivate *reader);
+	static ReaderPointers::const_iterator constUnsafeFindReaderPointer(ReaderPrivate *reader);
+	static ReaderPointers::iterator unsafeFindReaderPointer(ReaderPrivate *reader);
+
+	// All of them must be called with the shared readers mutex locked.
+	static void applyUpdates(TimeMs ms);
+	static bool anyBusy();
+	static bool armedBefore(TimeMs when);
+	static void wakeIdle();
+
+	ReaderPrivate *takeDue(TimeMs ms);
+	void release(
+		ReaderPrivate *reader,
+		TimeMs when,
+		bool waitingForData = false);
+	void scheduleProcess();
 
 	bool handleProcessResult(ReaderPrivate *reader, ProcessResult result, TimeMs ms);
 
@@ -228,12 +246,16 @@ private:
 	};
 	ResultHandleState handleResult(ReaderPrivate *reader, ProcessResult result, TimeMs ms);
 
-	typedef QMap<ReaderPrivate*, TimeMs> Readers;
-	Readers _readers;
-
+	int _index = 0;
 	QTimer _timer;
-	QThread *_processingInThread;
-	bool _needReProcess;
+	QThread *_processingInThread = nullptr;
+	bool _needReProcess = false;
+
+	// Guarded by the shared readers mutex.
+	bool _busy = false;
+	bool _blocked = false;
+	TimeMs _armedWhen = 0;
+	uint64 _pass = 0;
 
 };
 
@@ -920,6 +920,11 @@ void MediaView::onDocClick() {
 		if (_doc->loading() && !_radial.animating()) {
 			_radial.start(_doc->progress());
 		}
+		if (!_gif
+			&& (_doc->isAnimation() || _doc->isVideoFile())
+			&& _doc->canBeStreamed()) {
+			initAnimation();
+		}
 	}
 }
 
@@ -1790,6 +1795,8 @@ void MediaView::initAnimation() {
 	} else if (location.accessEnable()) {
 		createClipReader();
 		location.accessDisable();
+	} else if (_doc->canBeStreamed()) {
+		createClipReader();
 	} else if (_doc->dimensions.width() && _doc->dimensions.height()) {
 		auto w = _doc->dimensions.width();
 		auto h = _doc->dimensions.height();
@@ -12,6 +12,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "data/data_session.h"
 #include "base/timer.h"
 #include "core/update_checker.h"
+#include "core/startup_trace.h"
 #include "storage/localstorage.h"
 #include "platform/platform_specific.h"
 #include "mainwindow.h"
@@ -91,13 +92,23 @@ Messenger::Messenger(not_null<Core::Launcher*> launcher)
 
 	SingleInstance = this;
 
-	Fonts::Start();
+	using Trace = Core::StartupTrace::Scope;
+	{
+		const auto trace = Trace("Fonts::Start");
+		Fonts::Start();
+	}
 
 	ThirdParty::start();
 	Global::start();
 	Sandbox::refreshGlobalProxy(); // Depends on Global::started().
 
-	startLocalStorage();
+	{
+		const auto trace = Trace("startLocalStorage");
+		startLocalStorage();
+	}
+
+	// Joined in Local::readMap().
+	Local::prefetchMap();
 
 	if (Local::oldSettingsVersion() < AppVersion) {
 		psNewVersion();
@@ -112,11 +123,20 @@ Messenger::Messenger(not_null<Core::Launcher*> launcher)
 	_translator = std::make_unique<Lang::Translator>();
 	QCoreApplication::instance()->installTranslator(_translator.get());
 
-	style::startManager();
+	{
+		const auto trace = Trace("style::startManager");
+		style::startManager();
+	}
+
+	// Joined in Ui::Emoji::Init(), depends on the style scale.
+	Ui::Emoji::Preload();
+
 	anim::startManager();
 	Ui::InitTextOptions();
-	Ui::Emoji::Init();
-	Media::Player::start();
+	{
+		const auto trace = Trace("Media::Player::start");
+		Media::Player::start();
+	}
 
 	DEBUG_LOG(("Application Info: inited..."));
 
@@ -128,15 +148,25 @@ Messenger::Messenger(not_null<Core::Launcher*> launcher)
 
 	DEBUG_LOG(("Application Info: starting app..."));
 
-	// Create mime database, so it won't be slow later.
-	QMimeDatabase().mimeTypeForName(qsl("text/plain"));
-
-	_window = std::make_unique<MainWindow>();
-	_window->init();
+	{
+		const auto trace = Trace("QMimeDatabase");
 
-	auto currentGeometry = _window->geometry();
-	_mediaView = std::make_unique<MediaView>();
-	_window->setGeometry(currentGeometry);
+		// Create mime database, so it won't be slow later.
+		QMimeDatabase().mimeTypeForName(qsl("text/plain"));
+	}
+	{
+		const auto trace = Trace("Ui::Emoji::Init");
+		Ui::Emoji::Init();
+	}
+	{
+		const auto trace = Trace("MainWindow");
+		_window = std::make_unique<MainWindow>();
+		_window->init();
+
+		auto currentGeometry = _window->geometry();
+		_mediaView = std::make_unique<MediaView>();
+		_window->setGeometry(currentGeometry);
+	}
 
 	QCoreApplication::instance()->installEventFilter(this);
 	Sandbox::connect(SIGNAL(applicationStateChanged(Qt::ApplicationState)), this, SLOT(onAppStateChanged(Qt::ApplicationState)));
@@ -145,9 +175,15 @@ Messenger::Messenger(not_null<Core::Launcher*> launcher)
 
 	Shortcuts::start();
 
-	App::initMedia();
+	{
+		const auto trace = Trace("App::initMedia");
+		App::initMedia();
+	}
 
-	Local::ReadMapState state = Local::readMap(QByteArray());
+	const auto state = [] {
+		const auto trace = Trace("Local::readMap");
+		return Local::readMap(QByteArray());
+	}();
 	if (state == Local::ReadMapPassNeeded) {
 		Global::SetLocalPasscode(true);
 		Global::RefLocalPasscodeChanged().notify();
@@ -155,8 +191,13 @@ Messenger::Messenger(not_null<Core::Launcher*> launcher)
 		DEBUG_LOG(("Application Info: passcode needed..."));
 	} else {
 		DEBUG_LOG(("Application Info: local map read..."));
-		startMtp();
+		{
+			const auto trace = Trace("startMtp");
+			startMtp();
+		}
 		DEBUG_LOG(("Application Info: MTP started..."));
+
+		const auto trace = Trace("setupMain");
 		if (AuthSession::Exists()) {
 			_window->setupMain();
 		} else {
@@ -164,7 +205,10 @@ Messenger::Messenger(not_null<Core::Launcher*> launcher)
 		}
 	}
 	DEBUG_LOG(("Application Info: showing."));
-	_window->firstShow();
+	{
+		const auto trace = Trace("firstShow");
+		_window->firstShow();
+	}
 
 	if (cStartToSettings()) {
 		_window->showSettings();
@@ -172,6 +216,8 @@ Messenger::Messenger(not_null<Core::Launcher*> launcher)
 
 	_window->updateIsActive(Global::OnlineFocusTimeout());
 
+	Core::StartupTrace::Finish();
+
 	if (!Shortcuts::errors().isEmpty()) {
 		const QStringList &errors(Shortcuts::errors());
 		for (QStringList::const_iterator i = errors.cbegin(), e = errors.cend(); i != e; ++i) {
@@ -675,9 +721,12 @@ void Messenger::killDownloadSessions() {
 	auto ms = getms(), left = static_cast<TimeMs>(MTPAckSendWaiting) + MTPKillFileSessionTimeout;
 	for (auto i = killDownloadSessionTimes.begin(); i != killDownloadSessionTimes.end(); ) {
 		if (i.value() <= ms) {
-			for (int j = 0; j < MTP::kDownloadSessionsCount; ++j) {
+			for (int j = 0; j < MTP::kDownloadSessionsCountMax; ++j) {
 				MTP::stopSession(MTP::downloadDcId(i.key(), j));
 			}
+			if (AuthSession::Exists()) {
+				Auth().downloader().sessionsStopped(i.key());
+			}
 			i = killDownloadSessionTimes.erase(i);
 		} else {
 			if (i.value() - ms < left) {
@@ -12,7 +12,6 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "mtproto/rpc_sender.h"
 #include "mtproto/dc_options.h"
 #include "mtproto/connection_abstract.h"
-#include "zlib.h"
 #include "messenger.h"
 #include "core/launcher.h"
 #include "lang/lang_keys.h"
@@ -1235,7 +1234,9 @@ void ConnectionPrivate::onSentSome(uint64 size) {
 		if (isUploadDcId(_shiftedDcId)) {
 			remain *= kUploadSessionsCount;
 		} else if (isDownloadDcId(_shiftedDcId)) {
-			remain *= kDownloadSessionsCount;
+			// Downloader may use up to kDownloadSessionsCountMax sessions
+			// per dc that share the bandwidth, so the response may be late.
+			remain *= kDownloadSessionsCountMax;
 		}
 		_waitForReceivedTimer.callOnce(remain);
 	}
@@ -1544,7 +1545,7 @@ void ConnectionPrivate::handleReceived() {
 		auto from = decryptedInts + kEncryptedHeaderIntsCount;
 		auto end = from + (messageLength / kIntSize);
 		auto sfrom = decryptedInts + 4U; // msg_id + seq_no + length + message
-		MTP_LOG(_shiftedDcId, ("Recv: ") + mtpTextSerialize(sfrom, end));
+		MTP_TRACE(_shiftedDcId, false, sfrom, end);
 
 		bool needToHandle = false;
 		{
@@ -2181,50 +2182,10 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 	return HandleResult::Success;
 }
 
-mtpBuffer ConnectionPrivate::ungzip(const mtpPrime *from, const mtpPrime *end) const {
-	MTPstring packed;
-	packed.read(from, end); // read packed string as serialized mtp string type
-	uint32 packedLen = packed.v.size(), unpackedChunk = packedLen, unpackedLen = 0;
-
-	mtpBuffer result; // * 4 because of mtpPrime type
-	result.resize(0);
-	z_stream stream;
-	stream.zalloc = 0;
-	stream.zfree = 0;
-	stream.opaque = 0;
-	stream.avail_in = 0;
-	stream.next_in = 0;
-	int res = inflateInit2(&stream, 16 + MAX_WBITS);
-	if (res != Z_OK) {
-		LOG(("RPC Error: could not init zlib stream, code: %1").arg(res));
-		return result;
-	}
-	stream.avail_in = packedLen;
-	stream.next_in = reinterpret_cast<Bytef*>(packed.v.data());
-
-	stream.avail_out = 0;
-	while (!stream.avail_out) {
-		result.resize(result.size() + unpackedChunk);
-		stream.avail_out = unpackedChunk * sizeof(mtpPrime);
-		stream.next_out = (Bytef*)&result[result.size() - unpackedChunk];
-		int res = inflate(&stream, Z_NO_FLUSH);
-		if (res != Z_OK && res != Z_STREAM_END) {
-			inflateEnd(&stream);
-			LOG(("RPC Error: could not unpack gziped data, code: %1").arg(res));
-			DEBUG_LOG(("RPC Error: bad gzip: %1").arg(Logs::mb(packed.v.constData(), packedLen).str()));
-			return mtpBuffer();
-		}
-	}
-	if (stream.avail_out & 0x03) {
-		uint32 badSize = result.size() * sizeof(mtpPrime) - stream.avail_out;
-		LOG(("RPC Error: bad length of unpacked data %1").arg(badSize));
-		DEBUG_LOG(("RPC Error: bad unpacked data %1").arg(Logs::mb(result.data(), badSize).str()));
-		return mtpBuffer();
-	}
-	result.resize(result.size() - (stream.avail_out >> 2));
-	inflateEnd(&stream);
-	if (!result.size()) {
-		LOG(("RPC Error: bad length of unpacked data 0"));
+mtpBuffer ConnectionPrivate::ungzip(const mtpPrime *from, const mtpPrime *end) {
+	auto result = _inflater.inflate(from, end);
+	if (result.isEmpty()) {
+		LOG(("RPC Error: %1").arg(_inflater.error()));
 	}
 	return result;
 }
@@ -3129,7 +3090,7 @@ bool ConnectionPrivate::sendSecureRequest(
 	memcpy(request->data() + 2, &session, 2 * sizeof(mtpPrime));
 
 	auto from = request->constData() + 4;
-	MTP_LOG(_shiftedDcId, ("Send: ") + mtpTextSerialize(from, from + messageSize));
+	MTP_TRACE(_shiftedDcId, true, from, from + messageSize);
 
 #ifdef TDESKTOP_MTPROTO_OLD
 	uint32 padding = fullSize - 4 - messageSize;
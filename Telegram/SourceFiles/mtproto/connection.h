@@ -10,6 +10,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "mtproto/auth_key.h"
 #include "mtproto/dc_options.h"
 #include "mtproto/connection_abstract.h"
+#include "mtproto/gzip_packed.h"
 #include "base/openssl_help.h"
 #include "base/timer.h"
 
@@ -192,7 +193,7 @@ private:
 		ResetSession,
 	};
 	HandleResult handleOneReceived(const mtpPrime *from, const mtpPrime *end, uint64 msgId, int32 serverTime, uint64 serverSalt, bool badTime);
-	mtpBuffer ungzip(const mtpPrime *from, const mtpPrime *end) const;
+	mtpBuffer ungzip(const mtpPrime *from, const mtpPrime *end);
 	void handleMsgsStates(const QVector<MTPlong> &ids, const QByteArray &states, QVector<MTPlong> &acked);
 
 	void clearMessages();
@@ -252,6 +253,7 @@ private:
 	TimeMs firstSentAt = -1;
 
 	QVector<MTPlong> ackRequestData, resendRequestData;
+	GzipInflater _inflater;
 
 	mtpPingId _pingId = 0;
 	mtpPingId _pingIdToSend = 0;
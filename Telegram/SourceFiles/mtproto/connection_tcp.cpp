@@ -8,18 +8,12 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "mtproto/connection_tcp.h"
 
 #include "base/bytes.h"
-#include "base/openssl_help.h"
 #include "base/qthelp_url.h"
 
-extern "C" {
-#include <openssl/aes.h>
-} // extern "C"
-
 namespace MTP {
 namespace internal {
 namespace {
 
-constexpr auto kPacketSizeMax = int(0x01000000 * sizeof(mtpPrime));
 constexpr auto kFullConnectionTimeout = 8 * TimeMs(1000);
 constexpr auto kSmallBufferSize = 256 * 1024;
 constexpr auto kMinPacketBuffer = 256;
@@ -29,213 +23,6 @@ const auto QTcpSocket_error = ErrorSignal(&QAbstractSocket::error);
 
 } // namespace
 
-class TcpConnection::Protocol {
-public:
-	static std::unique_ptr<Protocol> Create(bytes::vector &&secret);
-
-	virtual uint32 id() const = 0;
-	virtual bool supportsArbitraryLength() const = 0;
-
-	virtual bool requiresExtendedPadding() const = 0;
-	virtual void prepareKey(bytes::span key, bytes::const_span source) = 0;
-	virtual bytes::span finalizePacket(mtpBuffer &buffer) = 0;
-
-	static constexpr auto kUnknownSize = -1;
-	static constexpr auto kInvalidSize = -2;
-	virtual int readPacketLength(bytes::const_span bytes) const = 0;
-	virtual bytes::const_span readPacket(bytes::const_span bytes) const = 0;
-
-	virtual ~Protocol() = default;
-
-private:
-	class Version0;
-	class Version1;
-	class VersionD;
-
-};
-
-class TcpConnection::Protocol::Version0 : public Protocol {
-public:
-	uint32 id() const override;
-	bool supportsArbitraryLength() const override;
-
-	bool requiresExtendedPadding() const override;
-	void prepareKey(bytes::span key, bytes::const_span source) override;
-	bytes::span finalizePacket(mtpBuffer &buffer) override;
-
-	int readPacketLength(bytes::const_span bytes) const override;
-	bytes::const_span readPacket(bytes::const_span bytes) const override;
-
-};
-
-uint32 TcpConnection::Protocol::Version0::id() const {
-	return 0xEFEFEFEFU;
-}
-
-bool TcpConnection::Protocol::Version0::supportsArbitraryLength() const {
-	return false;
-}
-
-bool TcpConnection::Protocol::Version0::requiresExtendedPadding() const {
-	return false;
-}
-
-void TcpConnection::Protocol::Version0::prepareKey(
-		bytes::span key,
-		bytes::const_span source) {
-	bytes::copy(key, source);
-}
-
-bytes::span TcpConnection::Protocol::Version0::finalizePacket(
-		mtpBuffer &buffer) {
-	Expects(buffer.size() > 2 && buffer.size() < 0x1000003U);
-
-	const auto intsSize = uint32(buffer.size() - 2);
-	const auto bytesSize = intsSize * sizeof(mtpPrime);
-	const auto data = reinterpret_cast<uchar*>(&buffer[0]);
-	const auto added = [&] {
-		if (intsSize < 0x7F) {
-			data[7] = uchar(intsSize);
-			return 1;
-		}
-		data[4] = uchar(0x7F);
-		data[5] = uchar(intsSize & 0xFF);
-		data[6] = uchar((intsSize >> 8) & 0xFF);
-		data[7] = uchar((intsSize >> 16) & 0xFF);
-		return 4;
-	}();
-	return bytes::make_span(buffer).subspan(8 - added, added + bytesSize);
-}
-
-int TcpConnection::Protocol::Version0::readPacketLength(
-		bytes::const_span bytes) const {
-	if (bytes.empty()) {
-		return kUnknownSize;
-	}
-	const auto first = static_cast<char>(bytes[0]);
-	if (first == 0x7F) {
-		if (bytes.size() < 4) {
-			return kUnknownSize;
-		}
-		const auto ints = static_cast<uint32>(bytes[1])
-			| (static_cast<uint32>(bytes[2]) << 8)
-			| (static_cast<uint32>(bytes[3]) << 16);
-		return (ints >= 0x7F) ? (int(ints << 2) + 4) : kInvalidSize;
-	} else if (first > 0 && first < 0x7F) {
-		const auto ints = uint32(first);
-		return int(ints << 2) + 1;
-	}
-	return kInvalidSize;
-}
-
-bytes::const_span TcpConnection::Protocol::Version0::readPacket(
-		bytes::const_span bytes) const {
-	const auto size = readPacketLength(bytes);
-	Assert(size != kUnknownSize
-		&& size != kInvalidSize
-		&& size <= bytes.size());
-	const auto sizeLength = (static_cast<char>(bytes[0]) == 0x7F) ? 4 : 1;
-	return bytes.subspan(sizeLength, size - sizeLength);
-}
-
-class TcpConnection::Protocol::Version1 : public Version0 {
-public:
-	explicit Version1(bytes::vector &&secret);
-
-	bool requiresExtendedPadding() const override;
-	void prepareKey(bytes::span key, bytes::const_span source) override;
-
-private:
-	bytes::vector _secret;
-
-};
-
-TcpConnection::Protocol::Version1::Version1(bytes::vector &&secret)
-: _secret(std::move(secret)) {
-}
-
-bool TcpConnection::Protocol::Version1::requiresExtendedPadding() const {
-	return true;
-}
-
-void TcpConnection::Protocol::Version1::prepareKey(
-		bytes::span key,
-		bytes::const_span source) {
-	const auto payload = bytes::concatenate(source, _secret);
-	bytes::copy(key, openssl::Sha256(payload));
-}
-
-class TcpConnection::Protocol::VersionD : public Version1 {
-public:
-	using Version1::Version1;
-
-	uint32 id() const override;
-	bool supportsArbitraryLength() const override;
-
-	bytes::span finalizePacket(mtpBuffer &buffer) override;
-
-	int readPacketLength(bytes::const_span bytes) const override;
-	bytes::const_span readPacket(bytes::const_span bytes) const override;
-
-};
-
-uint32 TcpConnection::Protocol::VersionD::id() const {
-	return 0xDDDDDDDDU;
-}
-
-bool TcpConnection::Protocol::VersionD::supportsArbitraryLength() const {
-	return true;
-}
-
-bytes::span TcpConnection::Protocol::VersionD::finalizePacket(
-		mtpBuffer &buffer) {
-	Expects(buffer.size() > 2 && buffer.size() < 0x1000003U);
-
-	const auto intsSize = uint32(buffer.size() - 2);
-	const auto padding = rand_value<uint32>() & 0x0F;
-	const auto bytesSize = intsSize * sizeof(mtpPrime) + padding;
-	buffer[1] = bytesSize;
-	for (auto added = 0; added < padding; added += 4) {
-		buffer.push_back(rand_value<mtpPrime>());
-	}
-
-	return bytes::make_span(buffer).subspan(4, 4 + bytesSize);
-}
-
-int TcpConnection::Protocol::VersionD::readPacketLength(
-		bytes::const_span bytes) const {
-	if (bytes.size() < 4) {
-		return kUnknownSize;
-	}
-	const auto value = *reinterpret_cast<const uint32*>(bytes.data()) + 4;
-	return (value >= 8 && value < kPacketSizeMax)
-		? int(value)
-		: kInvalidSize;
-}
-
-bytes::const_span TcpConnection::Protocol::VersionD::readPacket(
-		bytes::const_span bytes) const {
-	const auto size = readPacketLength(bytes);
-	Assert(size != kUnknownSize
-		&& size != kInvalidSize
-		&& size <= bytes.size());
-	const auto sizeLength = 4;
-	return bytes.subspan(sizeLength, size - sizeLength);
-}
-
-auto TcpConnection::Protocol::Create(bytes::vector &&secret)
--> std::unique_ptr<Protocol> {
-	if (secret.size() == 17 && static_cast<uchar>(secret[0]) == 0xDD) {
-		return std::make_unique<VersionD>(
-			bytes::make_vector(bytes::make_span(secret).subspan(1)));
-	} else if (secret.size() == 16) {
-		return std::make_unique<Version1>(std::move(secret));
-	} else if (secret.empty()) {
-		return std::make_unique<Version0>();
-	}
-	Unexpected("Secret bytes in TcpConnection::Protocol::Create.");
-}
-
 TcpConnection::TcpConnection(QThread *thread, const ProxyData &proxy)
 : AbstractConnection(thread, proxy)
 , _checkNonce(rand_value<MTPint128>()) {
@@ -325,7 +112,7 @@ void TcpConnection::socketRead() {
 			readLimit);
 		if (readCount > 0) {
 			const auto read = free.subspan(0, readCount);
-			aesCtrEncrypt(read, _receiveKey, &_receiveState);
+			_receive.apply(read);
 			TCP_LOG(("TCP Info: read %1 bytes").arg(readCount));
 
 			_readBytes += readCount;
@@ -348,7 +135,7 @@ void TcpConnection::socketRead() {
 				while (_readBytes > 0) {
 					const auto packetSize = _protocol->readPacketLength(
 						available);
-					if (packetSize == Protocol::kUnknownSize) {
+					if (packetSize == TcpProtocol::kUnknownSize) {
 						// Not enough bytes yet.
 						break;
 					} else if (packetSize <= 0) {
@@ -493,59 +280,14 @@ void TcpConnection::sendData(mtpBuffer &&buffer) {
 void TcpConnection::writeConnectionStart() {
 	Expects(_protocol != nullptr);
 
-	// prepare random part
-	auto nonceBytes = bytes::vector(64);
-	const auto nonce = bytes::make_span(nonceBytes);
-
-	const auto zero = reinterpret_cast<uchar*>(nonce.data());
-	const auto first = reinterpret_cast<uint32*>(nonce.data());
-	const auto second = first + 1;
-	const auto reserved01 = 0x000000EFU;
-	const auto reserved11 = 0x44414548U;
-	const auto reserved12 = 0x54534F50U;
-	const auto reserved13 = 0x20544547U;
-	const auto reserved14 = 0xEEEEEEEEU;
-	const auto reserved15 = 0xDDDDDDDDU;
-	const auto reserved21 = 0x00000000U;
-	do {
-		bytes::set_random(nonce);
-	} while (*zero == reserved01
-		|| *first == reserved11
-		|| *first == reserved12
-		|| *first == reserved13
-		|| *first == reserved14
-		|| *first == reserved15
-		|| *second == reserved21);
-
-	// prepare encryption key/iv
-	_protocol->prepareKey(
-		bytes::make_span(_sendKey),
-		nonce.subspan(8, CTRState::KeySize));
-	bytes::copy(
-		bytes::make_span(_sendState.ivec),
-		nonce.subspan(8 + CTRState::KeySize, CTRState::IvecSize));
-
-	// prepare decryption key/iv
-	auto reversedBytes = bytes::vector(48);
-	const auto reversed = bytes::make_span(reversedBytes);
-	bytes::copy(reversed, nonce.subspan(8, reversed.size()));
-	std::reverse(reversed.begin(), reversed.end());
-	_protocol->prepareKey(
-		bytes::make_span(_receiveKey),
-		reversed.subspan(0, CTRState::KeySize));
-	bytes::copy(
-		bytes::make_span(_receiveState.ivec),
-		reversed.subspan(CTRState::KeySize, CTRState::IvecSize));
-
-	// write protocol and dc ids
-	const auto protocol = reinterpret_cast<uint32*>(nonce.data() + 56);
-	*protocol = _protocol->id();
-	const auto dcId = reinterpret_cast<int16*>(nonce.data() + 60);
-	*dcId = _protocolDcId;
+	auto nonce = PrepareTcpConnectionStart(_protocol->id(), _protocolDcId);
+	auto obfuscation = PrepareTcpObfuscation(*_protocol, nonce);
+	_send = obfuscation.send;
+	_receive = obfuscation.receive;
 
 	_socket.write(reinterpret_cast<const char*>(nonce.data()), 56);
-	aesCtrEncrypt(nonce, _sendKey, &_sendState);
-	_socket.write(reinterpret_cast<const char*>(nonce.subspan(56).data()), 8);
+	_send.apply(nonce);
+	_socket.write(reinterpret_cast<const char*>(nonce.data() + 56), 8);
 }
 
 void TcpConnection::sendBuffer(mtpBuffer &&buffer) {
@@ -557,7 +299,7 @@ void TcpConnection::sendBuffer(mtpBuffer &&buffer) {
 	// buffer: 2 available int-s + data + available int.
 	const auto bytes = _protocol->finalizePacket(buffer);
 	TCP_LOG(("TCP Info: write packet %1 bytes").arg(bytes.size()));
-	aesCtrEncrypt(bytes, _sendKey, &_sendState);
+	_send.apply(bytes);
 	_socket.write(
 		reinterpret_cast<const char*>(bytes.data()),
 		bytes.size());
@@ -588,7 +330,7 @@ void TcpConnection::connectToServer(
 	if (_proxy.type == ProxyData::Type::Mtproto) {
 		_address = _proxy.host;
 		_port = _proxy.port;
-		_protocol = Protocol::Create(_proxy.secretFromMtprotoPassword());
+		_protocol = TcpProtocol::Create(_proxy.secretFromMtprotoPassword());
 
 		DEBUG_LOG(("TCP Info: "
 			"dc:%1 - Connecting to proxy '%2'"
@@ -597,7 +339,7 @@ void TcpConnection::connectToServer(
 	} else {
 		_address = address;
 		_port = port;
-		_protocol = Protocol::Create(base::duplicate(protocolSecret));
+		_protocol = TcpProtocol::Create(base::duplicate(protocolSecret));
 
 		DEBUG_LOG(("TCP Info: "
 			"dc:%1 - Connecting to '%2'"
@@ -9,6 +9,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "mtproto/auth_key.h"
 #include "mtproto/connection_abstract.h"
+#include "mtproto/connection_tcp_protocol.h"
 #include "base/timer.h"
 
 namespace MTP {
@@ -77,12 +78,9 @@ private:
 	bytes::vector _largeBuffer;
 	bool _usingLargeBuffer = false;
 
-	uchar _sendKey[CTRState::KeySize];
-	CTRState _sendState;
-	uchar _receiveKey[CTRState::KeySize];
-	CTRState _receiveState;
-	class Protocol;
-	std::unique_ptr<Protocol> _protocol;
+	TcpCipher _send;
+	TcpCipher _receive;
+	std::unique_ptr<TcpProtocol> _protocol;
 	int16 _protocolDcId = 0;
 
 	Status _status = Status::Waiting;
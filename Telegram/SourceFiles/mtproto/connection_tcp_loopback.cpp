@@ -0,0 +1,294 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "mtproto/connection_tcp_loopback.h"
+
+#include "base/openssl_help.h"
+
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+#include <chrono>
+#include <ctime>
+#include <deque>
+#include <random>
+
+namespace MTP {
+namespace internal {
+namespace {
+
+// Stopped server notices it at least that often.
+constexpr auto kWaitTimeout = 10;
+
+constexpr auto kReqPqId = mtpTypeId(0x60469778U);
+constexpr auto kReqPqMultiId = mtpTypeId(0xBE7E8EF1U);
+constexpr auto kResPqId = mtpTypeId(0x05162463U);
+constexpr auto kVectorId = mtpTypeId(0x1CB5C415U);
+
+// pq from the MTProto auth key creation example.
+constexpr auto kFakePq = uint64(0x17ED48941A08F981ULL);
+
+TimeMs Now() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64 ServerMessageId() {
+	static auto counter = std::atomic<uint32>(0);
+	return (uint64(std::time(nullptr)) << 32)
+		| (uint64(++counter) << 2)
+		| 1ULL;
+}
+
+} // namespace
+
+class TcpLoopback::Server : public QTcpServer {
+public:
+	explicit Server(Fn<void(qintptr)> accepted);
+
+protected:
+	void incomingConnection(qintptr descriptor) override;
+
+private:
+	Fn<void(qintptr)> _accepted;
+
+};
+
+TcpLoopback::Server::Server(Fn<void(qintptr)> accepted)
+: _accepted(std::move(accepted)) {
+}
+
+void TcpLoopback::Server::incomingConnection(qintptr descriptor) {
+	_accepted(descriptor);
+}
+
+TcpLoopback::TcpLoopback(Settings &&settings, Script script)
+: _settings(std::move(settings))
+, _script(std::move(script)) {
+	auto port = std::promise<int>();
+	auto result = port.get_future();
+	_accepting = std::thread([&] {
+		accept(port);
+	});
+	_port = result.get();
+}
+
+TcpLoopback::~TcpLoopback() {
+	_stopped = true;
+	_accepting.join();
+
+	const auto lock = std::unique_lock<std::mutex>(_mutex);
+	for (auto &thread : _serving) {
+		thread.join();
+	}
+}
+
+int TcpLoopback::port() const {
+	return _port;
+}
+
+int TcpLoopback::connections() const {
+	return _connections;
+}
+
+int TcpLoopback::receivedPackets() const {
+	return _received;
+}
+
+int TcpLoopback::droppedPackets() const {
+	return _dropped;
+}
+
+void TcpLoopback::accept(std::promise<int> &port) {
+	auto server = Server([=](qintptr descriptor) {
+		const auto lock = std::unique_lock<std::mutex>(_mutex);
+		_serving.emplace_back([=] {
+			serve(descriptor);
+		});
+	});
+	if (!server.listen(QHostAddress::LocalHost)) {
+		port.set_value(0);
+		return;
+	}
+	port.set_value(server.serverPort());
+	while (!_stopped) {
+		server.waitForNewConnection(kWaitTimeout);
+	}
+}
+
+void TcpLoopback::serve(qintptr descriptor) {
+	auto socket = QTcpSocket();
+	if (!socket.setSocketDescriptor(descriptor)) {
+		return;
+	}
+	++_connections;
+
+	auto protocol = TcpProtocol::Create(
+		bytes::make_vector(_settings.secret));
+	auto send = TcpCipher();
+	auto receive = TcpCipher();
+	auto started = false;
+
+	auto random = std::mt19937(std::random_device()());
+	auto loss = std::bernoulli_distribution(_settings.lossProbability);
+
+	struct Delayed {
+		TimeMs when = 0;
+		mtpBuffer packet;
+	};
+	auto delayed = std::deque<Delayed>();
+	auto buffer = bytes::vector();
+
+	const auto write = [&](const mtpBuffer &packet) {
+		auto framed = mtpBuffer();
+		framed.reserve(2 + packet.size() + 4);
+		framed.resize(2);
+		framed.append(packet);
+		const auto data = protocol->finalizePacket(framed);
+		send.apply(data);
+		socket.write(reinterpret_cast<const char*>(data.data()), data.size());
+	};
+	const auto start = [&] {
+		if (buffer.size() < kTcpConnectionStartSize) {
+			return false;
+		}
+		const auto connectionStart = bytes::make_span(buffer).subspan(
+			0,
+			kTcpConnectionStartSize);
+		const auto obfuscation = PrepareTcpObfuscation(
+			*protocol,
+			connectionStart);
+
+		// The client encrypts with its send cipher, we use it to decrypt.
+		send = obfuscation.receive;
+		receive = obfuscation.send;
+		receive.apply(connectionStart);
+		const auto id = *reinterpret_cast<const uint32*>(
+			connectionStart.data() + 56);
+		if (id != protocol->id()) {
+			return false;
+		}
+		receive.apply(bytes::make_span(buffer).subspan(
+			kTcpConnectionStartSize));
+		buffer.erase(
+			buffer.begin(),
+			buffer.begin() + kTcpConnectionStartSize);
+		started = true;
+		return true;
+	};
+	const auto parse = [&] {
+		auto offset = 0;
+		while (true) {
+			const auto available = bytes::make_span(buffer).subspan(offset);
+			const auto size = protocol->readPacketLength(available);
+			if (size == TcpProtocol::kUnknownSize) {
+				break;
+			} else if (size <= 0) {
+				return false;
+			} else if (available.size() < size) {
+				break;
+			}
+			const auto data = protocol->readPacket(available);
+			offset += size;
+
+			auto packet = mtpBuffer(data.size() / sizeof(mtpPrime));
+			bytes::copy(
+				bytes::make_span(packet),
+				data.subspan(0, packet.size() * sizeof(mtpPrime)));
+			++_received;
+			if (loss(random)) {
+				++_dropped;
+				continue;
+			}
+			const auto when = Now() + _settings.latency;
+			for (auto &answer : _script(packet)) {
+				delayed.push_back({ when, std::move(answer) });
+			}
+		}
+		buffer.erase(buffer.begin(), buffer.begin() + offset);
+		return true;
+	};
+
+	while (!_stopped && socket.state() == QAbstractSocket::ConnectedState) {
+		const auto now = Now();
+		while (!delayed.empty() && delayed.front().when <= now) {
+			write(delayed.front().packet);
+			delayed.pop_front();
+		}
+		const auto timeout = delayed.empty()
+			? kWaitTimeout
+			: int(std::min(TimeMs(kWaitTimeout), delayed.front().when - now));
+		if (!socket.waitForReadyRead(timeout)) {
+			continue;
+		}
+		const auto read = socket.readAll();
+		const auto was = buffer.size();
+		buffer.resize(was + read.size());
+		bytes::copy(
+			bytes::make_span(buffer).subspan(was),
+			bytes::make_span(read));
+		if (started) {
+			receive.apply(bytes::make_span(buffer).subspan(was));
+		} else if (buffer.size() < kTcpConnectionStartSize) {
+			continue;
+		} else if (!start()) {
+			break;
+		}
+		if (!parse()) {
+			break;
+		}
+	}
+	socket.close();
+}
+
+std::vector<mtpBuffer> TcpLoopback::AnswerRequestPQ(const mtpBuffer &packet) {
+	// auth_key_id:long message_id:long message_length:int
+	// req_pq#60469778 nonce:int128 or req_pq_multi#be7e8ef1 nonce:int128
+	constexpr auto kHeaderInts = 5;
+	constexpr auto kNonceInts = 4;
+	if (packet.size() < kHeaderInts + 1 + kNonceInts
+		|| packet[0] != 0
+		|| packet[1] != 0) {
+		return {};
+	}
+	const auto type = mtpTypeId(packet[kHeaderInts]);
+	if (type != kReqPqId && type != kReqPqMultiId) {
+		return {};
+	}
+
+	auto answer = mtpBuffer();
+	answer.reserve(32);
+	answer.resize(kHeaderInts);
+
+	// resPQ#05162463 nonce:int128 server_nonce:int128 pq:string
+	//   server_public_key_fingerprints:Vector<long>
+	answer.push_back(kResPqId);
+	answer.append(packet.mid(kHeaderInts + 1, kNonceInts));
+	auto serverNonce = bytes::array<kNonceInts * sizeof(mtpPrime)>();
+	bytes::set_random(serverNonce);
+	for (auto i = 0; i != kNonceInts; ++i) {
+		answer.push_back(
+			reinterpret_cast<const mtpPrime*>(serverNonce.data())[i]);
+	}
+	auto pq = bytes::array<12>();
+	pq[0] = gsl::byte(8);
+	for (auto i = 0; i != 8; ++i) {
+		pq[1 + i] = gsl::byte((kFakePq >> ((7 - i) * 8)) & 0xFF);
+	}
+	for (auto i = 0; i != 3; ++i) {
+		answer.push_back(reinterpret_cast<const mtpPrime*>(pq.data())[i]);
+	}
+	answer.push_back(kVectorId);
+	answer.push_back(0);
+
+	*reinterpret_cast<uint64*>(&answer[2]) = ServerMessageId();
+	answer[4] = (answer.size() - kHeaderInts) * sizeof(mtpPrime);
+	return { answer };
+}
+
+} // namespace internal
+} // namespace MTP
@@ -0,0 +1,78 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "mtproto/connection_tcp_protocol.h"
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MTP {
+namespace internal {
+
+// TCP transport server on localhost for the transport tests and benchmarks.
+//
+// Accepts TCP transport connections with the given protocol secret,
+// passes every received packet to the script and sends back the packets
+// it returns. Received packets can be dropped and the answers delayed
+// to simulate a bad network.
+//
+// The script gets raw transport packets, TcpLoopbackDc provides a script
+// that creates auth keys and answers the encrypted requests.
+class TcpLoopback {
+public:
+	using Script = Fn<std::vector<mtpBuffer>(const mtpBuffer &packet)>;
+
+	struct Settings {
+		bytes::vector secret;
+		float64 lossProbability = 0.;
+		TimeMs latency = 0;
+	};
+
+	TcpLoopback(Settings &&settings, Script script);
+	TcpLoopback(const TcpLoopback &other) = delete;
+	TcpLoopback &operator=(const TcpLoopback &other) = delete;
+	~TcpLoopback();
+
+	// Zero if the server could not listen.
+	int port() const;
+
+	int connections() const;
+	int receivedPackets() const;
+	int droppedPackets() const;
+
+	// Answers not encrypted req_pq and req_pq_multi with resPQ,
+	// the way TcpConnection checks a new connection.
+	static std::vector<mtpBuffer> AnswerRequestPQ(const mtpBuffer &packet);
+
+private:
+	class Server;
+
+	void accept(std::promise<int> &port);
+	void serve(qintptr descriptor);
+
+	const Settings _settings;
+	const Script _script;
+	int _port = 0;
+
+	std::atomic<bool> _stopped = { false };
+	std::atomic<int> _connections = { 0 };
+	std::atomic<int> _received = { 0 };
+	std::atomic<int> _dropped = { 0 };
+
+	std::thread _accepting;
+	std::mutex _mutex;
+	std::vector<std::thread> _serving;
+
+};
+
+} // namespace internal
+} // namespace MTP
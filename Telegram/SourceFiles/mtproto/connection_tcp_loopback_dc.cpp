@@ -0,0 +1,866 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "mtproto/connection_tcp_loopback_dc.h"
+
+#include "mtproto/gzip_packed.h"
+
+#include <ctime>
+
+namespace MTP {
+namespace internal {
+namespace {
+
+constexpr auto kIntSize = int(sizeof(mtpPrime));
+constexpr auto kRsaKeySize = 256;
+constexpr auto kRsaPrimeBits = 1024;
+constexpr auto kRsaExponent = 65537U;
+constexpr auto kAuthKeySize = 256;
+constexpr auto kDhG = 3;
+constexpr auto kTransportErrorNoKey = mtpPrime(-404);
+constexpr auto kBadServerSaltCode = 48;
+
+constexpr auto kReqPqId = mtpTypeId(0x60469778U);
+constexpr auto kReqPqMultiId = mtpTypeId(0xBE7E8EF1U);
+constexpr auto kResPqId = mtpTypeId(0x05162463U);
+constexpr auto kReqDHParamsId = mtpTypeId(0xD712E4BEU);
+constexpr auto kPQInnerDataId = mtpTypeId(0x83C95AECU);
+constexpr auto kPQInnerDataDcId = mtpTypeId(0xA9F55F95U);
+constexpr auto kServerDHParamsOkId = mtpTypeId(0xD0E8075CU);
+constexpr auto kServerDHInnerDataId = mtpTypeId(0xB5890DBAU);
+constexpr auto kSetClientDHParamsId = mtpTypeId(0xF5045F1FU);
+constexpr auto kClientDHInnerDataId = mtpTypeId(0x6643B654U);
+constexpr auto kDhGenOkId = mtpTypeId(0x3BCBF734U);
+constexpr auto kVectorId = mtpTypeId(0x1CB5C415U);
+constexpr auto kMsgContainerId = mtpTypeId(0x73F1F8DCU);
+constexpr auto kRpcResultId = mtpTypeId(0xF35C6D01U);
+constexpr auto kGzipPackedId = mtpTypeId(0x3072CFA1U);
+constexpr auto kMsgsAckId = mtpTypeId(0x62D6B459U);
+constexpr auto kHttpWaitId = mtpTypeId(0x9299359FU);
+constexpr auto kPingId = mtpTypeId(0x7ABE77ECU);
+constexpr auto kPingDelayDisconnectId = mtpTypeId(0xF3427B8CU);
+constexpr auto kPongId = mtpTypeId(0x347773C5U);
+constexpr auto kBadServerSaltId = mtpTypeId(0xEDAB447BU);
+constexpr auto kInvokeWithLayerId = mtpTypeId(0xDA9B0D0DU);
+constexpr auto kInitConnectionId = mtpTypeId(0x785188B8U);
+constexpr auto kInputClientProxyId = mtpTypeId(0x75588B3FU);
+constexpr auto kInvokeAfterMsgId = mtpTypeId(0xCB9F372DU);
+constexpr auto kInvokeWithoutUpdatesId = mtpTypeId(0xBF9459B7U);
+
+// pq from the MTProto auth key creation example.
+constexpr auto kFakeP = uint32(0x494C553BU);
+constexpr auto kFakeQ = uint32(0x53911073U);
+
+// The prime TcpConnection checks without the primality test.
+constexpr unsigned char kDhPrime[] = {
+	0xC7, 0x1C, 0xAE, 0xB9, 0xC6, 0xB1, 0xC9, 0x04, 0x8E, 0x6C, 0x52, 0x2F, 0x70, 0xF1, 0x3F, 0x73,
+	0x98, 0x0D, 0x40, 0x23, 0x8E, 0x3E, 0x21, 0xC1, 0x49, 0x34, 0xD0, 0x37, 0x56, 0x3D, 0x93, 0x0F,
+	0x48, 0x19, 0x8A, 0x0A, 0xA7, 0xC1, 0x40, 0x58, 0x22, 0x94, 0x93, 0xD2, 0x25, 0x30, 0xF4, 0xDB,
+	0xFA, 0x33, 0x6F, 0x6E, 0x0A, 0xC9, 0x25, 0x13, 0x95, 0x43, 0xAE, 0xD4, 0x4C, 0xCE, 0x7C, 0x37,
+	0x20, 0xFD, 0x51, 0xF6, 0x94, 0x58, 0x70, 0x5A, 0xC6, 0x8C, 0xD4, 0xFE, 0x6B, 0x6B, 0x13, 0xAB,
+	0xDC, 0x97, 0x46, 0x51, 0x29, 0x69, 0x32, 0x84, 0x54, 0xF1, 0x8F, 0xAF, 0x8C, 0x59, 0x5F, 0x64,
+	0x24, 0x77, 0xFE, 0x96, 0xBB, 0x2A, 0x94, 0x1D, 0x5B, 0xCD, 0x1D, 0x4A, 0xC8, 0xCC, 0x49, 0x88,
+	0x07, 0x08, 0xFA, 0x9B, 0x37, 0x8E, 0x3C, 0x4F, 0x3A, 0x90, 0x60, 0xBE, 0xE6, 0x7C, 0xF9, 0xA4,
+	0xA4, 0xA6, 0x95, 0x81, 0x10, 0x51, 0x90, 0x7E, 0x16, 0x27, 0x53, 0xB5, 0x6B, 0x0F, 0x6B, 0x41,
+	0x0D, 0xBA, 0x74, 0xD8, 0xA8, 0x4B, 0x2A, 0x14, 0xB3, 0x14, 0x4E, 0x0E, 0xF1, 0x28, 0x47, 0x54,
+	0xFD, 0x17, 0xED, 0x95, 0x0D, 0x59, 0x65, 0xB4, 0xB9, 0xDD, 0x46, 0x58, 0x2D, 0xB1, 0x17, 0x8D,
+	0x16, 0x9C, 0x6B, 0xC4, 0x65, 0xB0, 0xD6, 0xFF, 0x9C, 0xA3, 0x92, 0x8F, 0xEF, 0x5B, 0x9A, 0xE4,
+	0xE4, 0x18, 0xFC, 0x15, 0xE8, 0x3E, 0xBE, 0xA0, 0xF8, 0x7F, 0xA9, 0xFF, 0x5E, 0xED, 0x70, 0x05,
+	0x0D, 0xED, 0x28, 0x49, 0xF4, 0x7B, 0xF9, 0x59, 0xD9, 0x56, 0x85, 0x0C, 0xE9, 0x29, 0x85, 0x1F,
+	0x0D, 0x81, 0x15, 0xF6, 0x35, 0xB1, 0x05, 0xEE, 0x2E, 0x4E, 0x15, 0xD0, 0x4B, 0x24, 0x54, 0xBF,
+	0x6F, 0x4F, 0xAD, 0xF0, 0x34, 0xB1, 0x04, 0x03, 0x11, 0x9C, 0xD8, 0xE3, 0xB9, 0x2F, 0xCC, 0x5B };
+
+// Reads the TL serialized values, stops at the first error.
+class Reader {
+public:
+	Reader(const mtpPrime *from, const mtpPrime *end)
+	: _from(from)
+	, _end(end) {
+	}
+
+	bool failed() const {
+		return _failed;
+	}
+	const mtpPrime *from() const {
+		return _from;
+	}
+	const mtpPrime *end() const {
+		return _end;
+	}
+
+	mtpPrime readInt() {
+		if (!check(1)) {
+			return 0;
+		}
+		return *_from++;
+	}
+	uint64 readLong() {
+		const auto low = uint64(uint32(readInt()));
+		const auto high = uint64(uint32(readInt()));
+		return low | (high << 32);
+	}
+	bytes::vector readRaw(int size) {
+		Expects(size % kIntSize == 0);
+
+		const auto ints = size / kIntSize;
+		if (!check(ints)) {
+			return {};
+		}
+		auto result = bytes::make_vector(bytes::make_span(_from, ints));
+		_from += ints;
+		return result;
+	}
+	bytes::vector readBytes() {
+		if (!check(1)) {
+			return {};
+		}
+		const auto data = reinterpret_cast<const uchar*>(_from);
+		auto length = int(data[0]);
+		auto start = 1;
+		if (length == 254) {
+			length = int(data[1]) | (int(data[2]) << 8) | (int(data[3]) << 16);
+			start = 4;
+		}
+		const auto ints = (start + length + 3) / kIntSize;
+		if (!check(ints)) {
+			return {};
+		}
+		auto result = bytes::make_vector(bytes::make_span(
+			reinterpret_cast<const gsl::byte*>(data) + start,
+			length));
+		_from += ints;
+		return result;
+	}
+	void skipBytes() {
+		readBytes();
+	}
+
+private:
+	bool check(int ints) {
+		if (_failed || _end - _from < ints) {
+			_failed = true;
+			return false;
+		}
+		return true;
+	}
+
+	const mtpPrime *_from = nullptr;
+	const mtpPrime *_end = nullptr;
+	bool _failed = false;
+
+};
+
+void WriteLong(mtpBuffer &to, uint64 value) {
+	to.push_back(mtpPrime(value & 0xFFFFFFFFULL));
+	to.push_back(mtpPrime(value >> 32));
+}
+
+void WriteRaw(mtpBuffer &to, bytes::const_span data) {
+	Expects(data.size() % kIntSize == 0);
+
+	const auto was = to.size();
+	to.resize(was + data.size() / kIntSize);
+	bytes::copy(bytes::make_span(to).subspan(was * kIntSize), data);
+}
+
+void WriteBytes(mtpBuffer &to, bytes::const_span data) {
+	const auto length = int(data.size());
+	const auto start = (length < 254) ? 1 : 4;
+	const auto ints = (start + length + 3) / kIntSize;
+	auto serialized = bytes::vector(ints * kIntSize);
+	if (start == 1) {
+		serialized[0] = gsl::byte(length);
+	} else {
+		serialized[0] = gsl::byte(254);
+		serialized[1] = gsl::byte(length & 0xFF);
+		serialized[2] = gsl::byte((length >> 8) & 0xFF);
+		serialized[3] = gsl::byte((length >> 16) & 0xFF);
+	}
+	bytes::copy(bytes::make_span(serialized).subspan(start), data);
+	WriteRaw(to, serialized);
+}
+
+bytes::vector BigEndian(uint64 value, int size) {
+	auto result = bytes::vector(size);
+	for (auto i = 0; i != size; ++i) {
+		result[i] = gsl::byte((value >> ((size - i - 1) * 8)) & 0xFF);
+	}
+	return result;
+}
+
+bytes::vector PadLeft(bytes::vector &&data, int size) {
+	if (int(data.size()) >= size) {
+		return std::move(data);
+	}
+	return bytes::concatenate(bytes::vector(size - data.size()), data);
+}
+
+bytes::vector RandomBytes(int size) {
+	auto result = bytes::vector(size);
+	bytes::set_random(result);
+	return result;
+}
+
+uint64 RandomLong() {
+	auto result = uint64();
+	bytes::set_random(bytes::object_as_span(&result));
+	return result;
+}
+
+uint64 ServerMessageId() {
+	static auto counter = std::atomic<uint32>(0);
+	return (uint64(std::time(nullptr)) << 32)
+		| (uint64(++counter) << 2)
+		| 1ULL;
+}
+
+bytes::vector AesIge(
+		bytes::const_span data,
+		bytes::const_span key,
+		bytes::const_span iv,
+		bool encrypt) {
+	Expects(data.size() % AES_BLOCK_SIZE == 0);
+	Expects(key.size() == 32);
+	Expects(iv.size() == 32);
+
+	auto result = bytes::vector(data.size());
+	auto ivCopy = bytes::make_vector(iv);
+	AES_KEY aes;
+	if (encrypt) {
+		AES_set_encrypt_key(
+			reinterpret_cast<const uchar*>(key.data()),
+			256,
+			&aes);
+	} else {
+		AES_set_decrypt_key(
+			reinterpret_cast<const uchar*>(key.data()),
+			256,
+			&aes);
+	}
+	AES_ige_encrypt(
+		reinterpret_cast<const uchar*>(data.data()),
+		reinterpret_cast<uchar*>(result.data()),
+		data.size(),
+		&aes,
+		reinterpret_cast<uchar*>(ivCopy.data()),
+		encrypt ? AES_ENCRYPT : AES_DECRYPT);
+	return result;
+}
+
+// tmp_aes_key and tmp_aes_iv of the server_DH_inner_data encryption.
+std::pair<bytes::vector, bytes::vector> PrepareTemporaryAes(
+		bytes::const_span newNonce,
+		bytes::const_span serverNonce) {
+	const auto ns = openssl::Sha1(newNonce, serverNonce);
+	const auto sn = openssl::Sha1(serverNonce, newNonce);
+	const auto nn = openssl::Sha1(newNonce, newNonce);
+	auto key = bytes::concatenate(
+		ns,
+		bytes::make_span(sn).subspan(0, 12));
+	auto iv = bytes::concatenate(
+		bytes::make_span(sn).subspan(12, 8),
+		nn,
+		newNonce.subspan(0, 4));
+	return { std::move(key), std::move(iv) };
+}
+
+// MTProto 2.0 aes_key and aes_iv, x is 0 for the client messages.
+std::pair<bytes::vector, bytes::vector> PrepareAes(
+		bytes::const_span authKey,
+		bytes::const_span msgKey,
+		int x) {
+	const auto a = openssl::Sha256(msgKey, authKey.subspan(x, 36));
+	const auto b = openssl::Sha256(authKey.subspan(40 + x, 36), msgKey);
+	const auto aSpan = bytes::make_span(a);
+	const auto bSpan = bytes::make_span(b);
+	auto key = bytes::concatenate(
+		aSpan.subspan(0, 8),
+		bSpan.subspan(8, 16),
+		aSpan.subspan(24, 8));
+	auto iv = bytes::concatenate(
+		bSpan.subspan(0, 8),
+		aSpan.subspan(8, 16),
+		bSpan.subspan(24, 8));
+	return { std::move(key), std::move(iv) };
+}
+
+bytes::vector ComputeMsgKey(
+		bytes::const_span authKey,
+		bytes::const_span plaintext,
+		int x) {
+	const auto hash = openssl::Sha256(
+		authKey.subspan(88 + x, 32),
+		plaintext);
+	return bytes::make_vector(bytes::make_span(hash).subspan(8, 16));
+}
+
+mtpBuffer WrapNotEncrypted(const mtpBuffer &body) {
+	auto result = mtpBuffer();
+	result.reserve(5 + body.size());
+	WriteLong(result, 0);
+	WriteLong(result, ServerMessageId());
+	result.push_back(body.size() * kIntSize);
+	result.append(body);
+	return result;
+}
+
+} // namespace
+
+TcpLoopbackDc::TcpLoopbackDc(Handler handler)
+: _handler(std::move(handler)) {
+	// n is a product of two primes with the two top bits set,
+	// so it has exactly 2048 bits, like the datacenter keys.
+	const auto generate = [] {
+		auto result = openssl::BigNum();
+		BN_generate_prime_ex(
+			result.raw(),
+			kRsaPrimeBits,
+			0,
+			nullptr,
+			nullptr,
+			nullptr);
+		return result;
+	};
+	const auto context = openssl::Context();
+	_e.setWord(kRsaExponent);
+	while (true) {
+		const auto p = generate();
+		const auto q = generate();
+		_n = openssl::BigNum::Mul(p, q, context);
+		if (_n.bytesSize() != kRsaKeySize) {
+			continue;
+		}
+		auto p1 = p;
+		auto q1 = q;
+		p1.setSubWord(1);
+		q1.setSubWord(1);
+		const auto phi = openssl::BigNum::Mul(p1, q1, context);
+		if (BN_mod_inverse(_d.raw(), _e.raw(), phi.raw(), context.raw())) {
+			break;
+		}
+	}
+
+	// Fingerprint is the lower 64 bits of SHA1(rsa_public_key n e).
+	auto serialized = mtpBuffer();
+	WriteBytes(serialized, publicKeyN());
+	WriteBytes(serialized, publicKeyE());
+	const auto hash = openssl::Sha1(bytes::make_span(serialized));
+	bytes::copy(
+		bytes::object_as_span(&_fingerprint),
+		bytes::make_span(hash).subspan(12, 8));
+}
+
+TcpLoopback::Script TcpLoopbackDc::script() {
+	return [=](const mtpBuffer &packet) {
+		return handle(packet);
+	};
+}
+
+bytes::vector TcpLoopbackDc::publicKeyN() const {
+	return _n.getBytes();
+}
+
+bytes::vector TcpLoopbackDc::publicKeyE() const {
+	return _e.getBytes();
+}
+
+uint64 TcpLoopbackDc::publicKeyFingerprint() const {
+	return _fingerprint;
+}
+
+int TcpLoopbackDc::authKeysCount() const {
+	const auto lock = std::unique_lock<std::mutex>(_mutex);
+	return _keys.size();
+}
+
+int TcpLoopbackDc::answeredQueries() const {
+	const auto lock = std::unique_lock<std::mutex>(_mutex);
+	return _answered;
+}
+
+std::vector<mtpBuffer> TcpLoopbackDc::handle(const mtpBuffer &packet) {
+	const auto lock = std::unique_lock<std::mutex>(_mutex);
+
+	// auth_key_id:long, zero for the auth key creation messages.
+	if (packet.size() < 2) {
+		return {};
+	} else if (!packet[0] && !packet[1]) {
+		auto answer = handleNotEncrypted(packet);
+		if (answer.isEmpty()) {
+			return {};
+		}
+		return { WrapNotEncrypted(answer) };
+	}
+	return handleEncrypted(packet);
+}
+
+mtpBuffer TcpLoopbackDc::handleNotEncrypted(const mtpBuffer &packet) {
+	// auth_key_id:long message_id:long message_length:int
+	auto reader = Reader(
+		packet.constData(),
+		packet.constData() + packet.size());
+	reader.readLong();
+	reader.readLong();
+	const auto length = reader.readInt();
+	if (reader.failed()
+		|| length < kIntSize
+		|| length % kIntSize
+		|| (reader.end() - reader.from()) * kIntSize < length) {
+		return mtpBuffer();
+	}
+	const auto till = reader.from() + length / kIntSize;
+	const auto type = mtpTypeId(reader.readInt());
+	switch (type) {
+	case kReqPqId:
+	case kReqPqMultiId: {
+		const auto nonce = reader.readRaw(16);
+		return reader.failed() ? mtpBuffer() : answerRequestPQ(nonce);
+	}
+	case kReqDHParamsId:
+		return answerRequestDHParams(reader.from(), till);
+	case kSetClientDHParamsId:
+		return answerSetClientDHParams(reader.from(), till);
+	}
+	return mtpBuffer();
+}
+
+mtpBuffer TcpLoopbackDc::answerRequestPQ(bytes::const_span nonce) {
+	auto &handshake = _handshakes[bytes::make_vector(nonce)];
+	handshake.serverNonce = RandomBytes(16);
+
+	// resPQ nonce:int128 server_nonce:int128 pq:string
+	//   server_public_key_fingerprints:Vector<long>
+	auto result = mtpBuffer();
+	result.push_back(kResPqId);
+	WriteRaw(result, nonce);
+	WriteRaw(result, handshake.serverNonce);
+	WriteBytes(result, BigEndian(uint64(kFakeP) * kFakeQ, 8));
+	result.push_back(kVectorId);
+	result.push_back(1);
+	WriteLong(result, _fingerprint);
+	return result;
+}
+
+mtpBuffer TcpLoopbackDc::answerRequestDHParams(
+		const mtpPrime *from,
+		const mtpPrime *till) {
+	// req_DH_params nonce:int128 server_nonce:int128 p:string q:string
+	//   public_key_fingerprint:long encrypted_data:string
+	auto reader = Reader(from, till);
+	const auto nonce = reader.readRaw(16);
+	const auto serverNonce = reader.readRaw(16);
+	const auto p = reader.readBytes();
+	const auto q = reader.readBytes();
+	const auto fingerprint = reader.readLong();
+	const auto encrypted = reader.readBytes();
+	const auto i = _handshakes.find(nonce);
+	if (reader.failed()
+		|| i == end(_handshakes)
+		|| bytes::compare(i->second.serverNonce, serverNonce)
+		|| bytes::compare(p, BigEndian(kFakeP, 4))
+		|| bytes::compare(q, BigEndian(kFakeQ, 4))
+		|| fingerprint != _fingerprint
+		|| encrypted.size() != kRsaKeySize) {
+		return mtpBuffer();
+	}
+	auto &handshake = i->second;
+
+	// 0 + SHA1(data) + data + padding, encrypted without RSA padding.
+	const auto decrypted = PadLeft(
+		openssl::BigNum::ModExp(
+			openssl::BigNum(encrypted),
+			_d,
+			_n).getBytes(),
+		kRsaKeySize);
+	constexpr auto kDataOffset = 1 + openssl::kSha1Size;
+	auto data = mtpBuffer((kRsaKeySize - kDataOffset) / kIntSize);
+	bytes::copy(
+		bytes::make_span(data),
+		bytes::make_span(decrypted).subspan(
+			kDataOffset,
+			data.size() * kIntSize));
+
+	// p_q_inner_data_dc pq:string p:string q:string nonce:int128
+	//   server_nonce:int128 new_nonce:int256 dc:int
+	auto inner = Reader(data.constData(), data.constData() + data.size());
+	const auto innerType = mtpTypeId(inner.readInt());
+	inner.skipBytes();
+	inner.skipBytes();
+	inner.skipBytes();
+	const auto innerNonce = inner.readRaw(16);
+	const auto innerServerNonce = inner.readRaw(16);
+	const auto newNonce = inner.readRaw(32);
+	if (innerType == kPQInnerDataDcId) {
+		inner.readInt();
+	}
+	if (inner.failed()
+		|| (innerType != kPQInnerDataId && innerType != kPQInnerDataDcId)
+		|| bytes::compare(innerNonce, nonce)
+		|| bytes::compare(innerServerNonce, serverNonce)) {
+		return mtpBuffer();
+	}
+	const auto innerSize = (inner.from() - data.constData()) * kIntSize;
+	const auto hash = openssl::Sha1(
+		bytes::make_span(data).subspan(0, innerSize));
+	if (bytes::compare(
+			hash,
+			bytes::make_span(decrypted).subspan(1, openssl::kSha1Size))) {
+		return mtpBuffer();
+	}
+	handshake.newNonce = newNonce;
+
+	const auto context = openssl::Context();
+	const auto prime = openssl::BigNum(bytes::make_span(kDhPrime));
+	handshake.a = openssl::BigNum(RandomBytes(kAuthKeySize));
+	const auto ga = openssl::BigNum::ModExp(
+		openssl::BigNum(kDhG),
+		handshake.a,
+		prime,
+		context);
+
+	// server_DH_inner_data nonce:int128 server_nonce:int128 g:int
+	//   dh_prime:string g_a:string server_time:int
+	auto answer = mtpBuffer();
+	answer.push_back(kServerDHInnerDataId);
+	WriteRaw(answer, nonce);
+	WriteRaw(answer, serverNonce);
+	answer.push_back(kDhG);
+	WriteBytes(answer, bytes::make_span(kDhPrime));
+	WriteBytes(answer, PadLeft(ga.getBytes(), kAuthKeySize));
+	answer.push_back(mtpPrime(std::time(nullptr)));
+
+	const auto answerBytes = bytes::make_span(answer);
+	auto withHash = bytes::concatenate(
+		openssl::Sha1(answerBytes),
+		answerBytes);
+	const auto padding = (AES_BLOCK_SIZE - (withHash.size() % AES_BLOCK_SIZE))
+		% AES_BLOCK_SIZE;
+	withHash = bytes::concatenate(withHash, RandomBytes(padding));
+	const auto [key, iv] = PrepareTemporaryAes(newNonce, serverNonce);
+
+	// server_DH_params_ok nonce:int128 server_nonce:int128
+	//   encrypted_answer:string
+	auto result = mtpBuffer();
+	result.push_back(kServerDHParamsOkId);
+	WriteRaw(result, nonce);
+	WriteRaw(result, serverNonce);
+	WriteBytes(result, AesIge(withHash, key, iv, true));
+	return result;
+}
+
+mtpBuffer TcpLoopbackDc::answerSetClientDHParams(
+		const mtpPrime *from,
+		const mtpPrime *till) {
+	// set_client_DH_params nonce:int128 server_nonce:int128
+	//   encrypted_data:string
+	auto reader = Reader(from, till);
+	const auto nonce = reader.readRaw(16);
+	const auto serverNonce = reader.readRaw(16);
+	const auto encrypted = reader.readBytes();
+	const auto i = _handshakes.find(nonce);
+	if (reader.failed()
+		|| i == end(_handshakes)
+		|| i->second.newNonce.empty()
+		|| bytes::compare(i->second.serverNonce, serverNonce)
+		|| encrypted.empty()
+		|| encrypted.size() % AES_BLOCK_SIZE) {
+		return mtpBuffer();
+	}
+	const auto &handshake = i->second;
+	const auto [key, iv] = PrepareTemporaryAes(
+		handshake.newNonce,
+		serverNonce);
+	const auto decrypted = AesIge(encrypted, key, iv, false);
+	auto data = mtpBuffer(decrypted.size() / kIntSize);
+	bytes::copy(bytes::make_span(data), decrypted);
+
+	// SHA1(data) + client_DH_inner_data nonce:int128 server_nonce:int128
+	//   retry_id:long g_b:string + padding
+	constexpr auto kHashInts = openssl::kSha1Size / kIntSize;
+	auto inner = Reader(
+		data.constData() + kHashInts,
+		data.constData() + data.size());
+	const auto innerType = mtpTypeId(inner.readInt());
+	const auto innerNonce = inner.readRaw(16);
+	const auto innerServerNonce = inner.readRaw(16);
+	inner.readLong();
+	const auto gb = inner.readBytes();
+	if (inner.failed()
+		|| innerType != kClientDHInnerDataId
+		|| bytes::compare(innerNonce, nonce)
+		|| bytes::compare(innerServerNonce, serverNonce)) {
+		return mtpBuffer();
+	}
+	const auto innerSize = (inner.from() - data.constData() - kHashInts)
+		* kIntSize;
+	const auto hash = openssl::Sha1(
+		bytes::make_span(decrypted).subspan(
+			openssl::kSha1Size,
+			innerSize));
+	if (bytes::compare(
+			hash,
+			bytes::make_span(decrypted).subspan(0, openssl::kSha1Size))) {
+		return mtpBuffer();
+	}
+
+	const auto prime = openssl::BigNum(bytes::make_span(kDhPrime));
+	const auto authKey = PadLeft(
+		openssl::BigNum::ModExp(
+			openssl::BigNum(gb),
+			handshake.a,
+			prime).getBytes(),
+		kAuthKeySize);
+	const auto authKeyHash = openssl::Sha1(authKey);
+	auto keyId = uint64();
+	bytes::copy(
+		bytes::object_as_span(&keyId),
+		bytes::make_span(authKeyHash).subspan(12, 8));
+	auto &stored = _keys[keyId];
+	stored.data = authKey;
+	stored.salt = RandomLong();
+
+	// new_nonce_hash1 is the lower 128 bits of
+	// SHA1(new_nonce + 1 + auth_key_aux_hash).
+	const auto one = bytes::vector(1, gsl::byte(1));
+	const auto newNonceHash = openssl::Sha1(
+		handshake.newNonce,
+		one,
+		bytes::make_span(authKeyHash).subspan(0, 8));
+
+	// dh_gen_ok nonce:int128 server_nonce:int128 new_nonce_hash1:int128
+	auto result = mtpBuffer();
+	result.push_back(kDhGenOkId);
+	WriteRaw(result, nonce);
+	WriteRaw(result, serverNonce);
+	WriteRaw(result, bytes::make_span(newNonceHash).subspan(4, 16));
+	_handshakes.erase(i);
+	return result;
+}
+
+std::vector<mtpBuffer> TcpLoopbackDc::handleEncrypted(
+		const mtpBuffer &packet) {
+	// auth_key_id:long msg_key:int128 encrypted_data:bytes
+	constexpr auto kHeaderInts = 6;
+	if (packet.size() <= kHeaderInts) {
+		return {};
+	}
+	auto reader = Reader(
+		packet.constData(),
+		packet.constData() + kHeaderInts);
+	const auto keyId = reader.readLong();
+	const auto msgKey = reader.readRaw(16);
+	const auto i = _keys.find(keyId);
+	if (i == end(_keys)) {
+		return { mtpBuffer(1, kTransportErrorNoKey) };
+	}
+	auto &key = i->second;
+	const auto encrypted = bytes::make_span(packet).subspan(
+		kHeaderInts * kIntSize);
+	if (encrypted.size() % AES_BLOCK_SIZE) {
+		return {};
+	}
+	const auto [aesKey, aesIv] = PrepareAes(key.data, msgKey, 0);
+	const auto decrypted = AesIge(encrypted, aesKey, aesIv, false);
+	if (bytes::compare(ComputeMsgKey(key.data, decrypted, 0), msgKey)) {
+		return {};
+	}
+	auto data = mtpBuffer(decrypted.size() / kIntSize);
+	bytes::copy(bytes::make_span(data), decrypted);
+
+	// salt:long session_id:long message_id:long seq_no:int
+	//   message_data_length:int message_data:bytes padding:bytes
+	auto message = Reader(
+		data.constData(),
+		data.constData() + data.size());
+	const auto salt = message.readLong();
+	const auto sessionId = message.readLong();
+	const auto msgId = message.readLong();
+	const auto seqNo = message.readInt();
+	const auto length = message.readInt();
+	if (message.failed()
+		|| length < kIntSize
+		|| length % kIntSize
+		|| (message.end() - message.from()) * kIntSize < length) {
+		return {};
+	}
+	const auto from = message.from();
+	const auto till = from + length / kIntSize;
+	if (salt != key.salt) {
+		// bad_server_salt bad_msg_id:long bad_msg_seqno:int
+		//   error_code:int new_server_salt:long
+		auto answer = mtpBuffer();
+		answer.push_back(kBadServerSaltId);
+		WriteLong(answer, msgId);
+		answer.push_back(seqNo);
+		answer.push_back(kBadServerSaltCode);
+		WriteLong(answer, key.salt);
+		return { encrypt(key, keyId, sessionId, answer, false) };
+	}
+	auto answers = std::vector<mtpBuffer>();
+	handleMessage(msgId, from, till, answers);
+	for (auto &answer : answers) {
+		answer = encrypt(key, keyId, sessionId, answer, true);
+	}
+	return answers;
+}
+
+void TcpLoopbackDc::handleMessage(
+		uint64 msgId,
+		const mtpPrime *from,
+		const mtpPrime *till,
+		std::vector<mtpBuffer> &answers) {
+	auto reader = Reader(from, till);
+	const auto type = mtpTypeId(reader.readInt());
+	switch (type) {
+	case kMsgContainerId: {
+		// msg_container messages:vector<%Message>
+		// message msg_id:long seqno:int bytes:int body:Object
+		const auto count = reader.readInt();
+		for (auto i = 0; i != count; ++i) {
+			const auto innerId = reader.readLong();
+			reader.readInt();
+			const auto length = reader.readInt();
+			const auto body = reader.from();
+			if (length < 0 || length % kIntSize) {
+				return;
+			}
+			reader.readRaw(length);
+			if (reader.failed()) {
+				return;
+			}
+			handleMessage(innerId, body, reader.from(), answers);
+		}
+	} break;
+	case kPingId:
+	case kPingDelayDisconnectId: {
+		// pong msg_id:long ping_id:long
+		const auto pingId = reader.readLong();
+		if (!reader.failed()) {
+			auto answer = mtpBuffer();
+			answer.push_back(kPongId);
+			WriteLong(answer, msgId);
+			WriteLong(answer, pingId);
+			answers.push_back(std::move(answer));
+		}
+	} break;
+	case kMsgsAckId:
+	case kHttpWaitId:
+		break;
+	default:
+		handleQuery(msgId, from, till, answers);
+		break;
+	}
+}
+
+void TcpLoopbackDc::handleQuery(
+		uint64 msgId,
+		const mtpPrime *from,
+		const mtpPrime *till,
+		std::vector<mtpBuffer> &answers) {
+	auto reader = Reader(from, till);
+	auto unpacked = mtpBuffer();
+	while (true) {
+		const auto query = reader.from();
+		const auto type = mtpTypeId(reader.readInt());
+		if (type == kInvokeWithLayerId) {
+			reader.readInt();
+		} else if (type == kInitConnectionId) {
+			// initConnection flags:# api_id:int device_model:string
+			//   system_version:string app_version:string
+			//   system_lang_code:string lang_pack:string lang_code:string
+			//   proxy:flags.0?InputClientProxy query:!X
+			const auto flags = reader.readInt();
+			reader.readInt();
+			for (auto i = 0; i != 6; ++i) {
+				reader.skipBytes();
+			}
+			if ((flags & 1) && reader.readInt() == kInputClientProxyId) {
+				reader.skipBytes();
+				reader.readInt();
+			} else if (flags & 1) {
+				return;
+			}
+		} else if (type == kInvokeAfterMsgId) {
+			reader.readLong();
+		} else if (type == kInvokeWithoutUpdatesId) {
+		} else if (type == kGzipPackedId && unpacked.isEmpty()) {
+			const auto packed = reader.readBytes();
+			unpacked = GzipInflater().inflate(packed);
+			if (reader.failed() || unpacked.isEmpty()) {
+				return;
+			}
+			reader = Reader(
+				unpacked.constData(),
+				unpacked.constData() + unpacked.size());
+		} else {
+			if (reader.failed()) {
+				return;
+			}
+			auto serialized = mtpBuffer(reader.end() - query);
+			std::copy(query, reader.end(), serialized.begin());
+			const auto result = _handler(serialized);
+			if (result.isEmpty()) {
+				return;
+			}
+			++_answered;
+
+			// rpc_result req_msg_id:long result:Object
+			auto answer = mtpBuffer();
+			answer.reserve(3 + result.size());
+			answer.push_back(kRpcResultId);
+			WriteLong(answer, msgId);
+			answer.append(result);
+			answers.push_back(std::move(answer));
+			return;
+		}
+		if (reader.failed()) {
+			return;
+		}
+	}
+}
+
+mtpBuffer TcpLoopbackDc::encrypt(
+		Key &key,
+		uint64 keyId,
+		uint64 sessionId,
+		const mtpBuffer &body,
+		bool contentRelated) {
+	// Content related messages have odd seq_no and increment it.
+	auto &sent = key.sentBySession[sessionId];
+	const auto seqNo = contentRelated ? (sent++ * 2 + 1) : (sent * 2);
+
+	auto plain = mtpBuffer();
+	plain.reserve(8 + body.size() + 8);
+	WriteLong(plain, key.salt);
+	WriteLong(plain, sessionId);
+	WriteLong(plain, ServerMessageId());
+	plain.push_back(seqNo);
+	plain.push_back(body.size() * kIntSize);
+	plain.append(body);
+
+	// Padding is from 12 to 1024 bytes, we use the shortest one.
+	const auto size = plain.size() * kIntSize;
+	const auto padding = 12
+		+ ((AES_BLOCK_SIZE - ((size + 12) % AES_BLOCK_SIZE))
+			% AES_BLOCK_SIZE);
+	WriteRaw(plain, RandomBytes(padding));
+
+	const auto plainBytes = bytes::make_span(plain);
+	const auto msgKey = ComputeMsgKey(key.data, plainBytes, 8);
+	const auto [aesKey, aesIv] = PrepareAes(key.data, msgKey, 8);
+	const auto encrypted = AesIge(plainBytes, aesKey, aesIv, true);
+
+	auto result = mtpBuffer();
+	result.reserve(6 + encrypted.size() / kIntSize);
+	WriteLong(result, keyId);
+	WriteRaw(result, msgKey);
+	WriteRaw(result, encrypted);
+	return result;
+}
+
+} // namespace internal
+} // namespace MTP
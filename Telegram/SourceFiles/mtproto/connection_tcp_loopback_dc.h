@@ -0,0 +1,104 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "mtproto/connection_tcp_loopback.h"
+#include "base/openssl_help.h"
+
+#include <map>
+#include <mutex>
+
+namespace MTP {
+namespace internal {
+
+// Datacenter side of MTProto for the TcpLoopback server.
+//
+// Creates auth keys with its own test RSA key, the client should have
+// the key from publicKeyN() and publicKeyE() in its public keys list.
+// Encrypted messages are checked and decrypted, wrong server salts are
+// answered with bad_server_salt, pings with pong and the queries are
+// passed to the handler without the invokeWithLayer, initConnection,
+// invokeAfterMsg and gzip_packed wrappers. Unknown auth keys are
+// answered with the -404 transport error.
+class TcpLoopbackDc {
+public:
+	// Returns the serialized result of the query, sent back in
+	// rpc_result. An empty result leaves the query without an answer.
+	// Called with the datacenter locked, from the serving threads.
+	using Handler = Fn<mtpBuffer(const mtpBuffer &query)>;
+
+	explicit TcpLoopbackDc(Handler handler);
+	TcpLoopbackDc(const TcpLoopbackDc &other) = delete;
+	TcpLoopbackDc &operator=(const TcpLoopbackDc &other) = delete;
+
+	// The datacenter should outlive the TcpLoopback using the script.
+	TcpLoopback::Script script();
+
+	bytes::vector publicKeyN() const;
+	bytes::vector publicKeyE() const;
+	uint64 publicKeyFingerprint() const;
+
+	int authKeysCount() const;
+	int answeredQueries() const;
+
+private:
+	struct Handshake {
+		bytes::vector serverNonce;
+		bytes::vector newNonce;
+		openssl::BigNum a;
+	};
+	struct Key {
+		bytes::vector data;
+		uint64 salt = 0;
+		std::map<uint64, int> sentBySession;
+	};
+
+	std::vector<mtpBuffer> handle(const mtpBuffer &packet);
+	mtpBuffer handleNotEncrypted(const mtpBuffer &packet);
+	std::vector<mtpBuffer> handleEncrypted(const mtpBuffer &packet);
+
+	mtpBuffer answerRequestPQ(bytes::const_span nonce);
+	mtpBuffer answerRequestDHParams(
+		const mtpPrime *from,
+		const mtpPrime *till);
+	mtpBuffer answerSetClientDHParams(
+		const mtpPrime *from,
+		const mtpPrime *till);
+
+	void handleMessage(
+		uint64 msgId,
+		const mtpPrime *from,
+		const mtpPrime *till,
+		std::vector<mtpBuffer> &answers);
+	void handleQuery(
+		uint64 msgId,
+		const mtpPrime *from,
+		const mtpPrime *till,
+		std::vector<mtpBuffer> &answers);
+	mtpBuffer encrypt(
+		Key &key,
+		uint64 keyId,
+		uint64 sessionId,
+		const mtpBuffer &body,
+		bool contentRelated);
+
+	const Handler _handler;
+	openssl::BigNum _n;
+	openssl::BigNum _e;
+	openssl::BigNum _d;
+	uint64 _fingerprint = 0;
+
+	mutable std::mutex _mutex;
+	std::map<bytes::vector, Handshake> _handshakes;
+	std::map<uint64, Key> _keys;
+	int _answered = 0;
+
+};
+
+} // namespace internal
+} // namespace MTP
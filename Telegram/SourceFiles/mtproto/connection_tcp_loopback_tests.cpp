@@ -0,0 +1,825 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "mtproto/connection_tcp_loopback.h"
+#include "mtproto/connection_tcp_loopback_dc.h"
+#include "base/openssl_help.h"
+
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QNetworkProxy>
+#include <QtNetwork/QTcpSocket>
+
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <map>
+
+using namespace MTP::internal;
+
+constexpr auto kTimeout = 1000;
+constexpr auto kDcId = int16(2);
+
+// Client side of the transport, the same way TcpConnection works.
+class Client {
+public:
+	Client(int port, const bytes::vector &secret);
+
+	bool connected() const;
+	void send(const mtpBuffer &packet);
+	mtpBuffer receive(int timeout = kTimeout);
+
+private:
+	QTcpSocket _socket;
+	std::unique_ptr<TcpProtocol> _protocol;
+	TcpCipher _send;
+	TcpCipher _receive;
+	bytes::vector _buffer;
+
+};
+
+Client::Client(int port, const bytes::vector &secret)
+: _protocol(TcpProtocol::Create(bytes::make_vector(secret))) {
+	_socket.setProxy(QNetworkProxy::NoProxy);
+	_socket.connectToHost(QHostAddress::LocalHost, port);
+	if (!_socket.waitForConnected(kTimeout)) {
+		return;
+	}
+	auto start = PrepareTcpConnectionStart(_protocol->id(), kDcId);
+	const auto obfuscation = PrepareTcpObfuscation(*_protocol, start);
+	_send = obfuscation.send;
+	_receive = obfuscation.receive;
+
+	_socket.write(reinterpret_cast<const char*>(start.data()), 56);
+	_send.apply(start);
+	_socket.write(reinterpret_cast<const char*>(start.data() + 56), 8);
+}
+
+bool Client::connected() const {
+	return (_socket.state() == QAbstractSocket::ConnectedState);
+}
+
+void Client::send(const mtpBuffer &packet) {
+	auto framed = mtpBuffer();
+	framed.reserve(2 + packet.size() + 4);
+	framed.resize(2);
+	framed.append(packet);
+	const auto data = _protocol->finalizePacket(framed);
+	_send.apply(data);
+	_socket.write(reinterpret_cast<const char*>(data.data()), data.size());
+	_socket.flush();
+}
+
+mtpBuffer Client::receive(int timeout) {
+	while (true) {
+		const auto size = _protocol->readPacketLength(_buffer);
+		if (size > 0 && _buffer.size() >= size) {
+			const auto data = _protocol->readPacket(_buffer);
+			auto result = mtpBuffer(data.size() / sizeof(mtpPrime));
+			bytes::copy(
+				bytes::make_span(result),
+				data.subspan(0, result.size() * sizeof(mtpPrime)));
+			_buffer.erase(_buffer.begin(), _buffer.begin() + size);
+			return result;
+		} else if (size == TcpProtocol::kInvalidSize
+			|| !_socket.waitForReadyRead(timeout)) {
+			return mtpBuffer();
+		}
+		const auto read = _socket.readAll();
+		const auto was = _buffer.size();
+		_buffer.resize(was + read.size());
+		const auto added = bytes::make_span(_buffer).subspan(was);
+		bytes::copy(added, bytes::make_span(read));
+		_receive.apply(added);
+	}
+}
+
+std::vector<mtpBuffer> Echo(const mtpBuffer &packet) {
+	return { packet };
+}
+
+mtpBuffer Packet(int size, mtpPrime first) {
+	auto result = mtpBuffer(size);
+	for (auto i = 0; i != size; ++i) {
+		result[i] = first + i;
+	}
+	return result;
+}
+
+const auto Secrets = {
+	bytes::vector(),
+	bytes::vector(16, gsl::byte(0x11)),
+	bytes::concatenate(
+		bytes::vector(1, gsl::byte(0xDD)),
+		bytes::vector(16, gsl::byte(0x22))),
+};
+
+TEST_CASE("tcp loopback frames the packets", "[tcp_loopback]") {
+	for (const auto &secret : Secrets) {
+		auto server = TcpLoopback({ secret }, Echo);
+		REQUIRE(server.port() != 0);
+
+		auto client = Client(server.port(), secret);
+		REQUIRE(client.connected());
+
+		// Padded intermediate adds random bytes to the packets.
+		for (const auto size : { 5, 0x7E, 0x7F, 0x1000 }) {
+			const auto packet = Packet(size, size);
+			client.send(packet);
+			const auto received = client.receive();
+			REQUIRE(received.size() >= packet.size());
+			REQUIRE(received.mid(0, packet.size()) == packet);
+		}
+		REQUIRE(server.connections() == 1);
+		REQUIRE(server.receivedPackets() == 4);
+	}
+}
+
+TEST_CASE("tcp loopback answers the connection check", "[tcp_loopback]") {
+	auto server = TcpLoopback({}, TcpLoopback::AnswerRequestPQ);
+	auto client = Client(server.port(), bytes::vector());
+
+	// auth_key_id, message_id, message_length, req_pq_multi, nonce.
+	const auto request = mtpBuffer{
+		0, 0, 0x00000004, 0x5B000000, 20,
+		mtpPrime(0xBE7E8EF1U), 1, 2, 3, 4,
+	};
+	client.send(request);
+	const auto answer = client.receive();
+	REQUIRE(answer.size() > 10);
+	REQUIRE(answer[0] == 0);
+	REQUIRE(answer[1] == 0);
+	REQUIRE((uint32(answer[2]) & 0x03) == 1);
+	REQUIRE(answer[4] == (answer.size() - 5) * sizeof(mtpPrime));
+	REQUIRE(answer[5] == 0x05162463);
+	REQUIRE(answer.mid(6, 4) == request.mid(6, 4));
+}
+
+TEST_CASE("tcp loopback simulates a bad network", "[tcp_loopback]") {
+	SECTION("packets are dropped") {
+		auto server = TcpLoopback({ bytes::vector(), 1. }, Echo);
+		auto client = Client(server.port(), bytes::vector());
+		client.send(Packet(5, 0));
+		REQUIRE(client.receive(100).isEmpty());
+		REQUIRE(server.receivedPackets() == 1);
+		REQUIRE(server.droppedPackets() == 1);
+	}
+	SECTION("answers are delayed") {
+		constexpr auto kLatency = 100;
+		auto server = TcpLoopback({ bytes::vector(), 0., kLatency }, Echo);
+		auto client = Client(server.port(), bytes::vector());
+		const auto start = std::chrono::steady_clock::now();
+		client.send(Packet(5, 0));
+		REQUIRE(client.receive().size() == 5);
+		const auto passed = std::chrono::steady_clock::now() - start;
+		REQUIRE(passed >= std::chrono::milliseconds(kLatency));
+	}
+}
+
+constexpr auto kTestQueryId = mtpPrime(0x1E57C0DEU);
+constexpr auto kTestResultId = mtpPrime(0x1E57BEEFU);
+
+// pq from the MTProto auth key creation example.
+constexpr auto kP = uint32(0x494C553BU);
+constexpr auto kQ = uint32(0x53911073U);
+
+void AppendLong(mtpBuffer &to, uint64 value) {
+	to.push_back(mtpPrime(value & 0xFFFFFFFFULL));
+	to.push_back(mtpPrime(value >> 32));
+}
+
+void AppendRaw(mtpBuffer &to, bytes::const_span data) {
+	const auto was = to.size();
+	to.resize(was + data.size() / sizeof(mtpPrime));
+	bytes::copy(bytes::make_span(to).subspan(was * sizeof(mtpPrime)), data);
+}
+
+void AppendBytes(mtpBuffer &to, bytes::const_span data) {
+	auto serialized = bytes::vector();
+	if (data.size() < 254) {
+		serialized.push_back(gsl::byte(data.size()));
+	} else {
+		serialized.push_back(gsl::byte(254));
+		serialized.push_back(gsl::byte(data.size() & 0xFF));
+		serialized.push_back(gsl::byte((data.size() >> 8) & 0xFF));
+		serialized.push_back(gsl::byte((data.size() >> 16) & 0xFF));
+	}
+	serialized.insert(end(serialized), data.begin(), data.end());
+	serialized.resize((serialized.size() + 3) / 4 * 4);
+	AppendRaw(to, serialized);
+}
+
+uint64 ReadLong(const mtpBuffer &from, int index) {
+	return (index + 2 <= from.size())
+		? (uint64(uint32(from[index]))
+			| (uint64(uint32(from[index + 1])) << 32))
+		: 0;
+}
+
+bytes::vector ReadRaw(const mtpBuffer &from, int index, int ints) {
+	return (index + ints <= from.size())
+		? bytes::make_vector(bytes::make_span(from.constData() + index, ints))
+		: bytes::vector();
+}
+
+// Reads TL string at index and moves the index past it.
+bytes::vector ReadBytes(const mtpBuffer &from, int &index) {
+	const auto data = bytes::make_span(from).subspan(
+		std::min(index, from.size()) * sizeof(mtpPrime));
+	if (data.empty()) {
+		index = from.size() + 1;
+		return {};
+	}
+	const auto large = (uchar(data[0]) == 254);
+	const auto start = large ? 4 : 1;
+	const auto length = large
+		? (int(uchar(data[1]))
+			| (int(uchar(data[2])) << 8)
+			| (int(uchar(data[3])) << 16))
+		: int(uchar(data[0]));
+	index += (start + length + 3) / 4;
+	if (data.size() < start + length) {
+		index = from.size() + 1;
+		return {};
+	}
+	return bytes::make_vector(data.subspan(start, length));
+}
+
+mtpBuffer ToBuffer(bytes::const_span data) {
+	auto result = mtpBuffer(data.size() / sizeof(mtpPrime));
+	bytes::copy(
+		bytes::make_span(result),
+		data.subspan(0, result.size() * sizeof(mtpPrime)));
+	return result;
+}
+
+bytes::vector RandomBytes(int size) {
+	auto result = bytes::vector(size);
+	bytes::set_random(result);
+	return result;
+}
+
+bytes::vector BigEndian(uint64 value, int size) {
+	auto result = bytes::vector(size);
+	for (auto i = 0; i != size; ++i) {
+		result[size - i - 1] = gsl::byte((value >> (i * 8)) & 0xFF);
+	}
+	return result;
+}
+
+bytes::vector PadLeft(bytes::vector &&data, int size) {
+	while (int(data.size()) < size) {
+		data.insert(begin(data), gsl::byte());
+	}
+	return std::move(data);
+}
+
+bytes::vector AesIge(
+		bytes::const_span data,
+		bytes::const_span key,
+		bytes::const_span iv,
+		bool encrypt) {
+	auto result = bytes::vector(data.size());
+	auto ivCopy = bytes::make_vector(iv);
+	AES_KEY aes;
+	const auto raw = reinterpret_cast<const uchar*>(key.data());
+	if (encrypt) {
+		AES_set_encrypt_key(raw, 256, &aes);
+	} else {
+		AES_set_decrypt_key(raw, 256, &aes);
+	}
+	AES_ige_encrypt(
+		reinterpret_cast<const uchar*>(data.data()),
+		reinterpret_cast<uchar*>(result.data()),
+		data.size(),
+		&aes,
+		reinterpret_cast<uchar*>(ivCopy.data()),
+		encrypt ? AES_ENCRYPT : AES_DECRYPT);
+	return result;
+}
+
+mtpBuffer TestQuery(mtpPrime value) {
+	return { kTestQueryId, value };
+}
+
+// Answers only the test queries, with the test query argument.
+mtpBuffer AnswerTestQuery(const mtpBuffer &query) {
+	if (query.size() != 2 || query[0] != kTestQueryId) {
+		return mtpBuffer();
+	}
+	return { kTestResultId, query[1] };
+}
+
+// invokeWithLayer layer:int query:initConnection flags:# api_id:int
+//   device_model:string system_version:string app_version:string
+//   system_lang_code:string lang_pack:string lang_code:string query:!X
+mtpBuffer WrapInitConnection(const mtpBuffer &query) {
+	auto result = mtpBuffer{
+		mtpPrime(0xDA9B0D0DU),
+		82,
+		mtpPrime(0x785188B8U),
+		0,
+		2040,
+	};
+	for (const auto value : { "Test", "Linux", "1.0", "en", "", "en" }) {
+		const auto text = QByteArray(value);
+		AppendBytes(result, bytes::make_span(text));
+	}
+	result.append(query);
+	return result;
+}
+
+// Client side of MTProto for TcpLoopbackDc, written after the protocol
+// documentation, not after the datacenter code.
+class MtpClient {
+public:
+	MtpClient(int port, const TcpLoopbackDc &dc);
+
+	bool createAuthKey();
+	void setSalt(uint64 salt);
+	uint64 nextMessageId();
+
+	uint64 send(const mtpBuffer &body);
+
+	// Decrypted message body, empty on timeout or a bad message.
+	mtpBuffer receive(int timeout = kTimeout);
+
+private:
+	mtpBuffer requestNotEncrypted(const mtpBuffer &body);
+
+	// MTProto 2.0 aes_key and aes_iv, x is 8 for the server messages.
+	std::pair<bytes::vector, bytes::vector> prepareAes(
+		bytes::const_span msgKey,
+		int x) const;
+	bytes::vector computeMsgKey(bytes::const_span plain, int x) const;
+
+	Client _transport;
+	const bytes::vector _n;
+	const bytes::vector _e;
+	const uint64 _fingerprint = 0;
+	const uint64 _sessionId = 0;
+
+	bytes::vector _authKey;
+	uint64 _keyId = 0;
+	uint64 _salt = 0;
+	int _seqNo = 0;
+	uint64 _lastMessageId = 0;
+
+};
+
+MtpClient::MtpClient(int port, const TcpLoopbackDc &dc)
+: _transport(port, bytes::vector())
+, _n(dc.publicKeyN())
+, _e(dc.publicKeyE())
+, _fingerprint(dc.publicKeyFingerprint())
+, _sessionId(ReadLong(ToBuffer(RandomBytes(8)), 0)) {
+}
+
+uint64 MtpClient::nextMessageId() {
+	const auto now = uint64(std::time(nullptr)) << 32;
+	_lastMessageId = std::max(now, _lastMessageId + 4);
+	return _lastMessageId;
+}
+
+mtpBuffer MtpClient::requestNotEncrypted(const mtpBuffer &body) {
+	// auth_key_id:long message_id:long message_length:int
+	auto packet = mtpBuffer();
+	AppendLong(packet, 0);
+	AppendLong(packet, nextMessageId());
+	packet.push_back(body.size() * sizeof(mtpPrime));
+	packet.append(body);
+	_transport.send(packet);
+
+	const auto answer = _transport.receive();
+	if (answer.size() < 5
+		|| answer[0] != 0
+		|| answer[1] != 0
+		|| answer[4] % 4
+		|| answer[4] > (answer.size() - 5) * 4) {
+		return mtpBuffer();
+	}
+	return answer.mid(5, answer[4] / 4);
+}
+
+bool MtpClient::createAuthKey() {
+	// req_pq_multi nonce:int128
+	const auto nonce = RandomBytes(16);
+	auto reqPq = mtpBuffer{ mtpPrime(0xBE7E8EF1U) };
+	AppendRaw(reqPq, nonce);
+
+	// resPQ nonce:int128 server_nonce:int128 pq:string
+	//   server_public_key_fingerprints:Vector<long>
+	const auto resPq = requestNotEncrypted(reqPq);
+	if (resPq.size() < 10
+		|| resPq[0] != mtpPrime(0x05162463U)
+		|| ReadRaw(resPq, 1, 4) != nonce) {
+		return false;
+	}
+	const auto serverNonce = ReadRaw(resPq, 5, 4);
+	auto index = 9;
+	const auto pq = ReadBytes(resPq, index);
+	if (index + 2 > resPq.size() || resPq[index] != mtpPrime(0x1CB5C415U)) {
+		return false;
+	}
+	auto found = false;
+	for (auto i = 0; i != resPq[index + 1]; ++i) {
+		if (ReadLong(resPq, index + 2 + i * 2) == _fingerprint) {
+			found = true;
+		}
+	}
+
+	// The test datacenter uses pq from the documentation, so we don't
+	// factor it here.
+	if (!found || pq != BigEndian(uint64(kP) * kQ, 8)) {
+		return false;
+	}
+	const auto p = BigEndian(kP, 4);
+	const auto q = BigEndian(kQ, 4);
+
+	// p_q_inner_data_dc pq:string p:string q:string nonce:int128
+	//   server_nonce:int128 new_nonce:int256 dc:int
+	const auto newNonce = RandomBytes(32);
+	auto inner = mtpBuffer{ mtpPrime(0xA9F55F95U) };
+	AppendBytes(inner, pq);
+	AppendBytes(inner, p);
+	AppendBytes(inner, q);
+	AppendRaw(inner, nonce);
+	AppendRaw(inner, serverNonce);
+	AppendRaw(inner, newNonce);
+	inner.push_back(kDcId);
+
+	// 0 + SHA1(data) + data + padding, encrypted without RSA padding.
+	const auto innerBytes = bytes::make_span(inner);
+	auto withHash = bytes::concatenate(
+		bytes::vector(1),
+		openssl::Sha1(innerBytes),
+		innerBytes);
+	withHash = bytes::concatenate(
+		withHash,
+		RandomBytes(256 - withHash.size()));
+	const auto encrypted = PadLeft(
+		openssl::BigNum::ModExp(
+			openssl::BigNum(withHash),
+			openssl::BigNum(_e),
+			openssl::BigNum(_n)).getBytes(),
+		256);
+
+	// req_DH_params nonce:int128 server_nonce:int128 p:string q:string
+	//   public_key_fingerprint:long encrypted_data:string
+	auto reqDH = mtpBuffer{ mtpPrime(0xD712E4BEU) };
+	AppendRaw(reqDH, nonce);
+	AppendRaw(reqDH, serverNonce);
+	AppendBytes(reqDH, p);
+	AppendBytes(reqDH, q);
+	AppendLong(reqDH, _fingerprint);
+	AppendBytes(reqDH, encrypted);
+
+	// server_DH_params_ok nonce:int128 server_nonce:int128
+	//   encrypted_answer:string
+	const auto dhParams = requestNotEncrypted(reqDH);
+	if (dhParams.size() < 10
+		|| dhParams[0] != mtpPrime(0xD0E8075CU)
+		|| ReadRaw(dhParams, 1, 4) != nonce
+		|| ReadRaw(dhParams, 5, 4) != serverNonce) {
+		return false;
+	}
+	index = 9;
+	const auto encryptedAnswer = ReadBytes(dhParams, index);
+	if (encryptedAnswer.empty() || encryptedAnswer.size() % 16) {
+		return false;
+	}
+
+	// tmp_aes_key = SHA1(new_nonce + server_nonce)
+	//   + substr(SHA1(server_nonce + new_nonce), 0, 12)
+	// tmp_aes_iv = substr(SHA1(server_nonce + new_nonce), 12, 8)
+	//   + SHA1(new_nonce + new_nonce) + substr(new_nonce, 0, 4)
+	const auto sn = openssl::Sha1(serverNonce, newNonce);
+	const auto tmpKey = bytes::concatenate(
+		openssl::Sha1(newNonce, serverNonce),
+		bytes::make_span(sn).subspan(0, 12));
+	const auto tmpIv = bytes::concatenate(
+		bytes::make_span(sn).subspan(12, 8),
+		openssl::Sha1(newNonce, newNonce),
+		bytes::make_span(newNonce).subspan(0, 4));
+
+	// SHA1(answer) + server_DH_inner_data nonce:int128 server_nonce:int128
+	//   g:int dh_prime:string g_a:string server_time:int + padding
+	const auto answerWithHash = AesIge(encryptedAnswer, tmpKey, tmpIv, false);
+	const auto answer = ToBuffer(bytes::make_span(answerWithHash).subspan(20));
+	if (answer.size() < 10
+		|| answer[0] != mtpPrime(0xB5890DBAU)
+		|| ReadRaw(answer, 1, 4) != nonce
+		|| ReadRaw(answer, 5, 4) != serverNonce) {
+		return false;
+	}
+	const auto g = answer[9];
+	index = 10;
+	const auto dhPrime = ReadBytes(answer, index);
+	const auto ga = ReadBytes(answer, index);
+	++index;
+	if (index > answer.size()
+		|| g != 3
+		|| dhPrime.size() != 256
+		|| ga.empty()) {
+		return false;
+	}
+	const auto answerHash = openssl::Sha1(
+		bytes::make_span(answer).subspan(0, index * sizeof(mtpPrime)));
+	if (answerHash != bytes::make_vector(
+			bytes::make_span(answerWithHash).subspan(0, 20))) {
+		return false;
+	}
+
+	const auto prime = openssl::BigNum(dhPrime);
+	const auto b = openssl::BigNum(RandomBytes(256));
+	const auto gb = openssl::BigNum::ModExp(
+		openssl::BigNum(uint32(g)),
+		b,
+		prime).getBytes();
+
+	// client_DH_inner_data nonce:int128 server_nonce:int128
+	//   retry_id:long g_b:string
+	auto clientInner = mtpBuffer{ mtpPrime(0x6643B654U) };
+	AppendRaw(clientInner, nonce);
+	AppendRaw(clientInner, serverNonce);
+	AppendLong(clientInner, 0);
+	AppendBytes(clientInner, gb);
+	const auto clientBytes = bytes::make_span(clientInner);
+	auto clientWithHash = bytes::concatenate(
+		openssl::Sha1(clientBytes),
+		clientBytes);
+	clientWithHash = bytes::concatenate(
+		clientWithHash,
+		RandomBytes((16 - (clientWithHash.size() % 16)) % 16));
+
+	// set_client_DH_params nonce:int128 server_nonce:int128
+	//   encrypted_data:string
+	auto setDH = mtpBuffer{ mtpPrime(0xF5045F1FU) };
+	AppendRaw(setDH, nonce);
+	AppendRaw(setDH, serverNonce);
+	AppendBytes(setDH, AesIge(clientWithHash, tmpKey, tmpIv, true));
+
+	// dh_gen_ok nonce:int128 server_nonce:int128 new_nonce_hash1:int128
+	const auto dhGen = requestNotEncrypted(setDH);
+	if (dhGen.size() != 13
+		|| dhGen[0] != mtpPrime(0x3BCBF734U)
+		|| ReadRaw(dhGen, 1, 4) != nonce
+		|| ReadRaw(dhGen, 5, 4) != serverNonce) {
+		return false;
+	}
+	auto authKey = PadLeft(
+		openssl::BigNum::ModExp(openssl::BigNum(ga), b, prime).getBytes(),
+		256);
+	const auto authKeyHash = openssl::Sha1(authKey);
+	const auto newNonceHash = openssl::Sha1(
+		newNonce,
+		bytes::vector(1, gsl::byte(1)),
+		bytes::make_span(authKeyHash).subspan(0, 8));
+	if (ReadRaw(dhGen, 9, 4) != bytes::make_vector(
+			bytes::make_span(newNonceHash).subspan(4, 16))) {
+		return false;
+	}
+	_authKey = std::move(authKey);
+	_keyId = ReadLong(ToBuffer(
+		bytes::make_span(authKeyHash).subspan(12, 8)), 0);
+	return true;
+}
+
+void MtpClient::setSalt(uint64 salt) {
+	_salt = salt;
+}
+
+std::pair<bytes::vector, bytes::vector> MtpClient::prepareAes(
+		bytes::const_span msgKey,
+		int x) const {
+	const auto key = bytes::make_span(_authKey);
+	const auto a = openssl::Sha256(msgKey, key.subspan(x, 36));
+	const auto b = openssl::Sha256(key.subspan(40 + x, 36), msgKey);
+	return {
+		bytes::concatenate(
+			bytes::make_span(a).subspan(0, 8),
+			bytes::make_span(b).subspan(8, 16),
+			bytes::make_span(a).subspan(24, 8)),
+		bytes::concatenate(
+			bytes::make_span(b).subspan(0, 8),
+			bytes::make_span(a).subspan(8, 16),
+			bytes::make_span(b).subspan(24, 8)),
+	};
+}
+
+bytes::vector MtpClient::computeMsgKey(bytes::const_span plain, int x) const {
+	const auto hash = openssl::Sha256(
+		bytes::make_span(_authKey).subspan(88 + x, 32),
+		plain);
+	return bytes::make_vector(bytes::make_span(hash).subspan(8, 16));
+}
+
+uint64 MtpClient::send(const mtpBuffer &body) {
+	// salt:long session_id:long message_id:long seq_no:int
+	//   message_data_length:int message_data:bytes padding:bytes
+	const auto msgId = nextMessageId();
+	auto plain = mtpBuffer();
+	AppendLong(plain, _salt);
+	AppendLong(plain, _sessionId);
+	AppendLong(plain, msgId);
+	plain.push_back(_seqNo++ * 2 + 1);
+	plain.push_back(body.size() * sizeof(mtpPrime));
+	plain.append(body);
+	const auto size = plain.size() * sizeof(mtpPrime);
+	AppendRaw(plain, RandomBytes(12 + (16 - ((size + 12) % 16)) % 16));
+
+	const auto plainBytes = bytes::make_span(plain);
+	const auto msgKey = computeMsgKey(plainBytes, 0);
+	const auto [key, iv] = prepareAes(msgKey, 0);
+
+	// auth_key_id:long msg_key:int128 encrypted_data:bytes
+	auto packet = mtpBuffer();
+	AppendLong(packet, _keyId);
+	AppendRaw(packet, msgKey);
+	AppendRaw(packet, AesIge(plainBytes, key, iv, true));
+	_transport.send(packet);
+	return msgId;
+}
+
+mtpBuffer MtpClient::receive(int timeout) {
+	const auto packet = _transport.receive(timeout);
+	if (packet.size() <= 6 || ReadLong(packet, 0) != _keyId) {
+		return mtpBuffer();
+	}
+	const auto msgKey = ReadRaw(packet, 2, 4);
+	const auto data = bytes::make_span(packet).subspan(24);
+	const auto encrypted = data.subspan(0, data.size() - (data.size() % 16));
+	const auto [key, iv] = prepareAes(msgKey, 8);
+	const auto plain = AesIge(encrypted, key, iv, false);
+	if (computeMsgKey(plain, 8) != msgKey) {
+		return mtpBuffer();
+	}
+	const auto message = ToBuffer(plain);
+	if (message.size() < 8) {
+		return mtpBuffer();
+	}
+	const auto length = message[7];
+	if (ReadLong(message, 2) != _sessionId
+		|| length < 0
+		|| length % 4
+		|| length > (message.size() - 8) * 4) {
+		return mtpBuffer();
+	}
+	return message.mid(8, length / 4);
+}
+
+TEST_CASE("tcp loopback dc creates auth keys", "[tcp_loopback]") {
+	auto dc = TcpLoopbackDc(AnswerTestQuery);
+	auto server = TcpLoopback({}, dc.script());
+
+	auto client = MtpClient(server.port(), dc);
+	REQUIRE(client.createAuthKey());
+	REQUIRE(dc.authKeysCount() == 1);
+
+	auto other = MtpClient(server.port(), dc);
+	REQUIRE(other.createAuthKey());
+	REQUIRE(dc.authKeysCount() == 2);
+}
+
+TEST_CASE("tcp loopback dc answers the queries", "[tcp_loopback]") {
+	auto dc = TcpLoopbackDc(AnswerTestQuery);
+	auto server = TcpLoopback({}, dc.script());
+	auto client = MtpClient(server.port(), dc);
+	REQUIRE(client.createAuthKey());
+
+	// bad_server_salt bad_msg_id:long bad_msg_seqno:int error_code:int
+	//   new_server_salt:long
+	const auto badSaltId = client.send(TestQuery(0));
+	const auto badSalt = client.receive();
+	REQUIRE(badSalt.size() == 7);
+	REQUIRE(badSalt[0] == mtpPrime(0xEDAB447BU));
+	REQUIRE(ReadLong(badSalt, 1) == badSaltId);
+	REQUIRE(badSalt[4] == 48);
+	REQUIRE(dc.answeredQueries() == 0);
+	client.setSalt(ReadLong(badSalt, 5));
+
+	SECTION("queries get rpc_result") {
+		// rpc_result req_msg_id:long result:Object
+		const auto msgId = client.send(WrapInitConnection(TestQuery(5)));
+		const auto answer = client.receive();
+		REQUIRE(answer.size() == 5);
+		REQUIRE(answer[0] == mtpPrime(0xF35C6D01U));
+		REQUIRE(ReadLong(answer, 1) == msgId);
+		REQUIRE(answer.mid(3) == AnswerTestQuery(TestQuery(5)));
+		REQUIRE(dc.answeredQueries() == 1);
+	}
+	SECTION("pings get pong") {
+		// ping ping_id:long, pong msg_id:long ping_id:long
+		const auto msgId = client.send({ mtpPrime(0x7ABE77ECU), 7, 0 });
+		const auto answer = client.receive();
+		REQUIRE(answer.size() == 5);
+		REQUIRE(answer[0] == mtpPrime(0x347773C5U));
+		REQUIRE(ReadLong(answer, 1) == msgId);
+		REQUIRE(ReadLong(answer, 3) == 7);
+	}
+	SECTION("containers are unpacked") {
+		// msg_container messages:vector<%Message>
+		// message msg_id:long seqno:int bytes:int body:Object
+		auto container = mtpBuffer{ mtpPrime(0x73F1F8DCU), 2 };
+		auto ids = std::vector<uint64>();
+		for (const auto value : { 1, 2 }) {
+			const auto body = TestQuery(value);
+			ids.push_back(client.nextMessageId());
+			AppendLong(container, ids.back());
+			container.push_back(value * 2 + 1);
+			container.push_back(body.size() * sizeof(mtpPrime));
+			container.append(body);
+		}
+		client.send(container);
+		for (const auto value : { 1, 2 }) {
+			const auto answer = client.receive();
+			REQUIRE(answer.size() == 5);
+			REQUIRE(ReadLong(answer, 1) == ids[value - 1]);
+			REQUIRE(answer.mid(3) == AnswerTestQuery(TestQuery(value)));
+		}
+		REQUIRE(dc.answeredQueries() == 2);
+	}
+	SECTION("queries without a result are not answered") {
+		client.send({ kTestResultId, 0 });
+		REQUIRE(client.receive(100).isEmpty());
+		REQUIRE(dc.answeredQueries() == 0);
+	}
+}
+
+TEST_CASE("tcp loopback dc drops unknown auth keys", "[tcp_loopback]") {
+	auto dc = TcpLoopbackDc(AnswerTestQuery);
+	auto server = TcpLoopback({}, dc.script());
+	auto client = Client(server.port(), bytes::vector());
+
+	// auth_key_id:long msg_key:int128 encrypted_data:bytes
+	auto packet = mtpBuffer();
+	AppendLong(packet, 1);
+	AppendRaw(packet, RandomBytes(32));
+	client.send(packet);
+	REQUIRE(client.receive() == mtpBuffer(1, -404));
+}
+
+// Not run by default, use "[benchmark]" filter to run it.
+//
+// Measures only the framing, obfuscation and loopback sockets, requests
+// are resent by the test itself, not by Session.
+TEST_CASE("tcp transport round trips performance", "[.][benchmark]") {
+	constexpr auto kRequests = 5000;
+	constexpr auto kInFlight = 32;
+	constexpr auto kResendTimeout = 50;
+	constexpr auto kPacketSize = 64;
+
+	const auto measure = [&](const char *name, TcpLoopback::Settings &&settings) {
+		auto server = TcpLoopback(std::move(settings), Echo);
+		auto client = Client(server.port(), bytes::vector());
+		using Clock = std::chrono::steady_clock;
+
+		// Request id in the first int, resent after a timeout.
+		auto sent = std::map<int, Clock::time_point>();
+		auto next = 0;
+		auto done = 0;
+		auto resent = 0;
+		auto latency = Clock::duration();
+		const auto start = Clock::now();
+		while (done < kRequests) {
+			while (next < kRequests && sent.size() < kInFlight) {
+				sent.emplace(next, Clock::now());
+				client.send(Packet(kPacketSize, next++));
+			}
+			const auto answer = client.receive(kResendTimeout);
+			if (!answer.isEmpty()) {
+				const auto i = sent.find(answer[0]);
+				if (i != end(sent)) {
+					latency += Clock::now() - i->second;
+					sent.erase(i);
+					++done;
+				}
+				continue;
+			}
+			for (auto &[id, when] : sent) {
+				client.send(Packet(kPacketSize, id));
+				when = Clock::now();
+				++resent;
+			}
+		}
+		const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+			Clock::now() - start).count();
+		const auto average = std::chrono::duration_cast<
+			std::chrono::microseconds>(latency).count() / kRequests;
+		std::cout
+			<< name << ": "
+			<< kRequests << " requests in "
+			<< ms << " ms, "
+			<< (ms ? (kRequests * 1000 / ms) : 0) << " requests/s, "
+			<< average << " us average latency, "
+			<< resent << " resent." << std::endl;
+	};
+	measure("loopback", { bytes::vector() });
+	measure("5% loss", { bytes::vector(), 0.05 });
+	measure("5% loss, 20 ms latency", { bytes::vector(), 0.05, 20 });
+}
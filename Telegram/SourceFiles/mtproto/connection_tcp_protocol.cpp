@@ -0,0 +1,293 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "mtproto/connection_tcp_protocol.h"
+
+#include "base/openssl_help.h"
+
+extern "C" {
+#include <openssl/aes.h>
+#include <openssl/modes.h>
+} // extern "C"
+
+namespace MTP {
+namespace internal {
+namespace {
+
+constexpr auto kPacketSizeMax = int(0x01000000 * sizeof(mtpPrime));
+
+} // namespace
+
+class TcpProtocol::Version0 : public TcpProtocol {
+public:
+	uint32 id() const override;
+	bool supportsArbitraryLength() const override;
+
+	bool requiresExtendedPadding() const override;
+	void prepareKey(bytes::span key, bytes::const_span source) override;
+	bytes::span finalizePacket(mtpBuffer &buffer) override;
+
+	int readPacketLength(bytes::const_span bytes) const override;
+	bytes::const_span readPacket(bytes::const_span bytes) const override;
+
+};
+
+uint32 TcpProtocol::Version0::id() const {
+	return 0xEFEFEFEFU;
+}
+
+bool TcpProtocol::Version0::supportsArbitraryLength() const {
+	return false;
+}
+
+bool TcpProtocol::Version0::requiresExtendedPadding() const {
+	return false;
+}
+
+void TcpProtocol::Version0::prepareKey(
+		bytes::span key,
+		bytes::const_span source) {
+	bytes::copy(key, source);
+}
+
+bytes::span TcpProtocol::Version0::finalizePacket(mtpBuffer &buffer) {
+	Expects(buffer.size() > 2 && buffer.size() < 0x1000003U);
+
+	const auto intsSize = uint32(buffer.size() - 2);
+	const auto bytesSize = intsSize * sizeof(mtpPrime);
+	const auto data = reinterpret_cast<uchar*>(&buffer[0]);
+	const auto added = [&] {
+		if (intsSize < 0x7F) {
+			data[7] = uchar(intsSize);
+			return 1;
+		}
+		data[4] = uchar(0x7F);
+		data[5] = uchar(intsSize & 0xFF);
+		data[6] = uchar((intsSize >> 8) & 0xFF);
+		data[7] = uchar((intsSize >> 16) & 0xFF);
+		return 4;
+	}();
+	return bytes::make_span(buffer).subspan(8 - added, added + bytesSize);
+}
+
+int TcpProtocol::Version0::readPacketLength(bytes::const_span bytes) const {
+	if (bytes.empty()) {
+		return kUnknownSize;
+	}
+	const auto first = static_cast<char>(bytes[0]);
+	if (first == 0x7F) {
+		if (bytes.size() < 4) {
+			return kUnknownSize;
+		}
+		const auto ints = static_cast<uint32>(bytes[1])
+			| (static_cast<uint32>(bytes[2]) << 8)
+			| (static_cast<uint32>(bytes[3]) << 16);
+		return (ints >= 0x7F) ? (int(ints << 2) + 4) : kInvalidSize;
+	} else if (first > 0 && first < 0x7F) {
+		const auto ints = uint32(first);
+		return int(ints << 2) + 1;
+	}
+	return kInvalidSize;
+}
+
+bytes::const_span TcpProtocol::Version0::readPacket(
+		bytes::const_span bytes) const {
+	const auto size = readPacketLength(bytes);
+	Assert(size != kUnknownSize
+		&& size != kInvalidSize
+		&& size <= bytes.size());
+	const auto sizeLength = (static_cast<char>(bytes[0]) == 0x7F) ? 4 : 1;
+	return bytes.subspan(sizeLength, size - sizeLength);
+}
+
+class TcpProtocol::Version1 : public Version0 {
+public:
+	explicit Version1(bytes::vector &&secret);
+
+	bool requiresExtendedPadding() const override;
+	void prepareKey(bytes::span key, bytes::const_span source) override;
+
+private:
+	bytes::vector _secret;
+
+};
+
+TcpProtocol::Version1::Version1(bytes::vector &&secret)
+: _secret(std::move(secret)) {
+}
+
+bool TcpProtocol::Version1::requiresExtendedPadding() const {
+	return true;
+}
+
+void TcpProtocol::Version1::prepareKey(
+		bytes::span key,
+		bytes::const_span source) {
+	const auto payload = bytes::concatenate(source, _secret);
+	bytes::copy(key, openssl::Sha256(payload));
+}
+
+class TcpProtocol::VersionD : public Version1 {
+public:
+	using Version1::Version1;
+
+	uint32 id() const override;
+	bool supportsArbitraryLength() const override;
+
+	bytes::span finalizePacket(mtpBuffer &buffer) override;
+
+	int readPacketLength(bytes::const_span bytes) const override;
+	bytes::const_span readPacket(bytes::const_span bytes) const override;
+
+};
+
+uint32 TcpProtocol::VersionD::id() const {
+	return 0xDDDDDDDDU;
+}
+
+bool TcpProtocol::VersionD::supportsArbitraryLength() const {
+	return true;
+}
+
+bytes::span TcpProtocol::VersionD::finalizePacket(mtpBuffer &buffer) {
+	Expects(buffer.size() > 2 && buffer.size() < 0x1000003U);
+
+	auto random = bytes::array<sizeof(uint32)>();
+	bytes::set_random(random);
+
+	const auto intsSize = uint32(buffer.size() - 2);
+	const auto padding = static_cast<uint32>(random[0]) & 0x0F;
+	const auto bytesSize = intsSize * sizeof(mtpPrime) + padding;
+	buffer[1] = bytesSize;
+	for (auto added = 0; added < padding; added += 4) {
+		bytes::set_random(random);
+		buffer.push_back(*reinterpret_cast<const mtpPrime*>(random.data()));
+	}
+
+	return bytes::make_span(buffer).subspan(4, 4 + bytesSize);
+}
+
+int TcpProtocol::VersionD::readPacketLength(bytes::const_span bytes) const {
+	if (bytes.size() < 4) {
+		return kUnknownSize;
+	}
+	const auto value = *reinterpret_cast<const uint32*>(bytes.data()) + 4;
+	return (value >= 8 && value < kPacketSizeMax)
+		? int(value)
+		: kInvalidSize;
+}
+
+bytes::const_span TcpProtocol::VersionD::readPacket(
+		bytes::const_span bytes) const {
+	const auto size = readPacketLength(bytes);
+	Assert(size != kUnknownSize
+		&& size != kInvalidSize
+		&& size <= bytes.size());
+	const auto sizeLength = 4;
+	return bytes.subspan(sizeLength, size - sizeLength);
+}
+
+auto TcpProtocol::Create(bytes::vector &&secret)
+-> std::unique_ptr<TcpProtocol> {
+	if (secret.size() == 17 && static_cast<uchar>(secret[0]) == 0xDD) {
+		return std::make_unique<VersionD>(
+			bytes::make_vector(bytes::make_span(secret).subspan(1)));
+	} else if (secret.size() == 16) {
+		return std::make_unique<Version1>(std::move(secret));
+	} else if (secret.empty()) {
+		return std::make_unique<Version0>();
+	}
+	Unexpected("Secret bytes in TcpProtocol::Create.");
+}
+
+TcpCipher::TcpCipher(bytes::const_span key, bytes::const_span ivec) {
+	bytes::copy(_key, key);
+	bytes::copy(_ivec, ivec);
+}
+
+void TcpCipher::apply(bytes::span data) {
+	AES_KEY aes;
+	AES_set_encrypt_key(
+		reinterpret_cast<const uchar*>(_key.data()),
+		kKeySize * 8,
+		&aes);
+
+	static_assert(kIvecSize == AES_BLOCK_SIZE, "Wrong size of ctr ivec!");
+
+	CRYPTO_ctr128_encrypt(
+		reinterpret_cast<const uchar*>(data.data()),
+		reinterpret_cast<uchar*>(data.data()),
+		data.size(),
+		&aes,
+		reinterpret_cast<uchar*>(_ivec.data()),
+		reinterpret_cast<uchar*>(_ecount.data()),
+		&_num,
+		(block128_f)AES_encrypt);
+}
+
+bytes::vector PrepareTcpConnectionStart(uint32 protocolId, int16 dcId) {
+	auto result = bytes::vector(kTcpConnectionStartSize);
+	const auto nonce = bytes::make_span(result);
+
+	const auto zero = reinterpret_cast<uchar*>(nonce.data());
+	const auto first = reinterpret_cast<uint32*>(nonce.data());
+	const auto second = first + 1;
+	const auto reserved01 = 0x000000EFU;
+	const auto reserved11 = 0x44414548U;
+	const auto reserved12 = 0x54534F50U;
+	const auto reserved13 = 0x20544547U;
+	const auto reserved14 = 0xEEEEEEEEU;
+	const auto reserved15 = 0xDDDDDDDDU;
+	const auto reserved21 = 0x00000000U;
+	do {
+		bytes::set_random(nonce);
+	} while (*zero == reserved01
+		|| *first == reserved11
+		|| *first == reserved12
+		|| *first == reserved13
+		|| *first == reserved14
+		|| *first == reserved15
+		|| *second == reserved21);
+
+	// write protocol and dc ids
+	const auto protocol = reinterpret_cast<uint32*>(nonce.data() + 56);
+	*protocol = protocolId;
+	const auto dc = reinterpret_cast<int16*>(nonce.data() + 60);
+	*dc = dcId;
+
+	return result;
+}
+
+TcpObfuscation PrepareTcpObfuscation(
+		TcpProtocol &protocol,
+		bytes::const_span connectionStart) {
+	Expects(connectionStart.size() == kTcpConnectionStartSize);
+
+	constexpr auto kKeySize = TcpCipher::kKeySize;
+	constexpr auto kIvecSize = TcpCipher::kIvecSize;
+	auto key = bytes::array<kKeySize>();
+
+	// prepare encryption key/iv
+	protocol.prepareKey(key, connectionStart.subspan(8, kKeySize));
+	auto send = TcpCipher(
+		key,
+		connectionStart.subspan(8 + kKeySize, kIvecSize));
+
+	// prepare decryption key/iv
+	auto reversed = bytes::make_vector(
+		connectionStart.subspan(8, kKeySize + kIvecSize));
+	std::reverse(reversed.begin(), reversed.end());
+	protocol.prepareKey(key, bytes::make_span(reversed).subspan(0, kKeySize));
+	auto receive = TcpCipher(
+		key,
+		bytes::make_span(reversed).subspan(kKeySize, kIvecSize));
+
+	return { send, receive };
+}
+
+} // namespace internal
+} // namespace MTP
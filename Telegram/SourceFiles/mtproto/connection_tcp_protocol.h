@@ -0,0 +1,81 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "mtproto/core_types.h"
+
+namespace MTP {
+namespace internal {
+
+// Packet framing of the TCP transport, chosen by the protocol secret:
+// abridged without a secret, obfuscated abridged with a 16 bytes secret
+// and padded intermediate with a 0xDD-prefixed secret.
+class TcpProtocol {
+public:
+	static std::unique_ptr<TcpProtocol> Create(bytes::vector &&secret);
+
+	virtual uint32 id() const = 0;
+	virtual bool supportsArbitraryLength() const = 0;
+
+	virtual bool requiresExtendedPadding() const = 0;
+	virtual void prepareKey(bytes::span key, bytes::const_span source) = 0;
+	virtual bytes::span finalizePacket(mtpBuffer &buffer) = 0;
+
+	static constexpr auto kUnknownSize = -1;
+	static constexpr auto kInvalidSize = -2;
+	virtual int readPacketLength(bytes::const_span bytes) const = 0;
+	virtual bytes::const_span readPacket(bytes::const_span bytes) const = 0;
+
+	virtual ~TcpProtocol() = default;
+
+private:
+	class Version0;
+	class Version1;
+	class VersionD;
+
+};
+
+// AES-256-CTR of one direction of the obfuscated stream.
+class TcpCipher {
+public:
+	static constexpr auto kKeySize = 32;
+	static constexpr auto kIvecSize = 16;
+
+	TcpCipher() = default;
+	TcpCipher(bytes::const_span key, bytes::const_span ivec);
+
+	// Encrypts or decrypts in place, continuing the stream.
+	void apply(bytes::span data);
+
+private:
+	bytes::array<kKeySize> _key = { { gsl::byte{} } };
+	bytes::array<kIvecSize> _ivec = { { gsl::byte{} } };
+	bytes::array<kIvecSize> _ecount = { { gsl::byte{} } };
+	uint32 _num = 0;
+
+};
+
+struct TcpObfuscation {
+	TcpCipher send;
+	TcpCipher receive;
+};
+
+constexpr auto kTcpConnectionStartSize = 64;
+
+// Random bytes the client starts the connection with, the last eight
+// of them are the protocol id and the dc id and are sent encrypted.
+bytes::vector PrepareTcpConnectionStart(uint32 protocolId, int16 dcId);
+
+// Ciphers of the client for the connection start,
+// the server uses the same ones in the opposite directions.
+TcpObfuscation PrepareTcpObfuscation(
+	TcpProtocol &protocol,
+	bytes::const_span connectionStart);
+
+} // namespace internal
+} // namespace MTP
@@ -7,7 +7,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #include "mtproto/core_types.h"
 
-#include "zlib.h"
+#include "mtproto/gzip_packed.h"
 
 namespace MTP {
 namespace {
@@ -295,44 +295,10 @@ void mtpTextSerializeCore(MTPStringLogger &to, const mtpPrime *&from, const mtpP
 	} break;
 
 	case mtpc_gzip_packed: {
-		MTPstring packed;
-		packed.read(from, end); // read packed string as serialized mtp string type
-		uint32 packedLen = packed.v.size(), unpackedChunk = packedLen;
-		mtpBuffer result; // * 4 because of mtpPrime type
-		result.resize(0);
-
-		z_stream stream;
-		stream.zalloc = 0;
-		stream.zfree = 0;
-		stream.opaque = 0;
-		stream.avail_in = 0;
-		stream.next_in = 0;
-		int res = inflateInit2(&stream, 16 + MAX_WBITS);
-		if (res != Z_OK) {
-			throw Exception(QString("ungzip init, code: %1").arg(res));
-		}
-		stream.avail_in = packedLen;
-		stream.next_in = reinterpret_cast<Bytef*>(packed.v.data());
-		stream.avail_out = 0;
-		while (!stream.avail_out) {
-			result.resize(result.size() + unpackedChunk);
-			stream.avail_out = unpackedChunk * sizeof(mtpPrime);
-			stream.next_out = (Bytef*)&result[result.size() - unpackedChunk];
-			int res = inflate(&stream, Z_NO_FLUSH);
-			if (res != Z_OK && res != Z_STREAM_END) {
-				inflateEnd(&stream);
-				throw Exception(QString("ungzip unpack, code: %1").arg(res));
-			}
-		}
-		if (stream.avail_out & 0x03) {
-			uint32 badSize = result.size() * sizeof(mtpPrime) - stream.avail_out;
-			throw Exception(QString("ungzip bad length, size: %1").arg(badSize));
-		}
-		result.resize(result.size() - (stream.avail_out >> 2));
-		inflateEnd(&stream);
-
-		if (!result.size()) {
-			throw Exception("ungzip void data");
+		auto inflater = MTP::internal::GzipInflater();
+		const auto result = inflater.inflate(from, end);
+		if (result.isEmpty()) {
+			throw Exception("ungzip " + inflater.error());
 		}
 		const mtpPrime *newFrom = result.constData(), *newEnd = result.constData() + result.size();
 		to.add("[GZIPPED] "); mtpTextSerializeType(to, newFrom, newEnd, 0, level);
@@ -0,0 +1,171 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "mtproto/gzip_packed.h"
+
+#include "zlib.h"
+
+namespace MTP {
+namespace internal {
+namespace {
+
+// Unpacked to packed size ratio of the first payload, TL is very
+// repetitive so it is usually much higher than that.
+constexpr auto kDefaultRatio = 4.;
+
+// Weight of the last payload in the running ratio estimate.
+constexpr auto kRatioWeight = 0.25;
+
+// Estimated output size is increased to avoid growing the buffer
+// for payloads that compress a bit better than the previous ones.
+constexpr auto kEstimateReserve = 1.25;
+
+// Bad data should not make us allocate huge buffers at once.
+constexpr auto kEstimateMax = 16 * 1024 * 1024;
+constexpr auto kGrowMin = 1024;
+
+bytes::const_span ReadPackedData(
+		const mtpPrime *&from,
+		const mtpPrime *end) {
+	if (from + 1 > end) {
+		return {};
+	}
+	const auto buffer = reinterpret_cast<const uchar*>(from);
+	const auto longLength = (buffer[0] == 254);
+	const auto skip = longLength ? 4 : 1;
+	const auto length = longLength
+		? (uint32(buffer[1])
+			| (uint32(buffer[2]) << 8)
+			| (uint32(buffer[3]) << 16))
+		: uint32(buffer[0]);
+	const auto ints = (skip + length + 3) / 4;
+	if (ints > uint32(end - from)) {
+		return {};
+	}
+	from += ints;
+	return bytes::make_span(
+		reinterpret_cast<const gsl::byte*>(buffer + skip),
+		length);
+}
+
+} // namespace
+
+GzipInflater::GzipInflater()
+: _stream(std::make_unique<z_stream>())
+, _ratio(kDefaultRatio) {
+}
+
+GzipInflater::~GzipInflater() {
+	if (_streamReady) {
+		inflateEnd(_stream.get());
+	}
+}
+
+bool GzipInflater::ensureStream() {
+	if (_streamReady) {
+		return true;
+	}
+	_stream->zalloc = nullptr;
+	_stream->zfree = nullptr;
+	_stream->opaque = nullptr;
+	_stream->avail_in = 0;
+	_stream->next_in = nullptr;
+	const auto code = inflateInit2(_stream.get(), 16 + MAX_WBITS);
+	if (code != Z_OK) {
+		_error = QString("could not init zlib stream, code: %1").arg(code);
+		return false;
+	}
+	_streamReady = true;
+	return true;
+}
+
+int GzipInflater::estimateSize(int packed) const {
+	const auto result = packed * _ratio * kEstimateReserve;
+	return int(std::min(result, float64(kEstimateMax)));
+}
+
+void GzipInflater::updateRatio(int packed, int unpacked) {
+	if (packed > 0) {
+		const auto ratio = unpacked / float64(packed);
+		_ratio += (ratio - _ratio) * kRatioWeight;
+	}
+}
+
+mtpBuffer GzipInflater::fail(const QString &error) {
+	_error = error;
+	if (_streamReady && inflateReset(_stream.get()) != Z_OK) {
+		inflateEnd(_stream.get());
+		_streamReady = false;
+	}
+	return mtpBuffer();
+}
+
+mtpBuffer GzipInflater::inflate(const mtpPrime *&from, const mtpPrime *end) {
+	const auto packed = ReadPackedData(from, end);
+	if (packed.empty()) {
+		_error = "bad packed data";
+		return mtpBuffer();
+	}
+	return inflate(packed);
+}
+
+mtpBuffer GzipInflater::inflate(bytes::const_span packed) {
+	_error = QString();
+	if (!ensureStream()) {
+		return mtpBuffer();
+	}
+	const auto ints = [](int size) {
+		return (size + int(sizeof(mtpPrime)) - 1) / int(sizeof(mtpPrime));
+	};
+	const auto estimated = estimateSize(int(packed.size()));
+	auto result = mtpBuffer(ints(std::max(estimated, 1)));
+
+	// Zlib does not change the input, it just is not marked const.
+	_stream->next_in = reinterpret_cast<Bytef*>(
+		const_cast<gsl::byte*>(packed.data()));
+	_stream->avail_in = packed.size();
+	auto written = 0;
+	while (true) {
+		const auto capacity = int(result.size() * sizeof(mtpPrime));
+		_stream->next_out = reinterpret_cast<Bytef*>(result.data()) + written;
+		_stream->avail_out = capacity - written;
+		const auto code = ::inflate(_stream.get(), Z_NO_FLUSH);
+		written = capacity - int(_stream->avail_out);
+		if (code != Z_OK && code != Z_STREAM_END) {
+			return fail(
+				QString("could not unpack gziped data, code: %1").arg(code));
+		} else if (code == Z_STREAM_END || _stream->avail_out > 0) {
+			break;
+		}
+
+		// Grow by the estimate for the rest of the input.
+		const auto grow = std::max({
+			estimateSize(int(_stream->avail_in)),
+			capacity / 2,
+			kGrowMin });
+		result.resize(ints(capacity + grow));
+	}
+	if (written % sizeof(mtpPrime)) {
+		return fail(QString("bad length of unpacked data %1").arg(written));
+	} else if (!written) {
+		return fail("bad length of unpacked data 0");
+	}
+	result.resize(written / sizeof(mtpPrime));
+	updateRatio(int(packed.size()), written);
+	if (inflateReset(_stream.get()) != Z_OK) {
+		inflateEnd(_stream.get());
+		_streamReady = false;
+	}
+	return result;
+}
+
+QString GzipInflater::error() const {
+	return _error;
+}
+
+} // namespace internal
+} // namespace MTP
@@ -0,0 +1,52 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "mtproto/core_types.h"
+
+struct z_stream_s;
+
+namespace MTP {
+namespace internal {
+
+// Inflates gzip_packed payloads right into the buffers they are parsed
+// from and returns them without copying.
+//
+// The output buffer is sized from the unpacked to packed ratio of the
+// previous payloads, so most payloads are inflated without growing it.
+// The zlib stream is reset between payloads instead of being created
+// again, so its window is allocated only once.
+class GzipInflater {
+public:
+	GzipInflater();
+	GzipInflater(const GzipInflater &other) = delete;
+	GzipInflater &operator=(const GzipInflater &other) = delete;
+	~GzipInflater();
+
+	// Reads packed_data:bytes of gzip_packed in place and inflates it.
+	// Returns an empty buffer if the data is bad, see error().
+	mtpBuffer inflate(const mtpPrime *&from, const mtpPrime *end);
+	mtpBuffer inflate(bytes::const_span packed);
+
+	QString error() const;
+
+private:
+	bool ensureStream();
+	int estimateSize(int packed) const;
+	void updateRatio(int packed, int unpacked);
+	mtpBuffer fail(const QString &error);
+
+	std::unique_ptr<z_stream_s> _stream;
+	bool _streamReady = false;
+	float64 _ratio = 0.;
+	QString _error;
+
+};
+
+} // namespace internal
+} // namespace MTP
@@ -0,0 +1,256 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "mtproto/gzip_packed.h"
+#include "base/algorithm.h"
+
+#include "zlib.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+using namespace MTP::internal;
+
+QByteArray Gzip(const mtpBuffer &data) {
+	auto stream = z_stream();
+	deflateInit2(
+		&stream,
+		Z_DEFAULT_COMPRESSION,
+		Z_DEFLATED,
+		16 + MAX_WBITS,
+		8,
+		Z_DEFAULT_STRATEGY);
+	const auto size = int(data.size() * sizeof(mtpPrime));
+	auto result = QByteArray(deflateBound(&stream, size), Qt::Uninitialized);
+	stream.next_in = reinterpret_cast<Bytef*>(
+		const_cast<mtpPrime*>(data.constData()));
+	stream.avail_in = size;
+	stream.next_out = reinterpret_cast<Bytef*>(result.data());
+	stream.avail_out = result.size();
+	deflate(&stream, Z_FINISH);
+	result.resize(result.size() - stream.avail_out);
+	deflateEnd(&stream);
+	return result;
+}
+
+// gzip_packed#3072cfa1 packed_data:bytes, without the type id.
+mtpBuffer Serialize(const QByteArray &packed) {
+	const auto length = uint32(packed.size());
+	const auto skip = (length < 254) ? 1 : 4;
+	auto result = mtpBuffer((skip + length + 3) / 4, 0);
+	const auto buffer = reinterpret_cast<uchar*>(result.data());
+	if (length < 254) {
+		buffer[0] = uchar(length);
+	} else {
+		buffer[0] = uchar(254);
+		buffer[1] = uchar(length & 0xFF);
+		buffer[2] = uchar((length >> 8) & 0xFF);
+		buffer[3] = uchar((length >> 16) & 0xFF);
+	}
+	memcpy(buffer + skip, packed.constData(), length);
+	return result;
+}
+
+// Looks like updates and messages: type ids, small numbers and strings.
+mtpBuffer Payload(int size, uint32 seed) {
+	auto random = std::mt19937(seed);
+	auto result = mtpBuffer();
+	result.reserve(size);
+	const mtpPrime ids[] = {
+		mtpPrime(0x74AE4240U),
+		mtpPrime(0x44F9B43DU),
+		mtpPrime(0x1CB5C415U),
+		mtpPrime(0x2E02E29BU),
+	};
+	while (result.size() < size) {
+		result.push_back(ids[random() % base::array_size(ids)]);
+		result.push_back(mtpPrime(random() % 1000));
+		result.push_back(mtpPrime(0x5BA00000 + random() % 0x10000));
+		const auto words = int(random() % 8);
+		for (auto i = 0; i != words; ++i) {
+			result.push_back(mtpPrime(0x20202020 | (random() & 0x0F0F0F0F)));
+		}
+	}
+	result.resize(size);
+	return result;
+}
+
+mtpBuffer Inflate(GzipInflater &inflater, const mtpBuffer &serialized) {
+	auto from = serialized.constData();
+	const auto end = from + serialized.size();
+	auto result = inflater.inflate(from, end);
+	if (!result.isEmpty()) {
+		REQUIRE(from == end);
+	}
+	return result;
+}
+
+// The way ConnectionPrivate::ungzip worked before GzipInflater.
+mtpBuffer InflateReference(const mtpBuffer &serialized) {
+	auto from = serialized.constData();
+	const auto end = from + serialized.size();
+	const auto buffer = reinterpret_cast<const uchar*>(from);
+	const auto longLength = (buffer[0] == 254);
+	const auto packed = QByteArray(
+		reinterpret_cast<const char*>(buffer + (longLength ? 4 : 1)),
+		longLength
+			? (buffer[1] | (buffer[2] << 8) | (buffer[3] << 16))
+			: buffer[0]);
+	const auto packedLen = uint32(packed.size());
+	const auto unpackedChunk = packedLen;
+
+	auto result = mtpBuffer();
+	auto stream = z_stream();
+	if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+		return mtpBuffer();
+	}
+	stream.avail_in = packedLen;
+	stream.next_in = reinterpret_cast<Bytef*>(
+		const_cast<char*>(packed.constData()));
+	stream.avail_out = 0;
+	while (!stream.avail_out) {
+		result.resize(result.size() + unpackedChunk);
+		stream.avail_out = unpackedChunk * sizeof(mtpPrime);
+		stream.next_out = (Bytef*)&result[result.size() - unpackedChunk];
+		const auto res = inflate(&stream, Z_NO_FLUSH);
+		if (res != Z_OK && res != Z_STREAM_END) {
+			inflateEnd(&stream);
+			return mtpBuffer();
+		}
+	}
+	if (stream.avail_out & 0x03) {
+		inflateEnd(&stream);
+		return mtpBuffer();
+	}
+	result.resize(result.size() - (stream.avail_out >> 2));
+	inflateEnd(&stream);
+	return result;
+}
+
+TEST_CASE("gzip_packed payloads are inflated", "[gzip_packed]") {
+	auto inflater = GzipInflater();
+
+	SECTION("payloads of different sizes") {
+		for (const auto size : { 1, 10, 100, 1000, 10000, 300000 }) {
+			const auto payload = Payload(size, size);
+			const auto serialized = Serialize(Gzip(payload));
+			REQUIRE(Inflate(inflater, serialized) == payload);
+			REQUIRE(inflater.error().isEmpty());
+		}
+	}
+	SECTION("compression ratio changes between payloads") {
+		const auto zeros = mtpBuffer(100000, 0);
+		const auto random = [] {
+			auto result = mtpBuffer(1000);
+			auto generator = std::mt19937(42);
+			for (auto &value : result) {
+				value = mtpPrime(generator());
+			}
+			return result;
+		}();
+		for (const auto &payload : { random, zeros, random, zeros }) {
+			REQUIRE(Inflate(inflater, Serialize(Gzip(payload))) == payload);
+		}
+	}
+	SECTION("payload is followed by other data") {
+		const auto payload = Payload(100, 1);
+		auto serialized = Serialize(Gzip(payload));
+		serialized.push_back(0x12345678);
+		auto from = serialized.constData();
+		const auto end = from + serialized.size();
+		REQUIRE(inflater.inflate(from, end) == payload);
+		REQUIRE(from + 1 == end);
+	}
+}
+
+TEST_CASE("bad gzip_packed payloads are rejected", "[gzip_packed]") {
+	auto inflater = GzipInflater();
+	const auto payload = Payload(1000, 1);
+	const auto packed = Gzip(payload);
+
+	SECTION("not enough data") {
+		auto serialized = Serialize(packed);
+		serialized.resize(serialized.size() - 1);
+		REQUIRE(Inflate(inflater, serialized).isEmpty());
+		REQUIRE(!inflater.error().isEmpty());
+	}
+	SECTION("not gzip data") {
+		auto broken = packed;
+		broken[0] = 0;
+		REQUIRE(Inflate(inflater, Serialize(broken)).isEmpty());
+		REQUIRE(!inflater.error().isEmpty());
+	}
+	SECTION("unpacked length is not divisible by four") {
+		auto data = payload;
+		const auto gzip = [&] {
+			auto stream = z_stream();
+			deflateInit2(
+				&stream,
+				Z_DEFAULT_COMPRESSION,
+				Z_DEFLATED,
+				16 + MAX_WBITS,
+				8,
+				Z_DEFAULT_STRATEGY);
+			auto result = QByteArray(1 << 16, Qt::Uninitialized);
+			stream.next_in = reinterpret_cast<Bytef*>(data.data());
+			stream.avail_in = data.size() * sizeof(mtpPrime) - 1;
+			stream.next_out = reinterpret_cast<Bytef*>(result.data());
+			stream.avail_out = result.size();
+			deflate(&stream, Z_FINISH);
+			result.resize(result.size() - stream.avail_out);
+			deflateEnd(&stream);
+			return result;
+		}();
+		REQUIRE(Inflate(inflater, Serialize(gzip)).isEmpty());
+		REQUIRE(!inflater.error().isEmpty());
+	}
+	SECTION("empty data") {
+		REQUIRE(Inflate(inflater, Serialize(Gzip(mtpBuffer()))).isEmpty());
+		REQUIRE(!inflater.error().isEmpty());
+	}
+
+	// The stream is usable after the errors.
+	REQUIRE(Inflate(inflater, Serialize(packed)) == payload);
+	REQUIRE(inflater.error().isEmpty());
+}
+
+// Not run by default, use "[benchmark]" filter to run it.
+TEST_CASE("gzip_packed inflating performance", "[.][benchmark]") {
+	constexpr auto kIterations = 20;
+
+	// Approximate sizes of gzip_packed answers, in ints: difference,
+	// dialogs, history slices and a large contacts list.
+	const auto sizes = { 150, 600, 2500, 2500, 12000, 40000, 250000 };
+	auto payloads = std::vector<mtpBuffer>();
+	for (const auto size : sizes) {
+		payloads.push_back(Serialize(Gzip(Payload(size, size))));
+	}
+	using Clock = std::chrono::steady_clock;
+	const auto measure = [&](const char *name, auto &&method) {
+		const auto start = Clock::now();
+		auto total = int64();
+		for (auto i = 0; i != kIterations; ++i) {
+			for (const auto &serialized : payloads) {
+				total += method(serialized).size();
+			}
+		}
+		const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+			Clock::now() - start).count();
+		std::cout
+			<< name << ": "
+			<< (total * sizeof(mtpPrime) / (1024 * 1024)) << " MB in "
+			<< ms << " ms." << std::endl;
+	};
+	measure("reference", InflateReference);
+	auto inflater = GzipInflater();
+	measure("inflater", [&](const mtpBuffer &serialized) {
+		return Inflate(inflater, serialized);
+	});
+}
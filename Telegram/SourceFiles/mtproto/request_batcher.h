@@ -0,0 +1,122 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/assertion.h"
+#include "base/flat_map.h"
+#include "base/flat_set.h"
+
+#include <vector>
+
+namespace MTP {
+
+// Coalesces requests for objects that the API allows to request many
+// at once, like users.getUsers or channels.getMessages.
+//
+// A key added while the same key is already waiting or being requested
+// is merged with it. Waiting keys are taken in batches of a limited size,
+// each batch is sent as one request and finished when it is done or failed.
+template <typename Key>
+class RequestBatcher {
+public:
+	using BatchId = int;
+	struct Batch {
+		BatchId id = 0;
+		std::vector<Key> keys;
+	};
+
+	explicit RequestBatcher(int batchSizeMax);
+
+	// Returns false if the request was merged with an existing one.
+	bool add(const Key &key);
+	bool contains(const Key &key) const;
+	bool hasWaiting() const;
+
+	// Takes the first waiting keys, the result is empty if there are none.
+	Batch take();
+
+	// Returns the keys of the batch, they can be added again after that.
+	std::vector<Key> finish(BatchId id);
+
+	// Requests that were not sent because of merging and batching.
+	int savedRequests() const;
+
+private:
+	int _batchSizeMax = 0;
+	std::vector<Key> _waiting;
+	base::flat_set<Key> _keys;
+	base::flat_map<BatchId, std::vector<Key>> _batches;
+	BatchId _lastBatchId = 0;
+	int _savedRequests = 0;
+
+};
+
+template <typename Key>
+RequestBatcher<Key>::RequestBatcher(int batchSizeMax)
+: _batchSizeMax(batchSizeMax) {
+	Expects(_batchSizeMax > 0);
+}
+
+template <typename Key>
+bool RequestBatcher<Key>::add(const Key &key) {
+	if (_keys.contains(key)) {
+		++_savedRequests;
+		return false;
+	}
+	_keys.emplace(key);
+	_waiting.push_back(key);
+	return true;
+}
+
+template <typename Key>
+bool RequestBatcher<Key>::contains(const Key &key) const {
+	return _keys.contains(key);
+}
+
+template <typename Key>
+bool RequestBatcher<Key>::hasWaiting() const {
+	return !_waiting.empty();
+}
+
+template <typename Key>
+auto RequestBatcher<Key>::take() -> Batch {
+	if (_waiting.empty()) {
+		return Batch();
+	}
+	const auto count = std::min(int(_waiting.size()), _batchSizeMax);
+	auto result = Batch();
+	result.id = ++_lastBatchId;
+	result.keys = std::vector<Key>(
+		begin(_waiting),
+		begin(_waiting) + count);
+	_waiting.erase(begin(_waiting), begin(_waiting) + count);
+	_batches.emplace(result.id, result.keys);
+	_savedRequests += count - 1;
+	return result;
+}
+
+template <typename Key>
+std::vector<Key> RequestBatcher<Key>::finish(BatchId id) {
+	const auto i = _batches.find(id);
+	if (i == end(_batches)) {
+		return {};
+	}
+	auto result = std::move(i->second);
+	_batches.erase(i);
+	for (const auto &key : result) {
+		_keys.remove(key);
+	}
+	return result;
+}
+
+template <typename Key>
+int RequestBatcher<Key>::savedRequests() const {
+	return _savedRequests;
+}
+
+} // namespace MTP
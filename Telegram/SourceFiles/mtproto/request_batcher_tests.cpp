@@ -0,0 +1,61 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "mtproto/request_batcher.h"
+
+using Batcher = MTP::RequestBatcher<int>;
+
+TEST_CASE("request batcher merges and batches requests", "[request_batcher]") {
+	auto batcher = Batcher(3);
+	REQUIRE(!batcher.hasWaiting());
+	REQUIRE(batcher.take().keys.empty());
+
+	SECTION("same keys are merged") {
+		REQUIRE(batcher.add(1));
+		REQUIRE(!batcher.add(1));
+		REQUIRE(batcher.add(2));
+		REQUIRE(batcher.contains(1));
+		REQUIRE(!batcher.contains(3));
+
+		const auto batch = batcher.take();
+		REQUIRE(batch.keys == std::vector<int>{ 1, 2 });
+		REQUIRE(!batcher.hasWaiting());
+		REQUIRE(batcher.savedRequests() == 2);
+
+		// Requests in flight are merged as well.
+		REQUIRE(!batcher.add(2));
+		REQUIRE(batcher.savedRequests() == 3);
+		REQUIRE(!batcher.hasWaiting());
+
+		REQUIRE(batcher.finish(batch.id) == batch.keys);
+		REQUIRE(!batcher.contains(1));
+		REQUIRE(batcher.add(1));
+		REQUIRE(batcher.hasWaiting());
+	}
+	SECTION("batches have limited size") {
+		for (auto i = 0; i != 7; ++i) {
+			REQUIRE(batcher.add(i));
+		}
+		const auto first = batcher.take();
+		const auto second = batcher.take();
+		const auto third = batcher.take();
+		REQUIRE(!batcher.hasWaiting());
+		REQUIRE(first.keys == std::vector<int>{ 0, 1, 2 });
+		REQUIRE(second.keys == std::vector<int>{ 3, 4, 5 });
+		REQUIRE(third.keys == std::vector<int>{ 6 });
+		REQUIRE(first.id != second.id);
+		REQUIRE(batcher.savedRequests() == 4);
+
+		REQUIRE(batcher.finish(second.id) == second.keys);
+		REQUIRE(batcher.finish(second.id).empty());
+		REQUIRE(batcher.contains(0));
+		REQUIRE(!batcher.contains(3));
+		REQUIRE(batcher.contains(6));
+	}
+}
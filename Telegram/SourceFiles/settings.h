@@ -40,6 +40,7 @@ DeclareSetting(bool, StartMinimized);
 DeclareSetting(bool, StartInTray);
 DeclareSetting(bool, SendToMenu);
 DeclareSetting(bool, UseExternalVideoPlayer);
+DeclareSetting(bool, EmojiSprites);
 enum LaunchMode {
 	LaunchModeNormal = 0,
 	LaunchModeAutoStart,
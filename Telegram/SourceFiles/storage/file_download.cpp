@@ -13,6 +13,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "mainwindow.h"
 #include "messenger.h"
 #include "storage/localstorage.h"
+#include "storage/storage_streamed_file.h"
 #include "platform/platform_file_utilities.h"
 #include "auth_session.h"
 #include "apiwrap.h"
@@ -21,6 +22,14 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "base/openssl_help.h"
 
 namespace Storage {
+namespace {
+
+// Another download session is added to a dc if all of its sessions
+// have at least that much requested for some time.
+constexpr auto kSessionGrowLoad = int64(256 * 1024);
+constexpr auto kSessionGrowTimeout = TimeMs(1000);
+
+} // namespace
 
 Downloader::Downloader()
 : _delayedLoadersDestroyer([this] { _delayedDestroyedLoaders.clear(); }) {
@@ -36,28 +45,115 @@ void Downloader::clearPriorities() {
 }
 
 void Downloader::requestedAmountIncrement(MTP::DcId dcId, int index, int amount) {
-	Expects(index >= 0 && index < MTP::kDownloadSessionsCount);
-
-	auto it = _requestedBytesAmount.find(dcId);
-	if (it == _requestedBytesAmount.cend()) {
-		it = _requestedBytesAmount.emplace(dcId, RequestedInDc { { 0 } }).first;
+	Expects(index >= 0 && index < MTP::kDownloadSessionsCountMax);
+
+	auto &dc = _dcSessions[dcId];
+	auto &session = dc.sessions[index];
+	const auto wasBusy = (session.requested > 0);
+	session.requested += amount;
+	const auto busy = (session.requested > 0);
+	if (busy != wasBusy) {
+		const auto now = getms();
+		if (busy) {
+			session.busySince = now;
+		} else {
+			session.busyTime += now - session.busySince;
+		}
 	}
-	it->second[index] += amount;
-	if (it->second[index]) {
-		Messenger::Instance().killDownloadSessionsStop(dcId);
-	} else {
+	const auto idle = std::none_of(
+		begin(dc.sessions),
+		end(dc.sessions),
+		[](const Session &other) { return other.requested > 0; });
+	if (idle) {
 		Messenger::Instance().killDownloadSessionsStart(dcId);
+	} else {
+		Messenger::Instance().killDownloadSessionsStop(dcId);
 	}
 }
 
-int Downloader::chooseDcIndexForRequest(MTP::DcId dcId) const {
+void Downloader::receivedAmountIncrement(MTP::DcId dcId, int index, int amount) {
+	Expects(index >= 0 && index < MTP::kDownloadSessionsCountMax);
+
+	_dcSessions[dcId].sessions[index].received += amount;
+}
+
+int Downloader::chooseDcIndexForRequest(MTP::DcId dcId) {
+	auto &dc = _dcSessions[dcId];
+	checkSessionsGrow(dcId, dc);
+
 	auto result = 0;
-	auto it = _requestedBytesAmount.find(dcId);
-	if (it != _requestedBytesAmount.cend()) {
-		for (auto i = 1; i != MTP::kDownloadSessionsCount; ++i) {
-			if (it->second[i] < it->second[result]) {
-				result = i;
+	for (auto i = 1; i != dc.count; ++i) {
+		if (dc.sessions[i].requested < dc.sessions[result].requested) {
+			result = i;
+		}
+	}
+	return result;
+}
+
+void Downloader::checkSessionsGrow(MTP::DcId dcId, DcSessions &dc) {
+	if (dc.count == MTP::kDownloadSessionsCountMax) {
+		return;
+	}
+	const auto loaded = std::all_of(
+		begin(dc.sessions),
+		begin(dc.sessions) + dc.count,
+		[](const Session &session) {
+			return (session.requested >= kSessionGrowLoad);
+		});
+	if (!loaded) {
+		dc.loadedSince = 0;
+		return;
+	}
+	const auto now = getms();
+	if (!dc.loadedSince) {
+		dc.loadedSince = now;
+	} else if (now - dc.loadedSince >= kSessionGrowTimeout) {
+		++dc.count;
+		dc.loadedSince = 0;
+		DEBUG_LOG(("Download Info: using %1 sessions for dc %2."
+			).arg(dc.count
+			).arg(dcId));
+	}
+}
+
+void Downloader::sessionsStopped(MTP::DcId dcId) {
+	for (const auto &stats : sessionsStats()) {
+		if (stats.dcId == dcId && stats.received > 0) {
+			DEBUG_LOG(("Download Info: dc %1 session %2 received %3 bytes, "
+				"%4 bytes per second."
+				).arg(dcId
+				).arg(stats.index
+				).arg(stats.received
+				).arg(stats.bytesPerSecond()));
+		}
+	}
+	const auto i = _dcSessions.find(dcId);
+	if (i != end(_dcSessions) && i->second.count != MTP::kDownloadSessionsCount) {
+		i->second.count = MTP::kDownloadSessionsCount;
+		i->second.loadedSince = 0;
+		DEBUG_LOG(("Download Info: using %1 sessions for dc %2."
+			).arg(i->second.count
+			).arg(dcId));
+	}
+}
+
+std::vector<DownloadSessionStats> Downloader::sessionsStats() const {
+	const auto now = getms();
+	auto result = std::vector<DownloadSessionStats>();
+	for (const auto &[dcId, dc] : _dcSessions) {
+		for (auto i = 0; i != MTP::kDownloadSessionsCountMax; ++i) {
+			const auto &session = dc.sessions[i];
+			if (i >= dc.count && !session.requested && !session.received) {
+				continue;
 			}
+			auto stats = DownloadSessionStats();
+			stats.dcId = dcId;
+			stats.index = i;
+			stats.requested = session.requested;
+			stats.received = session.received;
+			stats.busyTime = session.busyTime
+				+ (session.requested > 0 ? (now - session.busySince) : 0);
+			result.push_back(stats);
 		}
 	}
 	return result;
@@ -588,6 +684,9 @@ mtpFileLoader::mtpFileLoader(
 }
 
 int32 mtpFileLoader::currentOffset(bool includeSkipped) const {
+	if (_streamed && !_fileIsOpen && !_finished) {
+		return _streamed->loadedSize();
+	}
 	return (_fileIsOpen ? _file.size() : _data.size()) - (includeSkipped ? 0 : _skippedBytes);
 }
 
@@ -626,6 +725,8 @@ void mtpFileLoader::refreshFileReferenceFrom(
 bool mtpFileLoader::loadPart() {
 	if (_finished || _lastComplete || (!_sentRequests.empty() && !_size)) {
 		return false;
+	} else if (_streamed) {
+		return loadStreamedPart();
 	} else if (_size && _nextRequestOffset >= _size) {
 		return false;
 	}
@@ -635,6 +736,77 @@ bool mtpFileLoader::loadPart() {
 	return true;
 }
 
+bool mtpFileLoader::loadStreamedPart() {
+	if (_streamedPartsLeft.empty()) {
+		return false;
+	}
+
+	// Continue from the part the readers wait for, wrap around
+	// to the skipped parts when everything after it is requested.
+	const auto wanted = std::max(_streamed->wantedOffset(), 0);
+	auto i = _streamedPartsLeft.lower_bound(wanted - (wanted % partSize()));
+	if (i == end(_streamedPartsLeft)) {
+		i = begin(_streamedPartsLeft);
+	}
+	const auto offset = *i;
+	_streamedPartsLeft.erase(i);
+	if (_streamedPartsLeft.empty()) {
+		_nextRequestOffset = _size;
+	}
+	makeRequest(offset);
+	return true;
+}
+
+std::shared_ptr<Storage::StreamedFile> mtpFileLoader::streamedFile() {
+	if (_streamed) {
+		return _streamed;
+	} else if (!_id || !_size || _finished || _lastComplete) {
+		return nullptr;
+	}
+	const auto toFile = !_filename.isEmpty()
+		&& (_toCache == LoadToFileOnly);
+	if (toFile && (!_fileIsOpen || !_file.flush())) {
+		return nullptr;
+	}
+	_streamed = std::make_shared<Storage::StreamedFile>(
+		_size,
+		partSize(),
+		toFile ? _filename : QString());
+
+	// Everything before the next request offset is loaded,
+	// except the parts that are still being requested.
+	auto pending = base::flat_set<int>();
+	for (const auto &[requestId, requestData] : _sentRequests) {
+		pending.emplace(requestData.offset);
+	}
+	for (const auto &[offset, part] : _cdnUncheckedParts) {
+		pending.emplace(offset);
+	}
+	const auto loadedTill = std::min(_nextRequestOffset, _size);
+	for (auto offset = 0; offset < loadedTill; offset += partSize()) {
+		if (pending.contains(offset)) {
+			continue;
+		} else if (toFile) {
+			_streamed->partWritten(offset);
+		} else {
+			_streamed->partLoaded(
+				offset,
+				bytes::make_span(_data).subspan(
+					offset,
+					std::min(partSize(), _data.size() - offset)));
+		}
+	}
+	for (auto offset = loadedTill; offset < _size; offset += partSize()) {
+		_streamedPartsLeft.emplace(offset);
+	}
+	if (!toFile) {
+		// From now on the data is kept only in the streamed file.
+		_data = QByteArray();
+		_skippedBytes = 0;
+	}
+	return _streamed;
+}
+
 int mtpFileLoader::partSize() const {
 	return kDownloadCdnPartSize;
 
@@ -773,7 +945,10 @@ void mtpFileLoader::normalPartLoaded(
 	Expects(!_finished);
 	Expects(result.type() == mtpc_upload_fileCdnRedirect || result.type() == mtpc_upload_file);
 
-	auto offset = finishSentRequestGetOffset(requestId);
+	const auto received = (result.type() == mtpc_upload_file)
+		? result.c_upload_file().vbytes.v.size()
+		: 0;
+	auto offset = finishSentRequestGetOffset(requestId, received);
 	if (result.type() == mtpc_upload_fileCdnRedirect) {
 		return switchToCDN(offset, result.c_upload_fileCdnRedirect());
 	}
@@ -786,8 +961,10 @@ void mtpFileLoader::webPartLoaded(
 		mtpRequestId requestId) {
 	Expects(result.type() == mtpc_upload_webFile);
 
-	auto offset = finishSentRequestGetOffset(requestId);
 	auto &webFile = result.c_upload_webFile();
+	auto offset = finishSentRequestGetOffset(
+		requestId,
+		webFile.vbytes.v.size());
 	if (!_size) {
 		_size = webFile.vsize.v;
 	} else if (webFile.vsize.v != _size) {
@@ -801,7 +978,10 @@ void mtpFileLoader::webPartLoaded(
 void mtpFileLoader::cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequestId requestId) {
 	Expects(!_finished);
 
-	auto offset = finishSentRequestGetOffset(requestId);
+	const auto received = (result.type() == mtpc_upload_cdnFile)
+		? result.c_upload_cdnFile().vbytes.v.size()
+		: 0;
+	auto offset = finishSentRequestGetOffset(requestId, received);
 	if (result.type() == mtpc_upload_cdnFileReuploadNeeded) {
 		auto requestData = RequestData();
 		requestData.dcId = _dcId;
@@ -927,12 +1107,20 @@ void mtpFileLoader::placeSentRequest(mtpRequestId requestId, const RequestData &
 	_sentRequests.emplace(requestId, requestData);
 }
 
-int mtpFileLoader::finishSentRequestGetOffset(mtpRequestId requestId) {
+int mtpFileLoader::finishSentRequestGetOffset(
+		mtpRequestId requestId,
+		int receivedBytes) {
 	auto it = _sentRequests.find(requestId);
 	Assert(it != _sentRequests.cend());
 
 	auto requestData = it->second;
 	_downloader->requestedAmountIncrement(requestData.dcId, requestData.dcIndex, -partSize());
+	if (receivedBytes > 0) {
+		_downloader->receivedAmountIncrement(
+			requestData.dcId,
+			requestData.dcIndex,
+			receivedBytes);
+	}
 
 	--_queue->queriesCount;
 	_sentRequests.erase(it);
@@ -956,6 +1144,8 @@ bool mtpFileLoader::feedPart(int offset, bytes::const_span buffer) {
 				cancel(true);
 				return false;
 			}
+		} else if (_streamed) {
+			_streamed->partLoaded(offset, buffer);
 		} else {
 			_data.reserve(offset + buffer.size());
 			if (offset > _data.size()) {
@@ -976,12 +1166,25 @@ bool mtpFileLoader::feedPart(int offset, bytes::const_span buffer) {
 			}
 		}
 	}
-	if (!buffer.size() || (buffer.size() % 1024)) { // bad next offset
-		_lastComplete = true;
+	if (!_streamed) {
+		if (!buffer.size() || (buffer.size() % 1024)) { // bad next offset
+			_lastComplete = true;
+		}
+	} else if (buffer.size() && _fileIsOpen) {
+		// Parts are loaded out of order, the last one is not the end.
+		if (_file.flush()) {
+			_streamed->partWritten(offset);
+		} else {
+			cancel(true);
+			return false;
+		}
 	}
 	if (_sentRequests.empty()
 		&& _cdnUncheckedParts.empty()
 		&& (_lastComplete || (_size && _nextRequestOffset >= _size))) {
+		if (_streamed && !_fileIsOpen) {
+			_data = _streamed->data();
+		}
 		if (!_filename.isEmpty() && (_toCache == LoadToCacheAsWell)) {
 			if (!_fileIsOpen) {
 				_fileIsOpen = _file.open(QIODevice::WriteOnly);
@@ -1084,6 +1287,9 @@ void mtpFileLoader::cancelRequests() {
 		MTP::cancel(requestId);
 		finishSentRequestGetOffset(requestId);
 	}
+	if (_streamed) {
+		_streamed->cancel();
+	}
 }
 
 void mtpFileLoader::switchToCDN(
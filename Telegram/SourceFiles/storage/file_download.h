@@ -16,6 +16,21 @@ namespace Cache {
 struct Key;
 } // namespace Cache
 
+class StreamedFile;
+
+struct DownloadSessionStats {
+	MTP::DcId dcId = 0;
+	int index = 0;
+	int64 requested = 0;
+	int64 received = 0;
+	TimeMs busyTime = 0;
+
+	// Received bytes per second of time with requests in flight.
+	int64 bytesPerSecond() const {
+		return busyTime ? (received * 1000 / busyTime) : 0;
+	}
+};
+
 constexpr auto kMaxFileInMemory = 10 * 1024 * 1024; // 10 MB max file could be hold in memory
 constexpr auto kMaxVoiceInMemory = 2 * 1024 * 1024; // 2 MB audio is hold in memory and auto loaded
 constexpr auto kMaxStickerInMemory = 2 * 1024 * 1024; // 2 MB stickers hold in memory, auto loaded and displayed inline
@@ -37,19 +52,39 @@ public:
 	}
 
 	void requestedAmountIncrement(MTP::DcId dcId, int index, int amount);
-	int chooseDcIndexForRequest(MTP::DcId dcId) const;
+	void receivedAmountIncrement(MTP::DcId dcId, int index, int amount);
+	int chooseDcIndexForRequest(MTP::DcId dcId);
+
+	// Called when idle download sessions of the dc were stopped.
+	void sessionsStopped(MTP::DcId dcId);
 
 	~Downloader();
 
 private:
+	struct Session {
+		int64 requested = 0;
+		int64 received = 0;
+		TimeMs busyTime = 0;
+		TimeMs busySince = 0;
+	};
+	struct DcSessions {
+		std::array<Session, MTP::kDownloadSessionsCountMax> sessions;
+		int count = MTP::kDownloadSessionsCount;
+		TimeMs loadedSince = 0;
+	};
+
+	void checkSessionsGrow(MTP::DcId dcId, DcSessions &dc);
+
+	// Per session traffic, written to the debug log when sessions stop.
+	std::vector<DownloadSessionStats> sessionsStats() const;
+
 	base::Observable<void> _taskFinishedObservable;
 	int _priority = 1;
 
 	SingleQueuedInvokation _delayedLoadersDestroyer;
 	std::vector<std::unique_ptr<FileLoader>> _delayedDestroyedLoaders;
 
-	using RequestedInDc = std::array<int64, MTP::kDownloadSessionsCount>;
-	std::map<MTP::DcId, RequestedInDc> _requestedBytesAmount;
+	std::map<MTP::DcId, DcSessions> _dcSessions;
 
 };
 
@@ -102,6 +137,11 @@ public:
 	virtual Data::FileOrigin fileOrigin() const {
 		return Data::FileOrigin();
 	}
+
+	// Lets the file be read while it is loading, null if not supported.
+	virtual std::shared_ptr<Storage::StreamedFile> streamedFile() {
+		return nullptr;
+	}
 	float64 currentProgress() const;
 	virtual int32 currentOffset(bool includeSkipped = false) const = 0;
 	int32 fullSize() const;
@@ -248,6 +288,10 @@ public:
 		int requestId,
 		const QByteArray &current);
 
+	// Loads the parts that the readers wait for first.
+	// Null for non-document files.
+	std::shared_ptr<Storage::StreamedFile> streamedFile() override;
+
 	~mtpFileLoader();
 
 private:
@@ -271,6 +315,7 @@ private:
 
 	MTPInputFileLocation computeLocation() const;
 	bool loadPart() override;
+	bool loadStreamedPart();
 	void normalPartLoaded(const MTPupload_File &result, mtpRequestId requestId);
 	void webPartLoaded(const MTPupload_WebFile &result, mtpRequestId requestId);
 	void cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequestId requestId);
@@ -285,7 +330,9 @@ private:
 	bool cdnPartFailed(const RPCError &error, mtpRequestId requestId);
 
 	void placeSentRequest(mtpRequestId requestId, const RequestData &requestData);
-	int finishSentRequestGetOffset(mtpRequestId requestId);
+	int finishSentRequestGetOffset(
+		mtpRequestId requestId,
+		int receivedBytes = 0);
 	void switchToCDN(int offset, const MTPDupload_fileCdnRedirect &redirect);
 	void addCdnHashes(const QVector<MTPFileHash> &hashes);
 	void changeCDNParams(int offset, MTP::DcId dcId, const QByteArray &token, const QByteArray &encryptionKey, const QByteArray &encryptionIV, const QVector<MTPFileHash> &hashes);
@@ -299,6 +346,9 @@ private:
 
 	std::map<mtpRequestId, RequestData> _sentRequests;
 
+	std::shared_ptr<Storage::StreamedFile> _streamed;
+	std::set<int> _streamedPartsLeft; // Not requested yet.
+
 	bool _lastComplete = false;
 	int32 _skippedBytes = 0;
 	int32 _nextRequestOffset = 0;
@@ -20,6 +20,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "export/export_settings.h"
 #include "core/crash_reports.h"
 #include "core/update_checker.h"
+#include "core/startup_trace.h"
 #include "observer_peer.h"
 #include "mainwidget.h"
 #include "mainwindow.h"
@@ -32,6 +33,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "auth_session.h"
 #include "window/window_controller.h"
 #include "base/flags.h"
+#include "base/flat_map.h"
 #include "data/data_session.h"
 #include "history/history.h"
 
@@ -46,6 +48,7 @@ constexpr auto kThemeFileSizeLimit = 5 * 1024 * 1024;
 constexpr auto kFileLoaderQueueStopTimeout = TimeMs(5000);
 constexpr auto kDefaultStickerInstallDate = TimeId(1);
 constexpr auto kProxyTypeShift = 1024;
+constexpr auto kJournalCheckpointSize = 256 * 1024;
 
 constexpr auto kSinglePeerTypeUser = qint32(1);
 constexpr auto kSinglePeerTypeChat = qint32(2);
@@ -101,6 +104,15 @@ bool keyAlreadyUsed(QString &name, FileOptions options = FileOption::User | File
 	return false;
 }
 
+// Small frequently changed records (drafts, draft cursors) are appended
+// to a single journal file and get their own files only on checkpoint.
+struct JournalRecord {
+	qint32 version = 0;
+	QByteArray encrypted;
+};
+QMap<FileKey, JournalRecord> _journalRecords;
+QSet<FileKey> _journalChanged;
+
 FileKey genKey(FileOptions options = FileOption::User | FileOption::Safe) {
 	if (options & FileOption::User) {
 		if (!_userWorking()) return 0;
@@ -116,7 +128,9 @@ FileKey genKey(FileOptions options = FileOption::User | FileOption::Safe) {
 		result = rand_value<FileKey>();
 		path.resize(base.size());
 		path += toFilePart(result);
-	} while (!result || keyAlreadyUsed(path, options));
+	} while (!result
+		|| keyAlreadyUsed(path, options)
+		|| _journalRecords.contains(result));
 
 	return result;
 }
@@ -128,6 +142,11 @@ void clearKey(const FileKey &key, FileOptions options = FileOption::User | FileO
 		if (!_working()) return;
 	}
 
+	if ((options & FileOption::User) && _journalRecords.remove(key)) {
+		_journalChanged.insert(key);
+		_manager->writeJournal(false);
+	}
+
 	QString base = (options & FileOption::User) ? _userBasePath : _basePath, name;
 	name.reserve(base.size() + 0x11);
 	name.append(base).append(toFilePart(key)).append('0');
@@ -215,7 +234,8 @@ struct EncryptedDescriptor {
 };
 
 struct FileWriteDescriptor {
-	FileWriteDescriptor(const FileKey &key, FileOptions options = FileOption::User | FileOption::Safe) {
+	FileWriteDescriptor(const FileKey &key, FileOptions options = FileOption::User | FileOption::Safe, qint32 version = AppVersion)
+	: version(version) {
 		init(toFilePart(key), options);
 	}
 	FileWriteDescriptor(const QString &name, FileOptions options = FileOption::User | FileOption::Safe) {
@@ -253,7 +273,6 @@ struct FileWriteDescriptor {
 		file.setFileName(toTry[0]);
 		if (file.open(QIODevice::WriteOnly)) {
 			file.write(tdfMagic, tdfMagicLen);
-			qint32 version = AppVersion;
 			file.write((const char*)&version, sizeof(version));
 
 			stream.setDevice(&file);
@@ -301,7 +320,6 @@ struct FileWriteDescriptor {
 		stream.setDevice(0);
 
 		md5.feed(&dataSize, sizeof(dataSize));
-		qint32 version = AppVersion;
 		md5.feed(&version, sizeof(version));
 		md5.feed(tdfMagic, tdfMagicLen);
 		file.write((const char*)md5.result(), 0x10);
@@ -318,26 +336,40 @@ struct FileWriteDescriptor {
 
 	HashMd5 md5;
 	int32 dataSize = 0;
+	qint32 version = AppVersion;
 
 	~FileWriteDescriptor() {
 		finish();
 	}
 };
 
-bool readFile(FileReadDescriptor &result, const QString &name, FileOptions options = FileOption::User | FileOption::Safe) {
-	if (options & FileOption::User) {
-		if (!_userWorking()) return false;
-	} else {
-		if (!_working()) return false;
-	}
+struct PrefetchedFile {
+	int32 version = 0;
+	QByteArray data;
+};
+
+void setupReadDescriptor(FileReadDescriptor &result, PrefetchedFile &&file) {
+	result.version = file.version;
+	result.data = std::move(file.data);
+	result.buffer.setBuffer(&result.data);
+	result.buffer.open(QIODevice::ReadOnly);
+	result.stream.setDevice(&result.buffer);
+	result.stream.setVersion(QDataStream::Qt_5_1);
+}
+
+// Files decrypted with LocalKey in the background while reading the map,
+// by full path. Used by readEncryptedFile() instead of reading them again.
+base::flat_map<QString, PrefetchedFile> _decryptedPrefetch;
 
+// Doesn't touch any global state, so it can be called from any thread.
+bool readFileAt(FileReadDescriptor &result, const QString &basePath, const QString &name, FileOptions options) {
 	// detect order of read attempts
 	QString toTry[2];
-	toTry[0] = ((options & FileOption::User) ? _userBasePath : _basePath) + name + '0';
+	toTry[0] = basePath + name + '0';
 	if (options & FileOption::Safe) {
 		QFileInfo toTry0(toTry[0]);
 		if (toTry0.exists()) {
-			toTry[1] = ((options & FileOption::User) ? _userBasePath : _basePath) + name + '1';
+			toTry[1] = basePath + name + '1';
 			QFileInfo toTry1(toTry[1]);
 			if (toTry1.exists()) {
 				QDateTime mod0 = toTry0.lastModified(), mod1 = toTry1.lastModified();
@@ -403,14 +435,7 @@ bool readFile(FileReadDescriptor &result, const QString &name, FileOptions optio
 		}
 
 		bytes.resize(dataSize);
-		result.data = bytes;
-		bytes = QByteArray();
-
-		result.version = version;
-		result.buffer.setBuffer(&result.data);
-		result.buffer.open(QIODevice::ReadOnly);
-		result.stream.setDevice(&result.buffer);
-		result.stream.setVersion(QDataStream::Qt_5_1);
+		setupReadDescriptor(result, { version, std::move(bytes) });
 
 		if ((i == 0 && !toTry[1].isEmpty()) || i == 1) {
 			QFile::remove(toTry[1 - i]);
@@ -421,6 +446,19 @@ bool readFile(FileReadDescriptor &result, const QString &name, FileOptions optio
 	return false;
 }
 
+bool readFile(FileReadDescriptor &result, const QString &name, FileOptions options = FileOption::User | FileOption::Safe) {
+	if (options & FileOption::User) {
+		if (!_userWorking()) return false;
+	} else {
+		if (!_working()) return false;
+	}
+	return readFileAt(
+		result,
+		(options & FileOption::User) ? _userBasePath : _basePath,
+		name,
+		options);
+}
+
 bool decryptLocal(EncryptedDescriptor &result, const QByteArray &encrypted, const MTP::AuthKeyPtr &key = LocalKey) {
 	if (encrypted.size() <= 16 || (encrypted.size() & 0x0F)) {
 		LOG(("App Error: bad encrypted part size: %1").arg(encrypted.size()));
@@ -458,6 +496,17 @@ bool decryptLocal(EncryptedDescriptor &result, const QByteArray &encrypted, cons
 }
 
 bool readEncryptedFile(FileReadDescriptor &result, const QString &name, FileOptions options = FileOption::User | FileOption::Safe, const MTP::AuthKeyPtr &key = LocalKey) {
+	if (key == LocalKey && !_decryptedPrefetch.empty()) {
+		const auto path = ((options & FileOption::User) ? _userBasePath : _basePath) + name;
+		const auto i = _decryptedPrefetch.find(path);
+		if (i != end(_decryptedPrefetch)) {
+			auto file = std::move(i->second);
+			_decryptedPrefetch.erase(i);
+			setupReadDescriptor(result, std::move(file));
+			result.buffer.seek(sizeof(uint32)); // skip len
+			return true;
+		}
+	}
 	if (!readFile(result, name, options)) {
 		return false;
 	}
@@ -487,11 +536,60 @@ bool readEncryptedFile(FileReadDescriptor &result, const QString &name, FileOpti
 	return true;
 }
 
+bool readJournalRecord(FileReadDescriptor &result, const FileKey &fkey) {
+	const auto i = _journalRecords.constFind(fkey);
+	if (i == _journalRecords.cend()) {
+		return false;
+	}
+	EncryptedDescriptor data;
+	if (!decryptLocal(data, i->encrypted)) {
+		return false;
+	}
+	const auto position = data.buffer.pos();
+	data.finish();
+	setupReadDescriptor(result, { i->version, std::move(data.data) });
+	result.buffer.seek(position);
+	return true;
+}
+
 bool readEncryptedFile(FileReadDescriptor &result, const FileKey &fkey, FileOptions options = FileOption::User | FileOption::Safe, const MTP::AuthKeyPtr &key = LocalKey) {
+	if ((options & FileOption::User)
+		&& key == LocalKey
+		&& readJournalRecord(result, fkey)) {
+		return true;
+	}
 	return readEncryptedFile(result, toFilePart(fkey), options, key);
 }
 
+// Doesn't touch any global state, so it can be called from any thread.
+PrefetchedFile decryptFileAt(const QString &basePath, const QString &name, FileOptions options, const MTP::AuthKeyPtr &key) {
+	FileReadDescriptor file;
+	if (!readFileAt(file, basePath, name, options)) {
+		return PrefetchedFile();
+	}
+	QByteArray encrypted;
+	file.stream >> encrypted;
+
+	EncryptedDescriptor data;
+	if (!decryptLocal(data, encrypted, key)) {
+		return PrefetchedFile();
+	}
+	data.finish();
+	return PrefetchedFile{ file.version, std::move(data.data) };
+}
+
 FileKey _dataNameKey = 0;
+std::unique_ptr<Core::StartupTask<PrefetchedFile>> _mapPrefetch;
+
+// Changed by reset(), the map read before is not applied after it.
+int _mapGeneration = 0;
+
+FileKey computeDataNameKey() {
+	QByteArray dataNameUtf8 = (cDataFile() + (cTestMode() ? qsl(":/test/") : QString())).toUtf8();
+	FileKey dataNameHash[2];
+	hashMd5(dataNameUtf8.constData(), dataNameUtf8.size(), dataNameHash);
+	return dataNameHash[0];
+}
 
 enum { // Local Storage Keys
 	lskUserMap = 0x00,
@@ -516,6 +614,8 @@ enum { // Local Storage Keys
 	lskExportSettings = 0x13, // no data
 	lskBackground = 0x14, // no data
 	lskSelfSerialized = 0x15, // serialized self
+	lskJournal = 0x16, // no data
+	lskSharedMedia = 0x17, // data: PeerId peer
 };
 
 enum {
@@ -621,6 +721,8 @@ typedef QMap<PeerId, FileKey> DraftsMap;
 DraftsMap _draftsMap, _draftCursorsMap;
 typedef QMap<PeerId, bool> DraftsNotReadMap;
 DraftsNotReadMap _draftsNotReadMap;
+using SharedMediaMap = QMap<PeerId, FileKey>;
+SharedMediaMap _sharedMediaMap;
 
 typedef QPair<FileKey, qint32> FileDesc; // file, size
 
@@ -665,6 +767,9 @@ FileKey _exportSettingsKey = 0;
 FileKey _savedPeersKey = 0;
 FileKey _langPackKey = 0;
 
+FileKey _journalKey = 0;
+qint64 _journalSize = 0;
+
 bool _mapChanged = false;
 int32 _oldMapVersion = 0, _oldSettingsVersion = 0;
 
@@ -684,6 +789,181 @@ AuthSessionSettings &GetStoredAuthSessionCache() {
 
 void _writeMap(WriteMapWhen when = WriteMapWhen::Soon);
 
+QString _journalPath() {
+	return _userBasePath + toFilePart(_journalKey) + '0';
+}
+
+void _checkpointJournal() {
+	for (auto i = _journalRecords.cbegin(), e = _journalRecords.cend(); i != e; ++i) {
+		FileWriteDescriptor file(
+			i.key(),
+			FileOption::User | FileOption::Safe,
+			i->version);
+		file.writeData(i->encrypted);
+	}
+	_journalRecords.clear();
+
+	// All records are in their own files now, start the journal over.
+	QFile::remove(_journalPath());
+	_journalSize = 0;
+}
+
+// Each flush appends one transaction: a serialized list of changed
+// records followed by its md5. A torn or corrupted transaction is
+// dropped as a whole when the journal is read back. A journal started
+// over gets all the live records in its first transaction.
+void _writeJournal(WriteMapWhen when = WriteMapWhen::Soon) {
+	if (when != WriteMapWhen::Now) {
+		_manager->writeJournal(when == WriteMapWhen::Fast);
+		return;
+	}
+	_manager->writingJournal();
+	if (_journalChanged.isEmpty() || !_userWorking()) return;
+
+	if (!_journalKey) {
+		_journalKey = genKey();
+		_mapChanged = true;
+		_writeMap(WriteMapWhen::Fast);
+	}
+
+	auto transaction = QByteArray();
+	{
+		QBuffer buffer(&transaction);
+		buffer.open(QIODevice::WriteOnly);
+		QDataStream stream(&buffer);
+		stream.setVersion(QDataStream::Qt_5_1);
+		if (!_journalSize) {
+			stream << quint32(_journalRecords.size());
+			for (auto i = _journalRecords.cbegin(), e = _journalRecords.cend(); i != e; ++i) {
+				stream << qint32(i->version) << quint64(i.key()) << i->encrypted;
+			}
+		} else {
+			stream << quint32(_journalChanged.size());
+			for (const auto key : _journalChanged) {
+				const auto i = _journalRecords.constFind(key);
+				if (i != _journalRecords.cend()) {
+					stream << qint32(i->version) << quint64(key) << i->encrypted;
+				} else {
+					stream << qint32(0) << quint64(key) << QByteArray();
+				}
+			}
+		}
+	}
+	char md5[16];
+	hashMd5(transaction.constData(), transaction.size(), md5);
+
+	// The changed records are kept until they are written, try again later.
+	const auto failed = [] {
+		_journalSize = 0;
+		_writeJournal(WriteMapWhen::Soon);
+	};
+
+	if (!QDir().exists(_userBasePath)) QDir().mkpath(_userBasePath);
+	QFile f(_journalPath());
+	if (!f.open(QIODevice::ReadWrite)) {
+		LOG(("App Error: could not open journal '%1'").arg(f.fileName()));
+		failed();
+		return;
+	}
+	if (!_journalSize) {
+		f.resize(0);
+		f.write(tdfMagic, tdfMagicLen);
+		qint32 version = AppVersion;
+		f.write((const char*)&version, sizeof(version));
+	} else {
+		// Drop a torn tail left by an interrupted write, if any.
+		f.resize(_journalSize);
+		f.seek(_journalSize);
+	}
+	{
+		QDataStream stream(&f);
+		stream.setVersion(QDataStream::Qt_5_1);
+		stream << transaction;
+		stream.writeRawData(md5, sizeof(md5));
+		if (!_checkStreamStatus(stream)) {
+			failed();
+			return;
+		}
+	}
+	_journalSize = f.pos();
+	_journalChanged.clear();
+	f.close();
+
+	if (_journalSize > kJournalCheckpointSize) {
+		_checkpointJournal();
+	}
+}
+
+void _writeJournalRecord(const FileKey &key, EncryptedDescriptor &data) {
+	auto &record = _journalRecords[key];
+	record.version = AppVersion;
+	record.encrypted = FileWriteDescriptor::prepareEncrypted(data);
+	_journalChanged.insert(key);
+	_writeJournal();
+}
+
+void _readJournal() {
+	_journalRecords.clear();
+	_journalChanged.clear();
+	_journalSize = 0;
+	if (!_journalKey) return;
+
+	QFile f(_journalPath());
+	if (!f.open(QIODevice::ReadOnly)) {
+		return;
+	}
+	const auto content = f.readAll();
+	f.close();
+
+	const auto headerSize = tdfMagicLen + int(sizeof(qint32));
+	if (content.size() < headerSize
+		|| memcmp(content.constData(), tdfMagic, tdfMagicLen)) {
+		LOG(("App Error: bad journal header, ignoring."));
+		return;
+	}
+
+	auto records = QMap<FileKey, JournalRecord>();
+	auto good = qint64(headerSize);
+	QBuffer buffer;
+	buffer.setData(content);
+	buffer.open(QIODevice::ReadOnly);
+	buffer.seek(headerSize);
+	QDataStream stream(&buffer);
+	stream.setVersion(QDataStream::Qt_5_1);
+	while (!stream.atEnd()) {
+		auto transaction = QByteArray();
+		char md5[16], check[16];
+		stream >> transaction;
+		if (stream.readRawData(md5, sizeof(md5)) != sizeof(md5)
+			|| stream.status() != QDataStream::Ok
+			|| memcmp(hashMd5(transaction.constData(), transaction.size(), check), md5, sizeof(md5))) {
+			LOG(("App Info: journal tail dropped at %1").arg(good));
+			break;
+		}
+		QDataStream parse(transaction);
+		parse.setVersion(QDataStream::Qt_5_1);
+		quint32 count = 0;
+		parse >> count;
+		for (quint32 i = 0; i != count; ++i) {
+			qint32 version = 0;
+			quint64 key = 0;
+			auto encrypted = QByteArray();
+			parse >> version >> key >> encrypted;
+			if (encrypted.isEmpty()) {
+				records.remove(key);
+			} else {
+				records.insert(key, { version, encrypted });
+			}
+		}
+		if (!_checkStreamStatus(parse)) {
+			break;
+		}
+		good = buffer.pos();
+	}
+	_journalRecords = std::move(records);
+	_journalSize = good;
+}
+
 void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon) {
 	if (when != WriteMapWhen::Now) {
 		_manager->writeLocations(when == WriteMapWhen::Fast);
@@ -2129,66 +2409,88 @@ void _readMtpData() {
 	applyReadContext(std::move(context));
 }
 
-ReadMapState _readMap(const QByteArray &pass) {
-	auto ms = getms();
-	QByteArray dataNameUtf8 = (cDataFile() + (cTestMode() ? qsl(":/test/") : QString())).toUtf8();
-	FileKey dataNameHash[2];
-	hashMd5(dataNameUtf8.constData(), dataNameUtf8.size(), dataNameHash);
-	_dataNameKey = dataNameHash[0];
+// Everything read from the map file and the encrypted files that
+// are read right after it, prepared without touching any global state.
+struct LoadedMap {
+	ReadMapState state = ReadMapFailed;
+	int32 version = 0;
+	QByteArray salt, keyEncrypted;
+	MTP::AuthKeyPtr passKey, localKey;
+
+	QByteArray selfSerialized;
+	DraftsMap draftsMap, draftCursorsMap;
+	DraftsNotReadMap draftsNotReadMap;
+	SharedMediaMap sharedMediaMap;
+	quint64 locationsKey = 0, reportSpamStatusesKey = 0, trustedBotsKey = 0;
+	quint64 recentStickersKeyOld = 0;
+	quint64 installedStickersKey = 0, featuredStickersKey = 0, recentStickersKey = 0, favedStickersKey = 0, archivedStickersKey = 0;
+	quint64 savedGifsKey = 0;
+	quint64 backgroundKeyOld = 0, backgroundKeyDay = 0, backgroundKeyNight = 0;
+	quint64 userSettingsKey = 0, recentHashtagsAndBotsKey = 0, savedPeersKey = 0, exportSettingsKey = 0;
+	quint64 journalKey = 0;
+
+	// Decrypted with localKey, by full path, see _decryptedPrefetch.
+	base::flat_map<QString, PrefetchedFile> files;
+};
+
+void prepareMapPaths() {
+	_dataNameKey = computeDataNameKey();
 	_userBasePath = _basePath + toFilePart(_dataNameKey) + QChar('/');
 	_userDbPath = _basePath
 		+ "user_" + cDataFile()
 		+ (cTestMode() ? "[test]" : "")
 		+ '/';
+}
+
+// Derives the passcode key and decrypts the map, which is slow, so
+// it doesn't touch any global state and can be called from any thread.
+LoadedMap loadMap(
+		PrefetchedFile &&prefetched,
+		const QByteArray &pass,
+		const QString &userBasePath) {
+	auto result = LoadedMap();
 
 	FileReadDescriptor mapData;
-	if (!readFile(mapData, qsl("map"))) {
-		return ReadMapFailed;
+	if (prefetched.version) {
+		setupReadDescriptor(mapData, std::move(prefetched));
+	} else if (!readFileAt(mapData, userBasePath, qsl("map"), FileOption::User | FileOption::Safe)) {
+		return result;
 	}
 	LOG(("App Info: reading map..."));
 
 	QByteArray salt, keyEncrypted, mapEncrypted;
 	mapData.stream >> salt >> keyEncrypted >> mapEncrypted;
 	if (!_checkStreamStatus(mapData.stream)) {
-		return ReadMapFailed;
+		return result;
 	}
 
 	if (salt.size() != LocalEncryptSaltSize) {
 		LOG(("App Error: bad salt in map file, size: %1").arg(salt.size()));
-		return ReadMapFailed;
+		return result;
 	}
-	createLocalKey(pass, &salt, &PassKey);
+	createLocalKey(pass, &salt, &result.passKey);
 
 	EncryptedDescriptor keyData, map;
-	if (!decryptLocal(keyData, keyEncrypted, PassKey)) {
+	if (!decryptLocal(keyData, keyEncrypted, result.passKey)) {
 		LOG(("App Info: could not decrypt pass-protected key from map file, maybe bad password..."));
-		return ReadMapPassNeeded;
+		result.state = ReadMapPassNeeded;
+		return result;
 	}
 	auto key = Serialize::read<MTP::AuthKey::Data>(keyData.stream);
 	if (keyData.stream.status() != QDataStream::Ok || !keyData.stream.atEnd()) {
 		LOG(("App Error: could not read pass-protected key from map file"));
-		return ReadMapFailed;
+		return result;
 	}
-	LocalKey = std::make_shared<MTP::AuthKey>(key);
-
-	_passKeyEncrypted = keyEncrypted;
-	_passKeySalt = salt;
+	result.localKey = std::make_shared<MTP::AuthKey>(key);
+	result.salt = salt;
+	result.keyEncrypted = keyEncrypted;
 
-	if (!decryptLocal(map, mapEncrypted)) {
+	if (!decryptLocal(map, mapEncrypted, result.localKey)) {
 		LOG(("App Error: could not decrypt map."));
-		return ReadMapFailed;
+		return result;
 	}
 	LOG(("App Info: reading encrypted map..."));
 
-	QByteArray selfSerialized;
-	DraftsMap draftsMap, draftCursorsMap;
-	DraftsNotReadMap draftsNotReadMap;
-	quint64 locationsKey = 0, reportSpamStatusesKey = 0, trustedBotsKey = 0;
-	quint64 recentStickersKeyOld = 0;
-	quint64 installedStickersKey = 0, featuredStickersKey = 0, recentStickersKey = 0, favedStickersKey = 0, archivedStickersKey = 0;
-	quint64 savedGifsKey = 0;
-	quint64 backgroundKeyDay = 0, backgroundKeyNight = 0;
-	quint64 userSettingsKey = 0, recentHashtagsAndBotsKey = 0, savedPeersKey = 0, exportSettingsKey = 0;
 	while (!map.stream.atEnd()) {
 		quint32 keyType;
 		map.stream >> keyType;
@@ -2200,12 +2502,12 @@ ReadMapState _readMap(const QByteArray &pass) {
 				FileKey key;
 				quint64 p;
 				map.stream >> key >> p;
-				draftsMap.insert(p, key);
-				draftsNotReadMap.insert(p, true);
+				result.draftsMap.insert(p, key);
+				result.draftsNotReadMap.insert(p, true);
 			}
 		} break;
 		case lskSelfSerialized: {
-			map.stream >> selfSerialized;
+			map.stream >> result.selfSerialized;
 		} break;
 		case lskDraftPosition: {
 			quint32 count = 0;
@@ -2214,7 +2516,7 @@ ReadMapState _readMap(const QByteArray &pass) {
 				FileKey key;
 				quint64 p;
 				map.stream >> key >> p;
-				draftCursorsMap.insert(p, key);
+				result.draftCursorsMap.insert(p, key);
 			}
 		} break;
 		case lskImages:
@@ -2231,83 +2533,193 @@ ReadMapState _readMap(const QByteArray &pass) {
 			}
 		} break;
 		case lskLocations: {
-			map.stream >> locationsKey;
+			map.stream >> result.locationsKey;
 		} break;
 		case lskReportSpamStatuses: {
-			map.stream >> reportSpamStatusesKey;
+			map.stream >> result.reportSpamStatusesKey;
 		} break;
 		case lskTrustedBots: {
-			map.stream >> trustedBotsKey;
+			map.stream >> result.trustedBotsKey;
 		} break;
 		case lskRecentStickersOld: {
-			map.stream >> recentStickersKeyOld;
+			map.stream >> result.recentStickersKeyOld;
 		} break;
 		case lskBackgroundOld: {
-			map.stream >> (Window::Theme::IsNightMode()
-				? backgroundKeyNight
-				: backgroundKeyDay);
+			// Night mode is known only on the main thread, see applyMap().
+			map.stream >> result.backgroundKeyOld;
 		} break;
 		case lskBackground: {
-			map.stream >> backgroundKeyDay >> backgroundKeyNight;
+			map.stream >> result.backgroundKeyDay >> result.backgroundKeyNight;
 		} break;
 		case lskUserSettings: {
-			map.stream >> userSettingsKey;
+			map.stream >> result.userSettingsKey;
 		} break;
 		case lskRecentHashtagsAndBots: {
-			map.stream >> recentHashtagsAndBotsKey;
+			map.stream >> result.recentHashtagsAndBotsKey;
 		} break;
 		case lskStickersOld: {
-			map.stream >> installedStickersKey;
+			map.stream >> result.installedStickersKey;
 		} break;
 		case lskStickersKeys: {
-			map.stream >> installedStickersKey >> featuredStickersKey >> recentStickersKey >> archivedStickersKey;
+			map.stream >> result.installedStickersKey >> result.featuredStickersKey >> result.recentStickersKey >> result.archivedStickersKey;
 		} break;
 		case lskFavedStickers: {
-			map.stream >> favedStickersKey;
+			map.stream >> result.favedStickersKey;
 		} break;
 		case lskSavedGifsOld: {
 			quint64 key;
 			map.stream >> key;
 		} break;
 		case lskSavedGifs: {
-			map.stream >> savedGifsKey;
+			map.stream >> result.savedGifsKey;
 		} break;
 		case lskSavedPeers: {
-			map.stream >> savedPeersKey;
+			map.stream >> result.savedPeersKey;
 		} break;
 		case lskExportSettings: {
-			map.stream >> exportSettingsKey;
+			map.stream >> result.exportSettingsKey;
+		} break;
+		case lskJournal: {
+			map.stream >> result.journalKey;
+		} break;
+		case lskSharedMedia: {
+			quint32 count = 0;
+			map.stream >> count;
+			for (quint32 i = 0; i < count; ++i) {
+				FileKey key;
+				quint64 p;
+				map.stream >> key >> p;
+				result.sharedMediaMap.insert(p, key);
+			}
 		} break;
 		default:
 		LOG(("App Error: unknown key type in encrypted map: %1").arg(keyType));
-		return ReadMapFailed;
+		return result;
 		}
 		if (!_checkStreamStatus(map.stream)) {
-			return ReadMapFailed;
-		}
-	}
-
-	_draftsMap = draftsMap;
-	_draftCursorsMap = draftCursorsMap;
-	_draftsNotReadMap = draftsNotReadMap;
-
-	_locationsKey = locationsKey;
-	_reportSpamStatusesKey = reportSpamStatusesKey;
-	_trustedBotsKey = trustedBotsKey;
-	_recentStickersKeyOld = recentStickersKeyOld;
-	_installedStickersKey = installedStickersKey;
-	_featuredStickersKey = featuredStickersKey;
-	_recentStickersKey = recentStickersKey;
-	_favedStickersKey = favedStickersKey;
-	_archivedStickersKey = archivedStickersKey;
-	_savedGifsKey = savedGifsKey;
-	_savedPeersKey = savedPeersKey;
-	_backgroundKeyDay = backgroundKeyDay;
-	_backgroundKeyNight = backgroundKeyNight;
-	_userSettingsKey = userSettingsKey;
-	_recentHashtagsAndBotsKey = recentHashtagsAndBotsKey;
-	_exportSettingsKey = exportSettingsKey;
-	_oldMapVersion = mapData.version;
+			return result;
+		}
+	}
+	result.version = mapData.version;
+	result.state = ReadMapDone;
+	return result;
+}
+
+struct MapFile {
+	QString base;
+	QString name;
+	FileOptions options;
+};
+
+// Files that are read right after the map, they are decrypted in parallel.
+std::vector<MapFile> mapFiles(const LoadedMap &loaded) {
+	if (loaded.state != ReadMapDone) {
+		return {};
+	}
+	auto result = std::vector<MapFile>();
+	const auto user = FileOption::User | FileOption::Safe;
+	if (loaded.locationsKey) {
+		result.push_back({ _userBasePath, toFilePart(loaded.locationsKey), user });
+	}
+	if (loaded.reportSpamStatusesKey) {
+		result.push_back({ _userBasePath, toFilePart(loaded.reportSpamStatusesKey), user });
+	}
+	if (loaded.userSettingsKey) {
+		result.push_back({ _userBasePath, toFilePart(loaded.userSettingsKey), user });
+	}
+	result.push_back({ _basePath, toFilePart(_dataNameKey), FileOption::Safe });
+	return result;
+}
+
+void decryptMapFiles(LoadedMap &loaded) {
+	using Task = Core::StartupTask<PrefetchedFile>;
+	auto tasks = std::vector<std::pair<QString, std::unique_ptr<Task>>>();
+	for (const auto &file : mapFiles(loaded)) {
+		auto task = std::make_unique<Task>(
+			"Local::decryptFile",
+			[=, key = loaded.localKey] {
+				return decryptFileAt(file.base, file.name, file.options, key);
+			});
+		tasks.emplace_back(file.base + file.name, std::move(task));
+	}
+	for (auto &[path, task] : tasks) {
+		auto decrypted = task->join();
+		if (decrypted.version) {
+			loaded.files.emplace(path, std::move(decrypted));
+		}
+	}
+}
+
+// Nothing waits in the crl::async() workers, the results are counted
+// on the main thread, so that the workers don't wait for each other.
+void decryptMapFilesAsync(
+		const std::shared_ptr<LoadedMap> &loaded,
+		Fn<void()> done) {
+	const auto files = mapFiles(*loaded);
+	if (files.empty()) {
+		done();
+		return;
+	}
+	const auto left = std::make_shared<int>(int(files.size()));
+	for (const auto &file : files) {
+		crl::async([=, key = loaded->localKey] {
+			auto decrypted = std::make_shared<PrefetchedFile>(
+				decryptFileAt(file.base, file.name, file.options, key));
+			crl::on_main([=] {
+				if (decrypted->version) {
+					loaded->files.emplace(
+						file.base + file.name,
+						std::move(*decrypted));
+				}
+				if (!--*left) {
+					done();
+				}
+			});
+		});
+	}
+}
+
+ReadMapState applyMap(LoadedMap &&loaded, TimeMs started) {
+	if (loaded.passKey) {
+		PassKey = loaded.passKey;
+	}
+	if (loaded.localKey) {
+		LocalKey = loaded.localKey;
+		_passKeyEncrypted = loaded.keyEncrypted;
+		_passKeySalt = loaded.salt;
+	}
+	if (loaded.state != ReadMapDone) {
+		return loaded.state;
+	}
+	if (loaded.backgroundKeyOld) {
+		(Window::Theme::IsNightMode()
+			? loaded.backgroundKeyNight
+			: loaded.backgroundKeyDay) = loaded.backgroundKeyOld;
+	}
+
+	_draftsMap = loaded.draftsMap;
+	_draftCursorsMap = loaded.draftCursorsMap;
+	_draftsNotReadMap = loaded.draftsNotReadMap;
+	_sharedMediaMap = loaded.sharedMediaMap;
+
+	_locationsKey = loaded.locationsKey;
+	_reportSpamStatusesKey = loaded.reportSpamStatusesKey;
+	_trustedBotsKey = loaded.trustedBotsKey;
+	_recentStickersKeyOld = loaded.recentStickersKeyOld;
+	_installedStickersKey = loaded.installedStickersKey;
+	_featuredStickersKey = loaded.featuredStickersKey;
+	_recentStickersKey = loaded.recentStickersKey;
+	_favedStickersKey = loaded.favedStickersKey;
+	_archivedStickersKey = loaded.archivedStickersKey;
+	_savedGifsKey = loaded.savedGifsKey;
+	_savedPeersKey = loaded.savedPeersKey;
+	_backgroundKeyDay = loaded.backgroundKeyDay;
+	_backgroundKeyNight = loaded.backgroundKeyNight;
+	_userSettingsKey = loaded.userSettingsKey;
+	_recentHashtagsAndBotsKey = loaded.recentHashtagsAndBotsKey;
+	_exportSettingsKey = loaded.exportSettingsKey;
+	_journalKey = loaded.journalKey;
+	_oldMapVersion = loaded.version;
 	if (_oldMapVersion < AppVersion) {
 		_mapChanged = true;
 		_writeMap();
@@ -2315,6 +2727,8 @@ ReadMapState _readMap(const QByteArray &pass) {
 		_mapChanged = false;
 	}
 
+	_decryptedPrefetch = std::move(loaded.files);
+	_readJournal();
 	if (_locationsKey) {
 		_readLocations();
 	}
@@ -2324,19 +2738,48 @@ ReadMapState _readMap(const QByteArray &pass) {
 
 	_readUserSettings();
 	_readMtpData();
+	_decryptedPrefetch.clear();
 
 	Messenger::Instance().setAuthSessionFromStorage(
 		std::move(StoredAuthSessionCache),
-		std::move(selfSerialized),
+		std::move(loaded.selfSerialized),
 		_oldMapVersion);
 
-	LOG(("Map read time: %1").arg(getms() - ms));
+	LOG(("Map read time: %1").arg(getms() - started));
 	if (_oldSettingsVersion < AppVersion) {
 		writeSettings();
 	}
 	return ReadMapDone;
 }
 
+PrefetchedFile joinMapPrefetch() {
+	if (const auto prefetch = base::take(_mapPrefetch)) {
+		return prefetch->join();
+	}
+	return PrefetchedFile();
+}
+
+ReadMapState _readMap(const QByteArray &pass) {
+	const auto ms = getms();
+	prepareMapPaths();
+	if (!_userWorking()) {
+		return ReadMapFailed;
+	}
+	auto loaded = loadMap(joinMapPrefetch(), pass, _userBasePath);
+	decryptMapFiles(loaded);
+	return applyMap(std::move(loaded), ms);
+}
+
+void _readMapFinished(ReadMapState result) {
+	if (result == ReadMapFailed) {
+		_mapChanged = true;
+		_writeMap(WriteMapWhen::Now);
+	}
+	if (result != ReadMapPassNeeded) {
+		Storage::ClearLegacyFiles(_userBasePath, FilterLegacyFiles);
+	}
+}
+
 void _writeMap(WriteMapWhen when) {
 	if (when != WriteMapWhen::Now) {
 		_manager->writeMap(when == WriteMapWhen::Fast);
@@ -2393,6 +2836,7 @@ void _writeMap(WriteMapWhen when) {
 	if (!self.isEmpty()) mapSize += sizeof(quint32) + Serialize::bytearraySize(self);
 	if (!_draftsMap.isEmpty()) mapSize += sizeof(quint32) * 2 + _draftsMap.size() * sizeof(quint64) * 2;
 	if (!_draftCursorsMap.isEmpty()) mapSize += sizeof(quint32) * 2 + _draftCursorsMap.size() * sizeof(quint64) * 2;
+	if (!_sharedMediaMap.isEmpty()) mapSize += sizeof(quint32) * 2 + _sharedMediaMap.size() * sizeof(quint64) * 2;
 	if (_locationsKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_reportSpamStatusesKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_trustedBotsKey) mapSize += sizeof(quint32) + sizeof(quint64);
@@ -2407,6 +2851,7 @@ void _writeMap(WriteMapWhen when) {
 	if (_userSettingsKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_recentHashtagsAndBotsKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_exportSettingsKey) mapSize += sizeof(quint32) + sizeof(quint64);
+	if (_journalKey) mapSize += sizeof(quint32) + sizeof(quint64);
 
 	EncryptedDescriptor mapData(mapSize);
 	if (!self.isEmpty()) {
@@ -2424,6 +2869,12 @@ void _writeMap(WriteMapWhen when) {
 			mapData.stream << quint64(i.value()) << quint64(i.key());
 		}
 	}
+	if (!_sharedMediaMap.isEmpty()) {
+		mapData.stream << quint32(lskSharedMedia) << quint32(_sharedMediaMap.size());
+		for (auto i = _sharedMediaMap.cbegin(), e = _sharedMediaMap.cend(); i != e; ++i) {
+			mapData.stream << quint64(i.value()) << quint64(i.key());
+		}
+	}
 	if (_locationsKey) {
 		mapData.stream << quint32(lskLocations) << quint64(_locationsKey);
 	}
@@ -2464,6 +2915,9 @@ void _writeMap(WriteMapWhen when) {
 	if (_exportSettingsKey) {
 		mapData.stream << quint32(lskExportSettings) << quint64(_exportSettingsKey);
 	}
+	if (_journalKey) {
+		mapData.stream << quint32(lskJournal) << quint64(_journalKey);
+	}
 	map.writeEncrypted(mapData);
 
 	_mapChanged = false;
@@ -2473,6 +2927,7 @@ void _writeMap(WriteMapWhen when) {
 
 void finish() {
 	if (_manager) {
+		_writeJournal(WriteMapWhen::Now);
 		_writeMap(WriteMapWhen::Now);
 		_manager->finish();
 		_manager->deleteLater();
@@ -2482,7 +2937,11 @@ void finish() {
 }
 
 void loadTheme();
-void readLangPack();
+QByteArray readLangPackData(
+	const QString &basePath,
+	FileKey key,
+	const MTP::AuthKeyPtr &settingsKey);
+void applyLangPack(const QByteArray &data);
 
 void start() {
 	Expects(!_manager);
@@ -2539,8 +2998,18 @@ void start() {
 	_oldSettingsVersion = settingsData.version;
 	_settingsSalt = salt;
 
+	// Lang pack is read and decrypted while the theme is being loaded.
+	auto langpack = Core::StartupTask<QByteArray>(
+		"Local::readLangPack",
+		[
+			basePath = _working() ? _basePath : QString(),
+			key = _langPackKey,
+			settingsKey = SettingsKey
+		] {
+			return readLangPackData(basePath, key, settingsKey);
+		});
 	loadTheme();
-	readLangPack();
+	applyLangPack(langpack.join());
 
 	applyReadContext(std::move(context));
 }
@@ -2708,14 +3177,20 @@ void reset() {
 	if (_localLoader) {
 		_localLoader->stop();
 	}
+	++_mapGeneration; // Don't apply the map that is being read now.
 
 	_passKeySalt.clear(); // reset passcode, local key
 	_draftsMap.clear();
 	_draftCursorsMap.clear();
+	_sharedMediaMap.clear();
 	_fileLocations.clear();
 	_fileLocationPairs.clear();
 	_fileLocationAliases.clear();
 	_draftsNotReadMap.clear();
+	_journalRecords.clear();
+	_journalChanged.clear();
+	_journalKey = 0;
+	_journalSize = 0;
 	_locationsKey = _reportSpamStatusesKey = _trustedBotsKey = 0;
 	_recentStickersKeyOld = 0;
 	_installedStickersKey = _featuredStickersKey = _recentStickersKey = _favedStickersKey = _archivedStickersKey = 0;
@@ -2739,6 +3214,16 @@ bool checkPasscode(const QByteArray &passcode) {
 	return checkKey->equals(PassKey);
 }
 
+void checkPasscodeAsync(const QByteArray &passcode, Fn<void(bool)> done) {
+	crl::async([=, salt = _passKeySalt]() mutable {
+		auto checkKey = MTP::AuthKeyPtr();
+		createLocalKey(passcode, &salt, &checkKey);
+		crl::on_main([=] {
+			done(PassKey && checkKey->equals(PassKey));
+		});
+	});
+}
+
 void setPasscode(const QByteArray &passcode) {
 	createLocalKey(passcode, &_passKeySalt, &PassKey);
 
@@ -2770,7 +3255,8 @@ base::flat_set<QString> CollectGoodNames() {
 		_recentHashtagsAndBotsKey,
 		_exportSettingsKey,
 		_savedPeersKey,
-		_trustedBotsKey
+		_trustedBotsKey,
+		_journalKey
 	};
 	auto result = base::flat_set<QString>{ "map0", "map1" };
 	const auto push = [&](FileKey key) {
@@ -2788,6 +3274,9 @@ base::flat_set<QString> CollectGoodNames() {
 	for (const auto &value : _draftCursorsMap) {
 		push(value);
 	}
+	for (const auto &value : _sharedMediaMap) {
+		push(value);
+	}
 	for (const auto &value : keys) {
 		push(value);
 	}
@@ -2800,18 +3289,63 @@ void FilterLegacyFiles(FnMut<void(base::flat_set<QString>&&)> then) {
 	});
 }
 
+void prefetchMap() {
+	Expects(_working());
+
+	const auto path = _basePath + toFilePart(computeDataNameKey()) + QChar('/');
+	_mapPrefetch = std::make_unique<Core::StartupTask<PrefetchedFile>>(
+		"Local::prefetchMap",
+		[=] {
+			FileReadDescriptor result;
+			if (!readFileAt(result, path, qsl("map"), FileOption::User | FileOption::Safe)) {
+				return PrefetchedFile();
+			}
+			return PrefetchedFile{ result.version, result.data };
+		});
+}
+
 ReadMapState readMap(const QByteArray &pass) {
-	ReadMapState result = _readMap(pass);
-	if (result == ReadMapFailed) {
-		_mapChanged = true;
-		_writeMap(WriteMapWhen::Now);
-	}
-	if (result != ReadMapPassNeeded) {
-		Storage::ClearLegacyFiles(_userBasePath, FilterLegacyFiles);
-	}
+	const auto result = _readMap(pass);
+	_readMapFinished(result);
 	return result;
 }
 
+void readMapAsync(const QByteArray &pass, Fn<void(ReadMapState)> done) {
+	const auto ms = getms();
+	prepareMapPaths();
+	if (!_userWorking()) {
+		_readMapFinished(ReadMapFailed);
+		done(ReadMapFailed);
+		return;
+	}
+
+	// The prefetch was started on launch, don't wait for it in a worker.
+	const auto prefetched = std::make_shared<PrefetchedFile>(
+		joinMapPrefetch());
+	const auto userBasePath = _userBasePath;
+	const auto generation = _mapGeneration;
+	const auto apply = [=](const std::shared_ptr<LoadedMap> &loaded) {
+		if (generation != _mapGeneration) {
+			return;
+		}
+		const auto result = applyMap(std::move(*loaded), ms);
+		_readMapFinished(result);
+		done(result);
+	};
+	crl::async([=] {
+		const auto loaded = std::make_shared<LoadedMap>(loadMap(
+			std::move(*prefetched),
+			pass,
+			userBasePath));
+		crl::on_main([=] {
+			if (generation != _mapGeneration) {
+				return;
+			}
+			decryptMapFilesAsync(loaded, [=] { apply(loaded); });
+		});
+	});
+}
+
 int32 oldMapVersion() {
 	return _oldMapVersion;
 }
@@ -2857,8 +3391,7 @@ void writeDrafts(const PeerId &peer, const MessageDraft &localDraft, const Messa
 		data.stream << editDraft.textWithTags.text << editTags;
 		data.stream << qint32(editDraft.msgId) << qint32(editDraft.previewCancelled ? 1 : 0);
 
-		FileWriteDescriptor file(i.value());
-		file.writeEncrypted(data);
+		_writeJournalRecord(i.value(), data);
 
 		_draftsNotReadMap.remove(peer);
 	}
@@ -2999,8 +3532,7 @@ void writeDraftCursors(const PeerId &peer, const MessageCursor &msgCursor, const
 		data.stream << quint64(peer) << qint32(msgCursor.position) << qint32(msgCursor.anchor) << qint32(msgCursor.scroll);
 		data.stream << qint32(editCursor.position) << qint32(editCursor.anchor) << qint32(editCursor.scroll);
 
-		FileWriteDescriptor file(i.value());
-		file.writeEncrypted(data);
+		_writeJournalRecord(i.value(), data);
 	}
 }
 
@@ -3012,6 +3544,61 @@ bool hasDraft(const PeerId &peer) {
 	return _draftsMap.contains(peer);
 }
 
+void clearSharedMedia(const PeerId &peer) {
+	auto i = _sharedMediaMap.find(peer);
+	if (i != _sharedMediaMap.cend()) {
+		clearKey(i.value());
+		_sharedMediaMap.erase(i);
+		_mapChanged = true;
+		_writeMap();
+	}
+}
+
+void writeSharedMedia(const PeerId &peer, const QByteArray &serialized) {
+	if (!_working()) return;
+
+	if (serialized.isEmpty()) {
+		clearSharedMedia(peer);
+		return;
+	}
+	auto i = _sharedMediaMap.constFind(peer);
+	if (i == _sharedMediaMap.cend()) {
+		i = _sharedMediaMap.insert(peer, genKey());
+		_mapChanged = true;
+		_writeMap(WriteMapWhen::Fast);
+	}
+
+	EncryptedDescriptor data(sizeof(quint64) + Serialize::bytearraySize(serialized));
+	data.stream << quint64(peer) << serialized;
+
+	FileWriteDescriptor file(i.value());
+	file.writeEncrypted(data);
+}
+
+QByteArray readSharedMedia(const PeerId &peer) {
+	const auto i = _sharedMediaMap.constFind(peer);
+	if (i == _sharedMediaMap.cend()) {
+		return QByteArray();
+	}
+	FileReadDescriptor file;
+	if (!readEncryptedFile(file, i.value())) {
+		clearSharedMedia(peer);
+		return QByteArray();
+	}
+	quint64 filePeer = 0;
+	QByteArray result;
+	file.stream >> filePeer >> result;
+	if (!_checkStreamStatus(file.stream) || filePeer != peer) {
+		clearSharedMedia(peer);
+		return QByteArray();
+	}
+	return result;
+}
+
+bool hasSharedMedia(const PeerId &peer) {
+	return _sharedMediaMap.contains(peer);
+}
+
 void writeFileLocation(MediaKey location, const FileLocation &local) {
 	if (local.fname.isEmpty()) return;
 
@@ -4088,14 +4675,35 @@ Window::Theme::Saved readThemeAfterSwitch() {
 	return readThemeUsingKey(key);
 }
 
-void readLangPack() {
-	FileReadDescriptor langpack;
-	if (!_langPackKey || !readEncryptedFile(langpack, _langPackKey, FileOption::Safe, SettingsKey)) {
-		return;
+// Doesn't touch any global state, so it can be called from any thread.
+QByteArray readLangPackData(
+		const QString &basePath,
+		FileKey key,
+		const MTP::AuthKeyPtr &settingsKey) {
+	if (basePath.isEmpty() || !key) {
+		return QByteArray();
+	}
+	auto decrypted = decryptFileAt(
+		basePath,
+		toFilePart(key),
+		FileOption::Safe,
+		settingsKey);
+	if (!decrypted.version) {
+		return QByteArray();
 	}
+	FileReadDescriptor langpack;
+	setupReadDescriptor(langpack, std::move(decrypted));
+	langpack.buffer.seek(sizeof(uint32)); // skip len
 	auto data = QByteArray();
 	langpack.stream >> data;
-	if (langpack.stream.status() == QDataStream::Ok) {
+	if (langpack.stream.status() != QDataStream::Ok) {
+		return QByteArray();
+	}
+	return data;
+}
+
+void applyLangPack(const QByteArray &data) {
+	if (!data.isEmpty()) {
 		Lang::Current().fillFromSerialized(data);
 	}
 }
@@ -4705,6 +5313,10 @@ bool ClearManager::addTask(int task) {
 			_draftCursorsMap.clear();
 			_mapChanged = true;
 		}
+		if (!_sharedMediaMap.isEmpty()) {
+			_sharedMediaMap.clear();
+			_mapChanged = true;
+		}
 		if (_locationsKey) {
 			_locationsKey = 0;
 			_mapChanged = true;
@@ -4733,6 +5345,13 @@ bool ClearManager::addTask(int task) {
 			_savedPeersKey = 0;
 			_mapChanged = true;
 		}
+		if (_journalKey) {
+			_journalRecords.clear();
+			_journalChanged.clear();
+			_journalKey = 0;
+			_journalSize = 0;
+			_mapChanged = true;
+		}
 		_writeMap();
 	} else {
 		for (int32 i = 0, l = data->tasks.size(); i < l; ++i) {
@@ -4836,6 +5455,8 @@ Manager::Manager() {
 	connect(&_mapWriteTimer, SIGNAL(timeout()), this, SLOT(mapWriteTimeout()));
 	_locationsWriteTimer.setSingleShot(true);
 	connect(&_locationsWriteTimer, SIGNAL(timeout()), this, SLOT(locationsWriteTimeout()));
+	_journalWriteTimer.setSingleShot(true);
+	connect(&_journalWriteTimer, SIGNAL(timeout()), this, SLOT(journalWriteTimeout()));
 }
 
 void Manager::writeMap(bool fast) {
@@ -4862,6 +5483,18 @@ void Manager::writingLocations() {
 	_locationsWriteTimer.stop();
 }
 
+void Manager::writeJournal(bool fast) {
+	if (!_journalWriteTimer.isActive() || fast) {
+		_journalWriteTimer.start(fast ? 1 : WriteMapTimeout);
+	} else if (_journalWriteTimer.remainingTime() <= 0) {
+		journalWriteTimeout();
+	}
+}
+
+void Manager::writingJournal() {
+	_journalWriteTimer.stop();
+}
+
 void Manager::mapWriteTimeout() {
 	_writeMap(WriteMapWhen::Now);
 }
@@ -4870,7 +5503,14 @@ void Manager::locationsWriteTimeout() {
 	_writeLocations(WriteMapWhen::Now);
 }
 
+void Manager::journalWriteTimeout() {
+	_writeJournal(WriteMapWhen::Now);
+}
+
 void Manager::finish() {
+	if (_journalWriteTimer.isActive()) {
+		journalWriteTimeout();
+	}
 	if (_mapWriteTimer.isActive()) {
 		mapWriteTimeout();
 	}
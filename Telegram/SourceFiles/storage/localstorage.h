@@ -42,6 +42,7 @@ QString readAutoupdatePrefix();
 void reset();
 
 bool checkPasscode(const QByteArray &passcode);
+void checkPasscodeAsync(const QByteArray &passcode, Fn<void(bool)> done);
 void setPasscode(const QByteArray &passcode);
 
 enum ClearManagerTask {
@@ -80,7 +81,14 @@ enum ReadMapState {
 	ReadMapDone = 1,
 	ReadMapPassNeeded = 2,
 };
+
+// Starts reading the map file in the background, next readMap() uses it.
+void prefetchMap();
 ReadMapState readMap(const QByteArray &pass);
+
+// Derives the key and decrypts the map in the background, calls done()
+// on the main thread after the map is applied.
+void readMapAsync(const QByteArray &pass, Fn<void(ReadMapState)> done);
 int32 oldMapVersion();
 
 int32 oldSettingsVersion();
@@ -101,6 +109,10 @@ void writeDraftCursors(const PeerId &peer, const MessageCursor &localCursor, con
 bool hasDraftCursors(const PeerId &peer);
 bool hasDraft(const PeerId &peer);
 
+void writeSharedMedia(const PeerId &peer, const QByteArray &serialized);
+QByteArray readSharedMedia(const PeerId &peer);
+bool hasSharedMedia(const PeerId &peer);
+
 void writeFileLocation(MediaKey location, const FileLocation &local);
 FileLocation readFileLocation(MediaKey location, bool check = true);
 
@@ -177,15 +189,19 @@ public:
 	void writingMap();
 	void writeLocations(bool fast);
 	void writingLocations();
+	void writeJournal(bool fast);
+	void writingJournal();
 	void finish();
 
 public slots:
 	void mapWriteTimeout();
 	void locationsWriteTimeout();
+	void journalWriteTimeout();
 
 private:
 	QTimer _mapWriteTimer;
 	QTimer _locationsWriteTimer;
+	QTimer _journalWriteTimer;
 
 };
 
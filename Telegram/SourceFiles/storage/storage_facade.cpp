@@ -21,7 +21,7 @@ public:
 	void remove(SharedMediaRemoveOne &&query);
 	void remove(SharedMediaRemoveAll &&query);
 	void invalidate(SharedMediaInvalidateBottom &&query);
-	rpl::producer<SharedMediaResult> query(SharedMediaQuery &&query) const;
+	rpl::producer<SharedMediaResult> query(SharedMediaQuery &&query);
 	rpl::producer<SharedMediaSliceUpdate> sharedMediaSliceUpdated() const;
 	rpl::producer<SharedMediaRemoveOne> sharedMediaOneRemoved() const;
 	rpl::producer<SharedMediaRemoveAll> sharedMediaAllRemoved() const;
@@ -79,7 +79,7 @@ void Facade::Impl::invalidate(SharedMediaInvalidateBottom &&query) {
 	_sharedMedia.invalidate(std::move(query));
 }
 
-rpl::producer<SharedMediaResult> Facade::Impl::query(SharedMediaQuery &&query) const {
+rpl::producer<SharedMediaResult> Facade::Impl::query(SharedMediaQuery &&query) {
 	return _sharedMedia.query(std::move(query));
 }
 
@@ -7,9 +7,19 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #include "storage/storage_shared_media.h"
 
+#include "storage/localstorage.h"
+
 #include <rpl/map.h>
 
 namespace Storage {
+namespace {
+
+constexpr auto kSaveDelay = TimeMs(5000);
+
+} // namespace
+
+SharedMedia::SharedMedia() : _saveTimer([=] { savePending(); }) {
+}
 
 std::map<PeerId, SharedMedia::Lists>::iterator
 		SharedMedia::enforceLists(PeerId peer) {
@@ -30,9 +40,83 @@ std::map<PeerId, SharedMedia::Lists>::iterator
 				update);
 		}) | rpl::start_to_stream(_sliceUpdated, _lifetime);
 	}
+	restoreLists(peer, result->second);
 	return result;
 }
 
+std::map<PeerId, SharedMedia::Lists>::iterator
+		SharedMedia::findLists(PeerId peer) {
+	const auto result = _lists.find(peer);
+	if (result != _lists.end() || !Local::hasSharedMedia(peer)) {
+		return result;
+	}
+	return enforceLists(peer);
+}
+
+void SharedMedia::restoreLists(PeerId peer, Lists &lists) {
+	const auto serialized = Local::readSharedMedia(peer);
+	if (serialized.isEmpty()) {
+		return;
+	}
+	QDataStream stream(serialized);
+	stream.setVersion(QDataStream::Qt_5_1);
+
+	auto count = qint32();
+	stream >> count;
+	const auto restored = [&] {
+		if (count != kSharedMediaTypeCount) {
+			return false;
+		}
+		for (auto &list : lists) {
+			if (!list.deserialize(stream)) {
+				return false;
+			}
+		}
+		return true;
+	}();
+	if (!restored) {
+		LOG(("Storage Error: "
+			"Could not restore shared media for peer %1.").arg(peer));
+		Local::writeSharedMedia(peer, QByteArray());
+	}
+}
+
+void SharedMedia::saveLists(PeerId peer, const Lists &lists) {
+	const auto empty = ranges::all_of(lists, [](const SparseIdsList &list) {
+		return list.empty();
+	});
+	if (empty) {
+		Local::writeSharedMedia(peer, QByteArray());
+		return;
+	}
+	auto serialized = QByteArray();
+	{
+		QDataStream stream(&serialized, QIODevice::WriteOnly);
+		stream.setVersion(QDataStream::Qt_5_1);
+		stream << qint32(kSharedMediaTypeCount);
+		for (const auto &list : lists) {
+			list.serialize(stream);
+		}
+	}
+	Local::writeSharedMedia(peer, serialized);
+}
+
+void SharedMedia::scheduleSave(PeerId peer) {
+	_savePending.emplace(peer);
+	if (!_saveTimer.isActive()) {
+		_saveTimer.callOnce(kSaveDelay);
+	}
+}
+
+void SharedMedia::savePending() {
+	for (const auto peer : base::take(_savePending)) {
+		const auto i = _lists.find(peer);
+		if (i != _lists.end()) {
+			saveLists(peer, i->second);
+		}
+	}
+}
+
 void SharedMedia::add(SharedMediaAddNew &&query) {
 	auto peer = query.peerId;
 	auto peerIt = enforceLists(peer);
@@ -42,6 +126,7 @@ void SharedMedia::add(SharedMediaAddNew &&query) {
 			peerIt->second[index].addNew(query.messageId);
 		}
 	}
+	scheduleSave(peer);
 }
 
 void SharedMedia::add(SharedMediaAddExisting &&query) {
@@ -52,6 +137,7 @@ void SharedMedia::add(SharedMediaAddExisting &&query) {
 			peerIt->second[index].addExisting(query.messageId, query.noSkipRange);
 		}
 	}
+	scheduleSave(query.peerId);
 }
 
 void SharedMedia::add(SharedMediaAddSlice &&query) {
@@ -63,10 +149,11 @@ void SharedMedia::add(SharedMediaAddSlice &&query) {
 		std::move(query.messageIds),
 		query.noSkipRange,
 		query.count);
+	scheduleSave(query.peerId);
 }
 
 void SharedMedia::remove(SharedMediaRemoveOne &&query) {
-	auto peerIt = _lists.find(query.peerId);
+	auto peerIt = findLists(query.peerId);
 	if (peerIt != _lists.end()) {
 		for (auto index = 0; index != kSharedMediaTypeCount; ++index) {
 			auto type = static_cast<SharedMediaType>(index);
@@ -74,33 +161,36 @@ void SharedMedia::remove(SharedMediaRemoveOne &&query) {
 				peerIt->second[index].removeOne(query.messageId);
 			}
 		}
+		scheduleSave(query.peerId);
 		_oneRemoved.fire(std::move(query));
 	}
 }
 
 void SharedMedia::remove(SharedMediaRemoveAll &&query) {
-	auto peerIt = _lists.find(query.peerId);
+	auto peerIt = findLists(query.peerId);
 	if (peerIt != _lists.end()) {
 		for (auto index = 0; index != kSharedMediaTypeCount; ++index) {
 			peerIt->second[index].removeAll();
 		}
+		scheduleSave(query.peerId);
 		_allRemoved.fire(std::move(query));
 	}
 }
 
 void SharedMedia::invalidate(SharedMediaInvalidateBottom &&query) {
-	auto peerIt = _lists.find(query.peerId);
+	auto peerIt = findLists(query.peerId);
 	if (peerIt != _lists.end()) {
 		for (auto index = 0; index != kSharedMediaTypeCount; ++index) {
 			peerIt->second[index].invalidateBottom();
 		}
+		scheduleSave(query.peerId);
 		_bottomInvalidated.fire(std::move(query));
 	}
 }
 
-rpl::producer<SharedMediaResult> SharedMedia::query(SharedMediaQuery &&query) const {
+rpl::producer<SharedMediaResult> SharedMedia::query(SharedMediaQuery &&query) {
 	Expects(IsValidSharedMediaType(query.key.type));
-	auto peerIt = _lists.find(query.key.peerId);
+	auto peerIt = findLists(query.key.peerId);
 	if (peerIt != _lists.end()) {
 		auto index = static_cast<int>(query.key.type);
 		return peerIt->second[index].query(SparseIdsListQuery(
@@ -10,6 +10,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include <rpl/event_stream.h>
 #include "storage/storage_facade.h"
 #include "storage/storage_sparse_ids_list.h"
+#include "base/timer.h"
 
 namespace Storage {
 
@@ -183,6 +184,8 @@ class SharedMedia {
 public:
 	using Type = SharedMediaType;
 
+	SharedMedia();
+
 	void add(SharedMediaAddNew &&query);
 	void add(SharedMediaAddExisting &&query);
 	void add(SharedMediaAddSlice &&query);
@@ -190,7 +193,7 @@ public:
 	void remove(SharedMediaRemoveAll &&query);
 	void invalidate(SharedMediaInvalidateBottom &&query);
 
-	rpl::producer<SharedMediaResult> query(SharedMediaQuery &&query) const;
+	rpl::producer<SharedMediaResult> query(SharedMediaQuery &&query);
 	rpl::producer<SharedMediaSliceUpdate> sliceUpdated() const;
 	rpl::producer<SharedMediaRemoveOne> oneRemoved() const;
 	rpl::producer<SharedMediaRemoveAll> allRemoved() const;
@@ -200,8 +203,16 @@ private:
 	using Lists = std::array<SparseIdsList, kSharedMediaTypeCount>;
 
 	std::map<PeerId, Lists>::iterator enforceLists(PeerId peer);
+	std::map<PeerId, Lists>::iterator findLists(PeerId peer);
+
+	void restoreLists(PeerId peer, Lists &lists);
+	void saveLists(PeerId peer, const Lists &lists);
+	void scheduleSave(PeerId peer);
+	void savePending();
 
 	std::map<PeerId, Lists> _lists;
+	base::flat_set<PeerId> _savePending;
+	base::Timer _saveTimer;
 
 	rpl::event_stream<SharedMediaSliceUpdate> _sliceUpdated;
 	rpl::event_stream<SharedMediaRemoveOne> _oneRemoved;
@@ -7,10 +7,21 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #include "storage/storage_sparse_ids_list.h"
 
+#include "base/algorithm.h"
+#include "base/assertion.h"
+
+#include <range/v3/algorithm/lower_bound.hpp>
+#include <range/v3/algorithm/upper_bound.hpp>
+
 namespace Storage {
+namespace {
+
+constexpr auto kMaxSerializedIds = quint32(1024 * 1024);
+
+} // namespace
 
 SparseIdsList::Slice::Slice(
-	base::flat_set<MsgId> &&messages,
+	base::chunked_set<MsgId> &&messages,
 	MsgRange range)
 : messages(std::move(messages))
 , range(range) {
@@ -79,7 +90,7 @@ SparseIdsList::AddResult SparseIdsList::addRangeItemsAndCountNew(
 		return uniteAndAdd(update, uniteFrom, uniteTill, messages, noSkipRange);
 	}
 
-	auto sliceMessages = base::flat_set<MsgId> {
+	auto sliceMessages = base::chunked_set<MsgId> {
 		std::begin(messages),
 		std::end(messages) };
 	auto slice = _slices.emplace(
@@ -137,9 +148,48 @@ void SparseIdsList::addSlice(
 		std::vector<MsgId> &&messageIds,
 		MsgRange noSkipRange,
 		std::optional<int> count) {
+	if (noSkipRange.from <= _unverifiedTill) {
+		removeUnverified(messageIds, noSkipRange);
+	}
 	addRange(messageIds, noSkipRange, count);
 }
 
+void SparseIdsList::removeUnverified(
+		const std::vector<MsgId> &messageIds,
+		MsgRange noSkipRange) {
+	const auto till = std::min(noSkipRange.till, _unverifiedTill);
+	const auto received = base::flat_set<MsgId> {
+		std::begin(messageIds),
+		std::end(messageIds) };
+	auto removed = 0;
+	auto slice = ranges::lower_bound(
+		_slices,
+		noSkipRange.from,
+		std::less<>(),
+		[](const Slice &slice) { return slice.range.till; });
+	for (; slice != _slices.end() && slice->range.from <= till; ++slice) {
+		auto stale = std::vector<MsgId>();
+		const auto &messages = slice->messages;
+		auto i = messages.lower_bound(noSkipRange.from);
+		for (; i != messages.end() && *i <= till; ++i) {
+			if (!received.contains(*i)) {
+				stale.push_back(*i);
+			}
+		}
+		if (!stale.empty()) {
+			_slices.modify(slice, [&](Slice &slice) {
+				for (const auto messageId : stale) {
+					slice.messages.remove(messageId);
+				}
+			});
+			removed += int(stale.size());
+		}
+	}
+	if (_count && removed > 0) {
+		*_count = std::max(*_count - removed, 0);
+	}
+}
+
 void SparseIdsList::removeOne(MsgId messageId) {
 	auto slice = ranges::lower_bound(
 		_slices,
@@ -158,7 +208,7 @@ void SparseIdsList::removeOne(MsgId messageId) {
 
 void SparseIdsList::removeAll() {
 	_slices.clear();
-	_slices.emplace(base::flat_set<MsgId>{}, MsgRange { 0, ServerMaxMsgId });
+	_slices.emplace(base::chunked_set<MsgId>{}, MsgRange { 0, ServerMaxMsgId });
 	_count = 0;
 }
 
@@ -203,16 +253,84 @@ rpl::producer<SparseIdsSliceUpdate> SparseIdsList::sliceUpdated() const {
 	return _sliceUpdated.events();
 }
 
+bool SparseIdsList::empty() const {
+	return _slices.empty() && !_count;
+}
+
+void SparseIdsList::serialize(QDataStream &stream) const {
+	stream << qint32(_count ? *_count : -1) << quint32(_slices.size());
+	for (const auto &slice : _slices) {
+		stream
+			<< qint32(slice.range.from)
+			<< qint32(slice.range.till)
+			<< quint32(slice.messages.size());
+		for (const auto messageId : slice.messages) {
+			stream << qint32(messageId);
+		}
+	}
+}
+
+bool SparseIdsList::deserialize(QDataStream &stream) {
+	auto count = qint32();
+	auto slicesCount = quint32();
+	stream >> count >> slicesCount;
+	if (stream.status() != QDataStream::Ok) {
+		return false;
+	}
+	auto slices = base::flat_set<Slice>();
+	auto total = quint32();
+	for (auto i = quint32(); i != slicesCount; ++i) {
+		auto from = qint32();
+		auto till = qint32();
+		auto messagesCount = quint32();
+		stream >> from >> till >> messagesCount;
+		if (stream.status() != QDataStream::Ok
+			|| from > till
+			|| messagesCount > kMaxSerializedIds - total) {
+			return false;
+		}
+		total += messagesCount;
+		auto messages = std::vector<MsgId>();
+		messages.reserve(messagesCount);
+		for (auto j = quint32(); j != messagesCount; ++j) {
+			auto messageId = qint32();
+			stream >> messageId;
+			messages.push_back(messageId);
+		}
+		if (stream.status() != QDataStream::Ok) {
+			return false;
+		}
+		slices.emplace(
+			base::chunked_set<MsgId> { messages.begin(), messages.end() },
+			MsgRange { from, till });
+	}
+	_slices = std::move(slices);
+	_count = (count >= 0) ? std::make_optional(int(count)) : std::nullopt;
+	_unverifiedTill = 0;
+	for (const auto &slice : _slices) {
+		if (!slice.messages.empty()) {
+			accumulate_max(_unverifiedTill, slice.messages.back());
+		}
+	}
+	invalidateBottom();
+	return true;
+}
+
 SparseIdsListResult SparseIdsList::queryFromSlice(
 		const SparseIdsListQuery &query,
 		const Slice &slice) const {
 	auto result = SparseIdsListResult {};
-	auto position = ranges::lower_bound(slice.messages, query.aroundId);
-	auto haveBefore = int(position - slice.messages.begin());
-	auto haveEqualOrAfter = int(slice.messages.end() - position);
+	const auto &messages = slice.messages;
+	auto haveBefore = int(messages.rank(query.aroundId));
+	auto haveEqualOrAfter = int(messages.size()) - haveBefore;
 	auto before = qMin(haveBefore, query.limitBefore);
 	auto equalOrAfter = qMin(haveEqualOrAfter, query.limitAfter + 1);
-	auto ids = std::vector<MsgId>(position - before, position + equalOrAfter);
+	auto ids = std::vector<MsgId>();
+	ids.reserve(before + equalOrAfter);
+	auto i = messages.nth(haveBefore - before);
+	for (auto left = before + equalOrAfter; left != 0; --left, ++i) {
+		ids.push_back(*i);
+	}
 	result.messageIds.merge(ids.begin(), ids.end());
 	if (slice.range.from == 0) {
 		result.skippedBefore = haveBefore - before;
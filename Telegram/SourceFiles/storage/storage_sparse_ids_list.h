@@ -7,6 +7,15 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #pragma once
 
+#include "data/data_msg_id.h"
+#include "base/chunked_set.h"
+#include "base/flat_set.h"
+
+#include <rpl/producer.h>
+#include <rpl/event_stream.h>
+#include <QtCore/QDataStream>
+#include <optional>
+
 namespace Storage {
 
 struct SparseIdsListQuery {
@@ -33,7 +42,7 @@ struct SparseIdsListResult {
 };
 
 struct SparseIdsSliceUpdate {
-	const base::flat_set<MsgId> *messages = nullptr;
+	const base::chunked_set<MsgId> *messages = nullptr;
 	MsgRange range;
 	std::optional<int> count;
 };
@@ -52,14 +61,22 @@ public:
 	rpl::producer<SparseIdsListResult> query(SparseIdsListQuery &&query) const;
 	rpl::producer<SparseIdsSliceUpdate> sliceUpdated() const;
 
+	bool empty() const;
+	void serialize(QDataStream &stream) const;
+
+	// The restored list may contain messages deleted while the app was
+	// closed and doesn't know about the new ones. So the bottom is
+	// invalidated and the restored ids are checked by the next slices.
+	bool deserialize(QDataStream &stream);
+
 private:
 	struct Slice {
-		Slice(base::flat_set<MsgId> &&messages, MsgRange range);
+		Slice(base::chunked_set<MsgId> &&messages, MsgRange range);
 
 		template <typename Range>
 		void merge(const Range &moreMessages, MsgRange moreNoSkipRange);
 
-		base::flat_set<MsgId> messages;
+		base::chunked_set<MsgId> messages;
 		MsgRange range;
 
 		inline bool operator<(const Slice &other) const {
@@ -94,9 +111,13 @@ private:
 	SparseIdsListResult queryFromSlice(
 		const SparseIdsListQuery &query,
 		const Slice &slice) const;
+	void removeUnverified(
+		const std::vector<MsgId> &messageIds,
+		MsgRange noSkipRange);
 
 	std::optional<int> _count;
 	base::flat_set<Slice> _slices;
+	MsgId _unverifiedTill = 0;
 
 	rpl::event_stream<SparseIdsSliceUpdate> _sliceUpdated;
 
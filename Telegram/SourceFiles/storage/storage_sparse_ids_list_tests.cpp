@@ -0,0 +1,161 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/storage_sparse_ids_list.h"
+
+using Storage::SparseIdsList;
+using Storage::SparseIdsListResult;
+
+QByteArray Serialize(const SparseIdsList &list) {
+	auto result = QByteArray();
+	{
+		QDataStream stream(&result, QIODevice::WriteOnly);
+		stream.setVersion(QDataStream::Qt_5_1);
+		list.serialize(stream);
+	}
+	return result;
+}
+
+bool Deserialize(SparseIdsList &list, const QByteArray &serialized) {
+	QDataStream stream(serialized);
+	stream.setVersion(QDataStream::Qt_5_1);
+	return list.deserialize(stream);
+}
+
+SparseIdsListResult Query(const SparseIdsList &list, MsgId aroundId) {
+	auto result = SparseIdsListResult();
+	auto lifetime = rpl::lifetime();
+	list.query(
+		{ aroundId, 10, 10 }
+	) | rpl::start_with_next([&](SparseIdsListResult &&value) {
+		result = std::move(value);
+	}, lifetime);
+	return result;
+}
+
+std::vector<MsgId> Ids(const SparseIdsListResult &result) {
+	return { result.messageIds.begin(), result.messageIds.end() };
+}
+
+TEST_CASE("sparse ids list serialization", "[storage_sparse_ids_list]") {
+	auto list = SparseIdsList();
+	list.addSlice({ 10, 20, 30 }, { 0, 35 }, 100);
+	list.addSlice({ 50, 60 }, { 45, ServerMaxMsgId }, std::nullopt);
+
+	SECTION("round trip restores slices and count") {
+		auto restored = SparseIdsList();
+		REQUIRE(Deserialize(restored, Serialize(list)));
+		const auto result = Query(restored, 20);
+		REQUIRE((Ids(result) == std::vector<MsgId>{ 10, 20, 30 }));
+		REQUIRE(result.count == 100);
+		REQUIRE(result.skippedBefore == 0);
+		REQUIRE(result.skippedAfter == 97);
+	}
+	SECTION("round trip without bottom slice is exact") {
+		auto top = SparseIdsList();
+		top.addSlice({ 10, 20, 30 }, { 0, 35 }, 3);
+		auto restored = SparseIdsList();
+		REQUIRE(Deserialize(restored, Serialize(top)));
+		REQUIRE(Serialize(restored) == Serialize(top));
+	}
+	SECTION("restored bottom is invalidated") {
+		REQUIRE(Query(list, 60).skippedAfter == 0);
+
+		auto restored = SparseIdsList();
+		REQUIRE(Deserialize(restored, Serialize(list)));
+		const auto result = Query(restored, 60);
+		REQUIRE((Ids(result) == std::vector<MsgId>{ 50, 60 }));
+		REQUIRE(!result.skippedAfter);
+	}
+	SECTION("empty list round trip") {
+		auto restored = SparseIdsList();
+		REQUIRE(Deserialize(restored, Serialize(SparseIdsList())));
+		REQUIRE(restored.empty());
+	}
+}
+
+TEST_CASE("sparse ids list verification", "[storage_sparse_ids_list]") {
+	auto list = SparseIdsList();
+	list.addSlice({ 10, 20, 30 }, { 0, 35 }, 3);
+	auto restored = SparseIdsList();
+	REQUIRE(Deserialize(restored, Serialize(list)));
+
+	SECTION("ids missing in a new slice are removed") {
+		restored.addSlice({ 10, 30 }, { 0, 35 }, 2);
+		const auto result = Query(restored, 20);
+		REQUIRE((Ids(result) == std::vector<MsgId>{ 10, 30 }));
+		REQUIRE(result.count == 2);
+	}
+	SECTION("ids outside of a new slice are kept") {
+		restored.addSlice({ 40 }, { 25, 50 }, std::nullopt);
+		const auto result = Query(restored, 20);
+		REQUIRE((Ids(result) == std::vector<MsgId>{ 10, 20, 40 }));
+	}
+	SECTION("slices after the restored ids are merged") {
+		restored.addSlice({ 45 }, { 35, 50 }, 4);
+		const auto result = Query(restored, 30);
+		REQUIRE((Ids(result) == std::vector<MsgId>{ 10, 20, 30, 45 }));
+		REQUIRE(result.count == 4);
+	}
+}
+
+TEST_CASE("sparse ids list corrupt data", "[storage_sparse_ids_list]") {
+	auto list = SparseIdsList();
+	list.addSlice({ 10, 20, 30 }, { 0, 35 }, 3);
+	const auto serialized = Serialize(list);
+
+	auto restored = SparseIdsList();
+	restored.addSlice({ 100 }, { 90, 110 }, 1);
+	const auto check = [&](const QByteArray &data) {
+		REQUIRE(!Deserialize(restored, data));
+		REQUIRE((Ids(Query(restored, 100)) == std::vector<MsgId>{ 100 }));
+		REQUIRE(Query(restored, 100).count == 1);
+	};
+
+	SECTION("empty blob") {
+		check(QByteArray());
+	}
+	SECTION("truncated blob") {
+		for (auto size = 0; size != serialized.size(); ++size) {
+			check(serialized.mid(0, size));
+		}
+	}
+	SECTION("reversed range") {
+		auto data = QByteArray();
+		{
+			QDataStream stream(&data, QIODevice::WriteOnly);
+			stream.setVersion(QDataStream::Qt_5_1);
+			stream
+				<< qint32(-1)
+				<< quint32(1)
+				<< qint32(20)
+				<< qint32(10)
+				<< quint32(0);
+		}
+		check(data);
+	}
+	SECTION("too many ids") {
+		auto data = QByteArray();
+		{
+			QDataStream stream(&data, QIODevice::WriteOnly);
+			stream.setVersion(QDataStream::Qt_5_1);
+			stream
+				<< qint32(-1)
+				<< quint32(2)
+				<< qint32(0)
+				<< qint32(10)
+				<< quint32(1)
+				<< qint32(5)
+				<< qint32(20)
+				<< qint32(30)
+				<< quint32(0xFFFFFFFFU);
+		}
+		check(data);
+	}
+}
@@ -0,0 +1,170 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_streamed_file.h"
+
+namespace Storage {
+namespace {
+
+// Interrupted readers notice it at least that often.
+constexpr auto kWaitTimeout = 100;
+
+} // namespace
+
+StreamedFile::StreamedFile(int size, int partSize, const QString &path)
+: _size(size)
+, _partSize(partSize)
+, _file(path) {
+	Expects(_size > 0);
+	Expects(_partSize > 0);
+
+	if (path.isEmpty()) {
+		_data.resize(_size);
+	}
+}
+
+int StreamedFile::size() const {
+	return _size;
+}
+
+int StreamedFile::loadedSize() const {
+	QMutexLocker lock(&_mutex);
+	return _loadedSize;
+}
+
+void StreamedFile::partLoaded(int offset, bytes::const_span buffer) {
+	Expects(offset >= 0 && offset < _size && !(offset % _partSize));
+	Expects(_file.fileName().isEmpty());
+
+	if (buffer.empty()) {
+		return;
+	}
+	{
+		QMutexLocker lock(&_mutex);
+		const auto count = std::min(int(buffer.size()), partSize(offset));
+		bytes::copy(
+			bytes::make_detached_span(_data).subspan(offset, count),
+			buffer.subspan(0, count));
+		markLoaded(offset);
+	}
+	_waiting.wakeAll();
+	if (_partCallback) {
+		_partCallback();
+	}
+}
+
+void StreamedFile::partWritten(int offset) {
+	Expects(offset >= 0 && offset < _size && !(offset % _partSize));
+	Expects(!_file.fileName().isEmpty());
+
+	{
+		QMutexLocker lock(&_mutex);
+		markLoaded(offset);
+	}
+	_waiting.wakeAll();
+	if (_partCallback) {
+		_partCallback();
+	}
+}
+
+void StreamedFile::setPartCallback(Fn<void()> callback) {
+	_partCallback = std::move(callback);
+}
+
+QByteArray StreamedFile::data() const {
+	QMutexLocker lock(&_mutex);
+	return _data;
+}
+
+void StreamedFile::cancel() {
+	{
+		QMutexLocker lock(&_mutex);
+		_cancelled = true;
+	}
+	_waiting.wakeAll();
+}
+
+void StreamedFile::wakeReaders() {
+	_waiting.wakeAll();
+}
+
+int StreamedFile::wantedOffset() const {
+	QMutexLocker lock(&_mutex);
+	return _wantedOffset;
+}
+
+bool StreamedFile::available(int offset) const {
+	QMutexLocker lock(&_mutex);
+	return (offset >= _size) || _cancelled || loaded(offset);
+}
+
+int StreamedFile::read(
+		int offset,
+		bytes::span buffer,
+		Fn<bool()> interrupted) {
+	Expects(offset >= 0);
+
+	if (offset >= _size || buffer.empty()) {
+		return 0;
+	}
+	QMutexLocker lock(&_mutex);
+	_wantedOffset = offset;
+	while (!loaded(offset)) {
+		if (_cancelled || (interrupted && interrupted())) {
+			return -1;
+		}
+		_waiting.wait(&_mutex, kWaitTimeout);
+	}
+	const auto result = readLoaded(offset, buffer);
+	if (result > 0) {
+		_wantedOffset = offset + result;
+	}
+	return result;
+}
+
+int StreamedFile::partSize(int offset) const {
+	return std::min(_partSize, _size - offset);
+}
+
+bool StreamedFile::loaded(int offset) const {
+	return _loaded.contains(offset - (offset % _partSize));
+}
+
+void StreamedFile::markLoaded(int offset) {
+	if (!_loaded.contains(offset)) {
+		_loaded.emplace(offset);
+		_loadedSize += partSize(offset);
+	}
+}
+
+int StreamedFile::readLoaded(int offset, bytes::span buffer) {
+	const auto limit = std::min(_size - offset, int(buffer.size()));
+	auto count = 0;
+	while (count < limit) {
+		const auto position = offset + count;
+		const auto part = position - (position % _partSize);
+		if (!_loaded.contains(part)) {
+			break;
+		}
+		count = std::min(part + _partSize - offset, limit);
+	}
+
+	if (!_file.fileName().isEmpty()) {
+		if (!_file.isOpen() && !_file.open(QIODevice::ReadOnly)) {
+			return -1;
+		} else if (!_file.seek(offset)) {
+			return -1;
+		}
+		return int(_file.read(reinterpret_cast<char*>(buffer.data()), count));
+	}
+	bytes::copy(
+		buffer.subspan(0, count),
+		bytes::make_span(_data).subspan(offset, count));
+	return count;
+}
+
+} // namespace Storage
@@ -0,0 +1,80 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/basic_types.h"
+#include "base/bytes.h"
+#include "base/flat_set.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+namespace Storage {
+
+// Parts of a file that is still being downloaded, shared with
+// the threads that read it before the download is finished.
+//
+// The loader feeds parts in any order from the main thread, readers
+// block on the parts that are not loaded yet. If the loader writes
+// the file to disk the parts are read back from it, otherwise the
+// streamed file keeps the only copy of the loaded data.
+class StreamedFile {
+public:
+	StreamedFile(int size, int partSize, const QString &path);
+
+	int size() const;
+	int loadedSize() const;
+
+	void partLoaded(int offset, bytes::const_span buffer);
+	void partWritten(int offset); // Only when the file is read from disk.
+
+	// Called on the main thread after each new part.
+	void setPartCallback(Fn<void()> callback);
+
+	// Only when the file is kept in memory, shares the loaded data.
+	QByteArray data() const;
+
+	// No more parts will be loaded, waiting reads fail.
+	void cancel();
+	void wakeReaders();
+
+	// Offset the readers want to get next or -1 if nothing was read.
+	int wantedOffset() const;
+
+	// Checks if a read from the offset won't wait for the parts.
+	bool available(int offset) const;
+
+	// Blocks until at least one byte at the offset is available.
+	// Returns the count of read bytes, 0 at the end of the file
+	// or -1 if the file was cancelled or the read was interrupted.
+	int read(int offset, bytes::span buffer, Fn<bool()> interrupted);
+
+private:
+	int partSize(int offset) const;
+	bool loaded(int offset) const;
+	void markLoaded(int offset);
+	int readLoaded(int offset, bytes::span buffer);
+
+	const int _size = 0;
+	const int _partSize = 0;
+
+	mutable QMutex _mutex;
+	QWaitCondition _waiting;
+	base::flat_set<int> _loaded;
+	int _loadedSize = 0;
+	QByteArray _data;
+	QFile _file;
+	int _wantedOffset = -1;
+	bool _cancelled = false;
+
+	Fn<void()> _partCallback;
+
+};
+
+} // namespace Storage
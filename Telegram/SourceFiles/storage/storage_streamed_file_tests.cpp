@@ -0,0 +1,123 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/storage_streamed_file.h"
+
+#include <atomic>
+#include <thread>
+
+using Storage::StreamedFile;
+
+constexpr auto kPartSize = 4;
+
+const auto Content = QByteArray("0123456789");
+const auto Name = QString("test.streamed");
+
+bytes::const_span Part(int offset) {
+	return bytes::make_span(Content).subspan(
+		offset,
+		std::min(kPartSize, Content.size() - offset));
+}
+
+QByteArray Read(StreamedFile &file, int offset, int count) {
+	auto result = QByteArray(count, Qt::Uninitialized);
+	const auto read = file.read(
+		offset,
+		bytes::make_detached_span(result),
+		nullptr);
+	return (read < 0) ? QByteArray() : result.mid(0, read);
+}
+
+TEST_CASE("streamed file parts in memory", "[storage_streamed_file]") {
+	auto file = StreamedFile(Content.size(), kPartSize, QString());
+
+	SECTION("reads stop at the first missing part") {
+		file.partLoaded(0, Part(0));
+		file.partLoaded(8, Part(8));
+		REQUIRE(Read(file, 1, 100) == "123");
+		REQUIRE(file.wantedOffset() == 4);
+		REQUIRE(Read(file, 8, 100) == "89");
+		REQUIRE(Read(file, 10, 100).isEmpty());
+
+		file.partLoaded(4, Part(4));
+		REQUIRE(Read(file, 0, 100) == Content);
+	}
+	SECTION("read waits for the missing part") {
+		file.partLoaded(0, Part(0));
+		auto result = QByteArray();
+		auto reader = std::thread([&] {
+			result = Read(file, 5, 3);
+		});
+		while (file.wantedOffset() != 5) {
+			std::this_thread::yield();
+		}
+		file.partLoaded(4, Part(4));
+		reader.join();
+		REQUIRE(result == "567");
+		REQUIRE(file.wantedOffset() == 8);
+	}
+	SECTION("loaded data is kept in a single buffer") {
+		auto calls = 0;
+		file.setPartCallback([&] { ++calls; });
+		file.partLoaded(4, Part(4));
+		REQUIRE(file.available(4));
+		REQUIRE(file.available(7));
+		REQUIRE(!file.available(0));
+		REQUIRE(file.available(Content.size()));
+		file.partLoaded(0, Part(0));
+		file.partLoaded(8, Part(8));
+		file.partLoaded(8, Part(8));
+		REQUIRE(calls == 4);
+		REQUIRE(file.loadedSize() == Content.size());
+		REQUIRE(file.data() == Content);
+	}
+	SECTION("cancel fails only the waiting reads") {
+		file.partLoaded(0, Part(0));
+		auto failed = false;
+		auto reader = std::thread([&] {
+			auto buffer = bytes::vector(4);
+			failed = (file.read(4, buffer, nullptr) < 0);
+		});
+		file.cancel();
+		reader.join();
+		REQUIRE(failed);
+		REQUIRE(Read(file, 0, 4) == "0123");
+	}
+	SECTION("interrupted read returns") {
+		auto interrupted = std::atomic<bool>(false);
+		auto failed = false;
+		auto reader = std::thread([&] {
+			auto buffer = bytes::vector(4);
+			failed = file.read(0, buffer, [&] {
+				return interrupted.load();
+			}) < 0;
+		});
+		interrupted = true;
+		file.wakeReaders();
+		reader.join();
+		REQUIRE(failed);
+	}
+}
+
+TEST_CASE("streamed file parts on disk", "[storage_streamed_file]") {
+	QFile::remove(Name);
+	{
+		QFile f(Name);
+		REQUIRE(f.open(QIODevice::WriteOnly));
+		f.write(Content.mid(0, 8));
+	}
+	{
+		auto file = StreamedFile(Content.size(), kPartSize, Name);
+		file.partWritten(4);
+		REQUIRE(Read(file, 4, 100) == "4567");
+		file.partWritten(0);
+		REQUIRE(Read(file, 2, 4) == "2345");
+	}
+	QFile::remove(Name);
+}
@@ -14,6 +14,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "base/bytes.h"
 #include "base/openssl_help.h"
 #include "auth_session.h"
+#include "core/startup_trace.h"
 
 namespace Ui {
 namespace Emoji {
@@ -26,17 +27,40 @@ constexpr auto kImageRowsPerSprite = 16;
 
 constexpr auto kVersion = 3;
 
+constexpr auto kAtlasGlyphsPerRow = 8;
+constexpr auto kAtlasGlyphsPerPage = kAtlasGlyphsPerRow * kAtlasGlyphsPerRow;
+constexpr auto kAtlasMaxPages = 16;
+constexpr auto kAtlasMaxGlyphs = kAtlasGlyphsPerPage * kAtlasMaxPages;
+constexpr auto kPersistGlyphsLimit = 4 * kAtlasGlyphsPerPage;
+constexpr auto kSaveGlyphsTimeout = 5000;
+constexpr auto kClearUniversalTimeout = 5000;
+constexpr auto kGlyphsVersion = 1;
+
 class UniversalImages {
 public:
 	void ensureLoaded();
+	void ensureLoaded(int index);
+	bool loaded(int index) const;
+	void loadAsync(int index);
 	void clear();
 
+	void markUsed(int index);
+
+	// Drops sprites not used since the previous call.
+	// Returns true if some sprites are left.
+	bool clearUnused();
+
 	void draw(QPainter &p, EmojiPtr emoji, int size, int x, int y) const;
 
 	QImage generate(int size, int index) const;
+	QImage generate(int size, EmojiPtr emoji) const;
 
 private:
+	void applyLoaded(int index, QImage &&image);
+
 	std::vector<QImage> _sprites;
+	std::vector<bool> _used;
+	base::flat_set<int> _loading;
 
 };
 
@@ -46,6 +70,13 @@ auto SpritesCount = -1;
 
 std::unique_ptr<Instance> InstanceNormal;
 std::unique_ptr<Instance> InstanceLarge;
+std::unique_ptr<Core::StartupTask<std::vector<QImage>>> PreloadNormal;
+std::unique_ptr<Core::StartupTask<std::vector<QImage>>> PreloadLarge;
+std::unique_ptr<GlyphAtlas> AtlasNormal;
+std::unique_ptr<GlyphAtlas> AtlasLarge;
+std::unique_ptr<Core::StartupTask<std::vector<GlyphAtlas::Glyph>>> PreloadGlyphsNormal;
+std::unique_ptr<Core::StartupTask<std::vector<GlyphAtlas::Glyph>>> PreloadGlyphsLarge;
+std::unique_ptr<base::Timer> ClearUniversalTimer;
 UniversalImages Universal;
 
 std::map<int, QPixmap> MainEmojiMap;
@@ -175,23 +206,109 @@ QImage LoadFromFile(int size, int index) {
 	return result;
 }
 
+std::vector<QImage> LoadCached(int size) {
+	auto result = std::vector<QImage>();
+	result.reserve(SpritesCount);
+	for (auto i = 0; i != SpritesCount; ++i) {
+		auto image = LoadFromFile(size, i);
+		if (image.isNull()) {
+			break;
+		}
+		result.push_back(std::move(image));
+	}
+	return result;
+}
+
 void UniversalImages::ensureLoaded() {
 	Expects(SpritesCount > 0);
 
-	if (!_sprites.empty()) {
-		return;
+	for (auto i = 0; i != SpritesCount; ++i) {
+		ensureLoaded(i);
 	}
-	_sprites.reserve(SpritesCount);
+}
+
+QImage LoadSprite(int index) {
 	const auto base = qsl(":/gui/emoji/emoji_");
-	for (auto i = 0; i != SpritesCount; ++i) {
-		auto image = QImage();
-		image.load(base + QString::number(i + 1) + ".webp", "WEBP");
-		_sprites.push_back(std::move(image));
+	auto result = QImage();
+	result.load(base + QString::number(index + 1) + ".webp", "WEBP");
+	return result;
+}
+
+void UniversalImages::ensureLoaded(int index) {
+	Expects(index >= 0 && index < SpritesCount);
+
+	if (_sprites.empty()) {
+		_sprites.resize(SpritesCount);
+	}
+	auto &image = _sprites[index];
+	if (image.isNull()) {
+		image = LoadSprite(index);
+	}
+}
+
+bool UniversalImages::loaded(int index) const {
+	return (index < _sprites.size()) && !_sprites[index].isNull();
+}
+
+void UniversalImages::loadAsync(int index) {
+	Expects(index >= 0 && index < SpritesCount);
+
+	if (_loading.contains(index)) {
+		return;
+	}
+	_loading.emplace(index);
+	crl::async([=] {
+		crl::on_main([=, image = LoadSprite(index)]() mutable {
+			applyLoaded(index, std::move(image));
+		});
+	});
+}
+
+void UniversalImages::applyLoaded(int index, QImage &&image) {
+	if (!_loading.remove(index)) {
+		return;
+	}
+	if (_sprites.empty()) {
+		_sprites.resize(SpritesCount);
+	}
+	if (_sprites[index].isNull()) {
+		_sprites[index] = std::move(image);
+	}
+
+	// Placeholders were painted instead of the emoji from this sprite.
+	for (const auto widget : QApplication::topLevelWidgets()) {
+		if (widget->isVisible()) {
+			Ui::ForceFullRepaint(widget);
+		}
 	}
 }
 
 void UniversalImages::clear() {
 	_sprites.clear();
+	_used.clear();
+	_loading.clear();
+}
+
+void UniversalImages::markUsed(int index) {
+	Expects(index >= 0 && index < SpritesCount);
+
+	if (_used.empty()) {
+		_used.resize(SpritesCount);
+	}
+	_used[index] = true;
+}
+
+bool UniversalImages::clearUnused() {
+	auto left = false;
+	for (auto i = 0, count = int(_sprites.size()); i != count; ++i) {
+		if (i < _used.size() && _used[i]) {
+			_used[i] = false;
+			left = left || !_sprites[i].isNull();
+		} else {
+			_sprites[i] = QImage();
+		}
+	}
+	return left;
 }
 
 void UniversalImages::draw(
@@ -254,6 +371,126 @@ QImage UniversalImages::generate(int size, int index) const {
 	return result;
 }
 
+QImage UniversalImages::generate(int size, EmojiPtr emoji) const {
+	Expects(size > 0);
+	Expects(emoji->sprite() < _sprites.size());
+
+	const auto large = kUniversalSize;
+	return _sprites[emoji->sprite()].copy(
+		emoji->column() * large,
+		emoji->row() * large,
+		large,
+		large
+	).scaled(
+		size,
+		size,
+		Qt::IgnoreAspectRatio,
+		Qt::SmoothTransformation
+	).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+}
+
+QString GlyphsFileName(int size) {
+	return "glyphs_" + QString::number(size);
+}
+
+QString GlyphsFilePath(int size) {
+	return CacheFileFolder() + '/' + GlyphsFileName(size);
+}
+
+void SaveGlyphsToFile(int size, const std::vector<GlyphAtlas::Glyph> &glyphs) {
+	const uint32 header[] = {
+		uint32(kGlyphsVersion),
+		uint32(internal::FullCount()),
+		uint32(size),
+		uint32(glyphs.size()),
+	};
+	auto content = QByteArray();
+	content.reserve(sizeof(header)
+		+ glyphs.size() * (sizeof(uint32) + size * size * 4)
+		+ openssl::kSha256Size);
+	const auto append = [&](const void *data, int length) {
+		content.append(reinterpret_cast<const char*>(data), length);
+	};
+	append(header, sizeof(header));
+	for (const auto &glyph : glyphs) {
+		Assert(glyph.image.width() == size && glyph.image.height() == size);
+		Assert(glyph.image.format() == QImage::Format_ARGB32_Premultiplied);
+
+		const auto index = uint32(glyph.index);
+		append(&index, sizeof(index));
+		for (auto y = 0; y != size; ++y) {
+			append(glyph.image.constScanLine(y), size * 4);
+		}
+	}
+	const auto signature = openssl::Sha256(bytes::make_span(content));
+	append(signature.data(), signature.size());
+
+	QFile f(GlyphsFilePath(size));
+	if (!f.open(QIODevice::WriteOnly)) {
+		if (!QDir::current().mkpath(CacheFileFolder())
+			|| !f.open(QIODevice::WriteOnly)) {
+			LOG(("App Error: Could not open emoji glyphs '%1' for size %2"
+				).arg(f.fileName()
+				).arg(size));
+			return;
+		}
+	}
+	if (f.write(content) != content.size()) {
+		LOG(("App Error: Could not write emoji glyphs '%1' for size %2"
+			).arg(f.fileName()
+			).arg(size));
+	}
+}
+
+std::vector<GlyphAtlas::Glyph> LoadGlyphs(int size) {
+	auto result = std::vector<GlyphAtlas::Glyph>();
+	QFile f(GlyphsFilePath(size));
+	if (!f.exists() || !f.open(QIODevice::ReadOnly)) {
+		return result;
+	}
+	const auto content = f.readAll();
+	uint32 header[4] = { 0 };
+	if (content.size() < sizeof(header) + openssl::kSha256Size) {
+		return result;
+	}
+	memcpy(header, content.constData(), sizeof(header));
+	const auto count = int(header[3]);
+	const auto glyphSize = int(sizeof(uint32) + size * size * 4);
+	if (header[0] != kGlyphsVersion
+		|| header[1] != internal::FullCount()
+		|| header[2] != size
+		|| count > kPersistGlyphsLimit
+		|| (content.size() != sizeof(header)
+			+ count * glyphSize
+			+ openssl::kSha256Size)) {
+		return result;
+	}
+	const auto data = bytes::make_span(content);
+	const auto body = data.subspan(0, data.size() - openssl::kSha256Size);
+	const auto signature = data.subspan(body.size());
+	if (bytes::compare(signature, openssl::Sha256(body)) != 0) {
+		return result;
+	}
+	result.reserve(count);
+	auto from = content.constData() + sizeof(header);
+	for (auto i = 0; i != count; ++i, from += glyphSize) {
+		auto index = uint32();
+		memcpy(&index, from, sizeof(index));
+		if (!internal::ByIndex(index)) {
+			return {};
+		}
+		auto image = QImage(size, size, QImage::Format_ARGB32_Premultiplied);
+		for (auto y = 0; y != size; ++y) {
+			memcpy(
+				image.scanLine(y),
+				from + sizeof(index) + y * size * 4,
+				size * 4);
+		}
+		result.push_back({ int(index), std::move(image) });
+	}
+	return result;
+}
+
 void AppendPartToResult(TextWithEntities &result, const QChar *start, const QChar *from, const QChar *to) {
 	if (to <= from) {
 		return;
@@ -303,9 +540,31 @@ void ClearUniversalChecked() {
 	}
 }
 
+void ClearUniversalIdle() {
+	Expects(ClearUniversalTimer != nullptr);
+
+	if (Universal.clearUnused()) {
+		ClearUniversalTimer->callOnce(kClearUniversalTimeout);
+	}
+}
+
+void ScheduleClearUniversal() {
+	Expects(ClearUniversalTimer != nullptr);
+
+	if (!ClearUniversalTimer->isActive()) {
+		ClearUniversalTimer->callOnce(kClearUniversalTimeout);
+	}
+}
+
+bool Preloaded() {
+	return cEmojiSprites()
+		? (PreloadNormal && PreloadLarge)
+		: (PreloadGlyphsNormal && PreloadGlyphsLarge);
+}
+
 } // namespace
 
-void Init() {
+void Preload() {
 	internal::Init();
 
 	SizeNormal = ConvertScale(18, cScale() * cIntRetinaFactor());
@@ -314,8 +573,48 @@ void Init() {
 	const auto persprite = kImagesPerRow * kImageRowsPerSprite;
 	SpritesCount = (count / persprite) + ((count % persprite) ? 1 : 0);
 
-	InstanceNormal = std::make_unique<Instance>(SizeNormal);
-	InstanceLarge = std::make_unique<Instance>(SizeLarge);
+	if (cEmojiSprites()) {
+		const auto load = [](int size) {
+			return std::make_unique<Core::StartupTask<std::vector<QImage>>>(
+				"emoji cache " + QByteArray::number(size),
+				[=] { return LoadCached(size); });
+		};
+		PreloadNormal = load(SizeNormal);
+		PreloadLarge = load(SizeLarge);
+	} else {
+		using Glyphs = std::vector<GlyphAtlas::Glyph>;
+		const auto load = [](int size) {
+			return std::make_unique<Core::StartupTask<Glyphs>>(
+				"emoji glyphs " + QByteArray::number(size),
+				[=] { return LoadGlyphs(size); });
+		};
+		PreloadGlyphsNormal = load(SizeNormal);
+		PreloadGlyphsLarge = load(SizeLarge);
+	}
+}
+
+void Init() {
+	if (!Preloaded()) {
+		Preload();
+	}
+	if (cEmojiSprites()) {
+		InstanceNormal = std::make_unique<Instance>(
+			SizeNormal,
+			base::take(PreloadNormal)->join());
+		InstanceLarge = std::make_unique<Instance>(
+			SizeLarge,
+			base::take(PreloadLarge)->join());
+	} else {
+		AtlasNormal = std::make_unique<GlyphAtlas>(
+			SizeNormal,
+			base::take(PreloadGlyphsNormal)->join());
+		AtlasLarge = std::make_unique<GlyphAtlas>(
+			SizeLarge,
+			base::take(PreloadGlyphsLarge)->join());
+		ClearUniversalTimer = std::make_unique<base::Timer>([] {
+			ClearUniversalIdle();
+		});
+	}
 }
 
 void Clear() {
@@ -324,6 +623,16 @@ void Clear() {
 
 	InstanceNormal = nullptr;
 	InstanceLarge = nullptr;
+	if (AtlasNormal) {
+		AtlasNormal->flush();
+	}
+	if (AtlasLarge) {
+		AtlasLarge->flush();
+	}
+	AtlasNormal = nullptr;
+	AtlasLarge = nullptr;
+	ClearUniversalTimer = nullptr;
+	Universal.clear();
 }
 
 void ClearIrrelevantCache() {
@@ -333,8 +642,12 @@ void ClearIrrelevantCache() {
 	crl::async([] {
 		const auto folder = CacheFileFolder();
 		const auto list = QDir(folder).entryList(QDir::Files);
-		const auto good1 = CacheFileNameMask(SizeNormal);
-		const auto good2 = CacheFileNameMask(SizeLarge);
+		const auto good1 = cEmojiSprites()
+			? CacheFileNameMask(SizeNormal)
+			: GlyphsFileName(SizeNormal);
+		const auto good2 = cEmojiSprites()
+			? CacheFileNameMask(SizeLarge)
+			: GlyphsFileName(SizeLarge);
 		for (const auto &name : list) {
 			if (!name.startsWith(good1) && !name.startsWith(good2)) {
 				QFile(folder + '/' + name).remove();
@@ -589,6 +902,10 @@ const QPixmap &SinglePixmap(EmojiPtr emoji, int fontHeight) {
 			QImage::Format_ARGB32_Premultiplied);
 		image.setDevicePixelRatio(cRetinaFactor());
 		image.fill(Qt::transparent);
+		if (AtlasNormal) {
+			// The pixmap is cached, so the glyph can't be a placeholder.
+			AtlasNormal->prepare(emoji);
+		}
 		{
 			QPainter p(&image);
 			Draw(
@@ -607,17 +924,27 @@ const QPixmap &SinglePixmap(EmojiPtr emoji, int fontHeight) {
 
 void Draw(QPainter &p, EmojiPtr emoji, int size, int x, int y) {
 	if (size == SizeNormal) {
-		InstanceNormal->draw(p, emoji, x, y);
+		if (AtlasNormal) {
+			AtlasNormal->draw(p, emoji, x, y);
+		} else {
+			InstanceNormal->draw(p, emoji, x, y);
+		}
 	} else if (size == SizeLarge) {
-		InstanceLarge->draw(p, emoji, x, y);
+		if (AtlasLarge) {
+			AtlasLarge->draw(p, emoji, x, y);
+		} else {
+			InstanceLarge->draw(p, emoji, x, y);
+		}
 	} else {
 		Unexpected("Size in Ui::Emoji::Draw.");
 	}
 }
 
-Instance::Instance(int size) : _size(size) {
-	readCache();
-	if (!cached()) {
+Instance::Instance(int size, std::vector<QImage> &&cached) : _size(size) {
+	for (auto &image : cached) {
+		pushSprite(std::move(image));
+	}
+	if (!this->cached()) {
 		Universal.ensureLoaded();
 		generateCache();
 	}
@@ -639,16 +966,6 @@ void Instance::draw(QPainter &p, EmojiPtr emoji, int x, int y) {
 		QRect(emoji->column() * _size, emoji->row() * _size, _size, _size));
 }
 
-void Instance::readCache() {
-	for (auto i = 0; i != SpritesCount; ++i) {
-		auto image = LoadFromFile(_size, i);
-		if (image.isNull()) {
-			return;
-		}
-		pushSprite(std::move(image));
-	}
-}
-
 void Instance::generateCache() {
 	const auto size = _size;
 	const auto index = _sprites.size();
@@ -678,5 +995,164 @@ void Instance::pushSprite(QImage &&data) {
 	_sprites.back().setDevicePixelRatio(cRetinaFactor());
 }
 
+GlyphAtlas::GlyphAtlas(int size, std::vector<Glyph> &&persisted)
+: _size(size)
+, _saveTimer([=] { save(); }) {
+	// Persisted glyphs come most recently used first.
+	for (auto i = persisted.rbegin(); i != persisted.rend(); ++i) {
+		if (_entries.find(i->index) == end(_entries)) {
+			insert(i->index, i->image);
+		}
+	}
+}
+
+void GlyphAtlas::draw(QPainter &p, EmojiPtr emoji, int x, int y) {
+	const auto slot = lookup(emoji, true);
+	if (slot < 0) {
+		drawPlaceholder(p, x, y);
+		return;
+	}
+	p.drawPixmap(
+		QPoint(x, y),
+		_pages[slot / kAtlasGlyphsPerPage],
+		QRect(slotPosition(slot), QSize(_size, _size)));
+}
+
+void GlyphAtlas::prepare(EmojiPtr emoji) {
+	lookup(emoji, false);
+}
+
+void GlyphAtlas::drawPlaceholder(QPainter &p, int x, int y) const {
+	const auto size = _size / cIntRetinaFactor();
+	const auto skip = size / 8;
+
+	p.save();
+	PainterHighQualityEnabler hq(p);
+	p.setPen(Qt::NoPen);
+	p.setBrush(st::windowBgOver);
+	p.drawEllipse(x + skip, y + skip, size - 2 * skip, size - 2 * skip);
+	p.restore();
+}
+
+bool GlyphAtlas::savePending() const {
+	return _saveTimer.isActive();
+}
+
+void GlyphAtlas::flush() {
+	if (savePending()) {
+		_saveTimer.cancel();
+		SaveGlyphsToFile(_size, collectForSave());
+	}
+}
+
+int GlyphAtlas::lookup(EmojiPtr emoji, bool async) {
+	const auto index = emoji->index();
+	const auto i = _entries.find(index);
+	if (i != end(_entries)) {
+		i->second.lastUsed = ++_useCounter;
+		return i->second.slot;
+	}
+	const auto sprite = emoji->sprite();
+	if (!Universal.loaded(sprite)) {
+		if (async) {
+			// Decoding a sprite is slow, it is done in the background.
+			Universal.loadAsync(sprite);
+			return -1;
+		}
+		Universal.ensureLoaded(sprite);
+	}
+	Universal.markUsed(sprite);
+	ScheduleClearUniversal();
+	const auto result = insert(index, Universal.generate(_size, emoji));
+	_saveTimer.callOnce(kSaveGlyphsTimeout);
+	return result;
+}
+
+int GlyphAtlas::insert(int index, const QImage &image) {
+	Expects(image.width() == _size && image.height() == _size);
+
+	const auto slot = allocateSlot();
+	const auto ratio = cRetinaFactor();
+	{
+		QPainter p(&_pages[slot / kAtlasGlyphsPerPage]);
+		p.setCompositionMode(QPainter::CompositionMode_Source);
+		p.drawImage(
+			QRectF(
+				QPointF(slotPosition(slot)) / ratio,
+				QSizeF(_size, _size) / ratio),
+			image);
+	}
+	_entries.emplace(index, Entry{ slot, ++_useCounter });
+	return slot;
+}
+
+int GlyphAtlas::allocateSlot() {
+	if (_allocated < kAtlasMaxGlyphs) {
+		if (_allocated == int(_pages.size()) * kAtlasGlyphsPerPage) {
+			const auto side = kAtlasGlyphsPerRow * _size;
+			auto image = QImage(
+				side,
+				side,
+				QImage::Format_ARGB32_Premultiplied);
+			image.fill(Qt::transparent);
+			_pages.push_back(App::pixmapFromImageInPlace(std::move(image)));
+			_pages.back().setDevicePixelRatio(cRetinaFactor());
+		}
+		return _allocated++;
+	}
+	const auto lru = std::min_element(
+		begin(_entries),
+		end(_entries),
+		[](const auto &a, const auto &b) {
+			return (a.second.lastUsed < b.second.lastUsed);
+		});
+	const auto result = lru->second.slot;
+	_entries.erase(lru);
+	return result;
+}
+
+QPoint GlyphAtlas::slotPosition(int slot) const {
+	const auto inpage = slot % kAtlasGlyphsPerPage;
+	return QPoint(
+		(inpage % kAtlasGlyphsPerRow) * _size,
+		(inpage / kAtlasGlyphsPerRow) * _size);
+}
+
+std::vector<GlyphAtlas::Glyph> GlyphAtlas::collectForSave() {
+	auto order = std::vector<std::pair<uint64, int>>();
+	order.reserve(_entries.size());
+	for (const auto &[index, entry] : _entries) {
+		order.emplace_back(entry.lastUsed, index);
+	}
+	std::sort(order.begin(), order.end(), std::greater<>());
+	if (order.size() > kPersistGlyphsLimit) {
+		order.resize(kPersistGlyphsLimit);
+	}
+
+	auto pages = std::vector<QImage>(_pages.size());
+	auto result = std::vector<Glyph>();
+	result.reserve(order.size());
+	for (const auto &used : order) {
+		const auto index = used.second;
+		const auto slot = _entries.find(index)->second.slot;
+		auto &page = pages[slot / kAtlasGlyphsPerPage];
+		if (page.isNull()) {
+			page = _pages[slot / kAtlasGlyphsPerPage].toImage(
+			).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+		}
+		result.push_back({
+			index,
+			page.copy(QRect(slotPosition(slot), QSize(_size, _size)))
+		});
+	}
+	return result;
+}
+
+void GlyphAtlas::save() {
+	crl::async([size = _size, glyphs = collectForSave()] {
+		SaveGlyphsToFile(size, glyphs);
+	});
+}
+
 } // namespace Emoji
 } // namespace Ui
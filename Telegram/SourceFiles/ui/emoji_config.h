@@ -8,6 +8,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #pragma once
 
 #include "base/binary_guard.h"
+#include "base/flat_map.h"
+#include "base/timer.h"
 #include "emoji.h"
 
 namespace Ui {
@@ -15,6 +17,8 @@ namespace Emoji {
 
 constexpr auto kRecentLimit = 42;
 
+// Reads cached sprites (or glyphs) in the background, Init() waits.
+void Preload();
 void Init();
 void Clear();
 
@@ -140,13 +144,12 @@ void Draw(QPainter &p, EmojiPtr emoji, int size, int x, int y);
 
 class Instance {
 public:
-	explicit Instance(int size);
+	Instance(int size, std::vector<QImage> &&cached);
 
 	bool cached() const;
 	void draw(QPainter &p, EmojiPtr emoji, int x, int y);
 
 private:
-	void readCache();
 	void generateCache();
 	void pushSprite(QImage &&data);
 
@@ -156,5 +159,50 @@ private:
 
 };
 
+// Rasterizes emoji one by one on first use, keeping at most a limited
+// number of them in atlas pages and evicting the least recently used.
+// Only the glyphs that were actually drawn are persisted to disk.
+class GlyphAtlas {
+public:
+	struct Glyph {
+		int index = 0;
+		QImage image;
+	};
+
+	GlyphAtlas(int size, std::vector<Glyph> &&persisted);
+
+	// Draws a placeholder if the glyph is not rasterized yet and its
+	// sprite is not loaded, the sprite is loaded in the background.
+	void draw(QPainter &p, EmojiPtr emoji, int x, int y);
+
+	// Rasterizes the glyph right away, loading its sprite if needed.
+	void prepare(EmojiPtr emoji);
+
+	bool savePending() const;
+	void flush();
+
+private:
+	struct Entry {
+		int slot = 0;
+		uint64 lastUsed = 0;
+	};
+
+	int lookup(EmojiPtr emoji, bool async);
+	void drawPlaceholder(QPainter &p, int x, int y) const;
+	int insert(int index, const QImage &image);
+	int allocateSlot();
+	QPoint slotPosition(int slot) const;
+	std::vector<Glyph> collectForSave();
+	void save();
+
+	int _size = 0;
+	std::vector<QPixmap> _pages;
+	base::flat_map<int, Entry> _entries;
+	int _allocated = 0;
+	uint64 _useCounter = 0;
+	base::Timer _saveTimer;
+
+};
+
 } // namespace Emoji
 } // namespace Ui
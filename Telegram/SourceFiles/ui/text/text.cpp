@@ -2742,6 +2742,14 @@ bool Text::hasSkipBlock() const {
 	return _blocks.empty() ? false : _blocks.back()->type() == TextBlockTSkip;
 }
 
+QSize Text::skipBlockSize() const {
+	if (!hasSkipBlock()) {
+		return QSize();
+	}
+	const auto block = static_cast<SkipBlock*>(_blocks.back().get());
+	return QSize(block->width(), block->height());
+}
+
 bool Text::updateSkipBlock(int width, int height) {
 	if (!_blocks.empty() && _blocks.back()->type() == TextBlockTSkip) {
 		const auto block = static_cast<SkipBlock*>(_blocks.back().get());
@@ -2773,6 +2781,25 @@ bool Text::removeSkipBlock() {
 	return true;
 }
 
+int64 Text::memoryUsage() const {
+	auto result = int64(_text.capacity()) * sizeof(QChar)
+		+ int64(_blocks.capacity()) * sizeof(TextBlocks::value_type)
+		+ int64(_links.capacity()) * sizeof(TextLinks::value_type);
+	for (const auto &block : _blocks) {
+		switch (block->type()) {
+		case TextBlockTText: {
+			const auto text = static_cast<const TextBlock*>(block.get());
+			result += sizeof(TextBlock)
+				+ int64(text->_words.capacity()) * sizeof(TextWord);
+		} break;
+		case TextBlockTEmoji: result += sizeof(EmojiBlock); break;
+		case TextBlockTSkip: result += sizeof(SkipBlock); break;
+		case TextBlockTNewline: result += sizeof(NewlineBlock); break;
+		}
+	}
+	return result;
+}
+
 int Text::countWidth(int width) const {
 	if (QFixed(width) >= _maxWidth) {
 		return _maxWidth.ceil().toInt();
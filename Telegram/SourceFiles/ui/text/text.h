@@ -88,9 +88,13 @@ public:
 	bool hasLinks() const;
 
 	bool hasSkipBlock() const;
+	QSize skipBlockSize() const;
 	bool updateSkipBlock(int width, int height);
 	bool removeSkipBlock();
 
+	// Approximate heap size of the parsed text, in bytes.
+	int64 memoryUsage() const;
+
 	int32 maxWidth() const {
 		return _maxWidth.ceil().toInt();
 	}
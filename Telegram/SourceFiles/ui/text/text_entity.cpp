@@ -11,6 +11,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "lang/lang_tag.h"
 #include "base/qthelp_url.h"
 #include "ui/emoji_config.h"
+#include "ui/text/text_entity_scanner.h"
 
 namespace TextUtilities {
 namespace {
@@ -1576,6 +1577,16 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 	int32 len = result.text.size(), commandOffset = rich ? 0 : len;
 	bool inLink = false, commandIsLink = false;
 	const QChar *start = result.text.constData(), *end = start + result.text.size();
+
+	// Each scanner remembers its next match, so the text is not
+	// scanned again from each matchOffset the loop advances to.
+	auto domains = RegExpScanner(result.text, qthelp::RegExpDomain());
+	auto explicitDomains = RegExpScanner(
+		result.text,
+		qthelp::RegExpDomainExplicit());
+	auto hashtags = TagScanner(result.text, TagType::Hashtag);
+	auto mentions = TagScanner(result.text, TagType::Mention);
+	auto botCommands = TagScanner(result.text, TagType::BotCommand);
 	for (int32 offset = 0, matchOffset = offset, mentionSkip = 0; offset < len;) {
 		if (commandOffset <= offset) {
 			for (commandOffset = offset; commandOffset < len; ++commandOffset) {
@@ -1586,11 +1597,11 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 				}
 			}
 		}
-		auto mDomain = qthelp::RegExpDomain().match(result.text, matchOffset);
-		auto mExplicitDomain = qthelp::RegExpDomainExplicit().match(result.text, matchOffset);
-		auto mHashtag = withHashtags ? RegExpHashtag().match(result.text, matchOffset) : QRegularExpressionMatch();
-		auto mMention = withMentions ? RegExpMention().match(result.text, qMax(mentionSkip, matchOffset)) : QRegularExpressionMatch();
-		auto mBotCommand = withBotCommands ? RegExpBotCommand().match(result.text, matchOffset) : QRegularExpressionMatch();
+		auto mDomain = domains.match(matchOffset);
+		auto mExplicitDomain = explicitDomains.match(matchOffset);
+		auto mHashtag = withHashtags ? hashtags.match(matchOffset) : TagMatch();
+		auto mMention = withMentions ? mentions.match(qMax(mentionSkip, matchOffset)) : TagMatch();
+		auto mBotCommand = withBotCommands ? botCommands.match(matchOffset) : TagMatch();
 
 		EntityInTextType lnkType = EntityInTextUrl;
 		int32 lnkStart = 0, lnkLength = 0;
@@ -1598,20 +1609,20 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 			domainEnd = mDomain.hasMatch() ? mDomain.capturedEnd() : kNotFound,
 			explicitDomainStart = mExplicitDomain.hasMatch() ? mExplicitDomain.capturedStart() : kNotFound,
 			explicitDomainEnd = mExplicitDomain.hasMatch() ? mExplicitDomain.capturedEnd() : kNotFound,
-			hashtagStart = mHashtag.hasMatch() ? mHashtag.capturedStart() : kNotFound,
-			hashtagEnd = mHashtag.hasMatch() ? mHashtag.capturedEnd() : kNotFound,
-			mentionStart = mMention.hasMatch() ? mMention.capturedStart() : kNotFound,
-			mentionEnd = mMention.hasMatch() ? mMention.capturedEnd() : kNotFound,
-			botCommandStart = mBotCommand.hasMatch() ? mBotCommand.capturedStart() : kNotFound,
-			botCommandEnd = mBotCommand.hasMatch() ? mBotCommand.capturedEnd() : kNotFound;
+			hashtagStart = mHashtag ? mHashtag.start : kNotFound,
+			hashtagEnd = mHashtag ? mHashtag.end : kNotFound,
+			mentionStart = mMention ? mMention.start : kNotFound,
+			mentionEnd = mMention ? mMention.end : kNotFound,
+			botCommandStart = mBotCommand ? mBotCommand.start : kNotFound,
+			botCommandEnd = mBotCommand ? mBotCommand.end : kNotFound;
 		auto hashtagIgnore = false;
 		auto mentionIgnore = false;
 
-		if (mHashtag.hasMatch()) {
-			if (!mHashtag.capturedRef(1).isEmpty()) {
+		if (mHashtag) {
+			if (mHashtag.separatorBefore) {
 				++hashtagStart;
 			}
-			if (!mHashtag.capturedRef(2).isEmpty()) {
+			if (mHashtag.separatorAfter) {
 				--hashtagEnd;
 			}
 			if (RegExpHashtagExclude().match(
@@ -1621,19 +1632,19 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 				hashtagIgnore = true;
 			}
 		}
-		while (mMention.hasMatch()) {
-			if (!mMention.capturedRef(1).isEmpty()) {
+		while (mMention) {
+			if (mMention.separatorBefore) {
 				++mentionStart;
 			}
-			if (!mMention.capturedRef(2).isEmpty()) {
+			if (mMention.separatorAfter) {
 				--mentionEnd;
 			}
 			if (!(start + mentionStart + 1)->isLetter() || !(start + mentionEnd - 1)->isLetterOrNumber()) {
 				mentionSkip = mentionEnd;
-				mMention = RegExpMention().match(result.text, qMax(mentionSkip, matchOffset));
-				if (mMention.hasMatch()) {
-					mentionStart = mMention.capturedStart();
-					mentionEnd = mMention.capturedEnd();
+				mMention = mentions.match(qMax(mentionSkip, matchOffset));
+				if (mMention) {
+					mentionStart = mMention.start;
+					mentionEnd = mMention.end;
 				} else {
 					mentionIgnore = true;
 				}
@@ -1641,19 +1652,19 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 				break;
 			}
 		}
-		if (mBotCommand.hasMatch()) {
-			if (!mBotCommand.capturedRef(1).isEmpty()) {
+		if (mBotCommand) {
+			if (mBotCommand.separatorBefore) {
 				++botCommandStart;
 			}
-			if (!mBotCommand.capturedRef(3).isEmpty()) {
+			if (mBotCommand.separatorAfter) {
 				--botCommandEnd;
 			}
 		}
 		if (!mDomain.hasMatch()
 			&& !mExplicitDomain.hasMatch()
-			&& !mHashtag.hasMatch()
-			&& !mMention.hasMatch()
-			&& !mBotCommand.hasMatch()) {
+			&& !mHashtag
+			&& !mMention
+			&& !mBotCommand) {
 			break;
 		}
 
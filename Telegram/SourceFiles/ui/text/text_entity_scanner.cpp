@@ -0,0 +1,233 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "ui/text/text_entity_scanner.h"
+
+#include "base/assertion.h"
+
+namespace TextUtilities {
+namespace {
+
+constexpr auto kHashtagMinLength = 2;
+constexpr auto kHashtagMaxLength = 64;
+constexpr auto kMentionMinLength = 1;
+constexpr auto kMentionMaxLength = 32;
+constexpr auto kBotCommandMinLength = 1;
+constexpr auto kBotCommandMaxLength = 64;
+constexpr auto kBotUsernameMinLength = 5;
+constexpr auto kBotUsernameMaxLength = 32;
+
+// QRegularExpression doesn't match anything in invalid UTF-16 text.
+bool IsValidUtf16(const QString &text) {
+	const auto size = text.size();
+	for (auto i = 0; i != size; ++i) {
+		const auto ch = text[i];
+		if (ch.isHighSurrogate()) {
+			if (i + 1 == size || !text[i + 1].isLowSurrogate()) {
+				return false;
+			}
+			++i;
+		} else if (ch.isLowSurrogate()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// And it doesn't match anything from an offset inside a character.
+bool InsideSurrogatePair(const QString &text, int offset) {
+	return (offset > 0)
+		&& (offset < text.size())
+		&& text[offset].isLowSurrogate()
+		&& text[offset - 1].isHighSurrogate();
+}
+
+int CharLength(const QString &text, int position) {
+	return text[position].isHighSurrogate() ? 2 : 1;
+}
+
+// "\w" with QRegularExpression::UseUnicodePropertiesOption.
+bool IsWordChar(const QString &text, int position) {
+	const auto ch = text[position];
+	const auto ucs4 = ch.isHighSurrogate()
+		? QChar::surrogateToUcs4(ch, text[position + 1])
+		: uint(ch.unicode());
+	return (ucs4 == '_') || QChar::isLetterOrNumber(ucs4);
+}
+
+// "[A-Za-z_0-9]".
+bool IsAsciiWordChar(QChar ch) {
+	const auto code = ch.unicode();
+	return (code >= 'a' && code <= 'z')
+		|| (code >= 'A' && code <= 'Z')
+		|| (code >= '0' && code <= '9')
+		|| (code == '_');
+}
+
+// Characters from ExpressionSeparators() with the additional ones.
+bool IsSeparator(QChar ch, TagType type) {
+	switch (ch.unicode()) {
+	case '.': case ',': case ':': case ';': case '<': case '>':
+	case '|': case '\'': case '"': case '[': case ']': case '{':
+	case '}': case '~': case '!': case '?': case '%': case '^':
+	case '(': case ')': case '-': case '+': case '=': case 0x10:
+	case 0xAB: case 0xBB: case 0x201C: case 0x201D: case 0x2018:
+	case 0x2019: case 0x2026: // Quotes()
+	case '`': case '*':
+	case 0x180E: // "\s" in PCRE still contains it.
+		return true;
+	case '/':
+		return (type != TagType::BotCommand);
+	}
+	return ch.isSpace();
+}
+
+int AsciiWordEnd(const QString &text, int position) {
+	const auto size = text.size();
+	while (position != size && IsAsciiWordChar(text[position])) {
+		++position;
+	}
+	return position;
+}
+
+// "([\W]|$)".
+bool ParseTagEnd(const QString &text, int position, TagMatch &result) {
+	if (position == text.size()) {
+		result.end = position;
+		result.separatorAfter = false;
+		return true;
+	} else if (IsWordChar(text, position)) {
+		return false;
+	}
+	result.end = position + CharLength(text, position);
+	result.separatorAfter = true;
+	return true;
+}
+
+// "[\w]{2,64}", the length is counted in characters, not in QChars.
+bool ParseHashtag(const QString &text, int position, TagMatch &result) {
+	const auto size = text.size();
+	auto length = 0;
+	while (position != size && IsWordChar(text, position)) {
+		if (++length > kHashtagMaxLength) {
+			return false;
+		}
+		position += CharLength(text, position);
+	}
+	return (length >= kHashtagMinLength)
+		&& ParseTagEnd(text, position, result);
+}
+
+// "[A-Za-z_0-9]{1,32}".
+bool ParseMention(const QString &text, int position, TagMatch &result) {
+	const auto end = AsciiWordEnd(text, position);
+	const auto length = end - position;
+	return (length >= kMentionMinLength)
+		&& (length <= kMentionMaxLength)
+		&& ParseTagEnd(text, end, result);
+}
+
+// "[A-Za-z_0-9]{1,64}(@[A-Za-z_0-9]{5,32})?".
+bool ParseBotCommand(const QString &text, int position, TagMatch &result) {
+	const auto end = AsciiWordEnd(text, position);
+	const auto length = end - position;
+	if (length < kBotCommandMinLength || length > kBotCommandMaxLength) {
+		return false;
+	} else if (end != text.size() && text[end] == '@') {
+		const auto usernameEnd = AsciiWordEnd(text, end + 1);
+		const auto usernameLength = usernameEnd - end - 1;
+		if (usernameLength >= kBotUsernameMinLength
+			&& usernameLength <= kBotUsernameMaxLength
+			&& ParseTagEnd(text, usernameEnd, result)) {
+			return true;
+		}
+	}
+	return ParseTagEnd(text, end, result);
+}
+
+QChar Sigil(TagType type) {
+	switch (type) {
+	case TagType::Hashtag: return '#';
+	case TagType::Mention: return '@';
+	case TagType::BotCommand: return '/';
+	}
+	Unexpected("Type in Sigil.");
+}
+
+} // namespace
+
+TagScanner::TagScanner(const QString &text, TagType type)
+: _text(text)
+, _type(type)
+, _valid(IsValidUtf16(text)) {
+}
+
+TagMatch TagScanner::match(int offset) {
+	if (!_valid || InsideSurrogatePair(_text, offset)) {
+		return TagMatch();
+	} else if (_searchedFrom < 0
+		|| offset < _searchedFrom
+		|| (_last && offset > _last.start)) {
+		_searchedFrom = offset;
+		_last = find(offset);
+	}
+	return _last;
+}
+
+TagMatch TagScanner::find(int offset) const {
+	const auto sigil = Sigil(_type);
+	const auto size = _text.size();
+	auto result = TagMatch();
+
+	// "(^|[...])" + sigil, the "^" alternative is tried first.
+	if (!offset && size > 0 && _text[0] == sigil && parseBody(1, result)) {
+		result.start = 0;
+		result.separatorBefore = false;
+		return result;
+	}
+	for (auto i = offset; i + 1 < size; ++i) {
+		if (_text[i + 1] == sigil
+			&& IsSeparator(_text[i], _type)
+			&& parseBody(i + 2, result)) {
+			result.start = i;
+			result.separatorBefore = true;
+			return result;
+		}
+	}
+	return TagMatch();
+}
+
+bool TagScanner::parseBody(int position, TagMatch &result) const {
+	switch (_type) {
+	case TagType::Hashtag: return ParseHashtag(_text, position, result);
+	case TagType::Mention: return ParseMention(_text, position, result);
+	case TagType::BotCommand:
+		return ParseBotCommand(_text, position, result);
+	}
+	Unexpected("Type in TagScanner::parseBody.");
+}
+
+RegExpScanner::RegExpScanner(
+	const QString &text,
+	const QRegularExpression &regexp)
+: _text(text)
+, _regexp(regexp) {
+}
+
+QRegularExpressionMatch RegExpScanner::match(int offset) {
+	if (InsideSurrogatePair(_text, offset)) {
+		return QRegularExpressionMatch();
+	} else if (_searchedFrom < 0
+		|| offset < _searchedFrom
+		|| (_last.hasMatch() && offset > _last.capturedStart())) {
+		_searchedFrom = offset;
+		_last = _regexp.match(_text, offset);
+	}
+	return _last;
+}
+
+} // namespace TextUtilities
@@ -0,0 +1,77 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/basic_types.h"
+
+#include <QtCore/QString>
+#include <QtCore/QRegularExpression>
+
+namespace TextUtilities {
+
+enum class TagType {
+	Hashtag,
+	Mention,
+	BotCommand,
+};
+
+struct TagMatch {
+	explicit operator bool() const {
+		return (start >= 0);
+	}
+
+	// Like the captured range of RegExpHashtag() and others:
+	// with the separator before the tag and the non-word char after it.
+	int start = -1;
+	int end = -1;
+	bool separatorBefore = false;
+	bool separatorAfter = false;
+
+};
+
+// Finds hashtags, mentions or bot commands with the same results as
+// RegExpHashtag(), RegExpMention() and RegExpBotCommand() matched from
+// the same offset, but without a regular expression.
+//
+// The last found match is remembered, so a search from an offset that
+// doesn't pass it doesn't scan the text again, and ParseEntities()
+// scans the text only once for each tag type.
+class TagScanner {
+public:
+	TagScanner(const QString &text, TagType type);
+
+	TagMatch match(int offset);
+
+private:
+	TagMatch find(int offset) const;
+	bool parseBody(int position, TagMatch &result) const;
+
+	const QString &_text;
+	const TagType _type = TagType::Hashtag;
+	const bool _valid = false;
+	int _searchedFrom = -1;
+	TagMatch _last;
+
+};
+
+// Remembers the last match of a regular expression the same way.
+class RegExpScanner {
+public:
+	RegExpScanner(const QString &text, const QRegularExpression &regexp);
+
+	QRegularExpressionMatch match(int offset);
+
+private:
+	const QString &_text;
+	const QRegularExpression &_regexp;
+	int _searchedFrom = -1;
+	QRegularExpressionMatch _last;
+
+};
+
+} // namespace TextUtilities
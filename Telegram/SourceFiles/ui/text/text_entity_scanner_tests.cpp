@@ -0,0 +1,246 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "ui/text/text_entity_scanner.h"
+#include "base/assertion.h"
+
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <random>
+
+using namespace TextUtilities;
+
+constexpr auto kNotFound = std::numeric_limits<int>::max();
+
+// The expressions that ParseEntities() matched before the scanners.
+QString Separators(const char *additional) {
+	return QString::fromUtf8("\\s\\.,:;<>|'\"\\[\\]\\{\\}\\~\\!\\?\\%\\^"
+		"\\(\\)\\-\\+=\\x10"
+		"\xC2\xAB\xC2\xBB\xE2\x80\x9C\xE2\x80\x9D"
+		"\xE2\x80\x98\xE2\x80\x99\xE2\x80\xA6") + additional;
+}
+
+QRegularExpression Create(const QString &expression) {
+	auto result = QRegularExpression(
+		expression,
+		QRegularExpression::UseUnicodePropertiesOption);
+	result.optimize();
+	return result;
+}
+
+const auto Hashtag = Create("(^|["
+	+ Separators("`\\*/")
+	+ "])#[\\w]{2,64}([\\W]|$)");
+const auto Mention = Create("(^|["
+	+ Separators("`\\*/")
+	+ "])@[A-Za-z_0-9]{1,32}([\\W]|$)");
+const auto BotCommand = Create("(^|["
+	+ Separators("`\\*")
+	+ "])/[A-Za-z_0-9]{1,64}(@[A-Za-z_0-9]{5,32})?([\\W]|$)");
+const auto Domain = Create(QString::fromUtf8("(?<![\\w\\$\\-\\_%=\\.])"
+	"(?:([a-zA-Z]+)://)?((?:[A-Za-z\xD0\x90-\xD0\xAF\xD0\x81"
+	"\xD0\xB0-\xD1\x8F\xD1\x91" "0-9\\-\\_]+\\.){1,10}([A-Za-z"
+	"\xD1\x80\xD1\x84" "\\-\\d]{2,22})(\\:\\d+)?)"));
+
+const QRegularExpression &Reference(TagType type) {
+	switch (type) {
+	case TagType::Hashtag: return Hashtag;
+	case TagType::Mention: return Mention;
+	case TagType::BotCommand: return BotCommand;
+	}
+	Unexpected("Type in Reference.");
+}
+
+TagMatch ReferenceMatch(TagType type, const QString &text, int offset) {
+	const auto &regexp = Reference(type);
+	const auto match = regexp.match(text, offset);
+	auto result = TagMatch();
+	if (match.hasMatch()) {
+		result.start = match.capturedStart();
+		result.end = match.capturedEnd();
+		result.separatorBefore = !match.capturedRef(1).isEmpty();
+		result.separatorAfter = !match.capturedRef(
+			regexp.captureCount()).isEmpty();
+	}
+	return result;
+}
+
+void CheckTags(TagType type, const QString &text) {
+	auto scanner = TagScanner(text, type);
+	const auto check = [&](int offset) {
+		INFO("text: " << text.toStdString() << ", offset: " << offset);
+		const auto found = scanner.match(offset);
+		const auto reference = ReferenceMatch(type, text, offset);
+		REQUIRE(found.start == reference.start);
+		REQUIRE(found.end == reference.end);
+		REQUIRE(found.separatorBefore == reference.separatorBefore);
+		REQUIRE(found.separatorAfter == reference.separatorAfter);
+	};
+
+	// Forward like ParseEntities() goes and back to reset the last match.
+	for (auto offset = 0; offset <= text.size() + 1; ++offset) {
+		check(offset);
+	}
+	for (auto offset = text.size(); offset >= 0; --offset) {
+		check(offset);
+	}
+}
+
+void CheckDomains(const QString &text) {
+	auto scanner = RegExpScanner(text, Domain);
+	for (auto offset = 0; offset <= text.size(); ++offset) {
+		INFO("text: " << text.toStdString() << ", offset: " << offset);
+		const auto found = scanner.match(offset);
+		const auto reference = Domain.match(text, offset);
+		REQUIRE(found.hasMatch() == reference.hasMatch());
+		REQUIRE(found.capturedStart() == reference.capturedStart());
+		REQUIRE(found.capturedEnd() == reference.capturedEnd());
+	}
+}
+
+void CheckAll(const QString &text) {
+	CheckTags(TagType::Hashtag, text);
+	CheckTags(TagType::Mention, text);
+	CheckTags(TagType::BotCommand, text);
+	CheckDomains(text);
+}
+
+TEST_CASE("entity scanners match the regular expressions", "[text_entity]") {
+	SECTION("known texts") {
+		const auto texts = {
+			QString(),
+			QString("#"),
+			QString("#a"),
+			QString("#ab"),
+			QString("#123"),
+			QString("text #hashtag, @mention and /command@SomeBot end"),
+			QString("(#tag) [@user] {/cmd} *#bold* `#code` /#slash"),
+			QString("/cmd@bot /cmd@longbot /cmd@longbot\xE2\x80\xA6 x/cmd"),
+			QString("@a @_x @1 @user_name_that_is_longer_than_thirty_two"),
+			QString("#") + QString(64, 'a') + " #" + QString(65, 'b'),
+			QString("/") + QString(64, 'c') + " /" + QString(65, 'd'),
+			QString::fromUtf8("#\xD1\x82\xD0\xB5\xD0\xB3 @user\xC3\xA9"
+				" #tag\xF0\x9F\x98\x80 #\xF0\x9D\x90\x80\xF0\x9D\x90\x81"
+				" \xC2\xAB#quoted\xC2\xBB"),
+			QString("see t.me/test, http://a.b/c?d and mail@example.com"),
+			QString("line\n#tag\n@user\n/cmd\n"),
+		};
+		for (const auto &text : texts) {
+			CheckAll(text);
+		}
+	}
+	SECTION("random texts") {
+		const auto pieces = {
+			QString("#"), QString("@"), QString("/"), QString("a"),
+			QString("Z"), QString("0"), QString("_"), QString(" "),
+			QString("."), QString("-"), QString("`"), QString("*"),
+			QString("\n"), QString("bot"), QString("tag12"),
+			QString("t.me"), QString("://"), QString("http"),
+			QString::fromUtf8("\xC3\xA9"), // e with acute
+			QString::fromUtf8("\xD0\xB4"), // cyrillic de
+			QString::fromUtf8("\xD9\xA3"), // arabic-indic digit three
+			QString::fromUtf8("\xC2\xAB"), // left guillemet
+			QString::fromUtf8("\xF0\x9F\x98\x80"), // emoji, not a word
+			QString::fromUtf8("\xF0\x9D\x90\x80"), // bold A, a word
+		};
+		auto generator = std::mt19937(42);
+		auto piece = std::uniform_int_distribution<int>(
+			0,
+			int(pieces.size()) - 1);
+		auto length = std::uniform_int_distribution<int>(0, 40);
+		for (auto i = 0; i != 2000; ++i) {
+			auto text = QString();
+			for (auto j = length(generator); j != 0; --j) {
+				text += *(pieces.begin() + piece(generator));
+			}
+			CheckAll(text);
+		}
+	}
+}
+
+// Finds entities the way ParseEntities() advances through the text.
+template <typename Method>
+int CountEntities(const QString &text, Method &&match) {
+	auto result = 0;
+	for (auto offset = 0;;) {
+		const auto end = match(offset);
+		if (end == kNotFound) {
+			return result;
+		}
+		offset = end;
+		++result;
+	}
+}
+
+// Not run by default, use "[benchmark]" filter to run it.
+TEST_CASE("entity scanners performance", "[.][benchmark]") {
+	constexpr auto kIterations = 100;
+
+	auto text = QString();
+	for (auto i = 0; i != 500; ++i) {
+		text += "some words #hashtag and @mention, ";
+	}
+	text += "t.me/link";
+
+	const auto regexps = [&](int offset) {
+		auto result = kNotFound;
+		for (auto regexp : { &Hashtag, &Mention, &BotCommand, &Domain }) {
+			const auto match = regexp->match(text, offset);
+			if (match.hasMatch()) {
+				result = std::min(result, match.capturedEnd());
+			}
+		}
+		return result;
+	};
+	const auto scanners = [&] {
+		auto hashtags = TagScanner(text, TagType::Hashtag);
+		auto mentions = TagScanner(text, TagType::Mention);
+		auto botCommands = TagScanner(text, TagType::BotCommand);
+		auto domains = RegExpScanner(text, Domain);
+		return [=](int offset) mutable {
+			auto result = kNotFound;
+			for (auto scanner : { &hashtags, &mentions, &botCommands }) {
+				if (const auto match = scanner->match(offset)) {
+					result = std::min(result, match.end);
+				}
+			}
+			const auto match = domains.match(offset);
+			if (match.hasMatch()) {
+				result = std::min(result, match.capturedEnd());
+			}
+			return result;
+		};
+	};
+	REQUIRE(CountEntities(text, regexps)
+		== CountEntities(text, scanners()));
+
+	const auto measure = [&](const char *name, auto &&method) {
+		const auto start = std::chrono::steady_clock::now();
+		for (auto i = 0; i != kIterations; ++i) {
+			method();
+		}
+		const auto finish = std::chrono::steady_clock::now();
+		const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+			finish - start).count();
+		std::cout
+			<< name << ": "
+			<< kIterations << " texts of "
+			<< text.size() << " chars in "
+			<< ms << " ms, "
+			<< (ms ? (qint64(kIterations) * text.size() / ms) : 0)
+			<< " chars/ms." << std::endl;
+	};
+	measure("regular expressions", [&] {
+		CountEntities(text, regexps);
+	});
+	measure("scanners", [&] {
+		CountEntities(text, scanners());
+	});
+}
@@ -121,7 +121,9 @@ void PasscodeLockWidget::paintContent(Painter &p) {
 }
 
 void PasscodeLockWidget::submit() {
-	if (_passcode->text().isEmpty()) {
+	if (_checking) {
+		return;
+	} else if (_passcode->text().isEmpty()) {
 		_passcode->showError();
 		return;
 	}
@@ -132,10 +134,24 @@ void PasscodeLockWidget::submit() {
 		return;
 	}
 
+	// Key derivation is slow, so it is done in the background.
+	_checking = true;
 	const auto passcode = _passcode->text().toUtf8();
-	const auto correct = App::main()
-		? Local::checkPasscode(passcode)
-		: (Local::readMap(passcode) != Local::ReadMapPassNeeded);
+	if (App::main()) {
+		Local::checkPasscodeAsync(passcode, crl::guard(this, [=](
+				bool correct) {
+			checked(correct);
+		}));
+	} else {
+		Local::readMapAsync(passcode, crl::guard(this, [=](
+				Local::ReadMapState result) {
+			checked(result != Local::ReadMapPassNeeded);
+		}));
+	}
+}
+
+void PasscodeLockWidget::checked(bool correct) {
+	_checking = false;
 	if (!correct) {
 		cSetPasscodeBadTries(cPasscodeBadTries() + 1);
 		cSetPasscodeLastTry(getms(true));
@@ -54,12 +54,14 @@ private:
 	void paintContent(Painter &p) override;
 	void changed();
 	void submit();
+	void checked(bool correct);
 	void error();
 
 	object_ptr<Ui::PasswordInput> _passcode;
 	object_ptr<Ui::RoundButton> _submit;
 	object_ptr<Ui::LinkButton> _logout;
 	QString _error;
+	bool _checking = false;
 
 };
 
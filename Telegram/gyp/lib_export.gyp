@@ -70,6 +70,8 @@
       '<(src_loc)/export/output/export_output_html.h',
       '<(src_loc)/export/output/export_output_json.cpp',
       '<(src_loc)/export/output/export_output_json.h',
+      '<(src_loc)/export/output/export_output_parallel.cpp',
+      '<(src_loc)/export/output/export_output_parallel.h',
       '<(src_loc)/export/output/export_output_result.h',
       '<(src_loc)/export/output/export_output_stats.cpp',
       '<(src_loc)/export/output/export_output_stats.h',
@@ -63,6 +63,8 @@
       '<(src_loc)/storage/storage_file_lock_posix.cpp',
       '<(src_loc)/storage/storage_file_lock_win.cpp',
       '<(src_loc)/storage/storage_file_lock.h',
+      '<(src_loc)/storage/storage_streamed_file.cpp',
+      '<(src_loc)/storage/storage_streamed_file.h',
       '<(src_loc)/storage/cache/storage_cache_binlog_reader.cpp',
       '<(src_loc)/storage/cache/storage_cache_binlog_reader.h',
       '<(src_loc)/storage/cache/storage_cache_cleaner.cpp',
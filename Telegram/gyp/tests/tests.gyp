@@ -23,6 +23,7 @@
     ],
     'dependencies': [
       '<!@(<(list_tests_command))',
+      'tests_export',
       'tests_storage',
     ],
     'sources': [
@@ -52,6 +53,37 @@
       '<(src_loc)/base/algorithm.h',
       '<(src_loc)/base/algorithm_tests.cpp',
     ],
+  }, {
+    'target_name': 'tests_chunked_set',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/chunked_set.h',
+      '<(src_loc)/base/chunked_set_tests.cpp',
+    ],
+  }, {
+    'target_name': 'tests_clip_frame',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/media/media_clip_frame.cpp',
+      '<(src_loc)/media/media_clip_frame.h',
+      '<(src_loc)/media/media_clip_frame_tests.cpp',
+    ],
+  }, {
+    'target_name': 'tests_export',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'dependencies': [
+      '../lib_export.gyp:lib_export',
+    ],
+    'sources': [
+      '<(src_loc)/export/output/export_output_file_tests.cpp',
+      '<(src_loc)/export/output/export_output_parallel_tests.cpp',
+    ],
   }, {
     'target_name': 'tests_flags',
     'includes': [
@@ -79,6 +111,58 @@
       '<(src_loc)/base/flat_set.h',
       '<(src_loc)/base/flat_set_tests.cpp',
     ],
+  }, {
+    'target_name': 'tests_mtproto',
+    'includes': [
+      'common_test.gypi',
+      '../openssl.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/mtproto/connection_tcp_loopback.cpp',
+      '<(src_loc)/mtproto/connection_tcp_loopback.h',
+      '<(src_loc)/mtproto/connection_tcp_loopback_dc.cpp',
+      '<(src_loc)/mtproto/connection_tcp_loopback_dc.h',
+      '<(src_loc)/mtproto/connection_tcp_loopback_tests.cpp',
+      '<(src_loc)/mtproto/connection_tcp_protocol.cpp',
+      '<(src_loc)/mtproto/connection_tcp_protocol.h',
+      '<(src_loc)/mtproto/gzip_packed.cpp',
+      '<(src_loc)/mtproto/gzip_packed.h',
+      '<(src_loc)/mtproto/gzip_packed_tests.cpp',
+      '<(src_loc)/mtproto/request_batcher.h',
+      '<(src_loc)/mtproto/request_batcher_tests.cpp',
+    ],
+    'include_dirs': [
+      '<(libs_loc)/zlib',
+    ],
+    'conditions': [
+      [ 'build_win', {
+        'libraries': [
+          '-lzlibstat',
+        ],
+        'configurations': {
+          'Debug': {
+            'library_dirs': [
+              '<(libs_loc)/zlib/contrib/vstudio/vc14/x86/ZlibStatDebug',
+            ],
+          },
+          'Release': {
+            'library_dirs': [
+              '<(libs_loc)/zlib/contrib/vstudio/vc14/x86/ZlibStatReleaseWithoutAsm',
+            ],
+          },
+        },
+      }],
+    ],
+  }, {
+    'target_name': 'tests_runtime_composer',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/runtime_composer.cpp',
+      '<(src_loc)/base/runtime_composer.h',
+      '<(src_loc)/base/runtime_composer_tests.cpp',
+    ],
   }, {
     'target_name': 'tests_rpl',
     'includes': [
@@ -117,6 +201,17 @@
       '<(src_loc)/rpl/variable.h',
       '<(src_loc)/rpl/variable_tests.cpp',
     ],
+  }, {
+    'target_name': 'tests_sparse_ids_list',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/data/data_msg_id.h',
+      '<(src_loc)/storage/storage_sparse_ids_list.cpp',
+      '<(src_loc)/storage/storage_sparse_ids_list.h',
+      '<(src_loc)/storage/storage_sparse_ids_list_tests.cpp',
+    ],
   }, {
     'target_name': 'tests_storage',
     'includes': [
@@ -128,6 +223,7 @@
     ],
     'sources': [
       '<(src_loc)/storage/storage_encrypted_file_tests.cpp',
+      '<(src_loc)/storage/storage_streamed_file_tests.cpp',
       '<(src_loc)/storage/cache/storage_cache_database_tests.cpp',
       '<(src_loc)/platform/win/windows_dlls.cpp',
       '<(src_loc)/platform/win/windows_dlls.h',
@@ -138,5 +234,15 @@
         '<(src_loc)/platform/win/windows_dlls.h',
       ],
     }]],
+  }, {
+    'target_name': 'tests_text_entity',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/ui/text/text_entity_scanner.cpp',
+      '<(src_loc)/ui/text/text_entity_scanner.h',
+      '<(src_loc)/ui/text/text_entity_scanner_tests.cpp',
+    ],
   }],
 }